@@ -0,0 +1,457 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "config.h"
+
+#define SECTION_GLOBAL 0
+#define SECTION_INPUT  1
+#define SECTION_FILTER 2
+#define SECTION_OUTPUT 3
+
+typedef struct {
+    int type;
+    int line;
+    char *name;
+    char *plugin;
+    char *args;
+    char *source;
+    char *cpus;
+    char *sched;
+    char *nice;
+} section;
+
+/* the options a file stands for, see config_load() */
+typedef struct {
+    int count;
+    char **argv;
+} options;
+
+/* keys of [global] and the option they stand for, flags have no value */
+static const struct {
+    const char *key;
+    const char *option;
+    int flag;
+} global_keys[] = {
+    { "history", "-H", 0 },
+    { "history_bytes", "-B", 0 },
+    { "threads", "-t", 0 },
+    { "control", "-c", 0 },
+    { "linger", "-L", 0 },
+    { "mutex_profile", "-M", 1 },
+    { "log_level", "-l", 0 },
+    { "memory_limit", "-m", 0 },
+    { "sync", "-S", 0 },
+    { "unchanged", "-U", 0 },
+    { "watchdog", "-W", 0 },
+    { "background", "-b", 1 },
+};
+
+/******************************************************************************
+Description.: remove the white space around a string
+Input Value.: s is the string, it is modified
+Return Value: the trimmed string within s
+******************************************************************************/
+static char *trim(char *s)
+{
+    char *end;
+
+    while(isspace((unsigned char)*s))
+        s++;
+
+    end = s + strlen(s);
+    while(end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+
+    return s;
+}
+
+/******************************************************************************
+Description.: append an option to the list
+Input Value.: o is the list
+              value is copied
+Return Value: 0 if everything is OK, -1 if not enough memory is available
+******************************************************************************/
+static int push(options *o, const char *value)
+{
+    char **tmp;
+
+    if((tmp = realloc(o->argv, (o->count + 2) * sizeof(char *))) == NULL)
+        return -1;
+    o->argv = tmp;
+
+    if((o->argv[o->count] = strdup(value)) == NULL)
+        return -1;
+    o->argv[++o->count] = NULL;
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: interpret a boolean value
+Input Value.: value is the text
+Return Value: 1 for yes, 0 for no, -1 if it is neither
+******************************************************************************/
+static int parse_bool(const char *value)
+{
+    if(!strcasecmp(value, "yes") || !strcasecmp(value, "true") || !strcasecmp(value, "on") || !strcmp(value, "1"))
+        return 1;
+    if(!strcasecmp(value, "no") || !strcasecmp(value, "false") || !strcasecmp(value, "off") || !strcmp(value, "0"))
+        return 0;
+    return -1;
+}
+
+/******************************************************************************
+Description.: find the id an input or filter will get
+Input Value.: sections and count describe the file
+              name of the input or filter
+              before limits the search to the sections before it
+Return Value: the id or -1 if there is no such input or filter
+******************************************************************************/
+static int input_id(section *sections, int count, const char *name, int before)
+{
+    int i, id = 0;
+
+    for(i = 0; i < count && i < before; i++) {
+        if(sections[i].type != SECTION_INPUT && sections[i].type != SECTION_FILTER)
+            continue;
+        if(!strcmp(sections[i].name, name))
+            return id;
+        id++;
+    }
+
+    return -1;
+}
+
+/******************************************************************************
+Description.: build the parameters of a plugin, the names in args are
+              replaced by their ids and the thread settings are appended
+Input Value.: path of the file for messages
+              sections and count describe the file
+              s is the section of the plugin
+Return Value: the specification "<plugin.so> [parameters]" or NULL on error
+******************************************************************************/
+static char *plugin_spec(const char *path, section *sections, int count, section *s)
+{
+    char *spec, *out, *end;
+    const char *in;
+    size_t size;
+    int id;
+
+    size = strlen(s->plugin) + 1;
+    if(s->args != NULL)
+        size += strlen(s->args) * 3 + 1;
+    size += 64 + (s->cpus ? strlen(s->cpus) : 0) + (s->sched ? strlen(s->sched) : 0) + (s->nice ? strlen(s->nice) : 0);
+    if((spec = malloc(size)) == NULL)
+        return NULL;
+
+    out = spec + sprintf(spec, "%s", s->plugin);
+    if(s->args != NULL) {
+        *out++ = ' ';
+        for(in = s->args; *in != '\0'; in++) {
+            if(in[0] != '$' || in[1] != '{' || (end = strchr(in, '}')) == NULL) {
+                *out++ = *in;
+                continue;
+            }
+
+            *end = '\0';
+            id = input_id(sections, count, in + 2, count);
+            if(id < 0) {
+                fprintf(stderr, "%s:%d: there is no input named %s\n", path, s->line, in + 2);
+                *end = '}';
+                free(spec);
+                return NULL;
+            }
+            *end = '}';
+            out += sprintf(out, "%d", id);
+            in = end;
+        }
+        *out = '\0';
+    }
+
+    if(s->cpus != NULL)
+        out += sprintf(out, " --cpus %s", s->cpus);
+    if(s->sched != NULL)
+        out += sprintf(out, " --sched %s", s->sched);
+    if(s->nice != NULL)
+        out += sprintf(out, " --nice %s", s->nice);
+
+    return spec;
+}
+
+/******************************************************************************
+Description.: translate the plugin sections to -i, -s/-f and -o options
+Input Value.: path of the file for messages
+              sections and count describe the file
+              o receives the options
+Return Value: 0 if everything is OK, -1 on error
+******************************************************************************/
+static int plugin_options(const char *path, section *sections, int count, options *o)
+{
+    static const char *types[] = { "-i", "-f", "-o" };
+    char *spec, id[16];
+    int i, source;
+
+    for(i = 0; i < count; i++) {
+        section *s = &sections[i];
+
+        if(s->type == SECTION_GLOBAL)
+            continue;
+
+        if(s->plugin == NULL) {
+            fprintf(stderr, "%s:%d: [%s] has no plugin\n", path, s->line, s->name);
+            return -1;
+        }
+
+        if(s->type == SECTION_FILTER) {
+            if(s->source == NULL) {
+                fprintf(stderr, "%s:%d: filter %s has no source\n", path, s->line, s->name);
+                return -1;
+            }
+            if((source = input_id(sections, count, s->source, i)) < 0) {
+                fprintf(stderr, "%s:%d: the source %s of filter %s must be an input or filter before it\n",
+                        path, s->line, s->source, s->name);
+                return -1;
+            }
+            snprintf(id, sizeof(id), "%d", source);
+            if(push(o, "-s") != 0 || push(o, id) != 0)
+                return -1;
+        } else if(s->source != NULL) {
+            fprintf(stderr, "%s:%d: only filters have a source\n", path, s->line);
+            return -1;
+        }
+
+        if((spec = plugin_spec(path, sections, count, s)) == NULL)
+            return -1;
+        if(push(o, types[s->type - SECTION_INPUT]) != 0 || push(o, spec) != 0) {
+            free(spec);
+            return -1;
+        }
+        free(spec);
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: store a key of a plugin section
+Input Value.: s is the section
+              key and value as in the file
+Return Value: 0 if everything is OK, -1 if the key is unknown
+******************************************************************************/
+static int plugin_key(section *s, const char *key, const char *value)
+{
+    char **field;
+
+    if(!strcmp(key, "plugin"))
+        field = &s->plugin;
+    else if(!strcmp(key, "args"))
+        field = &s->args;
+    else if(!strcmp(key, "source"))
+        field = &s->source;
+    else if(!strcmp(key, "cpus"))
+        field = &s->cpus;
+    else if(!strcmp(key, "sched"))
+        field = &s->sched;
+    else if(!strcmp(key, "nice"))
+        field = &s->nice;
+    else
+        return -1;
+
+    free(*field);
+    *field = strdup(value);
+    return 0;
+}
+
+/******************************************************************************
+Description.: translate a key of [global] to its option
+Input Value.: key and value as in the file
+              o receives the option
+Return Value: 0 if everything is OK, -1 if the key or value is invalid
+******************************************************************************/
+static int global_key(const char *key, const char *value, options *o)
+{
+    size_t i;
+    int flag;
+
+    for(i = 0; i < sizeof(global_keys) / sizeof(global_keys[0]); i++) {
+        if(strcmp(key, global_keys[i].key) != 0)
+            continue;
+
+        if(!global_keys[i].flag)
+            return (push(o, global_keys[i].option) == 0 && push(o, value) == 0) ? 0 : -1;
+
+        if((flag = parse_bool(value)) < 0)
+            return -1;
+        return (flag == 0 || push(o, global_keys[i].option) == 0) ? 0 : -1;
+    }
+
+    return -1;
+}
+
+/******************************************************************************
+Description.: parse the header of a section, "[global]" or "[<type> <name>]"
+Input Value.: path and line for messages
+              text is the line without the brackets
+              s receives the type and name
+Return Value: 0 if everything is OK, -1 on error
+******************************************************************************/
+static int section_header(const char *path, int line, char *text, section *s)
+{
+    char *name;
+
+    memset(s, 0, sizeof(*s));
+    s->line = line;
+
+    text = trim(text);
+    if(!strcmp(text, "global")) {
+        s->type = SECTION_GLOBAL;
+        s->name = strdup("global");
+        return 0;
+    }
+
+    if((name = strpbrk(text, " \t")) == NULL) {
+        fprintf(stderr, "%s:%d: the section [%s] needs a name\n", path, line, text);
+        return -1;
+    }
+    *name++ = '\0';
+    name = trim(name);
+
+    if(!strcmp(text, "input"))
+        s->type = SECTION_INPUT;
+    else if(!strcmp(text, "filter"))
+        s->type = SECTION_FILTER;
+    else if(!strcmp(text, "output"))
+        s->type = SECTION_OUTPUT;
+    else {
+        fprintf(stderr, "%s:%d: unknown section type %s\n", path, line, text);
+        return -1;
+    }
+
+    s->name = strdup(name);
+    return 0;
+}
+
+static void section_free(section *s)
+{
+    free(s->name);
+    free(s->plugin);
+    free(s->args);
+    free(s->source);
+    free(s->cpus);
+    free(s->sched);
+    free(s->nice);
+}
+
+/******************************************************************************
+Description.: read a configuration file, see config.h
+Input Value.: path of the file
+              argc and argv receive the options the file stands for, to be
+              parsed like the command line. argv[0] is NULL.
+Return Value: 0 if everything is OK, -1 on error
+******************************************************************************/
+int config_load(const char *path, int *argc, char ***argv)
+{
+    FILE *file;
+    char *buffer = NULL, *text, *value, *end;
+    size_t size = 0;
+    section *sections = NULL, *tmp, *current = NULL;
+    options o = { 0, NULL };
+    int count = 0, line = 0, rc = -1, i;
+
+    if((file = fopen(path, "r")) == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    /* argv[0] is the program name for getopt */
+    if(push(&o, "") != 0)
+        goto out;
+
+    while(getline(&buffer, &size, file) >= 0) {
+        line++;
+        text = trim(buffer);
+        if(*text == '\0' || *text == '#' || *text == ';')
+            continue;
+
+        if(*text == '[') {
+            if((end = strchr(text, ']')) == NULL || *trim(end + 1) != '\0') {
+                fprintf(stderr, "%s:%d: invalid section header\n", path, line);
+                goto out;
+            }
+            *end = '\0';
+
+            if((tmp = realloc(sections, (count + 1) * sizeof(section))) == NULL)
+                goto out;
+            sections = tmp;
+            if(section_header(path, line, text + 1, &sections[count]) != 0)
+                goto out;
+            current = &sections[count++];
+
+            for(i = 0; i < count - 1; i++) {
+                if(current->type != SECTION_GLOBAL && !strcmp(sections[i].name, current->name)) {
+                    fprintf(stderr, "%s:%d: the name %s is used twice\n", path, line, current->name);
+                    goto out;
+                }
+            }
+            continue;
+        }
+
+        if((value = strchr(text, '=')) == NULL || current == NULL) {
+            fprintf(stderr, "%s:%d: expected \"key = value\" within a section\n", path, line);
+            goto out;
+        }
+        *value++ = '\0';
+        text = trim(text);
+        value = trim(value);
+
+        if(current->type == SECTION_GLOBAL ? global_key(text, value, &o) : plugin_key(current, text, value)) {
+            fprintf(stderr, "%s:%d: invalid key or value: %s\n", path, line, text);
+            goto out;
+        }
+    }
+
+    if(plugin_options(path, sections, count, &o) != 0)
+        goto out;
+
+    *argc = o.count;
+    *argv = o.argv;
+    o.argv = NULL;
+    rc = 0;
+
+out:
+    for(i = 0; o.argv != NULL && i < o.count; i++)
+        free(o.argv[i]);
+    free(o.argv);
+    for(i = 0; i < count; i++)
+        section_free(&sections[i]);
+    free(sections);
+    free(buffer);
+    fclose(file);
+    return rc;
+}
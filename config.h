@@ -0,0 +1,53 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/*
+ * A configuration file describes the whole pipeline instead of -i/-f/-o:
+ *
+ *   [global]
+ *   history = 30
+ *
+ *   [input cam0]
+ *   plugin = input_uvc.so
+ *   args = -d /dev/video0 -r 1280x720
+ *   cpus = 0
+ *
+ *   [filter gray]
+ *   plugin = filter_gray.so
+ *   source = cam0
+ *
+ *   [output web]
+ *   plugin = output_http.so
+ *   args = -p 8080 -w "/usr/share/mjpg streamer/www"
+ *
+ * The sections are translated to the command line options they stand for,
+ * so both can be mixed and later options override the file. Inputs and
+ * filters get their ids in the order of the file, "${name}" in args is
+ * replaced by the id of the input or filter with that name.
+ */
+int config_load(const char *path, int *argc, char ***argv);
+
+#endif
@@ -0,0 +1,268 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mjpg_streamer.h"
+
+/*
+ * A line based protocol on a unix socket to change the plugins while
+ * everything keeps running, e.g. with "socat - UNIX-CONNECT:<path>":
+ *
+ *   load input <plugin.so> [parameters]            -> OK <id>
+ *   load filter <source> <plugin.so> [parameters]  -> OK <id>
+ *   load output <plugin.so> [parameters]           -> OK <id>
+ *   unload input <id>                              -> OK
+ *   unload output <id>                             -> OK
+ *   stop input <id>                                -> OK
+ *   stop output <id>                               -> OK
+ *   start input <id>                               -> OK
+ *   start output <id>                              -> OK
+ *   list                                           -> one line per plugin, then OK
+ *
+ * A stopped plugin keeps its id, consumers and frames, start initializes
+ * and runs it again. Filters can not be stopped, they follow their source.
+ * Errors are answered with "ERROR", the details go to the log.
+ */
+
+static globals *pglobal;
+static pthread_t thread;
+static int sd = -1;
+static char *socket_path;
+
+/******************************************************************************
+Description.: parse the id of a plugin at the start of an argument
+Input Value.: s is the argument
+              end receives the first character after the digits
+Return Value: the id or -1 if the argument does not start with a digit
+******************************************************************************/
+static int parse_id(char *s, char **end)
+{
+    *end = s;
+    if(!isdigit((unsigned char)*s))
+        return -1;
+
+    return strtol(s, end, 10);
+}
+
+/******************************************************************************
+Description.: execute one command and write the answer
+Input Value.: fd is the connection, line the command without newline
+Return Value: -
+******************************************************************************/
+static void execute(int fd, char *line)
+{
+    char answer[512];
+    char *cmd, *type, *rest = NULL, *end;
+    int id = -1, source, i;
+
+    cmd = strtok_r(line, " ", &rest);
+    type = strtok_r(NULL, " ", &rest);
+
+    if(cmd == NULL) {
+        return;
+    } else if(strcmp(cmd, "list") == 0) {
+        for(i = 0; i < pglobal->incnt; i++) {
+            snprintf(answer, sizeof(answer), "input %d %s %s\n", i, pglobal->in[i]->plugin,
+                     !pglobal->in[i]->loaded ? "unloaded" : pglobal->in[i]->stopped ? "stopped" : "loaded");
+            if(write(fd, answer, strlen(answer)) < 0)
+                return;
+        }
+        for(i = 0; i < pglobal->outcnt; i++) {
+            snprintf(answer, sizeof(answer), "output %d %s %s\n", i, pglobal->out[i]->plugin,
+                     !pglobal->out[i]->loaded ? "unloaded" : pglobal->out[i]->stopped ? "stopped" : "loaded");
+            if(write(fd, answer, strlen(answer)) < 0)
+                return;
+        }
+        id = 0;
+        type = NULL;
+    } else if(type != NULL && strcmp(cmd, "load") == 0 && *rest != '\0') {
+        if(strcmp(type, "input") == 0) {
+            if((id = input_load(pglobal, rest, -1)) >= 0 && input_start(pglobal, id) != 0)
+                id = -1;
+        } else if(strcmp(type, "filter") == 0) {
+            /* the source and the plugin are separated by a space */
+            if((source = parse_id(rest, &end)) >= 0 && *end == ' ') {
+                for(rest = end; *rest == ' '; rest++)
+                    ;
+                if(*rest != '\0')
+                    id = input_load(pglobal, rest, source);
+            }
+        } else if(strcmp(type, "output") == 0) {
+            if((id = output_load(pglobal, rest)) >= 0 && output_start(pglobal, id) != 0)
+                id = -1;
+        }
+    } else if(type != NULL && strcmp(cmd, "unload") == 0 && *rest != '\0') {
+        if((i = parse_id(rest, &end)) < 0 || *end != '\0')
+            id = -1;
+        else if(strcmp(type, "input") == 0)
+            id = (input_unload(pglobal, i) == 0) ? 0 : -1;
+        else if(strcmp(type, "output") == 0)
+            id = (output_unload(pglobal, i) == 0) ? 0 : -1;
+        type = NULL;
+    } else if(type != NULL && (strcmp(cmd, "stop") == 0 || strcmp(cmd, "start") == 0) && *rest != '\0') {
+        if((i = parse_id(rest, &end)) < 0 || *end != '\0')
+            id = -1;
+        else if(strcmp(type, "input") == 0 && strcmp(cmd, "stop") == 0)
+            id = (input_halt(pglobal, i) == 0) ? 0 : -1;
+        else if(strcmp(type, "input") == 0)
+            id = (input_resume(pglobal, i) == 0) ? 0 : -1;
+        else if(strcmp(type, "output") == 0 && strcmp(cmd, "stop") == 0)
+            id = (output_halt(pglobal, i) == 0) ? 0 : -1;
+        else if(strcmp(type, "output") == 0)
+            id = (output_resume(pglobal, i) == 0) ? 0 : -1;
+        type = NULL;
+    }
+
+    if(id < 0)
+        snprintf(answer, sizeof(answer), "ERROR\n");
+    else if(type != NULL)
+        snprintf(answer, sizeof(answer), "OK %d\n", id);
+    else
+        snprintf(answer, sizeof(answer), "OK\n");
+
+    if(write(fd, answer, strlen(answer)) < 0) {
+        DBG("write failed, done anyway\n");
+    }
+}
+
+/******************************************************************************
+Description.: serve one connection until the client closes it
+Input Value.: fd is the connection
+Return Value: -
+******************************************************************************/
+static void serve(int fd)
+{
+    char buffer[1024];
+    char *end;
+    int level = 0, cnt;
+
+    while((cnt = read(fd, buffer + level, sizeof(buffer) - 1 - level)) > 0) {
+        level += cnt;
+        buffer[level] = '\0';
+
+        while((end = strchr(buffer, '\n')) != NULL) {
+            *end = '\0';
+            if(end > buffer && *(end - 1) == '\r')
+                *(end - 1) = '\0';
+            execute(fd, buffer);
+            level -= end + 1 - buffer;
+            memmove(buffer, end + 1, level + 1);
+        }
+
+        /* a line that does not fit the buffer is dropped */
+        if(level == sizeof(buffer) - 1)
+            level = 0;
+    }
+}
+
+/******************************************************************************
+Description.: accept the connections of the control socket, one at a time
+Input Value.: unused
+Return Value: unused, always NULL
+******************************************************************************/
+static void *control_thread(void *arg)
+{
+    int fd;
+
+    while(!pglobal->stop) {
+        if((fd = accept(sd, NULL, NULL)) < 0) {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        serve(fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+Description.: open the control socket and start serving it
+Input Value.: global is the global state, path the file name of the socket
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+int control_start(globals *global, const char *path)
+{
+    struct sockaddr_un addr;
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        LOG("control socket path is too long\n");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if((sd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    /* a socket left over by a previous run would block bind() */
+    unlink(path);
+    if(bind(sd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sd, 4) != 0) {
+        perror("control socket");
+        close(sd);
+        sd = -1;
+        return -1;
+    }
+
+    pglobal = global;
+    socket_path = strdup(path);
+
+    if(thread_create(&thread, NULL, "control", -1, control_thread, NULL) != 0) {
+        LOG("could not start the control thread\n");
+        return -1;
+    }
+    pthread_detach(thread);
+
+    LOG("Control Socket........: %s\n", path);
+    return 0;
+}
+
+/******************************************************************************
+Description.: close the control socket
+Input Value.: -
+Return Value: -
+******************************************************************************/
+void control_stop(void)
+{
+    if(sd < 0)
+        return;
+
+    shutdown(sd, SHUT_RDWR);
+    close(sd);
+    sd = -1;
+    unlink(socket_path);
+}
@@ -0,0 +1,157 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "mjpg_streamer.h"
+
+/******************************************************************************
+Description.: register a filter plugin as consumer of an input. The list is
+              protected by the db mutex of the source, the filters are fed
+              while it is held. Filters always have a higher id than their
+              source, so the mutexes are always locked in the same order.
+Input Value.: src is the input the filter reads from
+              fin is the input of the filter
+Return Value: 0 if everything is OK, -1 if not enough memory is available
+******************************************************************************/
+int filter_attach(input *src, input *fin)
+{
+    int *tmp;
+
+    input_lock(src, DB_FILTER);
+    if((tmp = realloc(src->filters, (src->filter_count + 1) * sizeof(int))) == NULL) {
+        input_unlock(src);
+        return -1;
+    }
+
+    tmp[src->filter_count] = fin->param.id;
+    src->filters = tmp;
+    src->filter_count++;
+    input_unlock(src);
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: stop feeding a filter plugin and wait until it finished the
+              frame it is processing, afterwards it can be stopped
+Input Value.: src is the input the filter reads from
+              fin is the input of the filter
+Return Value: -
+******************************************************************************/
+void filter_detach(input *src, input *fin)
+{
+    int i, busy;
+
+    input_lock(src, DB_FILTER);
+    for(i = 0; i < src->filter_count; i++) {
+        if(src->filters[i] == fin->param.id) {
+            memmove(&src->filters[i], &src->filters[i + 1], (src->filter_count - i - 1) * sizeof(int));
+            src->filter_count--;
+            break;
+        }
+    }
+    input_unlock(src);
+
+    do {
+        input_lock(fin, DB_FILTER);
+        busy = fin->filter_busy;
+        input_unlock(fin);
+        if(busy)
+            usleep(1000);
+    } while(busy);
+}
+
+/******************************************************************************
+Description.: worker job of a filter, processes the pending frame until no
+              newer one arrived meanwhile
+Input Value.: arg is the input of the filter
+Return Value: -
+******************************************************************************/
+static void filter_job(void *arg)
+{
+    input *fin = arg;
+    frame *src, *dst;
+
+    while(1) {
+        input_lock(fin, DB_FILTER);
+        if((src = fin->filter_pending) == NULL) {
+            fin->filter_busy = 0;
+            input_unlock(fin);
+            return;
+        }
+        fin->filter_pending = NULL;
+        input_unlock(fin);
+
+        dst = NULL;
+        if(!fin->param.global->stop)
+            dst = fin->process(fin->param.id, src);
+
+        if(dst != NULL) {
+            dst->timestamp = src->timestamp;
+            dst->captured = src->captured;
+            input_publish_frame(fin, dst);
+        }
+
+        frame_unref(src);
+    }
+}
+
+/******************************************************************************
+Description.: hand a frame of the source over to a filter. If the filter is
+              idle a job is queued on the worker pool, otherwise the frame
+              replaces the one still waiting, so a slow filter skips frames
+              instead of falling behind.
+Input Value.: fin is the input of the filter
+              f is a reference to the frame, it is owned by the filter now
+Return Value: -
+******************************************************************************/
+void filter_feed(input *fin, frame *f)
+{
+    frame *old;
+    int start = 0;
+
+    input_lock(fin, DB_FILTER);
+    old = fin->filter_pending;
+    fin->filter_pending = f;
+    if(!fin->filter_busy) {
+        fin->filter_busy = 1;
+        start = 1;
+    }
+    input_unlock(fin);
+
+    frame_unref(old);
+
+    if(start && workers_submit(filter_job, fin) != 0) {
+        input_lock(fin, DB_FILTER);
+        f = fin->filter_pending;
+        fin->filter_pending = NULL;
+        fin->filter_busy = 0;
+        input_unlock(fin);
+        frame_unref(f);
+    }
+}
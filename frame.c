@@ -0,0 +1,1398 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+
+#include "mjpg_streamer.h"
+
+/******************************************************************************
+Description.: reset the description of a frame that is about to be filled
+Input Value.: f is the frame
+Return Value: -
+******************************************************************************/
+static void frame_reset_info(frame *f)
+{
+    f->width = f->height = 0;
+    f->format = V4L2_PIX_FMT_JPEG;
+    f->quality = -1;
+    clock_gettime(CLOCK_MONOTONIC, &f->captured);
+
+    f->raw_size = 0;
+    f->raw_format = 0;
+    f->encoder = NULL;
+    f->encoder_data = NULL;
+    f->encoded = 0;
+    f->dequeued.tv_sec = f->compressed.tv_sec = f->published.tv_sec = 0;
+    f->dequeued.tv_nsec = f->compressed.tv_nsec = f->published.tv_nsec = 0;
+    f->input = NULL;
+    f->unchanged = 0;
+    f->compare = 0;
+}
+
+/******************************************************************************
+Description.: release the JPG variants that were produced for a frame
+Input Value.: f is the frame
+Return Value: -
+******************************************************************************/
+static void frame_drop_variants(frame *f)
+{
+    frame *v;
+
+    while((v = f->variants) != NULL) {
+        f->variants = v->next;
+        frame_unref(v);
+    }
+}
+
+/******************************************************************************
+Description.: allocate a frame with a buffer for "capacity" bytes and charge
+              it to an input, the caller owns the only reference
+Input Value.: owner is the input the buffer is charged to, may be NULL
+              capacity is the size of the picture buffer
+Return Value: the frame or NULL if not enough memory is available
+******************************************************************************/
+static frame *frame_create(input *owner, size_t capacity)
+{
+    frame *f;
+
+    if(memory_charge(owner, capacity) != 0)
+        return NULL;
+
+    if((f = calloc(1, sizeof(frame))) == NULL) {
+        memory_uncharge(owner, capacity);
+        return NULL;
+    }
+
+    if((f->buf = malloc(capacity)) == NULL) {
+        memory_uncharge(owner, capacity);
+        free(f);
+        return NULL;
+    }
+
+    f->owner = owner;
+    f->charged = capacity;
+    f->capacity = capacity;
+    f->refcount = 1;
+    pthread_mutex_init(&f->lock, NULL);
+    frame_reset_info(f);
+    return f;
+}
+
+/******************************************************************************
+Description.: allocate a frame with a buffer for "capacity" bytes, the caller
+              owns the only reference
+Input Value.: capacity is the size of the picture buffer
+Return Value: the frame or NULL if not enough memory is available
+******************************************************************************/
+frame *frame_alloc(size_t capacity)
+{
+    return frame_create(NULL, capacity);
+}
+
+/******************************************************************************
+Description.: grow one of the buffers of a frame, the growth is charged to
+              the owner of the frame
+Input Value.: f is the frame
+              buf points to the buffer, capacity to its size
+              size is the new size
+Return Value: 0 if everything is OK, -1 if not enough memory is available
+******************************************************************************/
+static int frame_grow(frame *f, unsigned char **buf, size_t *capacity, size_t size)
+{
+    unsigned char *tmp;
+
+    if(memory_charge(f->owner, size - *capacity) != 0)
+        return -1;
+
+    if((tmp = realloc(*buf, size)) == NULL) {
+        memory_uncharge(f->owner, size - *capacity);
+        return -1;
+    }
+
+    f->charged += size - *capacity;
+    *buf = tmp;
+    *capacity = size;
+    return 0;
+}
+
+/******************************************************************************
+Description.: free a frame and its buffer
+Input Value.: f is the frame
+Return Value: -
+******************************************************************************/
+static void frame_free(frame *f)
+{
+    frame_drop_variants(f);
+    pthread_mutex_destroy(&f->lock);
+    memory_uncharge(f->owner, f->charged);
+    free(f->raw);
+    free(f->buf);
+    free(f);
+}
+
+/******************************************************************************
+Description.: initialize an empty pool of frames
+Input Value.: pool is the pool
+              max is the number of released frames kept for reuse
+Return Value: -
+******************************************************************************/
+void frame_pool_init(frame_pool *pool, unsigned int max)
+{
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->free = NULL;
+    pool->count = 0;
+    pool->max = max;
+    pool->owner = NULL;
+}
+
+/******************************************************************************
+Description.: get a frame from the pool, a released frame is reused if there
+              is one, its buffer only grows if it is too small
+Input Value.: pool is the pool
+              capacity is the size of the picture buffer
+Return Value: the frame or NULL if not enough memory is available
+******************************************************************************/
+frame *frame_pool_get(frame_pool *pool, size_t capacity)
+{
+    frame *f;
+
+    pthread_mutex_lock(&pool->lock);
+    if((f = pool->free) != NULL) {
+        pool->free = f->next;
+        pool->count--;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if(f == NULL) {
+        if((f = frame_create(pool->owner, capacity)) == NULL)
+            return NULL;
+        f->pool = pool;
+        return f;
+    }
+
+    if(f->capacity < capacity && frame_grow(f, &f->buf, &f->capacity, capacity) != 0) {
+        frame_free(f);
+        return NULL;
+    }
+
+    f->size = 0;
+    f->sequence = 0;
+    f->next = NULL;
+    f->refcount = 1;
+    frame_reset_info(f);
+    return f;
+}
+
+/******************************************************************************
+Description.: make sure the raw buffer of a frame can hold "size" bytes, it
+              is kept when the frame is reused by a pool
+Input Value.: f is the frame
+              size is the number of bytes
+Return Value: 0 if everything is OK, -1 if not enough memory is available
+******************************************************************************/
+int frame_reserve_raw(frame *f, size_t size)
+{
+    if(f->raw_capacity >= size)
+        return 0;
+
+    return frame_grow(f, &f->raw, &f->raw_capacity, size);
+}
+
+/******************************************************************************
+Description.: make sure the JPG representation of a frame is available. If
+              the input delivered raw pixels it is compressed now, once, by
+              the first consumer that asks for it.
+Input Value.: f is the frame
+Return Value: 0 if buf/size hold the JPG picture, -1 if encoding failed
+******************************************************************************/
+int frame_jpeg(frame *f)
+{
+    struct timespec start;
+    int size;
+
+    if(f->encoder == NULL || __sync_fetch_and_add(&f->encoded, 0))
+        return 0;
+
+    pthread_mutex_lock(&f->lock);
+    if(!f->encoded) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if((size = f->encoder(f, f->quality, f->buf, f->capacity)) >= 0) {
+            f->size = size;
+            __sync_synchronize();
+            f->encoded = 1;
+
+            clock_gettime(CLOCK_MONOTONIC, &f->compressed);
+            if(f->input != NULL) {
+                metric_observe(f->input->metrics.encode_seconds, (f->compressed.tv_sec - start.tv_sec) * 1000000000LL +
+                               (f->compressed.tv_nsec - start.tv_nsec));
+                metric_observe(f->input->metrics.frame_bytes, size);
+                metric_observe(f->input->metrics.latency_encode, frame_latency(f, &f->compressed));
+            }
+        }
+    }
+    size = f->encoded ? 0 : -1;
+    pthread_mutex_unlock(&f->lock);
+
+    return size;
+}
+
+/******************************************************************************
+Description.: get a JPG of the frame compressed with a different quality. The
+              variant is produced from the raw pixels on first demand and
+              kept as long as the frame lives.
+Input Value.: f is the frame
+              quality is the JPG quality 1..100
+Return Value: a frame holding the JPG, this is f itself if there are no raw
+              pixels or the quality matches, NULL on error.
+              Release it with frame_unref().
+******************************************************************************/
+frame *frame_jpeg_variant(frame *f, int quality)
+{
+    frame *v;
+    int size;
+
+    if(f->encoder == NULL || quality == f->quality)
+        return (frame_jpeg(f) == 0) ? frame_ref(f) : NULL;
+
+    pthread_mutex_lock(&f->lock);
+    for(v = f->variants; v != NULL; v = v->next) {
+        if(v->quality == quality)
+            break;
+    }
+
+    if(v == NULL && (v = frame_create(f->owner, f->capacity)) != NULL) {
+        if((size = f->encoder(f, quality, v->buf, v->capacity)) < 0) {
+            frame_unref(v);
+            v = NULL;
+        } else {
+            v->size = size;
+            v->timestamp = f->timestamp;
+            v->captured = f->captured;
+            v->sequence = f->sequence;
+            v->width = f->width;
+            v->height = f->height;
+            v->quality = quality;
+            v->next = f->variants;
+            f->variants = v;
+        }
+    }
+    frame_ref(v);
+    pthread_mutex_unlock(&f->lock);
+
+    return v;
+}
+
+/******************************************************************************
+Description.: fill in width, height and an estimated quality of a frame by
+              reading the headers of the JPG picture up to the scan data
+Input Value.: f is the frame, f->buf and f->size must be set
+Return Value: 0 if the size was found, -1 if this is no valid JPG picture
+******************************************************************************/
+int frame_parse_jpeg(frame *f)
+{
+    unsigned char *p = f->buf, *end = f->buf + f->size;
+    unsigned char marker;
+    int length, i, sum, scale, found = -1;
+
+    if(f->size < 4 || p[0] != 0xFF || p[1] != 0xD8)
+        return -1;
+    p += 2;
+
+    while(p + 4 <= end) {
+        if(*p != 0xFF)
+            return found;
+
+        /* skip fill bytes */
+        while(p < end && *p == 0xFF)
+            p++;
+        if(p + 3 > end)
+            break;
+
+        marker = *p++;
+        length = (p[0] << 8) | p[1];
+        if(length < 2 || p + length > end)
+            break;
+
+        if(marker == 0xDA) {
+            /* start of scan, no more headers */
+            break;
+        } else if(marker >= 0xC0 && marker <= 0xCF &&
+                  marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            /* start of frame: precision, height, width */
+            if(length >= 7) {
+                f->height = (p[3] << 8) | p[4];
+                f->width = (p[5] << 8) | p[6];
+                f->format = V4L2_PIX_FMT_JPEG;
+                found = 0;
+            }
+        } else if(marker == 0xDB && length >= 67 && (p[2] & 0xF0) == 0 && (p[2] & 0x0F) == 0) {
+            /*
+             * 8 bit luminance quantization table, compare it to the table
+             * libjpeg scales with the quality setting (sums to 3688)
+             */
+            for(i = 0, sum = 0; i < 64; i++)
+                sum += p[3 + i];
+            scale = (sum * 100 + 1844) / 3688;
+            if(scale <= 0)
+                f->quality = 100;
+            else if(scale <= 100)
+                f->quality = (200 - scale) / 2;
+            else
+                f->quality = 5000 / scale;
+            if(f->quality < 1)
+                f->quality = 1;
+        }
+
+        p += length;
+    }
+
+    return found;
+}
+
+/******************************************************************************
+Description.: take another reference to a frame
+Input Value.: f may be NULL
+Return Value: f
+******************************************************************************/
+frame *frame_ref(frame *f)
+{
+    if(f != NULL)
+        __sync_add_and_fetch(&f->refcount, 1);
+    return f;
+}
+
+/******************************************************************************
+Description.: release a reference, the last one returns the frame to its
+              pool or frees it
+Input Value.: f may be NULL
+Return Value: -
+******************************************************************************/
+void frame_unref(frame *f)
+{
+    frame_pool *pool;
+
+    if(f == NULL)
+        return;
+
+    if(__sync_sub_and_fetch(&f->refcount, 1) != 0)
+        return;
+
+    if((pool = f->pool) != NULL) {
+        frame_drop_variants(f);
+
+        pthread_mutex_lock(&pool->lock);
+        if(pool->count < pool->max) {
+            f->next = pool->free;
+            pool->free = f;
+            pool->count++;
+            f = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if(f != NULL)
+        frame_free(f);
+}
+
+/******************************************************************************
+Description.: time from the capture of a frame to one of its later stages
+Input Value.: f is the frame
+              at is a CLOCK_MONOTONIC time, NULL for now
+Return Value: the latency in nanoseconds
+******************************************************************************/
+long long frame_latency(frame *f, struct timespec *at)
+{
+    struct timespec now;
+
+    if(at == NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        at = &now;
+    }
+
+    return (at->tv_sec - f->captured.tv_sec) * 1000000000LL + (at->tv_nsec - f->captured.tv_nsec);
+}
+
+/******************************************************************************
+Description.: compare a frame by its perceptual signature with the last frame
+              of its input that changed (-U). Decoding takes milliseconds,
+              so like frame_jpeg() it is done once on first demand by a
+              consumer instead of by the capture thread. Raw frames are
+              encoded for it and compared by their bytes first, as
+              input_compare_frame() does for JPGs
+Input Value.: f is the frame
+Return Value: -
+******************************************************************************/
+static void frame_compare(frame *f)
+{
+    input *in = f->input;
+    unsigned long long hash;
+    signature sig;
+    int encoded, perceptual = 1;
+
+    if(in == NULL || !__sync_fetch_and_add(&f->compare, 0))
+        return;
+
+    /* takes f->lock itself */
+    encoded = (frame_jpeg(f) == 0);
+
+    pthread_mutex_lock(&f->lock);
+    if(f->compare && encoded && f->encoder != NULL) {
+        hash = signature_hash(f->buf, f->size);
+
+        input_lock(in, DB_COMPARE);
+        if(hash == in->reference.hash) {
+            f->unchanged = 1;
+            metric_add(in->metrics.unchanged, 1);
+        } else if(in->param.global->unchanged == 0 && f->sequence > in->reference_sequence) {
+            in->reference.hash = hash;
+            in->reference.valid = 0;
+            in->reference_sequence = f->sequence;
+        }
+        input_unlock(in);
+
+        perceptual = (!f->unchanged && in->param.global->unchanged > 0);
+    }
+
+    if(f->compare && encoded && perceptual) {
+        signature_jpeg(f->buf, f->size, &sig);
+
+        input_lock(in, DB_COMPARE);
+        if(signature_distance(&sig, &in->reference) <= in->param.global->unchanged) {
+            f->unchanged = 1;
+            metric_add(in->metrics.unchanged, 1);
+        } else if(f->sequence > in->reference_sequence) {
+            /* drift is measured against the last frame that changed, not the last frame */
+            in->reference = sig;
+            in->reference_sequence = f->sequence;
+        }
+        input_unlock(in);
+    }
+
+    /* a frame that could not be encoded is sent as changed, or not at all */
+    __sync_synchronize();
+    f->compare = 0;
+    pthread_mutex_unlock(&f->lock);
+}
+
+/******************************************************************************
+Description.: decide if a consumer skips a frame because it did not change.
+              Unchanged frames are still sent every unchanged_interval
+              milliseconds (-U), so clients notice the stream is alive, and
+              always to a consumer that did not send anything yet
+Input Value.: f is the frame
+              sent is the CLOCK_MONOTONIC time the consumer sent its last
+              frame, zero before the first. It is updated if f is sent
+Return Value: 1 if the frame should be skipped, 0 if it should be sent
+******************************************************************************/
+int frame_skip_unchanged(frame *f, struct timespec *sent)
+{
+    struct timespec now;
+    long long interval;
+
+    frame_compare(f);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(f->unchanged && f->input != NULL && (sent->tv_sec != 0 || sent->tv_nsec != 0)) {
+        interval = f->input->param.global->unchanged_interval * 1000000LL;
+        if(interval <= 0 || (now.tv_sec - sent->tv_sec) * 1000000000LL + (now.tv_nsec - sent->tv_nsec) < interval)
+            return 1;
+    }
+
+    *sent = now;
+    return 0;
+}
+
+/******************************************************************************
+Description.: set up the frame pool and the history ring of an input
+Input Value.: in is the input
+              frames is the number of frames to keep, 0 for no limit
+              bytes is the memory the kept frames may use, 0 for no limit
+              if both are 0 the input keeps no history
+Return Value: 0 if everything is OK, -1 if not enough memory is available
+******************************************************************************/
+int input_history_init(input *in, unsigned int frames, size_t bytes)
+{
+    in->history = NULL;
+    in->history_size = in->history_count = in->history_head = 0;
+    in->history_frames = frames;
+    in->history_bytes = bytes;
+    in->history_used = 0;
+    in->notify_fds = NULL;
+    in->notify_count = 0;
+
+    frame_pool_init(&in->pool, frames + FRAME_POOL_SPARE);
+    in->pool.owner = in;
+
+    /* the ring is allocated once, only a limit by bytes lets it grow */
+    if(frames > 0) {
+        if((in->history = calloc(frames, sizeof(frame *))) == NULL)
+            return -1;
+        in->history_size = frames;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: get an empty frame for an input, it is taken from the frame
+              pool of the input so the memory gets reused
+Input Value.: in is the input that will publish the frame
+              capacity is the size of the picture buffer
+Return Value: the frame or NULL if not enough memory is available
+******************************************************************************/
+frame *input_frame_alloc(input *in, size_t capacity)
+{
+    frame *f;
+
+    if((f = frame_pool_get(&in->pool, capacity)) != NULL)
+        f->input = in;
+
+    return f;
+}
+
+/******************************************************************************
+Description.: lock the "database" of an input. The time spent waiting for it
+              is accounted when somebody else holds it. With -M the wait and
+              hold times are recorded per call site as well.
+Input Value.: in is the input
+              site tells who locks, see db_site
+Return Value: -
+******************************************************************************/
+void input_lock(input *in, db_site site)
+{
+    struct timespec start;
+    long long wait = 0;
+
+    if(pthread_mutex_trylock(&in->db) != 0) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pthread_mutex_lock(&in->db);
+        clock_gettime(CLOCK_MONOTONIC, &in->db_locked);
+
+        wait = (in->db_locked.tv_sec - start.tv_sec) * 1000000000LL +
+               (in->db_locked.tv_nsec - start.tv_nsec);
+        metric_add(in->metrics.db_contended, 1);
+        metric_add(in->metrics.db_wait_seconds, wait);
+    } else if(in->param.global->mutex_profile) {
+        clock_gettime(CLOCK_MONOTONIC, &in->db_locked);
+    }
+
+    in->db_site = site;
+    if(in->param.global->mutex_profile)
+        metric_observe(in->metrics.db_site_wait[site], wait);
+}
+
+/******************************************************************************
+Description.: account the time the database was held since it was locked
+              (or since the last wait), db must be locked
+Input Value.: in is the input
+Return Value: -
+******************************************************************************/
+static void account_hold(input *in)
+{
+    struct timespec now;
+
+    if(!in->param.global->mutex_profile)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    metric_observe(in->metrics.db_site_hold[in->db_site],
+                   (now.tv_sec - in->db_locked.tv_sec) * 1000000000LL + (now.tv_nsec - in->db_locked.tv_nsec));
+}
+
+/******************************************************************************
+Description.: unlock the database locked with input_lock()
+Input Value.: in is the input
+Return Value: -
+******************************************************************************/
+void input_unlock(input *in)
+{
+    account_hold(in);
+    pthread_mutex_unlock(&in->db);
+}
+
+/*
+ * cleanup handler around wait_db(). pthread_cond_wait() is a cancellation
+ * point and returns with the mutex locked, so the plugins that cancel
+ * their threads in output_stop()/input_stop() would leave db locked
+ */
+static void unlock_db(void *arg)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)arg);
+}
+
+/******************************************************************************
+Description.: wait for db_update, the database is not held while waiting.
+              Callers that may be cancelled push unlock_db() around it
+Input Value.: in is the input, db must be locked with input_lock()
+Return Value: -
+******************************************************************************/
+static void wait_db(input *in)
+{
+    db_site site = in->db_site;
+
+    account_hold(in);
+    pthread_cond_wait(&in->db_update, &in->db);
+
+    in->db_site = site;
+    if(in->param.global->mutex_profile)
+        clock_gettime(CLOCK_MONOTONIC, &in->db_locked);
+}
+
+/******************************************************************************
+Description.: get a frame from the history ring, db must be locked
+Input Value.: in is the input
+              age is 0 for the newest frame, 1 for the one before and so on
+Return Value: the frame, not referenced
+******************************************************************************/
+static frame *history_at(input *in, unsigned int age)
+{
+    if(in->history_size == 0)
+        return (age == 0) ? in->current : NULL;
+
+    if(age >= in->history_count)
+        return NULL;
+
+    return in->history[(in->history_head + in->history_count - 1 - age) % in->history_size];
+}
+
+/******************************************************************************
+Description.: number of frames history_at() can return, db must be locked
+Input Value.: in is the input
+Return Value: count of frames
+******************************************************************************/
+static unsigned int history_length(input *in)
+{
+    if(in->history_size == 0)
+        return (in->current != NULL) ? 1 : 0;
+
+    return in->history_count;
+}
+
+/******************************************************************************
+Description.: drop the oldest frame of the history ring, db must be locked
+Input Value.: in is the input
+Return Value: the dropped frame, the caller has to release it
+******************************************************************************/
+static frame *history_drop(input *in)
+{
+    frame *f = in->history[in->history_head];
+
+    in->history[in->history_head] = NULL;
+    in->history_head = (in->history_head + 1) % in->history_size;
+    in->history_count--;
+    in->history_used -= f->capacity + f->raw_capacity;
+
+    return f;
+}
+
+/******************************************************************************
+Description.: append a frame to the history ring and drop old frames until
+              it fits the limits again, db must be locked
+Input Value.: in is the input
+              f is the new frame, the ring takes its own reference
+Return Value: -
+******************************************************************************/
+static void history_push(input *in, frame *f)
+{
+    frame **tmp;
+    unsigned int i, size;
+
+    if(in->history_frames == 0 && in->history_bytes == 0)
+        return;
+
+    while(in->history_count > 0 && in->history_bytes > 0 &&
+          in->history_used + f->capacity + f->raw_capacity > in->history_bytes)
+        frame_unref(history_drop(in));
+
+    if(in->history_count == in->history_size) {
+        if(in->history_frames > 0) {
+            frame_unref(history_drop(in));
+        } else {
+            /* limited by bytes only, grow the ring and keep the order */
+            size = (in->history_size > 0) ? in->history_size * 2 : 16;
+            if((tmp = calloc(size, sizeof(frame *))) == NULL)
+                return;
+            for(i = 0; i < in->history_count; i++)
+                tmp[i] = in->history[(in->history_head + i) % in->history_size];
+            free(in->history);
+            in->history = tmp;
+            in->history_size = size;
+            in->history_head = 0;
+            in->pool.max = size + FRAME_POOL_SPARE;
+        }
+    }
+
+    in->history[(in->history_head + in->history_count) % in->history_size] = frame_ref(f);
+    in->history_count++;
+    in->history_used += f->capacity + f->raw_capacity;
+}
+
+/******************************************************************************
+Description.: wake up the consumers that poll the eventfds of an input. A
+              write() is a cancellation point and db is locked, an input
+              thread cancelled by input_stop() in here would leave it locked
+              for good. Cancellation is held off until the writes are done.
+Input Value.: in is the input, its db mutex is locked
+Return Value: -
+******************************************************************************/
+static void notify_subscribers(input *in)
+{
+    int i, state;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+    for(i = 0; i < in->notify_count; i++)
+        eventfd_write(in->notify_fds[i], 1);
+    pthread_setcancelstate(state, NULL);
+}
+
+/******************************************************************************
+Description.: worker job that encodes a published frame ahead of its consumers
+Input Value.: arg is a reference to the frame, it is released here
+Return Value: -
+******************************************************************************/
+static void encode_ahead(void *arg)
+{
+    frame *f = arg;
+
+    frame_jpeg(f);
+    frame_unref(f);
+}
+
+/******************************************************************************
+Description.: mark a frame as unchanged if it has the same bytes as the last
+              frame of the input that changed (-U). Frames whose bytes differ
+              are compared by their perceptual signature later if the
+              threshold accepts similar pictures, see frame_compare()
+Input Value.: in is the input, its db mutex is locked
+              f is the frame that is published, a JPG
+              hash is the hash of its bytes, computed before locking
+Return Value: -
+******************************************************************************/
+static void input_compare_frame(input *in, frame *f, unsigned long long hash)
+{
+    if(hash == in->reference.hash) {
+        f->unchanged = 1;
+        metric_add(in->metrics.unchanged, 1);
+    } else if(in->param.global->unchanged > 0) {
+        f->compare = 1;
+    } else {
+        in->reference.hash = hash;
+        in->reference.valid = 0;
+        in->reference_sequence = f->sequence;
+    }
+}
+
+/******************************************************************************
+Description.: make a frame the current picture of an input and wake up all
+              consumers waiting for it, the reference of the caller is handed
+              over. The mutex is held to swap the pointer, update the history
+              and release the frames it drops, compute the frame rate,
+              notify the eventfd subscribers and feed the filters.
+Input Value.: in is the input the frame belongs to, f the filled frame
+Return Value: -
+******************************************************************************/
+void input_publish_frame(input *in, frame *f)
+{
+    frame *old, *ahead = NULL;
+    long long interval, rate;
+    unsigned long long hash = 0;
+    int i, compare;
+
+    /* the JPG of raw frames is counted when it gets encoded */
+    if(f->encoder == NULL)
+        metric_observe(in->metrics.frame_bytes, f->size);
+    metric_add(in->metrics.frames, 1);
+
+    /* raw frames are not compressed yet, they are compared once they are, see frame_compare() */
+    if((compare = (in->param.global->unchanged >= 0 && f->encoder == NULL)))
+        hash = signature_hash(f->buf, f->size);
+    else if(in->param.global->unchanged >= 0)
+        f->compare = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &f->published);
+    if(f->dequeued.tv_sec != 0 || f->dequeued.tv_nsec != 0)
+        metric_observe(in->metrics.latency_dequeue, frame_latency(f, &f->dequeued));
+    metric_observe(in->metrics.latency_publish, frame_latency(f, &f->published));
+
+    input_lock(in, DB_PUBLISH);
+
+    old = in->current;
+    f->sequence = ++in->sequence;
+    in->alive = f->published;
+    in->stalled = 0;
+    if(compare)
+        input_compare_frame(in, f, hash);
+
+    in->current = f;
+    history_push(in, f);
+    in->buf = f->buf;
+    in->size = f->size;
+    in->timestamp = f->timestamp;
+
+    /* signal fresh_frame */
+    TRACE3(frame_publish, in->param.id, f->sequence, f->size);
+    pthread_cond_broadcast(&in->db_update);
+    notify_subscribers(in);
+
+    if(f->encoder != NULL && old != NULL && old->encoded)
+        ahead = frame_ref(f);
+
+    /* frame rate in 1/1000 fps, smoothed over the last few frames */
+    if(old != NULL && in->metrics.fps != NULL) {
+        interval = (f->captured.tv_sec - old->captured.tv_sec) * 1000000000LL +
+                   (f->captured.tv_nsec - old->captured.tv_nsec);
+        if(interval > 0) {
+            rate = 1000000000000LL / interval;
+            if(in->metrics.fps->value > 0)
+                rate = in->metrics.fps->value + (rate - in->metrics.fps->value) / 8;
+            metric_set(in->metrics.fps, rate);
+        }
+    }
+
+    /* the filter plugins reading this input get the frame by reference */
+    for(i = 0; i < in->filter_count; i++)
+        filter_feed(in->param.global->in[in->filters[i]], frame_ref(f));
+    input_unlock(in);
+
+    /*
+     * somebody asked for the JPG of the previous frame, so this one will be
+     * needed as well. Encode it on the worker pool now instead of in the
+     * first consumer, this spreads the encoding of all inputs over the cores
+     */
+    if(ahead != NULL && workers_submit(encode_ahead, ahead) != 0)
+        frame_unref(ahead);
+
+    frame_unref(old);
+}
+
+/******************************************************************************
+Description.: take a reference to the current frame of an input, this does
+              not wait for a fresh frame
+Input Value.: in is the input to read from
+Return Value: the frame, NULL if nothing was published yet.
+              Release it with frame_unref().
+******************************************************************************/
+frame *input_get_frame(input *in)
+{
+    frame *f;
+
+    input_lock(in, DB_GET);
+    f = frame_ref(in->current);
+    input_unlock(in);
+
+    if(f != NULL)
+        TRACE2(frame_pickup, in->param.id, f->sequence);
+
+    return f;
+}
+
+/******************************************************************************
+Description.: wait until the input published a frame newer than "sequence" and
+              take a reference to it. Spurious wakeups are ignored and a frame
+              published before calling this is returned immediately, so no
+              frame is served twice and none is missed by sleeping too late.
+Input Value.: in is the input to read from
+              sequence is the sequence number of the last frame the caller
+              has seen, 0 to get the first available frame
+Return Value: the frame or NULL if the program is stopping or the input
+              was unloaded. Release it with frame_unref().
+******************************************************************************/
+frame *input_wait_frame(input *in, unsigned int sequence)
+{
+    frame *f = NULL;
+
+    input_lock(in, DB_WAIT);
+    /* consumer threads are cancelled when their output is stopped */
+    pthread_cleanup_push(unlock_db, &in->db);
+    while(in->sequence == sequence && in->loaded && !in->param.global->stop)
+        wait_db(in);
+
+    if(in->loaded && !in->param.global->stop)
+        f = frame_ref(in->current);
+    pthread_cleanup_pop(0);
+    input_unlock(in);
+
+    if(f != NULL)
+        TRACE2(frame_pickup, in->param.id, f->sequence);
+
+    return f;
+}
+
+/******************************************************************************
+Description.: like input_wait_frame(), but also return when the watchdog
+              finds the input stalled (-W), so the caller can send a
+              placeholder or give up instead of waiting for a camera that
+              may never deliver again
+Input Value.: in is the input to read from
+              sequence is the sequence number of the last frame the caller
+              has seen, 0 to get the first available frame
+              stalled is set to 1 if the input stalled, 0 otherwise
+Return Value: the frame, NULL if the input stalled, was unloaded or the
+              program is stopping. Release it with frame_unref().
+******************************************************************************/
+frame *input_wait_frame_stall(input *in, unsigned int sequence, int *stalled)
+{
+    frame *f = NULL;
+    unsigned int wakeups;
+
+    *stalled = 0;
+    input_lock(in, DB_WAIT);
+    wakeups = in->stall_wakeups;
+    pthread_cleanup_push(unlock_db, &in->db);
+    while(in->sequence == sequence && in->stall_wakeups == wakeups && in->loaded && !in->param.global->stop)
+        wait_db(in);
+
+    if(in->sequence != sequence && in->loaded && !in->param.global->stop)
+        f = frame_ref(in->current);
+    else if(in->stall_wakeups != wakeups)
+        *stalled = 1;
+    pthread_cleanup_pop(0);
+    input_unlock(in);
+
+    if(f != NULL)
+        TRACE2(frame_pickup, in->param.id, f->sequence);
+
+    return f;
+}
+
+/******************************************************************************
+Description.: look up a frame by its sequence number in the history
+Input Value.: in is the input to read from
+              sequence is the sequence number of the frame
+Return Value: the frame or NULL if it is not kept (anymore).
+              Release it with frame_unref().
+******************************************************************************/
+frame *input_find_frame(input *in, unsigned int sequence)
+{
+    frame *f, *found = NULL;
+    unsigned int i;
+
+    input_lock(in, DB_HISTORY);
+    for(i = 0; i < history_length(in); i++) {
+        f = history_at(in, i);
+        if(f->sequence == sequence) {
+            found = frame_ref(f);
+            break;
+        }
+    }
+    input_unlock(in);
+
+    return found;
+}
+
+/******************************************************************************
+Description.: look up the frame that was current at a certain time, this is
+              the newest frame with a timestamp not later than "at"
+Input Value.: in is the input to read from
+              at is the time, in the same clock as the frame timestamps
+Return Value: the frame or NULL if the history does not reach back that far.
+              Release it with frame_unref().
+******************************************************************************/
+frame *input_find_frame_at(input *in, struct timeval *at)
+{
+    frame *f, *found = NULL;
+    unsigned int i;
+
+    input_lock(in, DB_HISTORY);
+    for(i = 0; i < history_length(in); i++) {
+        f = history_at(in, i);
+        if(!timercmp(&f->timestamp, at, >)) {
+            found = frame_ref(f);
+            break;
+        }
+    }
+    input_unlock(in);
+
+    return found;
+}
+
+/******************************************************************************
+Description.: look up the frame with the timestamp closest to "at", before or
+              after it
+Input Value.: in is the input to read from
+              at is the time, in the same clock as the frame timestamps
+              distance receives the absolute difference in microseconds,
+              may be NULL
+Return Value: the frame or NULL if nothing was published yet. Release it
+              with frame_unref().
+******************************************************************************/
+frame *input_find_frame_near(input *in, struct timeval *at, long long *distance)
+{
+    frame *f, *found = NULL;
+    long long d, best = 0;
+    unsigned int i;
+
+    input_lock(in, DB_HISTORY);
+    for(i = 0; i < history_length(in); i++) {
+        f = history_at(in, i);
+        d = (f->timestamp.tv_sec - at->tv_sec) * 1000000LL + (f->timestamp.tv_usec - at->tv_usec);
+        if(d < 0)
+            d = -d;
+        if(found != NULL && d >= best)
+            break;
+        found = f;
+        best = d;
+    }
+    if(found != NULL)
+        frame_ref(found);
+    input_unlock(in);
+
+    if(distance != NULL)
+        *distance = best;
+    return found;
+}
+
+/******************************************************************************
+Description.: take references to all frames of the history that are not
+              older than "since", for example the last 5 seconds
+Input Value.: in is the input to read from
+              since is the oldest timestamp to return
+              frames receives the frames, oldest first
+              max is the number of entries "frames" can hold, if there are
+              more frames the newest are returned
+Return Value: the number of frames stored in "frames", release each of them
+              with frame_unref()
+******************************************************************************/
+int input_get_history(input *in, struct timeval *since, frame **frames, int max)
+{
+    frame *f;
+    unsigned int i, count = 0;
+
+    input_lock(in, DB_HISTORY);
+    for(i = 0; i < history_length(in) && count < (unsigned int)max; i++) {
+        f = history_at(in, i);
+        if(timercmp(&f->timestamp, since, <))
+            break;
+        count++;
+    }
+
+    /* history_at() counts from the newest, store them the other way round */
+    for(i = 0; i < count; i++)
+        frames[count - 1 - i] = frame_ref(history_at(in, i));
+    input_unlock(in);
+
+    return count;
+}
+
+/******************************************************************************
+Description.: get a file descriptor that becomes readable whenever the input
+              publishes a frame, for consumers with their own event loop
+              (poll, epoll, libuv). Read 8 bytes to clear it, then fetch the
+              frame with input_get_frame().
+Input Value.: in is the input to watch
+Return Value: the non-blocking eventfd or -1 on error
+******************************************************************************/
+int input_subscribe_fd(input *in)
+{
+    int fd, *tmp;
+
+    if((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        return -1;
+
+    input_lock(in, DB_SUBSCRIBE);
+    if((tmp = realloc(in->notify_fds, (in->notify_count + 1) * sizeof(int))) == NULL) {
+        input_unlock(in);
+        close(fd);
+        return -1;
+    }
+    in->notify_fds = tmp;
+    in->notify_fds[in->notify_count++] = fd;
+
+    /* a frame is already there, do not make the consumer wait for the next */
+    if(in->current != NULL)
+        eventfd_write(fd, 1);
+    input_unlock(in);
+
+    input_consumer_add(in);
+
+    return fd;
+}
+
+/******************************************************************************
+Description.: stop the notifications of input_subscribe_fd() and close the fd
+Input Value.: in is the input
+              fd is the file descriptor returned by input_subscribe_fd()
+Return Value: -
+******************************************************************************/
+void input_unsubscribe_fd(input *in, int fd)
+{
+    int i, found = 0;
+
+    input_lock(in, DB_SUBSCRIBE);
+    for(i = 0; i < in->notify_count; i++) {
+        if(in->notify_fds[i] == fd) {
+            in->notify_fds[i] = in->notify_fds[--in->notify_count];
+            found = 1;
+            break;
+        }
+    }
+    input_unlock(in);
+
+    if(found)
+        input_consumer_remove(in);
+    close(fd);
+}
+
+/******************************************************************************
+Description.: check if an input has demand while db is locked, see
+              input_has_demand()
+Input Value.: in is the input
+Return Value: 1 if the frames are needed, 0 otherwise
+******************************************************************************/
+static int has_demand(input *in)
+{
+    struct timespec now;
+    long idle;
+    int linger = in->param.global->linger;
+
+    if(linger < 0 || in->consumers > 0)
+        return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    idle = (now.tv_sec - in->idle_since.tv_sec) * 1000 +
+           (now.tv_nsec - in->idle_since.tv_nsec) / 1000000;
+
+    return idle < linger;
+}
+
+/******************************************************************************
+Description.: register a consumer of an input. Inputs may stop capturing while
+              nobody consumes their frames, a filter is a consumer of its
+              source as long as it has consumers itself.
+Input Value.: in is the input
+Return Value: 1 if the input had no demand before, the current frame may be
+              stale then and the caller should wait for a fresh one. 0 if the
+              input is capturing.
+******************************************************************************/
+int input_consumer_add(input *in)
+{
+    int idle, first;
+
+    input_lock(in, DB_DEMAND);
+    idle = !has_demand(in);
+    first = (in->consumers++ == 0);
+    metric_add(in->metrics.consumers, 1);
+
+    /* wake up the input if it waits in input_wait_demand() */
+    pthread_cond_broadcast(&in->db_update);
+    input_unlock(in);
+
+    if(first && in->source >= 0)
+        idle |= input_consumer_add(in->param.global->in[in->source]);
+
+    return idle;
+}
+
+/******************************************************************************
+Description.: unregister a consumer added with input_consumer_add()
+Input Value.: in is the input
+Return Value: -
+******************************************************************************/
+void input_consumer_remove(input *in)
+{
+    int last;
+
+    input_lock(in, DB_DEMAND);
+    last = (--in->consumers == 0);
+    metric_add(in->metrics.consumers, -1);
+    if(last)
+        clock_gettime(CLOCK_MONOTONIC, &in->idle_since);
+    input_unlock(in);
+
+    if(last && in->source >= 0)
+        input_consumer_remove(in->param.global->in[in->source]);
+}
+
+/******************************************************************************
+Description.: check if somebody needs the frames of an input. Inputs call this
+              before capturing and pause if it returns 0, the last consumer
+              may have left less than the linger time (-L) ago.
+Input Value.: in is the input
+Return Value: 1 if the input should capture, 0 if it may pause
+******************************************************************************/
+int input_has_demand(input *in)
+{
+    int demand;
+
+    input_lock(in, DB_DEMAND);
+    demand = has_demand(in);
+    input_unlock(in);
+
+    return demand;
+}
+
+/******************************************************************************
+Description.: sleep until the input has a consumer again, for paused inputs
+Input Value.: in is the input
+Return Value: 0 if there is a consumer, -1 if the program is stopping
+******************************************************************************/
+int input_wait_demand(input *in)
+{
+    int stop;
+
+    input_lock(in, DB_DEMAND);
+    /* input threads are cancelled when they are stopped */
+    pthread_cleanup_push(unlock_db, &in->db);
+    while(in->consumers == 0 && !in->param.global->stop)
+        wait_db(in);
+    stop = in->param.global->stop;
+    pthread_cleanup_pop(0);
+    input_unlock(in);
+
+    return stop ? -1 : 0;
+}
+
+/******************************************************************************
+Description.: check if an input stopped delivering frames, called by the
+              watchdog (-W). While it is stalled the waiters of
+              input_wait_frame_stall() are woken on every check. A paused
+              input (-L) does not stall, a filter stalls with its source.
+Input Value.: in is the input
+              limit is the time without a frame in nanoseconds that counts
+              as stall
+Return Value: 1 if the input should be restarted, 0 otherwise
+******************************************************************************/
+int input_check_stall(input *in, long long limit)
+{
+    struct timespec now;
+    input *src = NULL;
+    int restart = 0, stalled = 0;
+
+    if(in->source >= 0) {
+        src = in->param.global->in[in->source];
+        input_lock(src, DB_WATCHDOG);
+        stalled = src->stalled;
+        input_unlock(src);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    input_lock(in, DB_WATCHDOG);
+
+    if(src == NULL && !has_demand(in)) {
+        in->alive = now;
+    } else if(src == NULL && (now.tv_sec - in->alive.tv_sec) * 1000000000LL + (now.tv_nsec - in->alive.tv_nsec) > limit) {
+        /* the next restart is due when it did not help within the limit */
+        in->alive = now;
+        stalled = restart = 1;
+    }
+
+    if(stalled && !in->stalled) {
+        in->stalled = 1;
+        metric_add(in->metrics.stalls, 1);
+    }
+
+    if(in->stalled) {
+        in->stall_wakeups++;
+        pthread_cond_broadcast(&in->db_update);
+    }
+
+    input_unlock(in);
+
+    return restart;
+}
+
+/******************************************************************************
+Description.: free the released frames the pool of an input keeps for reuse
+Input Value.: in is the input
+Return Value: -
+******************************************************************************/
+void input_trim_pool(input *in)
+{
+    frame *f, *spare;
+
+    pthread_mutex_lock(&in->pool.lock);
+    spare = in->pool.free;
+    in->pool.free = NULL;
+    in->pool.count = 0;
+    pthread_mutex_unlock(&in->pool.lock);
+
+    while((f = spare) != NULL) {
+        spare = f->next;
+        frame_free(f);
+    }
+}
+
+/******************************************************************************
+Description.: drop the oldest frame of the history of an input, it is freed
+              once no consumer holds it anymore
+Input Value.: in is the input
+Return Value: 0 if a frame was dropped, -1 if the history is empty
+******************************************************************************/
+int input_trim_history(input *in)
+{
+    frame *f = NULL;
+
+    input_lock(in, DB_MEMORY);
+    if(in->history_count > 0)
+        f = history_drop(in);
+    input_unlock(in);
+
+    if(f == NULL)
+        return -1;
+
+    frame_unref(f);
+    return 0;
+}
+
+/******************************************************************************
+Description.: release the frames an input keeps after its plugin was stopped.
+              Consumers keep the frames they hold, released frames are not
+              kept for reuse anymore. Waiting consumers are woken up, they
+              notice that the input is not loaded anymore.
+Input Value.: in is the input
+Return Value: -
+******************************************************************************/
+void input_release_frames(input *in)
+{
+    frame *f, *current, *pending;
+
+    input_lock(in, DB_RELEASE);
+    while(in->history_count > 0)
+        frame_unref(history_drop(in));
+    current = in->current;
+    pending = in->filter_pending;
+    in->current = NULL;
+    in->filter_pending = NULL;
+    in->buf = NULL;
+    in->size = 0;
+    pthread_cond_broadcast(&in->db_update);
+    notify_subscribers(in);
+    input_unlock(in);
+
+    frame_unref(current);
+    frame_unref(pending);
+
+    pthread_mutex_lock(&in->pool.lock);
+    in->pool.max = 0;
+    while((f = in->pool.free) != NULL) {
+        in->pool.free = f->next;
+        in->pool.count--;
+        frame_free(f);
+    }
+    pthread_mutex_unlock(&in->pool.lock);
+}
@@ -0,0 +1,155 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+/* number of unused frames a pool keeps in addition to the history */
+#define FRAME_POOL_SPARE 4
+
+/*
+ * A frame holds one picture. Input plugins allocate a frame, fill it and
+ * hand it over to the input "database" with input_publish_frame(). From then
+ * on the frame is immutable, consumers take a reference to it and release it
+ * when they are done, so the picture is never copied for each consumer.
+ *
+ * The picture can be there as JPG (buf/size) and/or as raw pixels. An input
+ * that captures raw pixels sets an encoder instead of compressing each
+ * frame, the JPG is then produced by frame_jpeg() on first demand and kept
+ * for all other consumers. Consumers of the JPG must call frame_jpeg()
+ * before they read buf/size.
+ */
+typedef struct _frame frame;
+typedef struct _frame_pool frame_pool;
+
+/* compress the raw pixels of f to "buf", return the JPG size or -1 */
+typedef int (*frame_encoder)(frame *f, int quality, unsigned char *buf, int size);
+
+struct _frame {
+    unsigned char *buf;
+    int size;
+
+    /* raw pixels, raw_format is a V4L2_PIX_FMT_* fourcc, NULL if JPG only */
+    unsigned char *raw;
+    int raw_size;
+    unsigned int raw_format;
+
+    /* set by inputs that deliver raw pixels, see frame_jpeg() */
+    frame_encoder encoder;
+    void *encoder_data;
+
+    /* v4l2_buffer timestamp or the time the frame was received */
+    struct timeval timestamp;
+
+    /* set by input_publish_frame(), counts from 1 without gaps per input */
+    unsigned int sequence;
+
+    /*
+     * description of the picture, set by the input plugin so consumers do
+     * not have to parse it. format is a V4L2_PIX_FMT_* fourcc, quality the
+     * JPG quality or -1 if unknown
+     */
+    unsigned int width;
+    unsigned int height;
+    unsigned int format;
+    int quality;
+
+    /*
+     * CLOCK_MONOTONIC time of the capture, it does not jump like timestamp.
+     * Set when the frame is allocated, inputs that know better overwrite it
+     */
+    struct timespec captured;
+
+    /*
+     * CLOCK_MONOTONIC stamps of the later stages of the frame, zero until
+     * the stage is reached. dequeued is set by inputs that know when the
+     * driver handed the picture over. See frame_latency()
+     */
+    struct timespec dequeued;
+    struct timespec compressed;
+    struct timespec published;
+
+    /*
+     * set if the picture looks like the last one that changed, see -U and
+     * frame_skip_unchanged(). Identical bytes are found when the frame is
+     * published, similar pictures and raw frames when a consumer asks for
+     * the first time
+     */
+    int unchanged;
+
+    /* private */
+    int refcount;
+    size_t capacity;
+    size_t raw_capacity;
+    frame_pool *pool;
+    frame *next;
+
+    /* the input that allocated the frame for its statistics, may be NULL */
+    struct _input *input;
+
+    /* the buffers are charged to owner, see memory.h */
+    struct _input *owner;
+    size_t charged;
+
+    /* protects the lazily produced representations below */
+    pthread_mutex_t lock;
+    int encoded;
+    frame *variants;
+
+    /* set while the frame still has to be compared by frame_skip_unchanged() */
+    int compare;
+};
+
+/*
+ * Released frames of a pool are kept on a free list and handed out again by
+ * frame_pool_get(), so a running input does not malloc/free per frame.
+ */
+struct _frame_pool {
+    pthread_mutex_t lock;
+    frame *free;
+    unsigned int count;
+    unsigned int max;
+
+    /* the frames of the pool are charged to it, may be NULL */
+    struct _input *owner;
+};
+
+frame *frame_alloc(size_t capacity);
+int frame_reserve_raw(frame *f, size_t size);
+int frame_jpeg(frame *f);
+frame *frame_jpeg_variant(frame *f, int quality);
+int frame_parse_jpeg(frame *f);
+void frame_pool_init(frame_pool *pool, unsigned int max);
+frame *frame_pool_get(frame_pool *pool, size_t capacity);
+frame *frame_ref(frame *f);
+void frame_unref(frame *f);
+long long frame_latency(frame *f, struct timespec *at);
+int frame_skip_unchanged(frame *f, struct timespec *sent);
+
+#endif
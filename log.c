@@ -0,0 +1,519 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "log.h"
+#include "thread.h"
+
+/* messages a thread can have in flight before further ones are dropped */
+#define LOG_RING_SIZE 64
+#define LOG_LINE 1024
+
+/*
+ * messages per second a single call site of a thread may log, the rest is
+ * counted and reported as one line when the next second starts
+ */
+#define LOG_BURST 10
+#define LOG_SITES 8
+
+/* how often the writer looks for new messages, in ns */
+#define LOG_POLL 10000000
+
+typedef struct {
+    unsigned long long sequence;
+    int level;
+    int console;
+    char prefix[8];
+    char text[LOG_LINE];
+} log_entry;
+
+/*
+ * rate limit of one call site of a thread. The suppressed messages are
+ * counted by the owning thread and reported by the writer once the second
+ * is over, or by the owner when it reuses the slot for another site.
+ */
+typedef struct {
+    const char *fmt;
+    time_t second;
+    unsigned int count;
+    unsigned int suppressed;
+    int level;
+    int console;
+    char prefix[8];
+} log_site;
+
+/*
+ * single producer, single consumer ring of one thread. head is only written
+ * by the owning thread, tail only by the writer. Rings are only removed by
+ * the writer, dead rings of exited threads are freed once they are empty.
+ */
+typedef struct _log_ring log_ring;
+struct _log_ring {
+    log_entry entries[LOG_RING_SIZE];
+    unsigned int head;
+    unsigned int tail;
+    unsigned int dropped;
+    unsigned int reported;
+    int dead;
+    log_site sites[LOG_SITES];
+    log_ring *next;
+};
+
+static log_ring *rings;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static __thread log_ring *ring;
+
+static pthread_t writer;
+static int running;
+static int stopping;
+static int min_level = LOGLEVEL_INFO;
+static unsigned long long sequence;
+
+static const struct {
+    const char *name;
+    int level;
+} level_names[] = {
+    { "err", LOGLEVEL_ERR },
+    { "error", LOGLEVEL_ERR },
+    { "warning", LOGLEVEL_WARNING },
+    { "info", LOGLEVEL_INFO },
+    { "debug", LOGLEVEL_DEBUG },
+};
+
+/******************************************************************************
+Description.: write one message, to stderr with the prefix of the plugin and
+              to syslog without it
+Input Value.: level, prefix, console and text of the message
+Return Value: -
+******************************************************************************/
+static void emit(int level, const char *prefix, int console, const char *text)
+{
+    if(console)
+        fprintf(stderr, "%s%s", prefix, text);
+    syslog(level, "%s", text);
+}
+
+/******************************************************************************
+Description.: destructor of the thread specific ring, the writer frees it
+              after it wrote the remaining messages
+Input Value.: arg is the ring of the exiting thread
+Return Value: -
+******************************************************************************/
+static void ring_release(void *arg)
+{
+    log_ring *r = arg;
+
+    __atomic_store_n(&r->dead, 1, __ATOMIC_RELEASE);
+}
+
+static void ring_key_create(void)
+{
+    pthread_key_create(&ring_key, ring_release);
+}
+
+/******************************************************************************
+Description.: return the ring of the calling thread, create and publish it
+              on the first call
+Input Value.: -
+Return Value: the ring or NULL if not enough memory is available
+******************************************************************************/
+static log_ring *ring_get(void)
+{
+    log_ring *r;
+
+    if(ring != NULL)
+        return ring;
+
+    pthread_once(&ring_once, ring_key_create);
+    if((r = calloc(1, sizeof(log_ring))) == NULL)
+        return NULL;
+
+    r->next = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    while(!__atomic_compare_exchange_n(&rings, &r->next, r, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        ;
+
+    pthread_setspecific(ring_key, r);
+    ring = r;
+    return r;
+}
+
+/******************************************************************************
+Description.: queue a message on a ring, it is dropped and counted if the
+              ring is full. Only the thread of the ring pushes, never from
+              a signal handler, the entry is written before head is stored
+Input Value.: r is the ring of the calling thread
+              level, prefix, console: see log_message()
+              fmt and ap format the message
+Return Value: -
+******************************************************************************/
+static void ring_push(log_ring *r, int level, const char *prefix, int console, const char *fmt, va_list ap)
+{
+    unsigned int head = r->head;
+    log_entry *e;
+
+    if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    e = &r->entries[head % LOG_RING_SIZE];
+    vsnprintf(e->text, sizeof(e->text), fmt, ap);
+    e->level = level;
+    /* copied, the prefix may belong to a plugin that is unloaded meanwhile */
+    snprintf(e->prefix, sizeof(e->prefix), "%s", prefix);
+    e->console = console;
+    e->sequence = __atomic_fetch_add(&sequence, 1, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void ring_printf(log_ring *r, int level, const char *prefix, int console, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    ring_push(r, level, prefix, console, fmt, ap);
+    va_end(ap);
+}
+
+/******************************************************************************
+Description.: rate limit the messages of one call site, identified by its
+              format string
+Input Value.: r is the ring of the calling thread
+              level, prefix, console and fmt of the message
+Return Value: 1 if the message must be suppressed, 0 otherwise
+******************************************************************************/
+static int ring_throttle(log_ring *r, int level, const char *prefix, int console, const char *fmt)
+{
+    log_site *s = NULL;
+    time_t now = time(NULL);
+    unsigned int n;
+    int i;
+
+    for(i = 0; i < LOG_SITES; i++) {
+        if(r->sites[i].fmt == fmt) {
+            s = &r->sites[i];
+            break;
+        }
+        if(s == NULL || r->sites[i].second < s->second)
+            s = &r->sites[i];
+    }
+
+    if(s->fmt != fmt) {
+        if((n = __atomic_exchange_n(&s->suppressed, 0, __ATOMIC_SEQ_CST)) > 0)
+            ring_printf(r, s->level, s->prefix, s->console, "suppressed %u similar messages\n", n);
+        s->fmt = fmt;
+        s->level = level;
+        s->console = console;
+        snprintf(s->prefix, sizeof(s->prefix), "%s", prefix);
+        s->count = 0;
+    }
+
+    if(s->second != now) {
+        __atomic_store_n(&s->second, now, __ATOMIC_RELAXED);
+        s->count = 0;
+    }
+
+    if(++s->count > LOG_BURST) {
+        __atomic_add_fetch(&s->suppressed, 1, __ATOMIC_SEQ_CST);
+        return 1;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: report the messages suppressed by the rate limit of a ring
+              whose second is over
+Input Value.: r is the ring
+              now is the current time
+Return Value: -
+******************************************************************************/
+static void report_suppressed(log_ring *r, time_t now)
+{
+    char prefix[8];
+    unsigned int n;
+    log_site *s;
+    int i;
+
+    for(i = 0; i < LOG_SITES; i++) {
+        s = &r->sites[i];
+        if(__atomic_load_n(&s->suppressed, __ATOMIC_SEQ_CST) == 0 ||
+           __atomic_load_n(&s->second, __ATOMIC_RELAXED) == now)
+            continue;
+
+        /* the owner changes the prefix only after it took the count itself */
+        memcpy(prefix, s->prefix, sizeof(prefix));
+        prefix[sizeof(prefix) - 1] = '\0';
+        if((n = __atomic_exchange_n(&s->suppressed, 0, __ATOMIC_SEQ_CST)) == 0)
+            continue;
+
+        if(s->console)
+            fprintf(stderr, "%ssuppressed %u similar messages\n", prefix, n);
+        syslog(s->level, "suppressed %u similar messages", n);
+    }
+}
+
+/******************************************************************************
+Description.: write the oldest queued message of all rings
+Input Value.: -
+Return Value: 1 if a message was written, 0 if all rings are empty
+******************************************************************************/
+static int drain_one(void)
+{
+    log_ring *r, *oldest = NULL;
+    log_entry *e;
+    unsigned int tail, dropped;
+
+    for(r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        if(dropped != r->reported) {
+            fprintf(stderr, "log buffer full, dropped %u messages\n", dropped - r->reported);
+            syslog(LOGLEVEL_WARNING, "log buffer full, dropped %u messages", dropped - r->reported);
+            r->reported = dropped;
+        }
+
+        tail = r->tail;
+        if(tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+            continue;
+        if(oldest == NULL || r->entries[tail % LOG_RING_SIZE].sequence < oldest->entries[oldest->tail % LOG_RING_SIZE].sequence)
+            oldest = r;
+    }
+
+    if(oldest == NULL)
+        return 0;
+
+    e = &oldest->entries[oldest->tail % LOG_RING_SIZE];
+    emit(e->level, e->prefix, e->console, e->text);
+    __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/******************************************************************************
+Description.: report suppressed messages and free the empty rings of exited
+              threads. The head of the list is
+              kept because new rings are pushed in front of it concurrently.
+Input Value.: -
+Return Value: -
+******************************************************************************/
+static void reap(void)
+{
+    log_ring *prev = __atomic_load_n(&rings, __ATOMIC_ACQUIRE), *r;
+    time_t now = time(NULL);
+
+    for(r = prev; r != NULL; r = r->next)
+        report_suppressed(r, now);
+
+    if(prev == NULL)
+        return;
+
+    while((r = prev->next) != NULL) {
+        if(__atomic_load_n(&r->dead, __ATOMIC_ACQUIRE) &&
+           r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) &&
+           r->dropped == r->reported) {
+            report_suppressed(r, 0);
+            prev->next = r->next;
+            free(r);
+            continue;
+        }
+        prev = r;
+    }
+}
+
+/******************************************************************************
+Description.: thread that writes the queued messages
+Input Value.: -
+Return Value: -
+******************************************************************************/
+static void *writer_thread(void *arg)
+{
+    struct timespec poll = { 0, LOG_POLL };
+    int stop;
+
+    while(1) {
+        stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+        while(drain_one())
+            ;
+        reap();
+        if(stop)
+            break;
+        nanosleep(&poll, NULL);
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+Description.: start the background writer, from now on logging does not
+              block the calling thread any longer
+Input Value.: -
+Return Value: 0 if everything is OK, -1 if the thread could not be created
+******************************************************************************/
+int log_start(void)
+{
+    if(running)
+        return 0;
+
+    stopping = 0;
+    if(thread_create(&writer, NULL, "log", -1, writer_thread, NULL) != 0)
+        return -1;
+
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/******************************************************************************
+Description.: write all queued messages and stop the background writer,
+              later messages are written directly. Joins the writer, call
+              it from a normal thread and not from a signal handler
+Input Value.: -
+Return Value: -
+******************************************************************************/
+void log_stop(void)
+{
+    log_ring *r;
+
+    if(!running)
+        return;
+
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(writer, NULL);
+
+    /* messages of threads that saw running just before it was cleared */
+    while(drain_one())
+        ;
+
+    for(r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next)
+        report_suppressed(r, 0);
+}
+
+/******************************************************************************
+Description.: set the least important level that is still logged
+Input Value.: level is one of the LOGLEVEL_* values
+Return Value: -
+******************************************************************************/
+void log_set_level(int level)
+{
+    min_level = level;
+}
+
+/******************************************************************************
+Description.: translate the name of a level, e.g. "warning"
+Input Value.: name of the level
+Return Value: the LOGLEVEL_* value or -1 if the name is unknown
+******************************************************************************/
+int log_parse_level(const char *name)
+{
+    size_t i;
+
+    for(i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        if(strcasecmp(name, level_names[i].name) == 0)
+            return level_names[i].level;
+    }
+
+    return -1;
+}
+
+/******************************************************************************
+Description.: queue or write a message
+Input Value.: site identifies the call site for the rate limit
+              the other parameters: see log_message()
+Return Value: -
+******************************************************************************/
+static void dispatch(int level, const char *prefix, int console, const char *site, const char *fmt, va_list ap)
+{
+    char text[LOG_LINE];
+    log_ring *r;
+
+    if(__atomic_load_n(&running, __ATOMIC_ACQUIRE) && (r = ring_get()) != NULL) {
+        if(!ring_throttle(r, level, prefix, console, site))
+            ring_push(r, level, prefix, console, fmt, ap);
+    } else {
+        vsnprintf(text, sizeof(text), fmt, ap);
+        emit(level, prefix, console, text);
+    }
+}
+
+static void dispatch_printf(int level, const char *prefix, int console, const char *site, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    dispatch(level, prefix, console, site, fmt, ap);
+    va_end(ap);
+}
+
+/******************************************************************************
+Description.: log a message, this is what LOG, IPRINT and OPRINT expand to
+Input Value.: level is one of the LOGLEVEL_* values
+              prefix is written in front of the message on stderr
+              console is 0 to write the message only to syslog
+              fmt and the remaining arguments format the message
+Return Value: -
+******************************************************************************/
+void log_message(int level, const char *prefix, int console, const char *fmt, ...)
+{
+    va_list ap;
+
+    if(level > min_level)
+        return;
+
+    va_start(ap, fmt);
+    dispatch(level, prefix, console, fmt, fmt, ap);
+    va_end(ap);
+}
+
+/******************************************************************************
+Description.: log an event with structured fields for log processors, it is
+              written as one logfmt line "event=<event> <fields>" to syslog
+              only, e.g. log_event(LOGLEVEL_INFO, "plugin_start",
+              "input=%d plugin=%s", id, name)
+Input Value.: level is one of the LOGLEVEL_* values
+              event names what happened, a string literal
+              fmt formats the key=value fields separated by spaces
+Return Value: -
+******************************************************************************/
+void log_event(int level, const char *event, const char *fmt, ...)
+{
+    char fields[LOG_LINE];
+    va_list ap;
+
+    if(level > min_level)
+        return;
+
+    va_start(ap, fmt);
+    vsnprintf(fields, sizeof(fields), fmt, ap);
+    va_end(ap);
+
+    dispatch_printf(level, "", 0, event, "event=%s %s\n", event, fields);
+}
@@ -0,0 +1,54 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef LOG_H
+#define LOG_H
+
+/*
+ * Logging without blocking the frame path. Every thread writes its messages
+ * into a ring of its own, a single background thread drains the rings in the
+ * order the messages were made and writes them to stderr and syslog. Before
+ * log_start() and after log_stop() messages are written directly.
+ *
+ * Nothing here is async-signal-safe. A ring has a single producer, a
+ * message from a signal handler could take the slot the interrupted thread
+ * is writing, and log_stop() joins the writer thread.
+ *
+ * The levels have the values of their syslog counterparts, the names differ
+ * because some plugins bring headers that define LOG_INFO and friends.
+ */
+#define LOGLEVEL_ERR     3
+#define LOGLEVEL_WARNING 4
+#define LOGLEVEL_INFO    6
+#define LOGLEVEL_DEBUG   7
+
+int log_start(void);
+void log_stop(void);
+void log_set_level(int level);
+int log_parse_level(const char *name);
+void log_message(int level, const char *prefix, int console, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+void log_event(int level, const char *event, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif
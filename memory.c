@@ -0,0 +1,296 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "mjpg_streamer.h"
+
+static struct {
+    globals *global;
+    size_t limit;
+    size_t used;
+
+    /* serializes the reclaiming, the accounting itself is atomic */
+    pthread_mutex_t reclaim;
+
+    /* the registered consumers */
+    pthread_mutex_t lock;
+    memory_consumer *consumers;
+
+    metric *used_bytes;
+    metric *dropped;
+    metric *shed;
+    metric *rejected;
+} memory = {
+    .reclaim = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/******************************************************************************
+Description.: set the budget and register the global statistics, called
+              before any plugin is loaded
+Input Value.: global is the global state
+              limit is the budget in bytes, 0 for no limit
+Return Value: -
+******************************************************************************/
+void memory_init(globals *global, size_t limit)
+{
+    metric *m;
+
+    memory.global = global;
+    memory.limit = limit;
+
+    memory.used_bytes = metric_register(METRIC_GAUGE, "mjpg_memory_bytes",
+                                        "Bytes of all frame buffers", "", 1);
+    metric_set(memory.used_bytes, memory_used());
+    if((m = metric_register(METRIC_GAUGE, "mjpg_memory_limit_bytes",
+                            "Budget for the frame buffers, 0 if unlimited", "", 1)) != NULL)
+        metric_set(m, limit);
+    memory.dropped = metric_register(METRIC_COUNTER, "mjpg_memory_dropped_frames_total",
+                                     "Frames dropped from the histories to stay within the budget", "", 1);
+    memory.shed = metric_register(METRIC_COUNTER, "mjpg_memory_shed_consumers_total",
+                                  "Consumers shed to stay within the budget", "", 1);
+    memory.rejected = metric_register(METRIC_COUNTER, "mjpg_memory_rejected_total",
+                                      "Frame allocations refused because the budget was exhausted", "", 1);
+}
+
+/******************************************************************************
+Description.: total of all frame buffers
+Input Value.: -
+Return Value: the number of bytes
+******************************************************************************/
+size_t memory_used(void)
+{
+    return __atomic_load_n(&memory.used, __ATOMIC_RELAXED);
+}
+
+static int over_budget(void)
+{
+    return memory_used() > memory.limit;
+}
+
+/******************************************************************************
+Description.: ask the consumers of the lowest priority that hold frames an
+              input already replaced to go away, until the frames they hold
+              add up to "excess". They release the frames asynchronously.
+Input Value.: excess is the number of bytes to free
+Return Value: -
+******************************************************************************/
+static void shed_consumers(size_t excess)
+{
+    memory_consumer *c, *victim;
+    unsigned int sequence, oldest = 0;
+    size_t freed = 0;
+
+    pthread_mutex_lock(&memory.lock);
+    while(freed < excess) {
+        victim = NULL;
+        for(c = memory.consumers; c != NULL; c = c->next) {
+            sequence = __atomic_load_n(&c->held_sequence, __ATOMIC_RELAXED);
+            if(c->shed == NULL || c->shedding || sequence == 0 ||
+               sequence == __atomic_load_n(&c->in->sequence, __ATOMIC_RELAXED))
+                continue;
+
+            /* the lowest priority first, the oldest frame within it */
+            if(victim == NULL || c->priority < victim->priority ||
+               (c->priority == victim->priority && sequence < oldest)) {
+                victim = c;
+                oldest = sequence;
+            }
+        }
+
+        if(victim == NULL)
+            break;
+
+        victim->shedding = 1;
+        freed += __atomic_load_n(&victim->held_bytes, __ATOMIC_RELAXED);
+        metric_add(memory.shed, 1);
+        victim->shed(victim->arg);
+    }
+    pthread_mutex_unlock(&memory.lock);
+
+    if(freed > 0)
+        LOG("memory budget exceeded, shedding consumers holding %zu bytes\n", freed);
+}
+
+/******************************************************************************
+Description.: bring the usage below the budget again, see memory.h
+Input Value.: -
+Return Value: -
+******************************************************************************/
+static void reclaim(void)
+{
+    globals *g = memory.global;
+    input *in, *largest;
+    int i;
+
+    if(g == NULL)
+        return;
+
+    for(i = 0; i < g->incnt && over_budget(); i++) {
+        if(g->in[i]->loaded)
+            input_trim_pool(g->in[i]);
+    }
+
+    while(over_budget()) {
+        largest = NULL;
+        for(i = 0; i < g->incnt; i++) {
+            in = g->in[i];
+            if(in->loaded && in->history_count > 0 &&
+               (largest == NULL || in->history_used > largest->history_used))
+                largest = in;
+        }
+
+        if(largest == NULL || input_trim_history(largest) != 0)
+            break;
+
+        metric_add(memory.dropped, 1);
+        input_trim_pool(largest);
+    }
+
+    if(over_budget())
+        shed_consumers(memory_used() - memory.limit);
+}
+
+/******************************************************************************
+Description.: charge a new buffer, memory is reclaimed if it exceeds the
+              budget. Must not be called while a frame database is locked.
+Input Value.: owner is the input the buffer belongs to, may be NULL
+              bytes is the size of the buffer
+Return Value: 0 if the buffer may be allocated, -1 if the budget is
+              exhausted
+******************************************************************************/
+int memory_charge(input *owner, size_t bytes)
+{
+    if(__atomic_add_fetch(&memory.used, bytes, __ATOMIC_RELAXED) > memory.limit && memory.limit > 0) {
+        pthread_mutex_lock(&memory.reclaim);
+        reclaim();
+        pthread_mutex_unlock(&memory.reclaim);
+
+        if(over_budget()) {
+            __atomic_sub_fetch(&memory.used, bytes, __ATOMIC_RELAXED);
+            metric_add(memory.rejected, 1);
+            return -1;
+        }
+    }
+
+    metric_add(memory.used_bytes, bytes);
+    if(owner != NULL) {
+        __atomic_add_fetch(&owner->memory, bytes, __ATOMIC_RELAXED);
+        metric_add(owner->metrics.memory, bytes);
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: give back a buffer that was charged with memory_charge()
+Input Value.: owner is the input the buffer was charged to, may be NULL
+              bytes is the size of the buffer
+Return Value: -
+******************************************************************************/
+void memory_uncharge(input *owner, size_t bytes)
+{
+    __atomic_sub_fetch(&memory.used, bytes, __ATOMIC_RELAXED);
+    metric_add(memory.used_bytes, -(long long)bytes);
+    if(owner != NULL) {
+        __atomic_sub_fetch(&owner->memory, bytes, __ATOMIC_RELAXED);
+        metric_add(owner->metrics.memory, -(long long)bytes);
+    }
+}
+
+/******************************************************************************
+Description.: register a consumer that holds frames of an input
+Input Value.: c is the consumer, owned by the caller
+              in is the input it reads from
+              out is the output it belongs to, may be NULL
+              priority: consumers with a lower one are shed first
+              shed is called to make the consumer release its frame and go
+              away, NULL if it must never be shed. It is called with the
+              consumers locked, so it must not block.
+              arg is passed to shed
+Return Value: -
+******************************************************************************/
+void memory_consumer_add(memory_consumer *c, input *in, output *out, int priority, void (*shed)(void *arg), void *arg)
+{
+    c->in = in;
+    c->out = out;
+    c->priority = priority;
+    c->shed = shed;
+    c->arg = arg;
+    c->held_sequence = 0;
+    c->held_bytes = 0;
+    c->shedding = 0;
+
+    pthread_mutex_lock(&memory.lock);
+    c->prev = NULL;
+    c->next = memory.consumers;
+    if(c->next != NULL)
+        c->next->prev = c;
+    memory.consumers = c;
+    pthread_mutex_unlock(&memory.lock);
+}
+
+/******************************************************************************
+Description.: unregister a consumer, afterwards it is not shed anymore
+Input Value.: c is the consumer, nothing happens if it is not registered
+Return Value: -
+******************************************************************************/
+void memory_consumer_remove(memory_consumer *c)
+{
+    if(c->in == NULL)
+        return;
+
+    memory_consumer_hold(c, NULL);
+
+    pthread_mutex_lock(&memory.lock);
+    if(c->prev != NULL)
+        c->prev->next = c->next;
+    else
+        memory.consumers = c->next;
+    if(c->next != NULL)
+        c->next->prev = c->prev;
+    c->in = NULL;
+    pthread_mutex_unlock(&memory.lock);
+}
+
+/******************************************************************************
+Description.: tell which frame a consumer holds now, this does not lock
+Input Value.: c is the consumer
+              f is the frame, NULL after the consumer released it
+Return Value: -
+******************************************************************************/
+void memory_consumer_hold(memory_consumer *c, frame *f)
+{
+    size_t bytes = (f != NULL) ? f->capacity + f->raw_capacity : 0;
+
+    if(c->out != NULL)
+        metric_add(c->out->metrics.memory, (long long)bytes - (long long)c->held_bytes);
+
+    __atomic_store_n(&c->held_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->held_sequence, (f != NULL) ? f->sequence : 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,71 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+
+/*
+ * Accounting of the frame buffers against a global budget (-m). Every
+ * buffer is charged to the input that allocated it. When an allocation
+ * would exceed the budget, memory is reclaimed in this order:
+ *  - frames the pools of the inputs keep for reuse are freed
+ *  - the oldest frames of the histories are dropped
+ *  - the consumers of the lowest priority that hold stale frames are shed
+ * If that is not enough the allocation fails and the input skips a frame.
+ *
+ * Consumers that hold frames for a longer time register themselves, so the
+ * bytes they hold are reported per output and they can be shed.
+ */
+#define MEMORY_PRIORITY_VIEWER   0
+#define MEMORY_PRIORITY_RECORDER 10
+
+typedef struct _memory_consumer memory_consumer;
+struct _memory_consumer {
+    struct _input *in;
+    struct _output *out;
+    int priority;
+
+    /* asks the consumer to go away, NULL if it must never be shed */
+    void (*shed)(void *arg);
+    void *arg;
+
+    /* the frame the consumer holds, 0 if none */
+    unsigned int held_sequence;
+    size_t held_bytes;
+    int shedding;
+
+    memory_consumer *prev;
+    memory_consumer *next;
+};
+
+void memory_init(struct _globals *global, size_t limit);
+int memory_charge(struct _input *owner, size_t bytes);
+void memory_uncharge(struct _input *owner, size_t bytes);
+size_t memory_used(void);
+void memory_consumer_add(memory_consumer *c, struct _input *in, struct _output *out, int priority, void (*shed)(void *arg), void *arg);
+void memory_consumer_remove(memory_consumer *c);
+void memory_consumer_hold(memory_consumer *c, struct _frame *f);
+
+#endif
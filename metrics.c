@@ -0,0 +1,279 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "mjpg_streamer.h"
+
+/* newest metric first, only ever grows */
+static metric *registry = NULL;
+
+/******************************************************************************
+Description.: allocate a metric that is not in the registry yet
+Input Value.: see metric_register()
+Return Value: the metric or NULL if not enough memory is available
+******************************************************************************/
+static metric *metric_new(metric_type type, const char *name, const char *help, const char *labels, double scale)
+{
+    metric *m;
+
+    if((m = calloc(1, sizeof(metric))) == NULL)
+        return NULL;
+
+    m->type = type;
+    m->scale = scale;
+    if((m->name = strdup(name)) == NULL ||
+       (m->help = strdup(help)) == NULL ||
+       (m->labels = strdup((labels != NULL) ? labels : "")) == NULL) {
+        free(m->name);
+        free(m->help);
+        free(m);
+        return NULL;
+    }
+
+    return m;
+}
+
+/******************************************************************************
+Description.: make a complete metric visible, readers do not lock
+Input Value.: m is the metric
+Return Value: -
+******************************************************************************/
+static void metric_publish(metric *m)
+{
+    do {
+        m->next = registry;
+    } while(!__sync_bool_compare_and_swap(&registry, m->next, m));
+}
+
+/******************************************************************************
+Description.: look up a metric that was registered before, plugins register
+              theirs again when they are restarted (see watchdog.h)
+Input Value.: name and labels as given to metric_register()
+Return Value: the metric or NULL if there is none
+******************************************************************************/
+static metric *metric_find(const char *name, const char *labels)
+{
+    metric *m;
+
+    if(labels == NULL)
+        labels = "";
+
+    for(m = registry; m != NULL; m = m->next) {
+        if(strcmp(m->name, name) == 0 && strcmp(m->labels, labels) == 0)
+            return m;
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+Description.: add a metric to the registry, the entry is never removed so
+              pointers to it stay valid even after a plugin was unloaded.
+              Registering the same name and labels again returns the
+              existing metric, so its value continues
+Input Value.: type is the kind of metric
+              name is the Prometheus name, e.g. mjpg_input_frames_total
+              help is a short description
+              labels are the Prometheus labels without braces or NULL
+              scale converts the stored integers to the unit of the name
+Return Value: the metric or NULL if not enough memory is available
+******************************************************************************/
+metric *metric_register(metric_type type, const char *name, const char *help, const char *labels, double scale)
+{
+    metric *m;
+
+    if((m = metric_find(name, labels)) != NULL)
+        return m;
+
+    if((m = metric_new(type, name, help, labels, scale)) != NULL)
+        metric_publish(m);
+
+    return m;
+}
+
+/******************************************************************************
+Description.: register a histogram
+Input Value.: see metric_register()
+              bounds are the upper bounds of the buckets in ascending order,
+              the +Inf bucket is added by the registry
+              count is the number of bounds
+Return Value: the metric or NULL if not enough memory is available
+******************************************************************************/
+metric *metric_histogram(const char *name, const char *help, const char *labels, double scale, const long long *bounds, int count)
+{
+    metric *m;
+
+    if((m = metric_find(name, labels)) != NULL)
+        return m;
+
+    if((m = metric_new(METRIC_HISTOGRAM, name, help, labels, scale)) == NULL)
+        return NULL;
+
+    if((m->bounds = malloc(count * sizeof(long long))) == NULL ||
+       (m->buckets = calloc(count, sizeof(unsigned long long))) == NULL) {
+        free(m->bounds);
+        free(m->labels);
+        free(m->help);
+        free(m->name);
+        free(m);
+        return NULL;
+    }
+    memcpy(m->bounds, bounds, count * sizeof(long long));
+    m->bucket_count = count;
+
+    metric_publish(m);
+
+    return m;
+}
+
+/******************************************************************************
+Description.: increase a counter or change a gauge
+Input Value.: m is the metric
+              value is added, it may be negative for gauges
+Return Value: -
+******************************************************************************/
+void metric_add(metric *m, long long value)
+{
+    if(m != NULL)
+        __sync_add_and_fetch(&m->value, value);
+}
+
+/******************************************************************************
+Description.: set a gauge
+Input Value.: m is the metric
+              value is the new value
+Return Value: -
+******************************************************************************/
+void metric_set(metric *m, long long value)
+{
+    if(m != NULL)
+        __atomic_store_n(&m->value, value, __ATOMIC_RELAXED);
+}
+
+/******************************************************************************
+Description.: count an observation of a histogram
+Input Value.: m is the metric
+              value is the observed value, in the unit of the bounds
+Return Value: -
+******************************************************************************/
+void metric_observe(metric *m, long long value)
+{
+    int i;
+
+    if(m == NULL)
+        return;
+
+    /* only the first matching bucket is counted, rendering sums them up */
+    for(i = 0; i < m->bucket_count; i++) {
+        if(value <= m->bounds[i]) {
+            __sync_add_and_fetch(&m->buckets[i], 1);
+            break;
+        }
+    }
+    __sync_add_and_fetch(&m->count, 1);
+    __sync_add_and_fetch(&m->value, value);
+}
+
+/******************************************************************************
+Description.: write the samples of one metric in Prometheus text format
+Input Value.: out is the stream
+              m is the metric
+Return Value: -
+******************************************************************************/
+static void render_metric(FILE *out, metric *m)
+{
+    const char *sep = (m->labels[0] != '\0') ? "," : "";
+    unsigned long long cumulative = 0;
+    int i;
+
+    if(m->type != METRIC_HISTOGRAM) {
+        fprintf(out, "%s%s%s%s %.9g\n", m->name,
+                (m->labels[0] != '\0') ? "{" : "", m->labels,
+                (m->labels[0] != '\0') ? "}" : "",
+                __atomic_load_n(&m->value, __ATOMIC_RELAXED) * m->scale);
+        return;
+    }
+
+    for(i = 0; i < m->bucket_count; i++) {
+        cumulative += __atomic_load_n(&m->buckets[i], __ATOMIC_RELAXED);
+        fprintf(out, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", m->name, m->labels, sep,
+                m->bounds[i] * m->scale, cumulative);
+    }
+    fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", m->name, m->labels, sep,
+            __atomic_load_n(&m->count, __ATOMIC_RELAXED));
+    fprintf(out, "%s_sum%s%s%s %.9g\n", m->name,
+            (m->labels[0] != '\0') ? "{" : "", m->labels,
+            (m->labels[0] != '\0') ? "}" : "",
+            __atomic_load_n(&m->value, __ATOMIC_RELAXED) * m->scale);
+    fprintf(out, "%s_count%s%s%s %llu\n", m->name,
+            (m->labels[0] != '\0') ? "{" : "", m->labels,
+            (m->labels[0] != '\0') ? "}" : "",
+            __atomic_load_n(&m->count, __ATOMIC_RELAXED));
+}
+
+/******************************************************************************
+Description.: render all metrics in the Prometheus text format. This only
+              reads the metrics, the hot paths are never blocked by it.
+Input Value.: size receives the length of the text
+Return Value: the text, release it with free(). NULL if not enough memory
+              is available
+******************************************************************************/
+char *metrics_render(size_t *size)
+{
+    static const char *types[] = { "counter", "gauge", "histogram" };
+    metric *head, *m, *n, *seen;
+    char *text = NULL;
+    FILE *out;
+
+    if((out = open_memstream(&text, size)) == NULL)
+        return NULL;
+
+    /* all series of a name have to be in one group below one TYPE line */
+    head = __atomic_load_n(&registry, __ATOMIC_ACQUIRE);
+    for(m = head; m != NULL; m = m->next) {
+        for(seen = head; seen != m; seen = seen->next) {
+            if(strcmp(seen->name, m->name) == 0)
+                break;
+        }
+        if(seen != m)
+            continue;
+
+        fprintf(out, "# HELP %s %s\n", m->name, m->help);
+        fprintf(out, "# TYPE %s %s\n", m->name, types[m->type]);
+        for(n = m; n != NULL; n = n->next) {
+            if(strcmp(n->name, m->name) == 0)
+                render_metric(out, n);
+        }
+    }
+
+    if(fclose(out) != 0) {
+        free(text);
+        return NULL;
+    }
+
+    return text;
+}
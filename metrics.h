@@ -0,0 +1,72 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+/*
+ * Counters, gauges and histograms that the core and the plugins register
+ * once and update from their hot paths. Updates are atomic operations on
+ * the metric itself, they never take a lock. The registry only grows, so
+ * metrics_render() can walk it while plugins register new ones.
+ *
+ * Values are integers, "scale" converts them to the unit of the name when
+ * rendered, e.g. nanoseconds with a scale of 1e-9 for a *_seconds metric.
+ * All functions accept NULL for a metric that could not be registered.
+ */
+typedef enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+} metric_type;
+
+typedef struct _metric metric;
+struct _metric {
+    metric_type type;
+    char *name;
+    char *help;
+    char *labels;   /* e.g. input="0", without braces, may be empty */
+    double scale;
+
+    /* value of a counter or gauge, sum of the observations of a histogram */
+    long long value;
+
+    /* histogram only, buckets[i] counts the observations <= bounds[i] */
+    int bucket_count;
+    long long *bounds;
+    unsigned long long *buckets;
+    unsigned long long count;
+
+    metric *next;
+};
+
+metric *metric_register(metric_type type, const char *name, const char *help, const char *labels, double scale);
+metric *metric_histogram(const char *name, const char *help, const char *labels, double scale, const long long *bounds, int count);
+void metric_add(metric *m, long long value);
+void metric_set(metric *m, long long value);
+void metric_observe(metric *m, long long value);
+char *metrics_render(size_t *size);
+
+#endif
@@ -40,6 +40,7 @@
 #include <linux/videodev2.h>
 
 #include "utils.h"
+#include "config.h"
 #include "mjpg_streamer.h"
 
 /* globals */
@@ -56,9 +57,46 @@ static void help(char *progname)
     fprintf(stderr, "Usage: %s\n" \
             "  -i | --input \"<input-plugin.so> [parameters]\"\n" \
             "  -o | --output \"<output-plugin.so> [parameters]\"\n" \
+            " [-f | --filter \"<filter-plugin.so> [parameters]\"]\n" \
+            "                         process the frames of the input given before\n" \
+            "                         and make the result available as a new input\n" \
             " [-h | --help ]........: display this help\n" \
             " [-v | --version ].....: display version information\n" \
-            " [-b | --background]...: fork to the background, daemon mode\n", progname);
+            " [-b | --background]...: fork to the background, daemon mode\n" \
+            " [-H | --history ].....: keep the last <n> frames of each input\n" \
+            " [-B | --history_bytes]: limit the kept frames of each input to a size,\n" \
+            "                         k, M and G suffixes are allowed (e.g. 32M)\n" \
+            " [-t | --threads ].....: number of worker threads for encoding,\n" \
+            "                         default is one per CPU core\n" \
+            " [-c | --control ].....: unix socket to load and unload plugins at\n" \
+            "                         runtime, e.g. \"load input input_uvc.so\"\n" \
+            " [-L | --linger ]......: pause inputs nobody watches after <ms>,\n" \
+            "                         default is to capture all the time\n" \
+            " [-M | --mutex_profile]: record how long each part of the program\n" \
+            "                         waits for and holds the frame database of\n" \
+            "                         the inputs, see /metrics of output_http\n" \
+            " [-l | --log_level ]...: least important messages to log, one of\n" \
+            "                         error, warning, info (default) or debug\n" \
+            " [-m | --memory_limit].: budget for all frame buffers, k, M and G\n" \
+            "                         suffixes are allowed (e.g. 64M). Histories\n" \
+            "                         are trimmed and slow clients are dropped\n" \
+            "                         to stay within it\n" \
+            " [-C | --config ]......: read the inputs, filters, outputs and the\n" \
+            "                         options above from a file, see README.md\n" \
+            " [-s | --source ]......: id of the input the next filter reads from,\n" \
+            "                         default is the one given before the filter\n" \
+            " [-S | --sync ]........: match the frames of inputs by timestamp and\n" \
+            "                         publish them as sets, e.g. \"0,1:5\" for the\n" \
+            "                         inputs 0 and 1 within 5 ms (default 10 ms)\n" \
+            " [-U | --unchanged ]...: mark frames that differ from the last changed\n" \
+            "                         one by at most <n> (0-255, 0 compares the\n" \
+            "                         bytes only). Streams, recordings and web\n" \
+            "                         sockets send them only every <ms>, default\n" \
+            "                         1000, e.g. \"4:5000\". Raw frames are\n" \
+            "                         compared after their JPG compression\n" \
+            " [-W | --watchdog ]....: restart inputs that delivered no frame for\n" \
+            "                         <ms> (at least five frame intervals), waiting\n" \
+            "                         clients get the last frame meanwhile\n", progname);
     fprintf(stderr, "-----------------------------------------------------------------------\n");
     fprintf(stderr, "Example #1:\n" \
             " To open an UVC webcam \"/dev/video1\" and stream it via HTTP:\n" \
@@ -72,6 +110,10 @@ static void help(char *progname)
             " To get help for a certain input plugin:\n" \
             "  %s -i \"input_uvc.so --help\"\n", progname);
     fprintf(stderr, "-----------------------------------------------------------------------\n");
+    fprintf(stderr, "Example #4:\n" \
+            " To stream a webcam in color as input 0 and in grey as input 1:\n" \
+            "  %s -i \"input_uvc.so\" -f \"filter_gray.so\" -o \"output_http.so\"\n", progname);
+    fprintf(stderr, "-----------------------------------------------------------------------\n");
     fprintf(stderr, "In case the modules (=plugins) can not be found:\n" \
             " * Set the default search path for the modules with:\n" \
             "   export LD_LIBRARY_PATH=/path/to/plugins,\n" \
@@ -85,55 +127,79 @@ static void help(char *progname)
 /******************************************************************************
 Description.: pressing CTRL+C sends signals to this process instead of just
               killing it plugins can tidily shutdown and free allocated
-              resources. The function prototype is defined by the system,
-              because it is a callback function.
+              resources. The signals are blocked in all threads, main()
+              receives them with sigwait() and calls this as a normal
+              thread, so it can take locks and join threads.
 Input Value.: sig tells us which signal was received
 Return Value: -
 ******************************************************************************/
-static void signal_handler(int sig)
+static void shutdown_streamer(int sig)
 {
     int i;
 
-    /* signal "stop" to threads */
+    /* signal "stop" to threads, logging is fine here but not in a handler */
     LOG("setting signal to stop\n");
+    log_event(LOGLEVEL_INFO, "stop", "signal=%d", sig);
     global.stop = 1;
+    control_stop();
+    watchdog_stop();
+
+    /* wake up consumers waiting for a frame, they will notice "stop" */
+    for(i = 0; i < global.incnt; i++) {
+        input_lock(global.in[i], DB_OTHER);
+        pthread_cond_broadcast(&global.in[i]->db_update);
+        input_unlock(global.in[i]);
+    }
     usleep(1000 * 1000);
 
+    /*
+     * both join threads, so they may only run here and never in a handler
+     * or on one of the threads they join. The workers finish queued jobs
+     * before the plugins they call into are stopped
+     */
+    sync_stop(&global);
+    workers_stop();
+
     /* clean up threads */
     LOG("force cancellation of threads and cleanup resources\n");
     for(i = 0; i < global.incnt; i++) {
-        global.in[i].stop(i);
+        if(!global.in[i]->loaded || global.in[i]->stopped)
+            continue;
+        global.in[i]->stop(i);
         /*for (j = 0; j<MAX_PLUGIN_ARGUMENTS; j++) {
-            if (global.in[i].param.argv[j] != NULL) {
-                free(global.in[i].param.argv[j]);
+            if (global.in[i]->param.argv[j] != NULL) {
+                free(global.in[i]->param.argv[j]);
             }
         }*/
     }
 
     for(i = 0; i < global.outcnt; i++) {
-        global.out[i].stop(global.out[i].param.id);
-        pthread_cond_destroy(&global.in[i].db_update);
-        pthread_mutex_destroy(&global.in[i].db);
+        if(!global.out[i]->loaded || global.out[i]->stopped)
+            continue;
+        global.out[i]->stop(global.out[i]->param.id);
         /*for (j = 0; j<MAX_PLUGIN_ARGUMENTS; j++) {
-            if (global.out[i].param.argv[j] != NULL)
-                free(global.out[i].param.argv[j]);
+            if (global.out[i]->param.argv[j] != NULL)
+                free(global.out[i]->param.argv[j]);
         }*/
     }
     usleep(1000 * 1000);
 
-    /* close handles of input plugins */
+    /* close handles of input plugins, unloaded plugins were never closed */
     for(i = 0; i < global.incnt; i++) {
-        dlclose(global.in[i].handle);
+        if(global.in[i]->loaded)
+            dlclose(global.in[i]->handle);
     }
 
     for(i = 0; i < global.outcnt; i++) {
         int j, skip = 0;
+        if(!global.out[i]->loaded)
+            continue;
         DBG("about to decrement usage counter for handle of %s, id #%02d, handle: %p\n", \
-            global.out[i].plugin, global.out[i].param.id, global.out[i].handle);
+            global.out[i]->plugin, global.out[i]->param.id, global.out[i]->handle);
 
         for(j=i+1; j<global.outcnt; j++) {
-          if ( global.out[i].handle == global.out[j].handle ) {
-            DBG("handles are pointing to the same destination (%p == %p)\n", global.out[i].handle, global.out[j].handle);
+          if ( global.out[j]->loaded && global.out[i]->handle == global.out[j]->handle ) {
+            DBG("handles are pointing to the same destination (%p == %p)\n", global.out[i]->handle, global.out[j]->handle);
             skip = 1;
           }
         }
@@ -141,47 +207,56 @@ static void signal_handler(int sig)
           continue;
         }
 
-        DBG("closing handle %p\n", global.out[i].handle);
+        DBG("closing handle %p\n", global.out[i]->handle);
 
-        dlclose(global.out[i].handle);
+        dlclose(global.out[i]->handle);
     }
     DBG("all plugin handles closed\n");
 
     LOG("done\n");
 
+    log_stop();
     closelog();
-    exit(0);
-    return;
 }
 
-static int split_parameters(char *parameter_string, int *argc, char **argv)
+/******************************************************************************
+Description.: put the options a configuration file (-C) stands for in front
+              of the command line, so options given on the command line
+              override the file and its plugins get the lower ids
+Input Value.: argc and argv of main, replaced if -C is given
+Return Value: -
+******************************************************************************/
+static void merge_config(int *argc, char ***argv)
 {
-    int count = 1;
-    argv[0] = NULL; // the plugin may set it to 'INPUT_PLUGIN_NAME'
-    if(parameter_string != NULL && strlen(parameter_string) != 0) {
-        char *arg = NULL, *saveptr = NULL, *token = NULL;
-
-        arg = strdup(parameter_string);
-
-        if(strchr(arg, ' ') != NULL) {
-            token = strtok_r(arg, " ", &saveptr);
-            if(token != NULL) {
-                argv[count] = strdup(token);
-                count++;
-                while((token = strtok_r(NULL, " ", &saveptr)) != NULL) {
-                    argv[count] = strdup(token);
-                    count++;
-                    if(count >= MAX_PLUGIN_ARGUMENTS) {
-                        IPRINT("ERROR: too many arguments to input plugin\n");
-                        return 0;
-                    }
-                }
-            }
-        }
-        free(arg);
+    char **merged, **file_argv, *path = NULL;
+    int i, file_argc;
+
+    for(i = 1; i < *argc - 1; i++) {
+        if(!strcmp((*argv)[i], "-C") || !strcmp((*argv)[i], "--config"))
+            path = (*argv)[i + 1];
+    }
+    for(i = 1; i < *argc; i++) {
+        if(!strncmp((*argv)[i], "--config=", 9))
+            path = (*argv)[i] + 9;
+    }
+
+    if(path == NULL)
+        return;
+
+    if(config_load(path, &file_argc, &file_argv) != 0)
+        exit(EXIT_FAILURE);
+
+    if((merged = calloc(file_argc + *argc + 1, sizeof(char *))) == NULL) {
+        fprintf(stderr, "could not allocate memory\n");
+        exit(EXIT_FAILURE);
     }
-    *argc = count;
-    return 1;
+
+    merged[0] = (*argv)[0];
+    memcpy(&merged[1], &file_argv[1], (file_argc - 1) * sizeof(char *));
+    memcpy(&merged[file_argc], &(*argv)[1], (*argc - 1) * sizeof(char *));
+
+    *argc = file_argc + *argc - 1;
+    *argv = merged;
 }
 
 /******************************************************************************
@@ -192,14 +267,24 @@ Return Value:
 int main(int argc, char *argv[])
 {
     //char *input  = "input_uvc.so --resolution 640x480 --fps 5 --device /dev/video0";
-    char *input[MAX_INPUT_PLUGINS];
-    char *output[MAX_OUTPUT_PLUGINS];
-    int daemon = 0, i, j;
-    size_t tmp = 0;
+    char **input = NULL, **output = NULL, **sync = NULL;
+    int *source = NULL;
+    int inputs = 0, outputs = 0, syncs = 0;
+    int daemon = 0, i;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int level, next_source = -1;
+    char *control_path = NULL, *p;
+    sigset_t signals;
+    int sig;
 
-    output[0] = "output_http.so --port 8080";
     global.outcnt = 0;
     global.incnt = 0;
+    global.linger = -1;
+    global.unchanged = -1;
+    global.unchanged_interval = 1000;
+    global.watchdog = -1;
+
+    merge_config(&argc, &argv);
 
     /* parameter parsing */
     while(1) {
@@ -208,23 +293,78 @@ int main(int argc, char *argv[])
             {"help", no_argument, NULL, 'h'},
             {"input", required_argument, NULL, 'i'},
             {"output", required_argument, NULL, 'o'},
+            {"filter", required_argument, NULL, 'f'},
             {"version", no_argument, NULL, 'v'},
             {"background", no_argument, NULL, 'b'},
+            {"history", required_argument, NULL, 'H'},
+            {"history_bytes", required_argument, NULL, 'B'},
+            {"threads", required_argument, NULL, 't'},
+            {"control", required_argument, NULL, 'c'},
+            {"linger", required_argument, NULL, 'L'},
+            {"mutex_profile", no_argument, NULL, 'M'},
+            {"log_level", required_argument, NULL, 'l'},
+            {"memory_limit", required_argument, NULL, 'm'},
+            {"config", required_argument, NULL, 'C'},
+            {"source", required_argument, NULL, 's'},
+            {"sync", required_argument, NULL, 'S'},
+            {"unchanged", required_argument, NULL, 'U'},
+            {"watchdog", required_argument, NULL, 'W'},
             {NULL, 0, NULL, 0}
         };
 
-        c = getopt_long(argc, argv, "hi:o:vb", long_options, NULL);
+        c = getopt_long(argc, argv, "hi:o:f:vbH:B:t:c:L:Ml:m:C:s:S:U:W:", long_options, NULL);
 
         /* no more options to parse */
         if(c == -1) break;
 
         switch(c) {
-        case 'i':
-            input[global.incnt++] = strdup(optarg);
+        case 'i': /* fall through */
+        case 'f':
+            if(c == 'f' && inputs == 0) {
+                fprintf(stderr, "a filter needs an input (or filter) before it\n");
+                exit(EXIT_FAILURE);
+            }
+            if(c == 'f' && (next_source < -1 || next_source >= inputs)) {
+                fprintf(stderr, "the source of a filter must be given before it\n");
+                exit(EXIT_FAILURE);
+            }
+            input = realloc(input, (inputs + 1) * sizeof(char *));
+            source = realloc(source, (inputs + 1) * sizeof(int));
+            if(input == NULL || source == NULL) {
+                fprintf(stderr, "could not allocate memory\n");
+                exit(EXIT_FAILURE);
+            }
+            source[inputs] = (c == 'f') ? ((next_source >= 0) ? next_source : inputs - 1) : -1;
+            input[inputs++] = strdup(optarg);
+            if(c == 'f')
+                next_source = -1;
+            break;
+
+        case 's':
+            next_source = atoi(optarg);
+            if(next_source < 0)
+                next_source = -2;
+            break;
+
+        case 'C':
+            /* already merged into argv, see merge_config() */
+            break;
+
+        case 'S':
+            /* the groups are created once the inputs are loaded */
+            if((sync = realloc(sync, (syncs + 1) * sizeof(char *))) == NULL) {
+                fprintf(stderr, "could not allocate memory\n");
+                exit(EXIT_FAILURE);
+            }
+            sync[syncs++] = optarg;
             break;
 
         case 'o':
-            output[global.outcnt++] = strdup(optarg);
+            if((output = realloc(output, (outputs + 1) * sizeof(char *))) == NULL) {
+                fprintf(stderr, "could not allocate memory\n");
+                exit(EXIT_FAILURE);
+            }
+            output[outputs++] = strdup(optarg);
             break;
 
         case 'v':
@@ -244,6 +384,59 @@ int main(int argc, char *argv[])
             daemon = 1;
             break;
 
+        case 'H':
+            global.history_frames = atoi(optarg);
+            break;
+
+        case 'B':
+            global.history_bytes = parse_size_opt(optarg);
+            break;
+
+        case 't':
+            threads = atoi(optarg);
+            break;
+
+        case 'c':
+            control_path = optarg;
+            break;
+
+        case 'L':
+            global.linger = atoi(optarg);
+            break;
+
+        case 'M':
+            global.mutex_profile = 1;
+            break;
+
+        case 'l':
+            if((level = log_parse_level(optarg)) < 0) {
+                fprintf(stderr, "unknown log level: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            log_set_level(level);
+            break;
+
+        case 'm':
+            global.memory_limit = parse_size_opt(optarg);
+            break;
+
+        case 'U':
+            global.unchanged = atoi(optarg);
+            if((p = strchr(optarg, ':')) != NULL)
+                global.unchanged_interval = atoi(p + 1);
+            if(global.unchanged < 0 || global.unchanged > 255 || global.unchanged_interval < 0) {
+                fprintf(stderr, "invalid threshold of unchanged frames: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'W':
+            if((global.watchdog = atoi(optarg)) <= 0) {
+                fprintf(stderr, "the watchdog needs a time in milliseconds\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+
         case 'h': /* fall through */
         default:
             help(argv[0]);
@@ -253,7 +446,17 @@ int main(int argc, char *argv[])
 
     openlog("MJPG-streamer ", LOG_PID | LOG_CONS, LOG_USER);
     //openlog("MJPG-streamer ", LOG_PID|LOG_CONS|LOG_PERROR, LOG_USER);
-    syslog(LOG_INFO, "starting application");
+    log_event(LOGLEVEL_INFO, "start", "version=%s", SOURCE_VERSION);
+
+    /*
+     * block CTRL+C and SIGTERM before the first thread is started, all
+     * threads inherit the mask. A handler could interrupt a thread that
+     * holds a lock the shutdown needs, main() waits for them instead
+     */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
 
     /* fork to the background */
     if(daemon) {
@@ -261,16 +464,16 @@ int main(int argc, char *argv[])
         daemon_mode();
     }
 
-    /* ignore SIGPIPE (send by OS if transmitting to closed TCP sockets) */
-    signal(SIGPIPE, SIG_IGN);
-
-    /* register signal handler for <CTRL>+C in order to clean up */
-    if(signal(SIGINT, signal_handler) == SIG_ERR) {
-        LOG("could not register signal handler\n");
+    /* after the fork, the thread would not survive it */
+    if(log_start() != 0) {
+        fprintf(stderr, "could not start the log writer\n");
         closelog();
         exit(EXIT_FAILURE);
     }
 
+    /* ignore SIGPIPE (send by OS if transmitting to closed TCP sockets) */
+    signal(SIGPIPE, SIG_IGN);
+
     /*
      * messages like the following will only be visible on your terminal
      * if not running in daemon mode
@@ -282,118 +485,52 @@ int main(int argc, char *argv[])
 #endif
 
     /* check if at least one output plugin was selected */
-    if(global.outcnt == 0) {
+    if(outputs == 0) {
         /* no? Then use the default plugin instead */
-        global.outcnt = 1;
+        output = malloc(sizeof(char *));
+        output[outputs++] = "output_http.so --port 8080";
     }
 
-    /* open input plugin */
-    for(i = 0; i < global.incnt; i++) {
-        /* this mutex and the conditional variable are used to synchronize access to the global picture buffer */
-        if(pthread_mutex_init(&global.in[i].db, NULL) != 0) {
-            LOG("could not initialize mutex variable\n");
-            closelog();
-            exit(EXIT_FAILURE);
-        }
-        if(pthread_cond_init(&global.in[i].db_update, NULL) != 0) {
-            LOG("could not initialize condition variable\n");
-            closelog();
-            exit(EXIT_FAILURE);
-        }
-
-        tmp = (size_t)(strchr(input[i], ' ') - input[i]);
-        global.in[i].stop      = 0;
-        global.in[i].context   = NULL;
-        global.in[i].buf       = NULL;
-        global.in[i].size      = 0;
-        global.in[i].plugin = (tmp > 0) ? strndup(input[i], tmp) : strdup(input[i]);
-        global.in[i].handle = dlopen(global.in[i].plugin, RTLD_LAZY);
-        if(!global.in[i].handle) {
-            LOG("ERROR: could not find input plugin\n");
-            LOG("       Perhaps you want to adjust the search path with:\n");
-            LOG("       # export LD_LIBRARY_PATH=/path/to/plugin/folder\n");
-            LOG("       dlopen: %s\n", dlerror());
-            closelog();
-            exit(EXIT_FAILURE);
-        }
-        global.in[i].init = dlsym(global.in[i].handle, "input_init");
-        if(global.in[i].init == NULL) {
-            LOG("%s\n", dlerror());
-            exit(EXIT_FAILURE);
-        }
-        global.in[i].stop = dlsym(global.in[i].handle, "input_stop");
-        if(global.in[i].stop == NULL) {
-            LOG("%s\n", dlerror());
-            exit(EXIT_FAILURE);
-        }
-        global.in[i].run = dlsym(global.in[i].handle, "input_run");
-        if(global.in[i].run == NULL) {
-            LOG("%s\n", dlerror());
-            exit(EXIT_FAILURE);
-        }
-        /* try to find optional command */
-        global.in[i].cmd = dlsym(global.in[i].handle, "input_cmd");
-
-        global.in[i].param.parameters = strchr(input[i], ' ');
-
-        for (j = 0; j<MAX_PLUGIN_ARGUMENTS; j++) {
-            global.in[i].param.argv[j] = NULL;
-        }
+    /* start the workers before any plugin can submit a job */
+    if(workers_start(threads) != 0) {
+        LOG("could not start the worker threads\n");
+        log_stop();
+        closelog();
+        exit(EXIT_FAILURE);
+    }
+    LOG("Worker Threads........: %d\n", workers_count());
 
-        split_parameters(global.in[i].param.parameters, &global.in[i].param.argc, global.in[i].param.argv);
-        global.in[i].param.global = &global;
-        global.in[i].param.id = i;
+    memory_init(&global, global.memory_limit);
+    if(global.memory_limit > 0)
+        LOG("Memory limit..........: %zu bytes\n", global.memory_limit);
+    if(global.linger >= 0)
+        LOG("Pause idle inputs.....: after %d ms\n", global.linger);
+    if(global.unchanged >= 0)
+        LOG("Unchanged frames......: distance %d, sent every %d ms\n", global.unchanged, global.unchanged_interval);
 
-        if(global.in[i].init(&global.in[i].param, i)) {
-            LOG("input_init() return value signals to exit\n");
-            closelog();
-            exit(0);
-        }
+    /*
+     * open input plugin, the ids are given in the order of the command line.
+     * The inputs initialize in parallel, so several cameras start as fast
+     * as the slowest of them
+     */
+    if(inputs_load(&global, input, source, inputs) < 0) {
+        log_stop();
+        closelog();
+        exit(EXIT_FAILURE);
     }
 
-    /* open output plugin */
-    for(i = 0; i < global.outcnt; i++) {
-        tmp = (size_t)(strchr(output[i], ' ') - output[i]);
-        global.out[i].plugin = (tmp > 0) ? strndup(output[i], tmp) : strdup(output[i]);
-        global.out[i].handle = dlopen(global.out[i].plugin, RTLD_LAZY);
-        if(!global.out[i].handle) {
-            LOG("ERROR: could not find output plugin %s\n", global.out[i].plugin);
-            LOG("       Perhaps you want to adjust the search path with:\n");
-            LOG("       # export LD_LIBRARY_PATH=/path/to/plugin/folder\n");
-            LOG("       dlopen: %s\n", dlerror());
+    for(i = 0; i < syncs; i++) {
+        if(sync_create(&global, sync[i]) == NULL) {
+            log_stop();
             closelog();
             exit(EXIT_FAILURE);
         }
-        global.out[i].init = dlsym(global.out[i].handle, "output_init");
-        if(global.out[i].init == NULL) {
-            LOG("%s\n", dlerror());
-            exit(EXIT_FAILURE);
-        }
-        global.out[i].stop = dlsym(global.out[i].handle, "output_stop");
-        if(global.out[i].stop == NULL) {
-            LOG("%s\n", dlerror());
-            exit(EXIT_FAILURE);
-        }
-        global.out[i].run = dlsym(global.out[i].handle, "output_run");
-        if(global.out[i].run == NULL) {
-            LOG("%s\n", dlerror());
-            exit(EXIT_FAILURE);
-        }
-
-        /* try to find optional command */
-        global.out[i].cmd = dlsym(global.out[i].handle, "output_cmd");
-
-        global.out[i].param.parameters = strchr(output[i], ' ');
-
-        for (j = 0; j<MAX_PLUGIN_ARGUMENTS; j++) {
-            global.out[i].param.argv[j] = NULL;
-        }
-        split_parameters(global.out[i].param.parameters, &global.out[i].param.argc, global.out[i].param.argv);
+    }
 
-        global.out[i].param.global = &global;
-        global.out[i].param.id = i;
-        if(global.out[i].init(&global.out[i].param, i)) {
-            LOG("output_init() return value signals to exit\n");
+    /* open output plugin */
+    for(i = 0; i < outputs; i++) {
+        if(output_load(&global, output[i]) < 0) {
+            log_stop();
             closelog();
             exit(EXIT_FAILURE);
         }
@@ -402,22 +539,41 @@ int main(int argc, char *argv[])
     /* start to read the input, push pictures into global buffer */
     DBG("starting %d input plugin\n", global.incnt);
     for(i = 0; i < global.incnt; i++) {
-        syslog(LOG_INFO, "starting input plugin %s", global.in[i].plugin);
-        if(global.in[i].run(i)) {
-            LOG("can not run input plugin %d: %s\n", i, global.in[i].plugin);
+        if(input_start(&global, i) != 0) {
+            log_stop();
             closelog();
             return 1;
         }
     }
 
+    if(sync_start(&global) != 0) {
+        LOG("could not start the sync groups\n");
+        log_stop();
+        closelog();
+        return 1;
+    }
+
+    if(watchdog_start(&global) != 0) {
+        LOG("could not start the watchdog\n");
+        log_stop();
+        closelog();
+        return 1;
+    }
+
     DBG("starting %d output plugin(s)\n", global.outcnt);
     for(i = 0; i < global.outcnt; i++) {
-        syslog(LOG_INFO, "starting output plugin: %s (ID: %02d)", global.out[i].plugin, global.out[i].param.id);
-        global.out[i].run(global.out[i].param.id);
+        output_start(&global, i);
+    }
+
+    /* from now on plugins can be loaded and unloaded through the socket */
+    if(control_path != NULL && control_start(&global, control_path) != 0) {
+        LOG("could not open the control socket %s\n", control_path);
     }
 
-    /* wait for signals */
-    pause();
+    /* wait for <CTRL>+C or SIGTERM in order to clean up */
+    while(sigwait(&signals, &sig) != 0)
+        ;
+    shutdown_streamer(sig);
 
     return 0;
 }
@@ -24,9 +24,6 @@
 #define MJPG_STREAMER_H
 #define SOURCE_VERSION "2.0"
 
-/* FIXME take a look to the output_http clients thread marked with fixme if you want to set more then 10 plugins */
-#define MAX_INPUT_PLUGINS 10
-#define MAX_OUTPUT_PLUGINS 10
 #define MAX_PLUGIN_ARGUMENTS 32
 
 #include <linux/types.h>          /* for videodev2.h */
@@ -39,10 +36,19 @@
 #define DBG(...)
 #endif
 
-#define LOG(...) { char _bf[1024] = {0}; snprintf(_bf, sizeof(_bf)-1, __VA_ARGS__); fprintf(stderr, "%s", _bf); syslog(LOG_INFO, "%s", _bf); }
+#define LOG(...) log_message(LOGLEVEL_INFO, "", 1, __VA_ARGS__)
 
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include "thread.h"
 #include "plugins/input.h"
 #include "plugins/output.h"
+#include "memory.h"
+#include "workers.h"
+#include "plugins.h"
+#include "sync.h"
+#include "watchdog.h"
 
 /* global variables that are accessed by all plugins */
 typedef struct _globals globals;
@@ -80,14 +86,49 @@ struct _control {
 struct _globals {
     int stop;
 
-    /* input plugin */
-    input in[MAX_INPUT_PLUGINS];
+    /*
+     * input plugins, the index is the id of the plugin. Plugins are loaded
+     * and unloaded at runtime with the functions in plugins.h, an id is never
+     * used twice so the entries stay valid after the plugin was unloaded
+     */
+    input **in;
     int incnt;
 
     /* output plugin */
-    output out[MAX_OUTPUT_PLUGINS];
+    output **out;
     int outcnt;
 
+    /* frame history of each input, see input_history_init() */
+    unsigned int history_frames;
+    size_t history_bytes;
+
+    /*
+     * milliseconds an input keeps capturing after its last consumer left,
+     * -1 to capture all the time
+     */
+    int linger;
+
+    /* record wait and hold times of the frame databases per call site */
+    int mutex_profile;
+
+    /* budget for all frame buffers in bytes, 0 for no limit, see memory.h */
+    size_t memory_limit;
+
+    /*
+     * largest signature distance of frames that count as unchanged, -1 to
+     * compare nothing. Outputs send unchanged frames only every
+     * unchanged_interval milliseconds, see frame_skip_unchanged()
+     */
+    int unchanged;
+    int unchanged_interval;
+
+    /* milliseconds without a frame after which an input is restarted, -1 for never, see watchdog.h */
+    int watchdog;
+
+    /* groups of inputs whose frames are matched by timestamp, see sync.h */
+    struct _sync_group **sync;
+    int synccnt;
+
     /* pointer to control functions */
     //int (*control)(int command, char *details);
 };
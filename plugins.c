@@ -0,0 +1,943 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "mjpg_streamer.h"
+
+/* loading and unloading is serialized, the running plugins are not blocked */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* serializes the parameter parsing of the plugins, see plugin_args_parsed() */
+static pthread_mutex_t args_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread int holding_args;
+static int in_size, out_size;
+
+/* labels of the db_site values */
+static const char *db_sites[DB_SITES] = {
+    "publish", "get", "wait", "history", "subscribe", "demand", "filter", "release", "memory", "watchdog", "compare", "other"
+};
+
+/* milliseconds input_restart() waits for the threads of a stopped input */
+#define RESTART_TIMEOUT 5000
+
+/* buckets of the wait and hold times of the frame database in nanoseconds */
+static const long long lock_times[] = { 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+
+/* buckets of the capture to stage latencies in nanoseconds */
+static const long long latency[] = { 1000000, 2000000, 5000000, 10000000, 20000000, 50000000,
+                                     100000000, 200000000, 500000000, 1000000000, 2000000000 };
+
+/******************************************************************************
+Description.: split the parameters of a plugin into arguments like a shell
+              does. Arguments are separated by spaces, single and double
+              quotes keep spaces in an argument and a backslash escapes the
+              next character, except inside single quotes.
+Input Value.: parameter_string holds the parameters, may be NULL
+              argc and argv receive the arguments, argv[0] is left to the
+              plugin
+Return Value: 1 if everything is OK, 0 if there are too many arguments
+******************************************************************************/
+static int split_parameters(char *parameter_string, int *argc, char **argv)
+{
+    int count = 1;
+    char *p = parameter_string, *arg, *out;
+    char quote;
+
+    argv[0] = NULL; // the plugin may set it to 'INPUT_PLUGIN_NAME'
+    *argc = count;
+    if(p == NULL)
+        return 1;
+
+    while(1) {
+        while(*p == ' ' || *p == '\t')
+            p++;
+        if(*p == '\0')
+            break;
+
+        if(count >= MAX_PLUGIN_ARGUMENTS - 1) {
+            LOG("ERROR: too many arguments to plugin\n");
+            return 0;
+        }
+
+        /* the argument never gets longer than the rest of the string */
+        if((arg = out = malloc(strlen(p) + 1)) == NULL)
+            return 0;
+
+        quote = '\0';
+        for(; *p != '\0' && (quote != '\0' || (*p != ' ' && *p != '\t')); p++) {
+            if(quote == '\'') {
+                if(*p == '\'')
+                    quote = '\0';
+                else
+                    *out++ = *p;
+            } else if(*p == '\\' && p[1] != '\0') {
+                *out++ = *++p;
+            } else if(quote == '"') {
+                if(*p == '"')
+                    quote = '\0';
+                else
+                    *out++ = *p;
+            } else if(*p == '\'' || *p == '"') {
+                quote = *p;
+            } else {
+                *out++ = *p;
+            }
+        }
+        *out = '\0';
+
+        argv[count++] = arg;
+        *argc = count;
+    }
+
+    return 1;
+}
+
+/******************************************************************************
+Description.: make room for one more entry in a table of plugins. A grown
+              table replaces the old one, the old one is not freed because
+              plugin threads read the tables without locking. The caller
+              stores the table and its size together once everything else
+              it needs was allocated, or frees a grown table.
+Input Value.: table is the table, count the number of used entries and size
+              the number of allocated entries
+              new_size receives the number of entries of the returned table
+Return Value: the table or NULL if not enough memory is available
+******************************************************************************/
+static void **grow_table(void **table, int count, int size, int *new_size)
+{
+    void **tmp;
+
+    *new_size = size;
+    if(count < size)
+        return table;
+
+    *new_size = (size > 0) ? size * 2 : 8;
+    if((tmp = calloc(*new_size, sizeof(void *))) == NULL)
+        return NULL;
+
+    if(count > 0)
+        memcpy(tmp, table, count * sizeof(void *));
+
+    return tmp;
+}
+
+/******************************************************************************
+Description.: register the statistics every input has, the plugins may
+              register more with metric_register()
+Input Value.: in is the input, its id is set
+Return Value: -
+******************************************************************************/
+static void input_metrics(input *in)
+{
+    static const long long bytes[] = { 4096, 16384, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304 };
+    static const long long nsec[] = { 1000000, 2000000, 5000000, 10000000, 20000000, 50000000, 100000000, 250000000 };
+    char labels[256];
+    int i;
+
+    snprintf(labels, sizeof(labels), "input=\"%d\",plugin=\"%s\"", in->param.id, in->plugin);
+    in->metrics.frames = metric_register(METRIC_COUNTER, "mjpg_input_frames_total",
+                                         "Frames published by the input", labels, 1);
+    in->metrics.fps = metric_register(METRIC_GAUGE, "mjpg_input_fps",
+                                      "Frames per second published by the input", labels, 0.001);
+    in->metrics.frame_bytes = metric_histogram("mjpg_input_frame_bytes", "Size of the JPG frames",
+                                               labels, 1, bytes, sizeof(bytes) / sizeof(bytes[0]));
+    in->metrics.encode_seconds = metric_histogram("mjpg_input_encode_seconds", "Time to encode raw frames to JPG",
+                                                  labels, 1e-9, nsec, sizeof(nsec) / sizeof(nsec[0]));
+    in->metrics.consumers = metric_register(METRIC_GAUGE, "mjpg_input_consumers",
+                                            "Consumers of the input", labels, 1);
+    in->metrics.db_wait_seconds = metric_register(METRIC_COUNTER, "mjpg_input_db_wait_seconds_total",
+                                                  "Time spent waiting for the frame database of the input", labels, 1e-9);
+    in->metrics.db_contended = metric_register(METRIC_COUNTER, "mjpg_input_db_contended_total",
+                                               "Locks of the frame database that had to wait", labels, 1);
+    in->metrics.memory = metric_register(METRIC_GAUGE, "mjpg_input_memory_bytes",
+                                         "Bytes of the frame buffers of the input", labels, 1);
+    metric_set(in->metrics.memory, in->memory);
+    in->metrics.unchanged = metric_register(METRIC_COUNTER, "mjpg_input_frames_unchanged_total",
+                                            "Frames that looked like the last one that changed", labels, 1);
+    in->metrics.stalls = metric_register(METRIC_COUNTER, "mjpg_input_stalls_total",
+                                         "Times the input stopped delivering frames", labels, 1);
+    in->metrics.restarts = metric_register(METRIC_COUNTER, "mjpg_input_restarts_total",
+                                           "Restarts of the input after it stalled", labels, 1);
+
+    snprintf(labels, sizeof(labels), "input=\"%d\",plugin=\"%s\",stage=\"dequeue\"", in->param.id, in->plugin);
+    in->metrics.latency_dequeue = metric_histogram("mjpg_input_latency_seconds", "Time from the capture of a frame to a stage",
+                                                   labels, 1e-9, latency, sizeof(latency) / sizeof(latency[0]));
+    snprintf(labels, sizeof(labels), "input=\"%d\",plugin=\"%s\",stage=\"encode\"", in->param.id, in->plugin);
+    in->metrics.latency_encode = metric_histogram("mjpg_input_latency_seconds", "Time from the capture of a frame to a stage",
+                                                  labels, 1e-9, latency, sizeof(latency) / sizeof(latency[0]));
+    snprintf(labels, sizeof(labels), "input=\"%d\",plugin=\"%s\",stage=\"publish\"", in->param.id, in->plugin);
+    in->metrics.latency_publish = metric_histogram("mjpg_input_latency_seconds", "Time from the capture of a frame to a stage",
+                                                   labels, 1e-9, latency, sizeof(latency) / sizeof(latency[0]));
+
+    if(!in->param.global->mutex_profile)
+        return;
+
+    for(i = 0; i < DB_SITES; i++) {
+        snprintf(labels, sizeof(labels), "input=\"%d\",plugin=\"%s\",site=\"%s\"", in->param.id, in->plugin, db_sites[i]);
+        in->metrics.db_site_wait[i] = metric_histogram("mjpg_input_db_site_wait_seconds", "Time waited for the frame database by call site",
+                                                       labels, 1e-9, lock_times, sizeof(lock_times) / sizeof(lock_times[0]));
+        in->metrics.db_site_hold[i] = metric_histogram("mjpg_input_db_site_hold_seconds", "Time the frame database was held by call site",
+                                                       labels, 1e-9, lock_times, sizeof(lock_times) / sizeof(lock_times[0]));
+    }
+}
+
+/******************************************************************************
+Description.: register the statistics every output has, the plugin updates
+              them as it sends frames
+Input Value.: out is the output, its id is set
+Return Value: -
+******************************************************************************/
+static void output_metrics(output *out)
+{
+    char labels[256];
+
+    snprintf(labels, sizeof(labels), "output=\"%d\",plugin=\"%s\"", out->param.id, out->plugin);
+    out->metrics.frames = metric_register(METRIC_COUNTER, "mjpg_output_frames_total",
+                                          "Frames sent by the output", labels, 1);
+    out->metrics.bytes = metric_register(METRIC_COUNTER, "mjpg_output_bytes_total",
+                                         "Bytes of frames sent by the output", labels, 1);
+    out->metrics.clients = metric_register(METRIC_GAUGE, "mjpg_output_clients",
+                                           "Clients connected to the output", labels, 1);
+    out->metrics.memory = metric_register(METRIC_GAUGE, "mjpg_output_memory_bytes",
+                                          "Bytes of the frames held by the clients of the output", labels, 1);
+    out->metrics.unchanged = metric_register(METRIC_COUNTER, "mjpg_output_frames_unchanged_total",
+                                             "Unchanged frames the output did not send", labels, 1);
+
+    snprintf(labels, sizeof(labels), "output=\"%d\",plugin=\"%s\",stage=\"pickup\"", out->param.id, out->plugin);
+    out->metrics.latency_pickup = metric_histogram("mjpg_output_latency_seconds", "Time from the capture of a frame to a stage",
+                                                   labels, 1e-9, latency, sizeof(latency) / sizeof(latency[0]));
+    snprintf(labels, sizeof(labels), "output=\"%d\",plugin=\"%s\",stage=\"sent\"", out->param.id, out->plugin);
+    out->metrics.latency_sent = metric_histogram("mjpg_output_latency_seconds", "Time from the capture of a frame to a stage",
+                                                 labels, 1e-9, latency, sizeof(latency) / sizeof(latency[0]));
+}
+
+/******************************************************************************
+Description.: load an input or filter plugin and give it the next id, it is
+              not initialized yet
+Input Value.: global is the global state
+              spec is "<plugin.so> [parameters]"
+              source is the id of the input a filter reads from, -1 for inputs
+Return Value: the input or NULL on error
+******************************************************************************/
+static input *input_prepare(globals *global, const char *spec, int source)
+{
+    input *in = NULL;
+    void **table = NULL;
+    char *copy = NULL, *parameters;
+    int id, j, size;
+
+    pthread_mutex_lock(&lock);
+
+    if(source >= global->incnt || (source >= 0 && !global->in[source]->loaded)) {
+        LOG("there is no input %d to filter\n", source);
+        goto error;
+    }
+
+    if((table = grow_table((void **)global->in, global->incnt, in_size, &size)) == NULL ||
+       (in = calloc(1, sizeof(input))) == NULL || (copy = strdup(spec)) == NULL) {
+        LOG("could not allocate memory\n");
+        goto error;
+    }
+    global->in = (input **)table;
+    in_size = size;
+    id = global->incnt;
+
+    /* this mutex and the conditional variable are used to synchronize access to the global picture buffer */
+    if(pthread_mutex_init(&in->db, NULL) != 0) {
+        LOG("could not initialize mutex variable\n");
+        goto error;
+    }
+    if(pthread_cond_init(&in->db_update, NULL) != 0) {
+        LOG("could not initialize condition variable\n");
+        goto error;
+    }
+    if(input_history_init(in, global->history_frames, global->history_bytes) != 0) {
+        LOG("could not allocate the frame history\n");
+        goto error;
+    }
+
+    in->source = source;
+    /* the linger time of an input nobody consumes starts with its loading */
+    clock_gettime(CLOCK_MONOTONIC, &in->idle_since);
+    parameters = strchr(copy, ' ');
+    in->plugin = (parameters != NULL) ? strndup(copy, parameters - copy) : strdup(copy);
+    in->handle = dlopen(in->plugin, RTLD_LAZY);
+    if(!in->handle) {
+        LOG("ERROR: could not find %s plugin\n", (source >= 0) ? "filter" : "input");
+        LOG("       Perhaps you want to adjust the search path with:\n");
+        LOG("       # export LD_LIBRARY_PATH=/path/to/plugin/folder\n");
+        LOG("       dlopen: %s\n", dlerror());
+        goto error;
+    }
+
+    if(source >= 0) {
+        /* a filter plugin has no thread, the core feeds it with frames */
+        in->init = dlsym(in->handle, "filter_init");
+        in->stop = dlsym(in->handle, "filter_stop");
+        in->process = dlsym(in->handle, "filter_process");
+        if(in->init == NULL || in->stop == NULL || in->process == NULL) {
+            LOG("%s\n", dlerror());
+            goto error;
+        }
+    } else {
+        in->init = dlsym(in->handle, "input_init");
+        in->stop = dlsym(in->handle, "input_stop");
+        in->run = dlsym(in->handle, "input_run");
+        if(in->init == NULL || in->stop == NULL || in->run == NULL) {
+            LOG("%s\n", dlerror());
+            goto error;
+        }
+        /* try to find optional command */
+        in->cmd = dlsym(in->handle, "input_cmd");
+    }
+
+    in->param.parameters = parameters;
+
+    for (j = 0; j<MAX_PLUGIN_ARGUMENTS; j++) {
+        in->param.argv[j] = NULL;
+    }
+
+    split_parameters(in->param.parameters, &in->param.argc, in->param.argv);
+    if(thread_config_parse(&in->threads, &in->param.argc, in->param.argv) != 0)
+        goto error;
+    in->param.global = global;
+    in->param.id = id;
+    in->loaded = 1;
+
+    /* the plugin looks itself up in the table during init */
+    global->in[id] = in;
+    __sync_synchronize();
+    global->incnt++;
+
+    pthread_mutex_unlock(&lock);
+    return in;
+
+error:
+    if(in != NULL) {
+        if(in->handle != NULL)
+            dlclose(in->handle);
+        free(in->history);
+        free(in->threads.cpus);
+        free(in->plugin);
+        free(in);
+    }
+    if(table != (void **)global->in)
+        free(table);
+    free(copy);
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+
+/******************************************************************************
+Description.: keep the parameters of the plugins for the calling thread,
+              see plugin_args_parsed()
+Input Value.: -
+Return Value: -
+******************************************************************************/
+static void args_take(void)
+{
+    pthread_mutex_lock(&args_lock);
+    holding_args = 1;
+}
+
+/******************************************************************************
+Description.: plugins parse their parameters with getopt, whose state is
+              shared by all threads. The init functions of the plugins are
+              therefore serialized until a plugin calls this after parsing,
+              then the slow rest of its init, like opening and enumerating a
+              camera, runs in parallel to the init of other plugins.
+Input Value.: -
+Return Value: -
+******************************************************************************/
+void plugin_args_parsed(void)
+{
+    if(!holding_args)
+        return;
+
+    holding_args = 0;
+    pthread_mutex_unlock(&args_lock);
+}
+
+/******************************************************************************
+Description.: initialize an input that was prepared by input_prepare(),
+              inputs with different ids can be initialized in parallel
+Input Value.: global is the global state
+              in is the input
+Return Value: the id of the input or -1 on error
+******************************************************************************/
+static int input_setup(globals *global, input *in)
+{
+    int id = in->param.id, rc;
+
+    if(in->source >= 0 && !global->in[in->source]->loaded) {
+        LOG("there is no input %d to filter\n", in->source);
+        in->loaded = 0;
+        return -1;
+    }
+
+    args_take();
+    rc = in->init(&in->param, id);
+    plugin_args_parsed();
+
+    if(rc) {
+        LOG("input_init() return value signals to exit\n");
+        in->loaded = 0;
+        return -1;
+    }
+    input_metrics(in);
+
+    if(in->source >= 0 && filter_attach(global->in[in->source], in) != 0) {
+        LOG("could not attach the filter to input %d\n", in->source);
+        in->stop(id);
+        in->loaded = 0;
+        return -1;
+    }
+
+    return id;
+}
+
+/******************************************************************************
+Description.: load an input or filter plugin and initialize it, it does not
+              run yet
+Input Value.: global is the global state
+              spec is "<plugin.so> [parameters]"
+              source is the id of the input a filter reads from, -1 for inputs
+Return Value: the id of the input or -1 on error
+******************************************************************************/
+int input_load(globals *global, const char *spec, int source)
+{
+    input *in;
+
+    if((in = input_prepare(global, spec, source)) == NULL)
+        return -1;
+
+    return input_setup(global, in);
+}
+
+/* an input initialized by its own thread, see inputs_load() */
+typedef struct {
+    globals *global;
+    input *in;
+    pthread_t thread;
+    int started;
+    int rc;
+} input_job;
+
+static void *input_setup_thread(void *arg)
+{
+    input_job *job = arg;
+
+    job->rc = input_setup(job->global, job->in);
+    return NULL;
+}
+
+/******************************************************************************
+Description.: load several inputs and filters at once. The ids are given in
+              the order of the list, the inputs are initialized in parallel
+              so slow cameras do not wait for each other. Filters are
+              initialized afterwards, when their source is ready.
+Input Value.: global is the global state
+              specs are "<plugin.so> [parameters]"
+              sources are the ids of the inputs the filters read from, -1
+              for inputs
+              count is the number of entries
+Return Value: 0 if everything is OK, -1 if a plugin failed
+******************************************************************************/
+int inputs_load(globals *global, char **specs, int *sources, int count)
+{
+    input_job *jobs;
+    int i, rc = 0;
+
+    if(count == 0)
+        return 0;
+
+    if((jobs = calloc(count, sizeof(input_job))) == NULL)
+        return -1;
+
+    for(i = 0; i < count; i++) {
+        jobs[i].global = global;
+        if((jobs[i].in = input_prepare(global, specs[i], sources[i])) == NULL) {
+            free(jobs);
+            return -1;
+        }
+    }
+
+    for(i = 0; i < count; i++) {
+        if(sources[i] >= 0)
+            continue;
+        if(thread_create(&jobs[i].thread, NULL, "init", jobs[i].in->param.id, input_setup_thread, &jobs[i]) == 0)
+            jobs[i].started = 1;
+        else
+            input_setup_thread(&jobs[i]);
+    }
+
+    for(i = 0; i < count; i++) {
+        if(jobs[i].started)
+            pthread_join(jobs[i].thread, NULL);
+    }
+
+    for(i = 0; i < count; i++) {
+        if(sources[i] >= 0)
+            jobs[i].rc = input_setup(global, jobs[i].in);
+        if(jobs[i].rc < 0)
+            rc = -1;
+    }
+
+    free(jobs);
+    return rc;
+}
+
+/******************************************************************************
+Description.: start an input plugin, filters start with their source
+Input Value.: global is the global state, id the input
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+int input_start(globals *global, int id)
+{
+    input *in;
+    int rc = 0;
+
+    pthread_mutex_lock(&lock);
+
+    if(id < 0 || id >= global->incnt || !global->in[id]->loaded) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    in = global->in[id];
+
+    /* the watchdog gives the input its limit from now on to deliver */
+    input_lock(in, DB_WATCHDOG);
+    clock_gettime(CLOCK_MONOTONIC, &in->alive);
+    input_unlock(in);
+
+    if(in->run != NULL) {
+        log_event(LOGLEVEL_INFO, "plugin_start", "input=%d plugin=%s", id, in->plugin);
+        if(in->run(id)) {
+            LOG("can not run input plugin %d: %s\n", id, in->plugin);
+            rc = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&lock);
+    return rc;
+}
+
+/******************************************************************************
+Description.: initialize and run a stopped input again with the same
+              parameters and id, once its threads ended. Waiting and
+              initializing can take seconds, the lock is only held to run
+              the plugin so loading, unloading and the restarts of other
+              inputs go on meanwhile.
+Input Value.: global is the global state, in the input and id its id. The
+              caller has set its restarting flag, input_unload() refuses it
+              meanwhile
+Return Value: 0 if the input runs again, -1 otherwise
+******************************************************************************/
+static int input_reinit(globals *global, input *in, int id)
+{
+    int rc;
+
+    /* a thread stuck in the driver would still use the device */
+    if(thread_wait_all(&in->threads, RESTART_TIMEOUT) != 0) {
+        LOG("input %d did not stop\n", id);
+        return -1;
+    }
+
+    args_take();
+    rc = in->init(&in->param, id);
+    plugin_args_parsed();
+
+    pthread_mutex_lock(&lock);
+
+    /* the program may have begun to stop meanwhile */
+    if(global->stop) {
+        rc = -1;
+    } else if(rc == 0) {
+        input_lock(in, DB_WATCHDOG);
+        clock_gettime(CLOCK_MONOTONIC, &in->alive);
+        input_unlock(in);
+        in->stopped = 0;
+        rc = in->run(id);
+    }
+
+    pthread_mutex_unlock(&lock);
+    return rc ? -1 : 0;
+}
+
+/******************************************************************************
+Description.: restart an input that stopped delivering frames, see
+              watchdog.h. The plugin is stopped and initialized and run
+              again by input_reinit(). Consumers and history are kept.
+Input Value.: global is the global state, id the input. The caller has set
+              its restarting flag
+Return Value: 0 if the input runs again, -1 otherwise
+******************************************************************************/
+int input_restart(globals *global, int id)
+{
+    input *in;
+
+    pthread_mutex_lock(&lock);
+
+    if(global->stop || id < 0 || id >= global->incnt || !global->in[id]->loaded ||
+       global->in[id]->stopped || global->in[id]->run == NULL) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    in = global->in[id];
+    log_event(LOGLEVEL_WARNING, "plugin_restart", "input=%d plugin=%s", id, in->plugin);
+    metric_add(in->metrics.restarts, 1);
+    in->stop(id);
+
+    pthread_mutex_unlock(&lock);
+
+    if(input_reinit(global, in, id) != 0) {
+        if(!global->stop)
+            LOG("could not restart input %d: %s, trying again later\n", id, in->plugin);
+        return -1;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: stop an input until input_resume(), unlike input_unload() it
+              keeps its frames, consumers and id. Filters can not be halted,
+              they only run while their source delivers.
+Input Value.: global is the global state, id the input
+Return Value: 0 if everything is OK, -1 if there is no such running input
+******************************************************************************/
+int input_halt(globals *global, int id)
+{
+    input *in;
+
+    pthread_mutex_lock(&lock);
+
+    if(id < 0 || id >= global->incnt || !global->in[id]->loaded || global->in[id]->stopped ||
+       global->in[id]->run == NULL || __sync_fetch_and_add(&global->in[id]->restarting, 0)) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    in = global->in[id];
+    in->stopped = 1;
+    log_event(LOGLEVEL_INFO, "plugin_stop", "input=%d plugin=%s", id, in->plugin);
+    in->stop(id);
+
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+/******************************************************************************
+Description.: initialize and run an input again that was halted
+Input Value.: global is the global state, id the input
+Return Value: 0 if the input runs again, -1 otherwise
+******************************************************************************/
+int input_resume(globals *global, int id)
+{
+    input *in;
+    int rc;
+
+    pthread_mutex_lock(&lock);
+
+    if(id < 0 || id >= global->incnt || !global->in[id]->loaded || !global->in[id]->stopped ||
+       __sync_lock_test_and_set(&global->in[id]->restarting, 1)) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    in = global->in[id];
+    log_event(LOGLEVEL_INFO, "plugin_start", "input=%d plugin=%s", id, in->plugin);
+
+    pthread_mutex_unlock(&lock);
+
+    if((rc = input_reinit(global, in, id)) != 0)
+        LOG("could not start input %d: %s\n", id, in->plugin);
+
+    __sync_lock_release(&in->restarting);
+    return rc;
+}
+
+/******************************************************************************
+Description.: stop an input or filter plugin and release its frames. The id
+              stays valid, consumers of it just do not get new frames anymore.
+              The shared object is not closed, threads of the plugin may still
+              run for a moment after it was stopped.
+Input Value.: global is the global state, id the input
+Return Value: 0 if everything is OK, -1 if there is no such input
+******************************************************************************/
+int input_unload(globals *global, int id)
+{
+    input *in;
+
+    pthread_mutex_lock(&lock);
+
+    if(id < 0 || id >= global->incnt || !global->in[id]->loaded) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    /* input_restart() initializes the plugin without holding the lock */
+    if(__sync_fetch_and_add(&global->in[id]->restarting, 0)) {
+        LOG("input %d is restarting, try again later\n", id);
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    in = global->in[id];
+    in->loaded = 0;
+    in->cmd = NULL;
+
+    if(in->source >= 0)
+        filter_detach(global->in[in->source], in);
+
+    /* a halted plugin was stopped already */
+    if(!in->stopped) {
+        log_event(LOGLEVEL_INFO, "plugin_stop", "input=%d plugin=%s", id, in->plugin);
+        in->stop(id);
+    }
+    input_release_frames(in);
+
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+/******************************************************************************
+Description.: load an output plugin and initialize it, it does not run yet
+Input Value.: global is the global state
+              spec is "<plugin.so> [parameters]"
+Return Value: the id of the output or -1 on error
+******************************************************************************/
+int output_load(globals *global, const char *spec)
+{
+    output *out = NULL;
+    void **table = NULL;
+    char *copy = NULL, *parameters;
+    int id, j, rc, size;
+
+    pthread_mutex_lock(&lock);
+
+    if((table = grow_table((void **)global->out, global->outcnt, out_size, &size)) == NULL ||
+       (out = calloc(1, sizeof(output))) == NULL || (copy = strdup(spec)) == NULL) {
+        LOG("could not allocate memory\n");
+        goto error;
+    }
+    global->out = (output **)table;
+    out_size = size;
+    id = global->outcnt;
+
+    parameters = strchr(copy, ' ');
+    out->plugin = (parameters != NULL) ? strndup(copy, parameters - copy) : strdup(copy);
+    out->handle = dlopen(out->plugin, RTLD_LAZY);
+    if(!out->handle) {
+        LOG("ERROR: could not find output plugin %s\n", out->plugin);
+        LOG("       Perhaps you want to adjust the search path with:\n");
+        LOG("       # export LD_LIBRARY_PATH=/path/to/plugin/folder\n");
+        LOG("       dlopen: %s\n", dlerror());
+        goto error;
+    }
+    out->init = dlsym(out->handle, "output_init");
+    out->stop = dlsym(out->handle, "output_stop");
+    out->run = dlsym(out->handle, "output_run");
+    if(out->init == NULL || out->stop == NULL || out->run == NULL) {
+        LOG("%s\n", dlerror());
+        goto error;
+    }
+
+    /* try to find optional command */
+    out->cmd = dlsym(out->handle, "output_cmd");
+
+    out->param.parameters = parameters;
+
+    for (j = 0; j<MAX_PLUGIN_ARGUMENTS; j++) {
+        out->param.argv[j] = NULL;
+    }
+    split_parameters(out->param.parameters, &out->param.argc, out->param.argv);
+    if(thread_config_parse(&out->threads, &out->param.argc, out->param.argv) != 0)
+        goto error;
+
+    out->param.global = global;
+    out->param.id = id;
+    out->loaded = 1;
+
+    /* the plugin looks itself up in the table during init */
+    global->out[id] = out;
+    __sync_synchronize();
+    global->outcnt++;
+
+    args_take();
+    rc = out->init(&out->param, id);
+    plugin_args_parsed();
+
+    if(rc) {
+        LOG("output_init() return value signals to exit\n");
+        out->loaded = 0;
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    output_metrics(out);
+
+    pthread_mutex_unlock(&lock);
+    return id;
+
+error:
+    if(out != NULL) {
+        if(out->handle != NULL)
+            dlclose(out->handle);
+        free(out->threads.cpus);
+        free(out->plugin);
+        free(out);
+    }
+    if(table != (void **)global->out)
+        free(table);
+    free(copy);
+    pthread_mutex_unlock(&lock);
+    return -1;
+}
+
+/******************************************************************************
+Description.: start an output plugin
+Input Value.: global is the global state, id the output
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+int output_start(globals *global, int id)
+{
+    output *out;
+    int rc;
+
+    pthread_mutex_lock(&lock);
+
+    if(id < 0 || id >= global->outcnt || !global->out[id]->loaded) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    out = global->out[id];
+    log_event(LOGLEVEL_INFO, "plugin_start", "output=%d plugin=%s", out->param.id, out->plugin);
+    rc = (out->run(out->param.id) == 0) ? 0 : -1;
+
+    pthread_mutex_unlock(&lock);
+    return rc;
+}
+
+/******************************************************************************
+Description.: stop an output plugin, the shared object is not closed because
+              threads of the plugin may still run for a moment
+Input Value.: global is the global state, id the output
+Return Value: 0 if everything is OK, -1 if there is no such output
+******************************************************************************/
+int output_unload(globals *global, int id)
+{
+    output *out;
+
+    pthread_mutex_lock(&lock);
+
+    if(id < 0 || id >= global->outcnt || !global->out[id]->loaded) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    out = global->out[id];
+    out->loaded = 0;
+    out->cmd = NULL;
+
+    /* a halted plugin was stopped already */
+    if(!out->stopped) {
+        log_event(LOGLEVEL_INFO, "plugin_stop", "output=%d plugin=%s", out->param.id, out->plugin);
+        out->stop(out->param.id);
+    }
+
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+/******************************************************************************
+Description.: stop an output until output_resume(), unlike output_unload()
+              it keeps its id
+Input Value.: global is the global state, id the output
+Return Value: 0 if everything is OK, -1 if there is no such running output
+******************************************************************************/
+int output_halt(globals *global, int id)
+{
+    output *out;
+
+    pthread_mutex_lock(&lock);
+
+    if(id < 0 || id >= global->outcnt || !global->out[id]->loaded || global->out[id]->stopped) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    out = global->out[id];
+    out->stopped = 1;
+    log_event(LOGLEVEL_INFO, "plugin_stop", "output=%d plugin=%s", out->param.id, out->plugin);
+    out->stop(out->param.id);
+
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+/******************************************************************************
+Description.: run an output again that was halted, once its threads ended.
+              The lock is not held while waiting for them.
+Input Value.: global is the global state, id the output
+Return Value: 0 if the output runs again, -1 otherwise
+******************************************************************************/
+int output_resume(globals *global, int id)
+{
+    output *out;
+    int rc = -1;
+
+    pthread_mutex_lock(&lock);
+    if(id < 0 || id >= global->outcnt || !global->out[id]->loaded || !global->out[id]->stopped) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    out = global->out[id];
+    pthread_mutex_unlock(&lock);
+
+    if(thread_wait_all(&out->threads, RESTART_TIMEOUT) != 0) {
+        LOG("output %d did not stop\n", id);
+        return -1;
+    }
+
+    pthread_mutex_lock(&lock);
+
+    /* it may have been resumed or unloaded meanwhile */
+    if(out->loaded && out->stopped && !global->stop) {
+        log_event(LOGLEVEL_INFO, "plugin_start", "output=%d plugin=%s", out->param.id, out->plugin);
+        if((rc = (out->run(out->param.id) == 0) ? 0 : -1) == 0)
+            out->stopped = 0;
+    }
+
+    pthread_mutex_unlock(&lock);
+    return rc;
+}
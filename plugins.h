@@ -0,0 +1,58 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#ifndef PLUGINS_H
+#define PLUGINS_H
+
+/*
+ * Loading and unloading of plugin instances, at startup as well as while
+ * the other plugins keep running. A plugin is given as "<plugin.so>
+ * [parameters]" like on the command line, filters additionally need the id
+ * of their source input. The ids of unloaded plugins are not reused, other
+ * plugins may still refer to them. A halted plugin keeps its id and its
+ * consumers, resuming it initializes and runs it again.
+ */
+int input_load(struct _globals *global, const char *spec, int source);
+int inputs_load(struct _globals *global, char **specs, int *sources, int count);
+int input_start(struct _globals *global, int id);
+int input_unload(struct _globals *global, int id);
+int input_restart(struct _globals *global, int id);
+int input_halt(struct _globals *global, int id);
+int input_resume(struct _globals *global, int id);
+
+int output_load(struct _globals *global, const char *spec);
+int output_start(struct _globals *global, int id);
+int output_unload(struct _globals *global, int id);
+int output_halt(struct _globals *global, int id);
+int output_resume(struct _globals *global, int id);
+
+/*
+ * called by plugins from their init once they are done with their
+ * parameters, the remaining init may run in parallel to other plugins
+ */
+void plugin_args_parsed(void);
+
+/* unix socket to load and unload plugins at runtime, see control.c */
+int control_start(struct _globals *global, const char *path);
+void control_stop(void);
+
+#endif
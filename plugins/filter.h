@@ -0,0 +1,42 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#include "../mjpg_streamer.h"
+#define FILTER_PLUGIN_PREFIX " f: "
+#define FPRINT(...) log_message(LOGLEVEL_INFO, FILTER_PLUGIN_PREFIX, 1, __VA_ARGS__)
+
+/*
+ * A filter plugin is loaded with "-f" and processes the frames of the input
+ * given before it on the command line. For the outputs it is just another
+ * input: global->in[id] holds its frames, global->in[id]->source is the index
+ * of the input it reads from.
+ *
+ * filter_process() is called on the worker pool for each new frame of the
+ * source, never twice at the same time for one filter. If the filter is
+ * still busy when new frames arrive, only the latest is processed. The
+ * filter returns a new frame from input_frame_alloc(global->in[id], ...)
+ * that is published for the outputs, or NULL to drop the frame. The
+ * timestamps of the source frame are copied to it.
+ */
+int filter_init(input_parameter *param, int id);
+frame *filter_process(int id, frame *src);
+int filter_stop(int id);
@@ -0,0 +1,283 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <setjmp.h>
+#include <syslog.h>
+#include <jpeglib.h>
+
+#include "../../utils.h"
+#include "../filter.h"
+
+#define FILTER_PLUGIN_NAME "GRAY filter plugin"
+
+/* private functions and variables to this plugin */
+static globals *pglobal;
+static int plugin_number;
+static int quality = 80;
+
+void help(void);
+
+/* libjpeg calls exit() on errors by default, jump back instead */
+struct error_mgr {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void error_exit(j_common_ptr cinfo)
+{
+    struct error_mgr *err = (struct error_mgr *)cinfo->err;
+    longjmp(err->jump, 1);
+}
+
+/*** plugin interface functions ***/
+int filter_init(input_parameter *param, int id)
+{
+    int i;
+    plugin_number = id;
+
+    param->argv[0] = FILTER_PLUGIN_NAME;
+
+    /* show all parameters for DBG purposes */
+    for(i = 0; i < param->argc; i++) {
+        DBG("argv[%d]=%s\n", i, param->argv[i]);
+    }
+
+    reset_getopt();
+    while(1) {
+        int option_index = 0, c = 0;
+        static struct option long_options[] = {
+            {"h", no_argument, 0, 0},
+            {"help", no_argument, 0, 0},
+            {"q", required_argument, 0, 0},
+            {"quality", required_argument, 0, 0},
+            {0, 0, 0, 0}
+        };
+
+        c = getopt_long_only(param->argc, param->argv, "", long_options, &option_index);
+
+        /* no more options to parse */
+        if(c == -1) break;
+
+        /* unrecognized option */
+        if(c == '?') {
+            help();
+            return 1;
+        }
+
+        switch(option_index) {
+            /* h, help */
+        case 0:
+        case 1:
+            DBG("case 0,1\n");
+            help();
+            return 1;
+            break;
+
+            /* q, quality */
+        case 2:
+        case 3:
+            DBG("case 2,3\n");
+            quality = MIN(MAX(atoi(optarg), 0), 100);
+            break;
+
+        default:
+            DBG("default case\n");
+            help();
+            return 1;
+        }
+    }
+
+    pglobal = param->global;
+
+    FPRINT("reading from input: %d\n", pglobal->in[id]->source);
+    FPRINT("JPEG quality......: %d\n", quality);
+
+    param->global->in[id]->name = malloc((strlen(FILTER_PLUGIN_NAME) + 1) * sizeof(char));
+    sprintf(param->global->in[id]->name, FILTER_PLUGIN_NAME);
+
+    return 0;
+}
+
+int filter_stop(int id)
+{
+    DBG("nothing to clean up\n");
+    return 0;
+}
+
+/******************************************************************************
+Description.: compress the grey pixels of a frame, this is the frame_encoder
+              so it only runs if somebody asks for the JPG
+Input Value.: f is the frame, quality the JPG quality, buf/size the target
+Return Value: size of the JPG or -1 if it does not fit or libjpeg failed
+******************************************************************************/
+static int encode_frame(frame *f, int quality, unsigned char *buf, int size)
+{
+    struct jpeg_compress_struct cinfo;
+    struct error_mgr jerr;
+    unsigned char *out = NULL;
+    unsigned long out_size = 0;
+    JSAMPROW row;
+    int result = -1;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = error_exit;
+    if(setjmp(jerr.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        free(out);
+        return -1;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &out_size);
+
+    cinfo.image_width = f->width;
+    cinfo.image_height = f->height;
+    cinfo.input_components = 1;
+    cinfo.in_color_space = JCS_GRAYSCALE;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while(cinfo.next_scanline < cinfo.image_height) {
+        row = f->raw + cinfo.next_scanline * f->width;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    if(out_size <= (unsigned long)size) {
+        memcpy(buf, out, out_size);
+        result = out_size;
+    }
+    free(out);
+
+    return result;
+}
+
+/******************************************************************************
+Description.: get the luminance of a JPG picture
+Input Value.: src is the frame holding the JPG, dst receives the pixels
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+static int decode_gray(frame *src, frame *dst)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct error_mgr jerr;
+    JSAMPROW row;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = error_exit;
+    if(setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, src->buf, src->size);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_GRAYSCALE;
+    jpeg_start_decompress(&cinfo);
+
+    if(frame_reserve_raw(dst, cinfo.output_width * cinfo.output_height) != 0) {
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+    dst->width = cinfo.output_width;
+    dst->height = cinfo.output_height;
+
+    while(cinfo.output_scanline < cinfo.output_height) {
+        row = dst->raw + cinfo.output_scanline * dst->width;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: turn a frame into a grey one. Raw YUYV and GREY frames are taken
+              as they are, everything else is decoded from the JPG.
+Input Value.: id is the index of this filter, src the frame of the source
+Return Value: the grey frame or NULL if src could not be processed
+******************************************************************************/
+frame *filter_process(int id, frame *src)
+{
+    frame *dst;
+    unsigned int i, pixels;
+    size_t capacity;
+
+    /* a grey JPG is smaller than one byte per pixel, the headers aside */
+    if(src->width > 0 && src->height > 0)
+        capacity = src->width * src->height + 4096;
+    else
+        capacity = src->size + 4096;
+
+    if((dst = input_frame_alloc(pglobal->in[id], capacity)) == NULL)
+        return NULL;
+
+    if(src->raw != NULL && src->raw_format == V4L2_PIX_FMT_YUYV) {
+        pixels = src->width * src->height;
+        if(frame_reserve_raw(dst, pixels) != 0)
+            goto error;
+        /* Y0 U Y1 V, the luminance is every other byte */
+        for(i = 0; i < pixels; i++)
+            dst->raw[i] = src->raw[i * 2];
+        dst->width = src->width;
+        dst->height = src->height;
+    } else if(src->raw != NULL && src->raw_format == V4L2_PIX_FMT_GREY) {
+        pixels = src->width * src->height;
+        if(frame_reserve_raw(dst, pixels) != 0)
+            goto error;
+        memcpy(dst->raw, src->raw, pixels);
+        dst->width = src->width;
+        dst->height = src->height;
+    } else {
+        if(frame_jpeg(src) != 0 || decode_gray(src, dst) != 0)
+            goto error;
+    }
+
+    dst->raw_size = dst->width * dst->height;
+    dst->raw_format = V4L2_PIX_FMT_GREY;
+    dst->format = V4L2_PIX_FMT_JPEG;
+    dst->quality = quality;
+    dst->encoder = encode_frame;
+    return dst;
+
+error:
+    frame_unref(dst);
+    return NULL;
+}
+
+void help(void)
+{
+    fprintf(stderr, " ---------------------------------------------------------------\n" \
+    " Help for filter plugin.: "FILTER_PLUGIN_NAME"\n" \
+    " ---------------------------------------------------------------\n" \
+    " The following parameters can be passed to this plugin:\n\n" \
+    " [-q | --quality ]......: JPEG quality of the grey frames (0-100)\n" \
+    " ---------------------------------------------------------------\n");
+}
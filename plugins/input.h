@@ -22,8 +22,10 @@
 
 #include <syslog.h>
 #include "../mjpg_streamer.h"
+#include "../frame.h"
+#include "../signature.h"
 #define INPUT_PLUGIN_PREFIX " i: "
-#define IPRINT(...) { char _bf[1024] = {0}; snprintf(_bf, sizeof(_bf)-1, __VA_ARGS__); fprintf(stderr, "%s", INPUT_PLUGIN_PREFIX); fprintf(stderr, "%s", _bf); syslog(LOG_INFO, "%s", _bf); }
+#define IPRINT(...) log_message(LOGLEVEL_INFO, INPUT_PLUGIN_PREFIX, 1, __VA_ARGS__)
 
 /* parameters for input plugin */
 typedef struct _input_parameter input_parameter;
@@ -49,6 +51,26 @@ struct _input_format {
     char currentResolution;
 };
 
+/*
+ * the places that lock the frame "database" of an input, the wait and hold
+ * times are recorded for each of them with -M
+ */
+typedef enum {
+    DB_PUBLISH,
+    DB_GET,
+    DB_WAIT,
+    DB_HISTORY,
+    DB_SUBSCRIBE,
+    DB_DEMAND,
+    DB_FILTER,
+    DB_RELEASE,
+    DB_MEMORY,
+    DB_WATCHDOG,
+    DB_COMPARE,
+    DB_OTHER,
+    DB_SITES
+} db_site;
+
 /* structure to store variables/functions for input plugin */
 typedef struct _input input;
 struct _input {
@@ -69,7 +91,101 @@ struct _input {
     pthread_mutex_t db;
     pthread_cond_t  db_update;
 
-    /* global JPG frame, this is more or less the "database" */
+    /* the most recently published frame, this is the "database" */
+    frame *current;
+
+    /* sequence number of the current frame, 0 until the first is published */
+    unsigned int sequence;
+
+    /* recycles the frames of this input, see input_frame_alloc() */
+    frame_pool pool;
+
+    /*
+     * the last published frames including the current one, protected by db.
+     * history_head is the oldest, limited by count and/or bytes
+     */
+    frame **history;
+    unsigned int history_size;
+    unsigned int history_count;
+    unsigned int history_head;
+    unsigned int history_frames;
+    size_t history_bytes;
+    size_t history_used;
+
+    /* eventfds of consumers that poll for fresh frames, protected by db */
+    int *notify_fds;
+    int notify_count;
+
+    /*
+     * filter plugins are inputs derived from another input: source is its
+     * index, -1 for real inputs. filters lists the inputs fed by this one.
+     * filter_pending/filter_busy are protected by db, see filter.c
+     */
+    int source;
+    int *filters;
+    int filter_count;
+    frame *filter_pending;
+    int filter_busy;
+
+    /*
+     * number of consumers, protected by db. The input may stop capturing
+     * when it drops to 0 and did not change for the linger time (-L)
+     */
+    int consumers;
+    struct timespec idle_since;
+
+    /*
+     * stall detection of the watchdog (-W), protected by db. alive is the
+     * time of the last frame or restart, stalled is set until the next
+     * frame. Waiters of input_wait_frame_stall() wake up when stall_wakeups
+     * changes, see watchdog.h
+     */
+    struct timespec alive;
+    int stalled;
+    unsigned int stall_wakeups;
+
+    /* set while the watchdog restarts the input */
+    int restarting;
+
+    /* statistics of this input, registered by input_load(), see metrics.h */
+    struct {
+        metric *frames;
+        metric *fps;
+        metric *frame_bytes;
+        metric *encode_seconds;
+        metric *consumers;
+        metric *db_wait_seconds;
+        metric *db_contended;
+        metric *latency_dequeue;
+        metric *latency_encode;
+        metric *latency_publish;
+        metric *db_site_wait[DB_SITES];
+        metric *db_site_hold[DB_SITES];
+        metric *memory;
+        metric *unchanged;
+        metric *stalls;
+        metric *restarts;
+    } metrics;
+
+    /*
+     * signature of the last frame that changed and its sequence number,
+     * frames are compared against it with -U. Protected by db, see
+     * frame_skip_unchanged()
+     */
+    signature reference;
+    unsigned int reference_sequence;
+
+    /* bytes of the frame buffers charged to this input, see memory.h */
+    size_t memory;
+
+    /* who locked db and when, protected by db, see input_lock() */
+    db_site db_site;
+    struct timespec db_locked;
+
+    /*
+     * mirror of the current frame for plugins that still read the database
+     * directly, only valid while db is locked
+     */
     unsigned char *buf;
     int size;
 
@@ -82,8 +198,47 @@ struct _input {
     
     void *context; // private data for the plugin
 
+    /* how the threads of the plugin run, see thread_create() */
+    thread_config threads;
+
+    /* 0 after the plugin was unloaded at runtime, see plugins.c */
+    int loaded;
+
+    /* 1 while the plugin is stopped through the control socket, see input_halt() */
+    int stopped;
+
     int (*init)(input_parameter *, int id);
     int (*stop)(int);
     int (*run)(int);
     int (*cmd)(int plugin, unsigned int control_id, unsigned int group, int value, char *value_str);
+    frame *(*process)(int id, frame *src);
 };
+
+/* access to the frame "database" of an input, implemented in frame.c */
+int input_history_init(input *in, unsigned int frames, size_t bytes);
+frame *input_frame_alloc(input *in, size_t capacity);
+void input_publish_frame(input *in, frame *f);
+frame *input_get_frame(input *in);
+frame *input_wait_frame(input *in, unsigned int sequence);
+frame *input_wait_frame_stall(input *in, unsigned int sequence, int *stalled);
+frame *input_find_frame(input *in, unsigned int sequence);
+frame *input_find_frame_at(input *in, struct timeval *at);
+frame *input_find_frame_near(input *in, struct timeval *at, long long *distance);
+int input_get_history(input *in, struct timeval *since, frame **frames, int max);
+int input_subscribe_fd(input *in);
+void input_unsubscribe_fd(input *in, int fd);
+void input_release_frames(input *in);
+void input_trim_pool(input *in);
+int input_trim_history(input *in);
+void input_lock(input *in, db_site site);
+void input_unlock(input *in);
+int input_consumer_add(input *in);
+void input_consumer_remove(input *in);
+int input_has_demand(input *in);
+int input_wait_demand(input *in);
+int input_check_stall(input *in, long long limit);
+
+/* feeding filter plugins, implemented in filter.c */
+int filter_attach(input *src, input *fin);
+void filter_detach(input *src, input *fin);
+void filter_feed(input *fin, frame *f);
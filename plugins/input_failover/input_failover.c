@@ -0,0 +1,484 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+/*
+  This input plugin is a hot standby of two other inputs for the same
+  scene, e.g. a local camera and input_http pulling from another box. It
+  republishes the frames of the primary input and switches to the secondary
+  one when the primary misses a frame (no frame for two of its frame
+  intervals) or delivers a frame that is no complete JPG. It switches back
+  once the primary delivered a number of good frames in a row. Consumers
+  of this input see one continuous stream, whichever source it comes from.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <poll.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+
+#include "../../mjpg_streamer.h"
+#include "../../utils.h"
+
+#define INPUT_PLUGIN_NAME "Failover input plugin"
+
+#define PRIMARY   0
+#define SECONDARY 1
+
+/* the state of one instance, in->context */
+typedef struct {
+    int id;
+    pthread_t worker;
+
+    /* ids of the sources and the eventfds the worker polls */
+    int source[2];
+    int fd[2];
+
+    /* the source that is republished, PRIMARY or SECONDARY */
+    int active;
+
+    /* sequence of the last frame taken from each source */
+    unsigned int last[2];
+
+    /* CLOCK_MONOTONIC time of the last good frame of the primary */
+    struct timespec primary_seen;
+
+    /* good frames of the primary in a row while the secondary is active */
+    int recovered;
+
+    /* -t and -r */
+    int timeout;
+    int recover;
+
+    metric *active_metric;
+    metric *switches[2];
+    metric *invalid[2];
+} context;
+
+static globals *pglobal;
+
+void *worker_thread(void *);
+void worker_cleanup(void *);
+void help(void);
+
+static const char *source_names[2] = { "primary", "secondary" };
+
+/*** plugin interface functions ***/
+int input_init(input_parameter *param, int id)
+{
+    input *in = param->global->in[id];
+    context *pctx;
+    char labels[64];
+    int i;
+
+    /* a restart by the watchdog initializes the plugin again */
+    free(in->context);
+    if((pctx = calloc(1, sizeof(context))) == NULL) {
+        IPRINT("error allocating context\n");
+        return 1;
+    }
+    in->context = pctx;
+    pctx->id = id;
+    pctx->source[PRIMARY] = pctx->source[SECONDARY] = -1;
+    pctx->fd[PRIMARY] = pctx->fd[SECONDARY] = -1;
+    pctx->timeout = 1000;
+    pctx->recover = 25;
+
+    param->argv[0] = INPUT_PLUGIN_NAME;
+
+    /* show all parameters for DBG purposes */
+    for(i = 0; i < param->argc; i++) {
+        DBG("argv[%d]=%s\n", i, param->argv[i]);
+    }
+
+    reset_getopt();
+    while(1) {
+        int option_index = 0, c = 0;
+        static struct option long_options[] = {
+            {"h", no_argument, 0, 0
+            },
+            {"help", no_argument, 0, 0},
+            {"p", required_argument, 0, 0},
+            {"primary", required_argument, 0, 0},
+            {"s", required_argument, 0, 0},
+            {"secondary", required_argument, 0, 0},
+            {"t", required_argument, 0, 0},
+            {"timeout", required_argument, 0, 0},
+            {"r", required_argument, 0, 0},
+            {"recover", required_argument, 0, 0},
+            {0, 0, 0, 0}
+        };
+
+        c = getopt_long_only(param->argc, param->argv, "", long_options, &option_index);
+
+        /* no more options to parse */
+        if(c == -1) break;
+
+        /* unrecognized option */
+        if(c == '?') {
+            help();
+            return 1;
+        }
+
+        switch(option_index) {
+            /* h, help */
+        case 0:
+        case 1:
+            DBG("case 0,1\n");
+            help();
+            return 1;
+            break;
+
+            /* p, primary */
+        case 2:
+        case 3:
+            DBG("case 2,3\n");
+            pctx->source[PRIMARY] = atoi(optarg);
+            break;
+
+            /* s, secondary */
+        case 4:
+        case 5:
+            DBG("case 4,5\n");
+            pctx->source[SECONDARY] = atoi(optarg);
+            break;
+
+            /* t, timeout */
+        case 6:
+        case 7:
+            DBG("case 6,7\n");
+            pctx->timeout = atoi(optarg);
+            break;
+
+            /* r, recover */
+        case 8:
+        case 9:
+            DBG("case 8,9\n");
+            pctx->recover = atoi(optarg);
+            break;
+
+        default:
+            DBG("default case\n");
+            help();
+            return 1;
+        }
+    }
+
+    pglobal = param->global;
+
+    /* the sources are loaded before, their ids are lower */
+    for(i = PRIMARY; i <= SECONDARY; i++) {
+        if(pctx->source[i] < 0 || pctx->source[i] >= id) {
+            IPRINT("the %s input must be given before this one\n", source_names[i]);
+            return 1;
+        }
+    }
+    if(pctx->source[PRIMARY] == pctx->source[SECONDARY] || pctx->timeout <= 0 || pctx->recover <= 0) {
+        help();
+        return 1;
+    }
+
+    IPRINT("primary input.....: %d\n", pctx->source[PRIMARY]);
+    IPRINT("secondary input...: %d\n", pctx->source[SECONDARY]);
+    IPRINT("timeout...........: %d ms until the primary delivered twice\n", pctx->timeout);
+    IPRINT("switch back after.: %d good frames of the primary\n", pctx->recover);
+
+    snprintf(labels, sizeof(labels), "input=\"%d\"", id);
+    pctx->active_metric = metric_register(METRIC_GAUGE, "mjpg_failover_active_source",
+                                          "Source the failover input republishes, 0 primary, 1 secondary", labels, 1);
+    for(i = PRIMARY; i <= SECONDARY; i++) {
+        snprintf(labels, sizeof(labels), "input=\"%d\",to=\"%s\"", id, source_names[i]);
+        pctx->switches[i] = metric_register(METRIC_COUNTER, "mjpg_failover_switches_total",
+                                            "Switches of the failover input between its sources", labels, 1);
+        snprintf(labels, sizeof(labels), "input=\"%d\",reason=\"invalid_%s\"", id, source_names[i]);
+        pctx->invalid[i] = metric_register(METRIC_COUNTER, "mjpg_input_frames_dropped_total",
+                                           "Frames dropped by the input plugin", labels, 1);
+    }
+
+    in->name = malloc((strlen(INPUT_PLUGIN_NAME) + 1) * sizeof(char));
+    sprintf(in->name, INPUT_PLUGIN_NAME);
+
+    return 0;
+}
+
+int input_stop(int id)
+{
+    context *pctx = pglobal->in[id]->context;
+
+    DBG("will cancel input thread\n");
+    pthread_cancel(pctx->worker);
+    return 0;
+}
+
+int input_run(int id)
+{
+    input *in = pglobal->in[id];
+    context *pctx = in->context;
+
+    if(thread_create(&pctx->worker, &in->threads, "failover", id, worker_thread, pctx) != 0) {
+        fprintf(stderr, "could not start worker thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_detach(pctx->worker);
+
+    return 0;
+}
+
+/*** private functions for this plugin below ***/
+void help(void)
+{
+    fprintf(stderr, " ---------------------------------------------------------------\n" \
+    " Help for input plugin..: "INPUT_PLUGIN_NAME"\n" \
+    " ---------------------------------------------------------------\n" \
+    " The following parameters can be passed to this plugin:\n\n" \
+    " [-p | --primary ]......: id of the input to republish normally\n" \
+    " [-s | --secondary ]....: id of the input to republish while the primary\n" \
+    "                          misses frames or delivers broken ones\n" \
+    " [-t | --timeout ]......: milliseconds without a frame of the primary\n" \
+    "                          until its frame rate is known, default 1000\n" \
+    " [-r | --recover ]......: good frames of the primary in a row to switch\n" \
+    "                          back to it, default 25\n" \
+    " ---------------------------------------------------------------\n");
+}
+
+/******************************************************************************
+Description.: check that a frame holds a complete JPG picture, a broken
+              camera or a connection that was cut delivers truncated ones
+Input Value.: f is the frame, it is encoded first if it is raw
+Return Value: 1 if the frame is good, 0 otherwise
+******************************************************************************/
+static int frame_valid(frame *f)
+{
+    int i;
+
+    if(frame_jpeg(f) != 0 || f->size < 4 || f->buf[0] != 0xFF || f->buf[1] != 0xD8)
+        return 0;
+
+    /* some cameras pad the picture after the end marker */
+    for(i = f->size - 2; i >= 2 && i >= f->size - 64; i--) {
+        if(f->buf[i] == 0xFF && f->buf[i + 1] == 0xD9)
+            return 1;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: publish a copy of a frame of a source as frame of this input,
+              the frames of an input belong to its own pool and history
+Input Value.: pctx is the instance
+              src is the frame, a good one
+Return Value: -
+******************************************************************************/
+static void republish(context *pctx, frame *src)
+{
+    input *in = pglobal->in[pctx->id];
+    frame *f;
+
+    /* the memory budget (-m) may be exhausted */
+    if((f = input_frame_alloc(in, src->size)) == NULL)
+        return;
+
+    memcpy(f->buf, src->buf, src->size);
+    f->size = src->size;
+    f->timestamp = src->timestamp;
+    f->captured = src->captured;
+    f->width = src->width;
+    f->height = src->height;
+    f->format = V4L2_PIX_FMT_JPEG;
+    f->quality = src->quality;
+
+    input_publish_frame(in, f);
+}
+
+/******************************************************************************
+Description.: make another source the active one
+Input Value.: pctx is the instance
+              which is PRIMARY or SECONDARY
+              why is logged
+Return Value: -
+******************************************************************************/
+static void switch_to(context *pctx, int which, const char *why)
+{
+    frame *f;
+
+    pctx->active = which;
+    pctx->recovered = 0;
+    metric_set(pctx->active_metric, which);
+    metric_add(pctx->switches[which], 1);
+    log_event(LOGLEVEL_WARNING, "failover", "input=%d source=%d to=%s reason=%s",
+              pctx->id, pctx->source[which], source_names[which], why);
+
+    /* the latest frame of the new source closes the gap right away */
+    if((f = input_get_frame(pglobal->in[pctx->source[which]])) == NULL)
+        return;
+
+    if(f->sequence != pctx->last[which] && frame_valid(f))
+        republish(pctx, f);
+    pctx->last[which] = f->sequence;
+    frame_unref(f);
+}
+
+/******************************************************************************
+Description.: the time the primary may take for its next frame, two of its
+              frame intervals, so one missed frame is noticed
+Input Value.: pctx is the instance
+Return Value: the limit in milliseconds
+******************************************************************************/
+static long long primary_limit(context *pctx)
+{
+    input *in = pglobal->in[pctx->source[PRIMARY]];
+    long long fps;
+
+    /* the rate is kept in 1/1000 fps */
+    if(in->metrics.fps == NULL || (fps = in->metrics.fps->value) <= 0)
+        return pctx->timeout;
+
+    return 2 * 1000000LL / fps + 1;
+}
+
+/******************************************************************************
+Description.: take the frame a source just published
+Input Value.: pctx is the instance
+              which is PRIMARY or SECONDARY
+Return Value: -
+******************************************************************************/
+static void source_frame(context *pctx, int which)
+{
+    frame *f;
+    int good;
+
+    if((f = input_get_frame(pglobal->in[pctx->source[which]])) == NULL)
+        return;
+
+    if(f->sequence == pctx->last[which]) {
+        frame_unref(f);
+        return;
+    }
+    pctx->last[which] = f->sequence;
+
+    if(!(good = frame_valid(f)))
+        metric_add(pctx->invalid[which], 1);
+
+    if(which == PRIMARY) {
+        if(good)
+            clock_gettime(CLOCK_MONOTONIC, &pctx->primary_seen);
+
+        if(pctx->active == PRIMARY && !good) {
+            switch_to(pctx, SECONDARY, "invalid");
+        } else if(pctx->active == SECONDARY) {
+            pctx->recovered = good ? pctx->recovered + 1 : 0;
+            if(pctx->recovered >= pctx->recover)
+                switch_to(pctx, PRIMARY, "recovered");
+        }
+    }
+
+    if(good && pctx->active == which)
+        republish(pctx, f);
+
+    frame_unref(f);
+}
+
+/* the worker thread of an instance */
+void *worker_thread(void *arg)
+{
+    context *pctx = arg;
+    struct pollfd fds[2];
+    struct timespec now;
+    eventfd_t count;
+    long long late, limit;
+    int i;
+
+    /* set cleanup handler to cleanup allocated resources */
+    pthread_cleanup_push(worker_cleanup, pctx);
+
+    /* both sources capture all the time, the standby one must be warm */
+    for(i = PRIMARY; i <= SECONDARY; i++) {
+        if((pctx->fd[i] = input_subscribe_fd(pglobal->in[pctx->source[i]])) < 0) {
+            IPRINT("could not subscribe to input %d\n", pctx->source[i]);
+            goto out;
+        }
+        fds[i].fd = pctx->fd[i];
+        fds[i].events = POLLIN;
+    }
+
+    pctx->active = PRIMARY;
+    clock_gettime(CLOCK_MONOTONIC, &pctx->primary_seen);
+
+    while(!pglobal->stop) {
+        /* wake up when the primary is late */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        limit = primary_limit(pctx);
+        late = limit - ((now.tv_sec - pctx->primary_seen.tv_sec) * 1000LL +
+                        (now.tv_nsec - pctx->primary_seen.tv_nsec) / 1000000);
+
+        if(late <= 0) {
+            if(pctx->active == PRIMARY)
+                switch_to(pctx, SECONDARY, "stalled");
+            pctx->recovered = 0;
+            /* while the primary is gone check it again every timeout */
+            pctx->primary_seen = now;
+            continue;
+        }
+
+        if(poll(fds, 2, late) < 0) {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+
+        for(i = PRIMARY; i <= SECONDARY; i++) {
+            if(!(fds[i].revents & POLLIN))
+                continue;
+            eventfd_read(fds[i].fd, &count);
+            source_frame(pctx, i);
+        }
+    }
+
+out:
+    DBG("leaving input thread, calling cleanup function now\n");
+    /* call cleanup handler, signal with the parameter */
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+void worker_cleanup(void *arg)
+{
+    context *pctx = arg;
+    int i;
+
+    DBG("cleaning up resources allocated by input thread\n");
+
+    for(i = PRIMARY; i <= SECONDARY; i++) {
+        if(pctx->fd[i] >= 0)
+            input_unsubscribe_fd(pglobal->in[pctx->source[i]], pctx->fd[i]);
+        pctx->fd[i] = -1;
+    }
+}
@@ -171,8 +171,8 @@ int input_init(input_parameter *param, int id)
     IPRINT("delete file.......: %s\n", (rm) ? "yes, delete" : "no, do not delete");
     IPRINT("filename must be..: %s\n", (filename == NULL) ? "-no filter for certain filename set-" : filename);
 
-    param->global->in[id].name = malloc((strlen(INPUT_PLUGIN_NAME) + 1) * sizeof(char));
-    sprintf(param->global->in[id].name, INPUT_PLUGIN_NAME);
+    param->global->in[id]->name = malloc((strlen(INPUT_PLUGIN_NAME) + 1) * sizeof(char));
+    sprintf(param->global->in[id]->name, INPUT_PLUGIN_NAME);
 
     return 0;
 }
@@ -186,8 +186,6 @@ int input_stop(int id)
 
 int input_run(int id)
 {
-    pglobal->in[id].buf = NULL;
-
     if (mode == NewFilesOnly) {
         rc = fd = inotify_init();
         if(rc == -1) {
@@ -209,8 +207,7 @@ int input_run(int id)
         }
     }
 
-    if(pthread_create(&worker, 0, worker_thread, NULL) != 0) {
-        free(pglobal->in[id].buf);
+    if(thread_create(&worker, &pglobal->in[id]->threads, "file", id, worker_thread, NULL) != 0) {
         fprintf(stderr, "could not start worker thread\n");
         exit(EXIT_FAILURE);
     }
@@ -247,6 +244,7 @@ void *worker_thread(void *arg)
     int currentFileNumber = 0;
     char hasJpgFile = 0;
     struct timeval timestamp;
+    frame *f;
 
     if (mode == ExistingFiles) {
         fileCount = scandir(folder, &fileList, 0, alphasort);
@@ -324,34 +322,29 @@ void *worker_thread(void *arg)
 
         filesize = stats.st_size;
 
-        /* copy frame from file to global buffer */
-        pthread_mutex_lock(&pglobal->in[plugin_number].db);
-
-        /* allocate memory for frame */
-        if(pglobal->in[plugin_number].buf != NULL)
-            free(pglobal->in[plugin_number].buf);
-
-        pglobal->in[plugin_number].buf = malloc(filesize + (1 << 16));
-
-        if(pglobal->in[plugin_number].buf == NULL) {
+        /* read the frame from file into a buffer of its own */
+        if((f = input_frame_alloc(pglobal->in[plugin_number], filesize)) == NULL) {
             fprintf(stderr, "could not allocate memory\n");
+            close(file);
             break;
         }
 
-        if((pglobal->in[plugin_number].size = read(file, pglobal->in[plugin_number].buf, filesize)) == -1) {
+        if((f->size = read(file, f->buf, filesize)) == -1) {
             perror("could not read from file");
-            free(pglobal->in[plugin_number].buf); pglobal->in[plugin_number].buf = NULL; pglobal->in[plugin_number].size = 0;
-            pthread_mutex_unlock(&pglobal->in[plugin_number].db);
+            frame_unref(f);
             close(file);
             break;
         }
+        TRACE2(frame_grab, plugin_number, f->size);
 
         gettimeofday(&timestamp, NULL);
-        pglobal->in[plugin_number].timestamp = timestamp;
-        DBG("new frame copied (size: %d)\n", pglobal->in[plugin_number].size);
-        /* signal fresh_frame */
-        pthread_cond_broadcast(&pglobal->in[plugin_number].db_update);
-        pthread_mutex_unlock(&pglobal->in[plugin_number].db);
+        f->timestamp = timestamp;
+        if(frame_parse_jpeg(f) != 0)
+            DBG("could not find the size of the JPG picture\n");
+        DBG("new frame copied (size: %d)\n", f->size);
+
+        /* hand the frame over to the consumers and signal fresh_frame */
+        input_publish_frame(pglobal->in[plugin_number], f);
 
         close(file);
 
@@ -392,8 +385,6 @@ void worker_cleanup(void *arg)
     first_run = 0;
     DBG("cleaning up resources allocated by input thread\n");
 
-    if(pglobal->in[plugin_number].buf != NULL) free(pglobal->in[plugin_number].buf);
-
     free(ev);
 
     if (mode == NewFilesOnly) {
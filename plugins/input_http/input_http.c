@@ -72,6 +72,7 @@ int input_init(input_parameter *param, int plugin_no)
     }
 
     param->argv[0] = INPUT_PLUGIN_NAME;
+    plugin_number = plugin_no;
 
     /* show all parameters for DBG purposes */
     for(i = 0; i < param->argc; i++) {
@@ -105,20 +106,13 @@ int input_stop(int id)
 }
 
 /******************************************************************************
-Description.: starts the worker thread and allocates memory
+Description.: starts the worker thread
 Input Value.: -
 Return Value: 0
 ******************************************************************************/
 int input_run(int id)
 {
-    pglobal->in[id].buf = malloc(256 * 1024);
-    if(pglobal->in[id].buf == NULL) {
-        fprintf(stderr, "could not allocate memory\n");
-        exit(EXIT_FAILURE);
-    }
-
-    if(pthread_create(&worker, 0, worker_thread, NULL) != 0) {
-        free(pglobal->in[id].buf);
+    if(thread_create(&worker, &pglobal->in[id]->threads, "http-in", id, worker_thread, NULL) != 0) {
         fprintf(stderr, "could not start worker thread\n");
         exit(EXIT_FAILURE);
     }
@@ -129,34 +123,22 @@ int input_run(int id)
 
 
 void on_image_received(char * data, int length){
-        int buf_size = 0;
-        unsigned char *tmp_framebuffer = NULL;
-
-        /* copy JPG picture to global buffer */
-        pthread_mutex_lock(&pglobal->in[plugin_number].db);
-
-        /* check if buffer for frame is large enough, increase it if necessary */
-        buf_size = pglobal->in[plugin_number].size;
-        if (length > buf_size)
-        {
-            DBG("increasing input buffer size to %d\n", length+1);
-
-            if((tmp_framebuffer = (unsigned char*)realloc(pglobal->in[plugin_number].buf, length+1)) == NULL) 
-            {
-                pthread_mutex_unlock(&pglobal->in[plugin_number].db);
-                LOG("not enough memory\n");
-                return;
-            }
-
-            pglobal->in[plugin_number].buf = tmp_framebuffer;
-        }
-        pglobal->in[plugin_number].size = length+1;
-        memcpy(pglobal->in[plugin_number].buf, data, pglobal->in[plugin_number].size);
+        frame *f;
+
+        TRACE2(frame_grab, plugin_number, length);
 
-        /* signal fresh_frame */
-        pthread_cond_broadcast(&pglobal->in[plugin_number].db_update);
-        pthread_mutex_unlock(&pglobal->in[plugin_number].db);
+        /* copy JPG picture to a frame of its own */
+        if((f = input_frame_alloc(pglobal->in[plugin_number], length)) == NULL) {
+            LOG("not enough memory\n");
+            return;
+        }
+        memcpy(f->buf, data, length);
+        f->size = length;
+        gettimeofday(&f->timestamp, NULL);
+        frame_parse_jpeg(f);
 
+        /* hand the frame over to the consumers and signal fresh_frame */
+        input_publish_frame(pglobal->in[plugin_number], f);
 }
 
 void *worker_thread(void *arg)
@@ -192,7 +174,6 @@ void worker_cleanup(void *arg)
     first_run = 0;
     DBG("cleaning up resources allocated by input thread\n");
     close_mjpg_proxy(&proxy);
-    if(pglobal->in[plugin_number].buf != NULL) free(pglobal->in[plugin_number].buf);
 }
 
 
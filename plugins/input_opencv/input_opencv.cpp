@@ -71,6 +71,7 @@ typedef struct {
 
 void *worker_thread(void *);
 void worker_cleanup(void *);
+static int encode_frame(frame *f, int quality, unsigned char *buf, int size);
 
 #define INPUT_PLUGIN_NAME "OpenCV Input plugin"
 static char plugin_name[] = INPUT_PLUGIN_NAME;
@@ -148,7 +149,7 @@ int input_init(input_parameter *param, int plugin_no)
     
     settings = pctx->init_settings = init_settings();
     pglobal = param->global;
-    in = &pglobal->in[plugin_no];
+    in = pglobal->in[plugin_no];
     in->context = pctx;
 
     param->argv[0] = plugin_name;
@@ -249,6 +250,9 @@ int input_init(input_parameter *param, int plugin_no)
         }
     }
 
+    /* opening the camera is slow, let other inputs initialize meanwhile */
+    plugin_args_parsed();
+
     IPRINT("device........... : %s\n", device);
     IPRINT("Desired Resolution: %i x %i\n", width, height);
     
@@ -341,7 +345,7 @@ Return Value: 0
 ******************************************************************************/
 int input_stop(int id)
 {
-    input * in = &pglobal->in[id];
+    input * in = pglobal->in[id];
     context *pctx = (context*)in->context;
     
     if (pctx != NULL) {
@@ -352,19 +356,16 @@ int input_stop(int id)
 }
 
 /******************************************************************************
-Description.: starts the worker thread and allocates memory
+Description.: starts the worker thread
 Input Value.: -
 Return Value: 0
 ******************************************************************************/
 int input_run(int id)
 {
-    input * in = &pglobal->in[id];
+    input * in = pglobal->in[id];
     context *pctx = (context*)in->context;
     
-    in->buf = NULL;
-    in->size = 0;
-    
-    if(pthread_create(&pctx->worker, 0, worker_thread, in) != 0) {
+    if(thread_create(&pctx->worker, &in->threads, "opencv", id, worker_thread, in) != 0) {
         worker_cleanup(in);
         fprintf(stderr, "could not start worker thread\n");
         exit(EXIT_FAILURE);
@@ -414,6 +415,7 @@ void *worker_thread(void *arg)
     
     Mat src, dst;
     vector<uchar> jpeg_buffer;
+    frame *f;
     
     // this exists so that the numpy allocator can assign a custom allocator to
     // the mat, so that it doesn't need to copy the data each time
@@ -421,27 +423,60 @@ void *worker_thread(void *arg)
         src = pctx->filter_init_frame(pctx->filter_ctx);
     
     while (!pglobal->stop) {
+        // skip the capture and the filter while nobody needs the frames, see -L
+        if (!input_has_demand(in) && input_wait_demand(in) != 0)
+            break;
+        
         if (!pctx->capture.read(src))
             break; // TODO
+        TRACE2(frame_grab, in->param.id, src.total() * src.elemSize());
             
         // call the filter function
         pctx->filter_process(pctx->filter_ctx, src, dst);
             
-        /* copy JPG picture to global buffer */
-        pthread_mutex_lock(&in->db);
-        
-        // take whatever Mat it returns, and write it to jpeg buffer
-        imencode(".jpg", dst, jpeg_buffer, compression_params);
-        
-        // TODO: what to do if imencode returns an error?
+        if (dst.type() == CV_8UC3 || dst.type() == CV_8UC1) {
+            // keep the pixels, the JPG is encoded on demand by encode_frame
+            size_t raw_size = dst.total() * dst.elemSize();
+            
+            f = input_frame_alloc(in, raw_size);
+            if (f == NULL || frame_reserve_raw(f, raw_size) != 0) {
+                IPRINT("could not allocate memory for frame\n");
+                frame_unref(f);
+                continue;
+            }
+            
+            if (!dst.isContinuous())
+                dst = dst.clone();
+            memcpy(f->raw, dst.data, raw_size);
+            f->raw_size = raw_size;
+            f->raw_format = (dst.type() == CV_8UC1) ? V4L2_PIX_FMT_GREY : V4L2_PIX_FMT_BGR24;
+            f->encoder = encode_frame;
+        } else {
+            // take whatever Mat it returns, and write it to jpeg buffer
+            imencode(".jpg", dst, jpeg_buffer, compression_params);
+            
+            // TODO: what to do if imencode returns an error?
+            
+            /* copy JPG picture to a frame of its own */
+            f = input_frame_alloc(in, jpeg_buffer.size());
+            if (f == NULL) {
+                IPRINT("could not allocate memory for frame\n");
+                continue;
+            }
+            
+            // std::vector is guaranteed to be contiguous
+            memcpy(f->buf, &jpeg_buffer[0], jpeg_buffer.size());
+            f->size = jpeg_buffer.size();
+        }
         
-        // std::vector is guaranteed to be contiguous
-        in->buf = &jpeg_buffer[0];
-        in->size = jpeg_buffer.size();
+        gettimeofday(&f->timestamp, NULL);
+        f->width = dst.cols;
+        f->height = dst.rows;
+        f->format = V4L2_PIX_FMT_JPEG;
+        f->quality = compression_params[1];
         
-        /* signal fresh_frame */
-        pthread_cond_broadcast(&in->db_update);
-        pthread_mutex_unlock(&in->db);
+        /* hand the frame over to the consumers and signal fresh_frame */
+        input_publish_frame(in, f);
     }
     
     IPRINT("leaving input thread, calling cleanup function now\n");
@@ -450,6 +485,29 @@ void *worker_thread(void *arg)
     return NULL;
 }
 
+/******************************************************************************
+Description.: encoder of the frames, it is called by the first consumer that
+              needs the JPG picture, so analysis-only consumers of the raw
+              pixels never pay for imencode
+Input Value.: f is the frame with the raw pixels, quality and destination
+Return Value: size of the JPG picture, -1 on error
+******************************************************************************/
+static int encode_frame(frame *f, int quality, unsigned char *buf, int size)
+{
+    Mat m(f->height, f->width, (f->raw_format == V4L2_PIX_FMT_GREY) ? CV_8UC1 : CV_8UC3, f->raw);
+    vector<uchar> jpeg_buffer;
+    vector<int> compression_params;
+
+    compression_params.push_back(CV_IMWRITE_JPEG_QUALITY);
+    compression_params.push_back(quality);
+
+    if (!imencode(".jpg", m, jpeg_buffer, compression_params) || jpeg_buffer.size() > (size_t)size)
+        return -1;
+
+    memcpy(buf, &jpeg_buffer[0], jpeg_buffer.size());
+    return jpeg_buffer.size();
+}
+
 /******************************************************************************
 Description.: this functions cleans up allocated resources
 Input Value.: arg is unused
@@ -88,6 +88,9 @@ static RASPICAM_CAMERA_PARAMETERS c_params;
 
 static struct timeval timestamp;
 
+/* the frame the encoder callback is currently filling */
+static frame *pending = NULL;
+
 /** Struct used to pass information in encoder port userdata to callback
  */
 typedef struct
@@ -381,11 +384,12 @@ static void encoder_buffer_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buf
       //fprintf(stderr, "The flags are %x of length %i offset %i\n", buffer->flags, buffer->length, pData->offset);
 
       //Write bytes
-      /* copy JPG picture to global buffer */
-      if(pData->offset == 0)
-        pthread_mutex_lock(&pglobal->in[plugin_number].db);
+      /* collect the JPG picture in a frame of its own */
+      if(pending == NULL)
+        pending = input_frame_alloc(pglobal->in[plugin_number], width * height * 3);
 
-      memcpy(pData->offset + pglobal->in[plugin_number].buf, buffer->data, buffer->length);
+      if(pending != NULL && pData->offset + buffer->length <= pending->capacity)
+        memcpy(pData->offset + pending->buf, buffer->data, buffer->length);
       pData->offset += buffer->length;
       //fwrite(buffer->data, 1, buffer->length, pData->file_handle);
       mmal_buffer_header_mem_unlock(buffer);
@@ -394,23 +398,34 @@ static void encoder_buffer_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buf
     // Now flag if we have completed
     if (buffer->flags & (MMAL_BUFFER_HEADER_FLAG_FRAME_END | MMAL_BUFFER_HEADER_FLAG_TRANSMISSION_FAILED))
     {
-      //set frame size
-      pglobal->in[plugin_number].size = pData->offset;
+      //mark frame complete
+      complete = 1;
 
-      //Set frame timestamp
-      if(wantTimestamp)
+      if(pending != NULL && pData->offset <= pending->capacity)
       {
-        gettimeofday(&timestamp, NULL);
-        pglobal->in[plugin_number].timestamp = timestamp;
+        //set frame size
+        pending->size = pData->offset;
+
+        //describe the picture, the encoder output port uses these settings
+        pending->width = width;
+        pending->height = height;
+        pending->format = V4L2_PIX_FMT_JPEG;
+        pending->quality = quality;
+
+        //Set frame timestamp
+        if(wantTimestamp)
+        {
+          gettimeofday(&timestamp, NULL);
+          pending->timestamp = timestamp;
+        }
+
+        /* hand the frame over to the consumers and signal fresh_frame */
+        TRACE2(frame_grab, plugin_number, pending->size);
+        input_publish_frame(pglobal->in[plugin_number], pending);
+        pending = NULL;
       }
 
-      //mark frame complete
-      complete = 1;
-
       pData->offset = 0;
-      /* signal fresh_frame */
-      pthread_cond_broadcast(&pglobal->in[plugin_number].db_update);
-      pthread_mutex_unlock(&pglobal->in[plugin_number].db);
     }
   }
   else
@@ -474,22 +489,14 @@ static void camera_control_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buf
 }
 
 /******************************************************************************
-  Description.: starts the worker thread and allocates memory
+  Description.: starts the worker thread
   Input Value.: -
   Return Value: 0
  ******************************************************************************/
 int input_run(int id)
 {
-  pglobal->in[id].buf = malloc(width * height * 3);
-  if (pglobal->in[id].buf == NULL)
-  {
-    fprintf(stderr, "could not allocate memory\n");
-    exit(EXIT_FAILURE);
-  }
-
-  if (pthread_create(&worker, 0, worker_thread, NULL) != 0)
+  if (thread_create(&worker, &pglobal->in[id]->threads, "raspicam", id, worker_thread, NULL) != 0)
   {
-    free(pglobal->in[id].buf);
     fprintf(stderr, "could not start worker thread\n");
     exit(EXIT_FAILURE);
   }
@@ -1093,8 +1100,8 @@ void worker_cleanup(void *arg)
   first_run = 0;
   DBG("cleaning up resources allocated by input thread\n");
 
-  if(pglobal->in[plugin_number].buf != NULL)
-    free(pglobal->in[plugin_number].buf);
+  frame_unref(pending);
+  pending = NULL;
 }
 
 
@@ -0,0 +1,376 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+/*
+  This input plugin reads the frames another process publishes into a
+  shared memory ring with output_shm, see ../output_shm/shm_ring.h. The
+  ring is mapped read-only, a frame is copied out under the seqlock of its
+  slot. When the writer restarts, the plugin maps the new ring on its own.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "../../mjpg_streamer.h"
+#include "../../utils.h"
+#include "../output_shm/shm_ring.h"
+
+#define INPUT_PLUGIN_NAME "SHM input plugin"
+
+/* private functions and variables to this plugin */
+static pthread_t   worker;
+static globals     *pglobal;
+
+void *worker_thread(void *);
+void worker_cleanup(void *);
+void help(void);
+
+static char *name = "/mjpg_streamer";
+static int plugin_number;
+
+/* the mapped ring and the identity of its object, NULL if not mapped */
+static const struct shm_ring_header *ring = NULL;
+static size_t ring_size;
+static dev_t ring_dev;
+static ino_t ring_ino;
+
+/*** plugin interface functions ***/
+int input_init(input_parameter *param, int id)
+{
+    int i;
+    plugin_number = id;
+
+    param->argv[0] = INPUT_PLUGIN_NAME;
+
+    /* show all parameters for DBG purposes */
+    for(i = 0; i < param->argc; i++) {
+        DBG("argv[%d]=%s\n", i, param->argv[i]);
+    }
+
+    reset_getopt();
+    while(1) {
+        int option_index = 0, c = 0;
+        static struct option long_options[] = {
+            {"h", no_argument, 0, 0
+            },
+            {"help", no_argument, 0, 0},
+            {"n", required_argument, 0, 0},
+            {"name", required_argument, 0, 0},
+            {0, 0, 0, 0}
+        };
+
+        c = getopt_long_only(param->argc, param->argv, "", long_options, &option_index);
+
+        /* no more options to parse */
+        if(c == -1) break;
+
+        /* unrecognized option */
+        if(c == '?') {
+            help();
+            return 1;
+        }
+
+        switch(option_index) {
+            /* h, help */
+        case 0:
+        case 1:
+            DBG("case 0,1\n");
+            help();
+            return 1;
+            break;
+
+            /* n, name */
+        case 2:
+        case 3:
+            DBG("case 2,3\n");
+            /* shm_open() wants exactly one leading slash */
+            name = malloc(strlen(optarg) + 2);
+            sprintf(name, "%s%s", (optarg[0] == '/') ? "" : "/", optarg);
+            break;
+        default:
+            DBG("default case\n");
+            help();
+            return 1;
+        }
+    }
+
+    pglobal = param->global;
+
+    IPRINT("shared memory.....: %s\n", name);
+
+    param->global->in[id]->name = malloc((strlen(INPUT_PLUGIN_NAME) + 1) * sizeof(char));
+    sprintf(param->global->in[id]->name, INPUT_PLUGIN_NAME);
+
+    return 0;
+}
+
+int input_stop(int id)
+{
+    DBG("will cancel input thread\n");
+    pthread_cancel(worker);
+    return 0;
+}
+
+int input_run(int id)
+{
+    if(thread_create(&worker, &pglobal->in[id]->threads, "shm", id, worker_thread, NULL) != 0) {
+        fprintf(stderr, "could not start worker thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_detach(worker);
+
+    return 0;
+}
+
+/*** private functions for this plugin below ***/
+void help(void)
+{
+    fprintf(stderr, " ---------------------------------------------------------------\n" \
+    " Help for input plugin..: "INPUT_PLUGIN_NAME"\n" \
+    " ---------------------------------------------------------------\n" \
+    " The following parameters can be passed to this plugin:\n\n" \
+    " [-n | --name ].........: name of the shared memory object written by output_shm,\n" \
+    "                          default /mjpg_streamer\n" \
+    " ---------------------------------------------------------------\n");
+}
+
+/******************************************************************************
+Description.: map the ring if the writer created it completely
+Input Value.: -
+Return Value: 0 if the ring is mapped, -1 if not (yet)
+******************************************************************************/
+static int ring_open(void)
+{
+    const struct shm_ring_header *hdr;
+    struct stat st;
+    int fd;
+
+    if((fd = shm_open(name, O_RDONLY, 0)) < 0)
+        return -1;
+
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*hdr)) {
+        close(fd);
+        return -1;
+    }
+
+    hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(hdr == MAP_FAILED)
+        return -1;
+
+    /* the writer sets magic last */
+    if(__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC ||
+       hdr->version != SHM_RING_VERSION || hdr->slot_count == 0 ||
+       hdr->slot_size <= sizeof(struct shm_ring_slot) ||
+       hdr->header_size + hdr->slot_count * hdr->slot_size > (uint64_t)st.st_size) {
+        munmap((void *)hdr, st.st_size);
+        return -1;
+    }
+
+    ring = hdr;
+    ring_size = st.st_size;
+    ring_dev = st.st_dev;
+    ring_ino = st.st_ino;
+    IPRINT("reading %u slots of %s written by process %u\n", hdr->slot_count, name, hdr->writer_pid);
+
+    return 0;
+}
+
+static void ring_close(void)
+{
+    munmap((void *)ring, ring_size);
+    ring = NULL;
+}
+
+/******************************************************************************
+Description.: check whether the name refers to another object than the one
+              mapped, that happens if the writer crashed and was restarted
+Input Value.: -
+Return Value: 1 if the ring was replaced, 0 otherwise
+******************************************************************************/
+static int ring_replaced(void)
+{
+    struct stat st;
+    int fd, replaced = 0;
+
+    if((fd = shm_open(name, O_RDONLY, 0)) < 0)
+        return 0;
+
+    if(fstat(fd, &st) == 0)
+        replaced = (st.st_dev != ring_dev || st.st_ino != ring_ino);
+    close(fd);
+
+    return replaced;
+}
+
+/******************************************************************************
+Description.: copy a frame out of its slot
+Input Value.: sequence is the frame to read
+              f receives the frame
+Return Value: 0 if the frame was copied, -1 if the writer overwrote the slot
+              meanwhile, -2 if the frame can not be read at all
+******************************************************************************/
+static int ring_read(uint64_t sequence, frame **f)
+{
+    const struct shm_ring_slot *slot;
+    struct shm_ring_slot copy;
+    uint64_t lock;
+
+    slot = (const struct shm_ring_slot *)((const unsigned char *)ring + ring->header_size +
+                                          (sequence % ring->slot_count) * ring->slot_size);
+
+    lock = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+    if(lock & 1)
+        return -1;
+
+    memcpy(&copy, slot, sizeof(copy));
+    if(copy.sequence != sequence)
+        return -1;
+    if(copy.size > SHM_RING_CAPACITY(ring))
+        return -2;
+
+    if((*f = input_frame_alloc(pglobal->in[plugin_number], copy.size)) == NULL)
+        return -2;
+    memcpy((*f)->buf, SHM_RING_DATA(slot), copy.size);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&slot->lock, __ATOMIC_RELAXED) != lock) {
+        frame_unref(*f);
+        return -1;
+    }
+
+    (*f)->size = copy.size;
+    (*f)->format = copy.format;
+    (*f)->width = copy.width;
+    (*f)->height = copy.height;
+    (*f)->quality = copy.quality;
+    (*f)->timestamp.tv_sec = copy.timestamp_sec;
+    (*f)->timestamp.tv_usec = copy.timestamp_usec;
+
+    /* CLOCK_MONOTONIC is the same for all processes, keep the latency */
+    if(copy.captured_sec != 0 || copy.captured_nsec != 0) {
+        (*f)->captured.tv_sec = copy.captured_sec;
+        (*f)->captured.tv_nsec = copy.captured_nsec;
+    }
+
+    return 0;
+}
+
+/* the single reader thread */
+void *worker_thread(void *arg)
+{
+    input *in = pglobal->in[plugin_number];
+    struct timespec timeout = {1, 0};
+    uint64_t sequence, last = 0;
+    uint32_t notify;
+    int waiting = 0, rc;
+    frame *f;
+
+    /* set cleanup handler to cleanup allocated resources */
+    pthread_cleanup_push(worker_cleanup, NULL);
+
+    while(!pglobal->stop) {
+        /* skip the copies while nobody needs the frames, see -L */
+        if(!input_has_demand(in) && input_wait_demand(in) != 0)
+            break;
+
+        if(ring == NULL) {
+            if(ring_open() != 0) {
+                if(!waiting)
+                    IPRINT("waiting for %s to be created by output_shm\n", name);
+                waiting = 1;
+                usleep(100 * 1000);
+                continue;
+            }
+            waiting = 0;
+            last = 0;
+        }
+
+        /* read notify first, a frame published after it ends the wait */
+        notify = __atomic_load_n(&ring->notify, __ATOMIC_ACQUIRE);
+        sequence = __atomic_load_n(&ring->sequence, __ATOMIC_ACQUIRE);
+
+        if(sequence == last) {
+            if(__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+                IPRINT("the writer closed %s\n", name);
+                ring_close();
+                continue;
+            }
+
+            if(syscall(SYS_futex, &ring->notify, FUTEX_WAIT, notify, &timeout, NULL, 0) != 0 &&
+               errno == ETIMEDOUT && ring_replaced()) {
+                IPRINT("%s was created again\n", name);
+                ring_close();
+            }
+            continue;
+        }
+
+        /* a live source, so always take the newest frame */
+        if((rc = ring_read(sequence, &f)) == -1)
+            continue;
+
+        last = sequence;
+        if(rc != 0) {
+            DBG("could not read frame %llu\n", (unsigned long long)sequence);
+            continue;
+        }
+
+        TRACE2(frame_grab, plugin_number, f->size);
+        DBG("new frame copied (size: %d)\n", f->size);
+        input_publish_frame(in, f);
+    }
+
+    DBG("leaving input thread, calling cleanup function now\n");
+    /* call cleanup handler, signal with the parameter */
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+void worker_cleanup(void *arg)
+{
+    static unsigned char first_run = 1;
+
+    if(!first_run) {
+        DBG("already cleaned up resources\n");
+        return;
+    }
+
+    first_run = 0;
+    DBG("cleaning up resources allocated by input thread\n");
+
+    if(ring != NULL)
+        ring_close();
+}
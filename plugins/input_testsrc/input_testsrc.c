@@ -0,0 +1,599 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+/*
+  This input plugin generates a test pattern for benchmarks and tests
+  without a camera. A pool of JPG frames is encoded when the plugin is
+  initialized, at runtime a frame of the pool is only copied and stamped
+  with its sequence number and time, so even thousands of frames per
+  second cost next to nothing. The frames can be padded to a range of
+  sizes and published in bursts, all deterministic from run to run.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <syslog.h>
+#include <jpeglib.h>
+
+#include "../../mjpg_streamer.h"
+#include "../../utils.h"
+
+#define INPUT_PLUGIN_NAME "Test source input plugin"
+
+/*
+ * the first segment after SOI and APP0 of every frame is a COM segment
+ * holding this text, the fields are overwritten for each published frame.
+ * All fields have a fixed width
+ */
+#define MARKER_FORMAT "mjpg-testsrc seq=%010u sec=%010ld usec=%06ld"
+#define MARKER_LENGTH 54
+
+/* payload of a COM segment that pads a frame, at most 65533 bytes */
+#define PAD_CHUNK 65000
+
+/* the state of one instance, in->context */
+typedef struct {
+    int id;
+    pthread_t worker;
+
+    /* -r, -f, -q, -n, -s and -b */
+    int width;
+    int height;
+    int fps;
+    int quality;
+    int count;
+    size_t min_size;
+    size_t max_size;
+    int burst;
+
+    /* the encoded frames and the offset of the marker text in them */
+    unsigned char **pool;
+    int *sizes;
+    int marker;
+
+    /* frames published so far, the number in the marker */
+    unsigned int sequence;
+} context;
+
+static globals *pglobal;
+
+void *worker_thread(void *);
+void worker_cleanup(void *);
+void help(void);
+
+/* libjpeg calls exit() on errors by default, jump back instead */
+struct error_mgr {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void error_exit(j_common_ptr cinfo)
+{
+    struct error_mgr *err = (struct error_mgr *)cinfo->err;
+    longjmp(err->jump, 1);
+}
+
+static int encode_pool(context *pctx);
+static void free_pool(context *pctx);
+
+/*** plugin interface functions ***/
+int input_init(input_parameter *param, int id)
+{
+    input *in = param->global->in[id];
+    context *pctx;
+    char *range, *dash;
+    int i;
+
+    /* a restart by the watchdog initializes the plugin again */
+    if(in->context != NULL) {
+        free_pool(in->context);
+        free(in->context);
+    }
+    if((pctx = calloc(1, sizeof(context))) == NULL) {
+        IPRINT("error allocating context\n");
+        return 1;
+    }
+    in->context = pctx;
+    pctx->id = id;
+    pctx->width = 640;
+    pctx->height = 480;
+    pctx->fps = 30;
+    pctx->quality = 80;
+    pctx->count = 30;
+    pctx->burst = 1;
+
+    param->argv[0] = INPUT_PLUGIN_NAME;
+
+    /* show all parameters for DBG purposes */
+    for(i = 0; i < param->argc; i++) {
+        DBG("argv[%d]=%s\n", i, param->argv[i]);
+    }
+
+    reset_getopt();
+    while(1) {
+        int option_index = 0, c = 0;
+        static struct option long_options[] = {
+            {"h", no_argument, 0, 0
+            },
+            {"help", no_argument, 0, 0},
+            {"r", required_argument, 0, 0},
+            {"resolution", required_argument, 0, 0},
+            {"f", required_argument, 0, 0},
+            {"fps", required_argument, 0, 0},
+            {"q", required_argument, 0, 0},
+            {"quality", required_argument, 0, 0},
+            {"n", required_argument, 0, 0},
+            {"frames", required_argument, 0, 0},
+            {"s", required_argument, 0, 0},
+            {"size", required_argument, 0, 0},
+            {"b", required_argument, 0, 0},
+            {"burst", required_argument, 0, 0},
+            {0, 0, 0, 0}
+        };
+
+        c = getopt_long_only(param->argc, param->argv, "", long_options, &option_index);
+
+        /* no more options to parse */
+        if(c == -1) break;
+
+        /* unrecognized option */
+        if(c == '?') {
+            help();
+            return 1;
+        }
+
+        switch(option_index) {
+            /* h, help */
+        case 0:
+        case 1:
+            DBG("case 0,1\n");
+            help();
+            return 1;
+            break;
+
+            /* r, resolution */
+        case 2:
+        case 3:
+            DBG("case 2,3\n");
+            parse_resolution_opt(optarg, &pctx->width, &pctx->height);
+            break;
+
+            /* f, fps */
+        case 4:
+        case 5:
+            DBG("case 4,5\n");
+            pctx->fps = atoi(optarg);
+            break;
+
+            /* q, quality */
+        case 6:
+        case 7:
+            DBG("case 6,7\n");
+            pctx->quality = MIN(MAX(atoi(optarg), 0), 100);
+            break;
+
+            /* n, frames */
+        case 8:
+        case 9:
+            DBG("case 8,9\n");
+            pctx->count = atoi(optarg);
+            break;
+
+            /* s, size */
+        case 10:
+        case 11:
+            DBG("case 10,11\n");
+            range = strdup(optarg);
+            if((dash = strchr(range, '-')) != NULL)
+                *dash++ = '\0';
+            pctx->min_size = parse_size_opt(range);
+            pctx->max_size = (dash != NULL) ? parse_size_opt(dash) : pctx->min_size;
+            free(range);
+            break;
+
+            /* b, burst */
+        case 12:
+        case 13:
+            DBG("case 12,13\n");
+            pctx->burst = atoi(optarg);
+            break;
+
+        default:
+            DBG("default case\n");
+            help();
+            return 1;
+        }
+    }
+
+    pglobal = param->global;
+
+    if(pctx->width <= 0 || pctx->height <= 0 || pctx->width > 8192 || pctx->height > 8192 ||
+       pctx->fps < 0 || pctx->count <= 0 || pctx->burst <= 0 || pctx->max_size < pctx->min_size) {
+        help();
+        return 1;
+    }
+
+    /* encoding the pool takes a while, let the other plugins parse meanwhile */
+    plugin_args_parsed();
+
+    IPRINT("resolution........: %i x %i\n", pctx->width, pctx->height);
+    IPRINT("frames per second.: %i%s\n", pctx->fps, (pctx->fps == 0) ? " (as fast as possible)" : "");
+    IPRINT("JPEG quality......: %i\n", pctx->quality);
+    IPRINT("distinct frames...: %i\n", pctx->count);
+    if(pctx->max_size > 0)
+        IPRINT("frame size........: %zu - %zu bytes\n", pctx->min_size, pctx->max_size);
+    if(pctx->burst > 1)
+        IPRINT("burst.............: %i frames\n", pctx->burst);
+
+    if(encode_pool(pctx) != 0) {
+        IPRINT("could not encode the test pattern\n");
+        return 1;
+    }
+
+    in->name = malloc((strlen(INPUT_PLUGIN_NAME) + 1) * sizeof(char));
+    sprintf(in->name, INPUT_PLUGIN_NAME);
+
+    return 0;
+}
+
+int input_stop(int id)
+{
+    context *pctx = pglobal->in[id]->context;
+
+    DBG("will cancel input thread\n");
+    pthread_cancel(pctx->worker);
+    return 0;
+}
+
+int input_run(int id)
+{
+    input *in = pglobal->in[id];
+    context *pctx = in->context;
+
+    if(thread_create(&pctx->worker, &in->threads, "testsrc", id, worker_thread, pctx) != 0) {
+        fprintf(stderr, "could not start worker thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_detach(pctx->worker);
+
+    return 0;
+}
+
+/*** private functions for this plugin below ***/
+void help(void)
+{
+    fprintf(stderr, " ---------------------------------------------------------------\n" \
+    " Help for input plugin..: "INPUT_PLUGIN_NAME"\n" \
+    " ---------------------------------------------------------------\n" \
+    " The following parameters can be passed to this plugin:\n\n" \
+    " [-r | --resolution ]...: size of the frames, default 640x480\n" \
+    " [-f | --fps ]..........: frames per second, 0 for as fast as possible,\n" \
+    "                          default 30\n" \
+    " [-q | --quality ]......: JPEG quality, default 80\n" \
+    " [-n | --frames ].......: number of distinct frames that are encoded\n" \
+    "                          in advance and repeated, default 30\n" \
+    " [-s | --size ].........: pad the frames to a size or a range of sizes,\n" \
+    "                          k and M suffixes are allowed, e.g. 50k-200k\n" \
+    " [-b | --burst ]........: publish this many frames at once and pause\n" \
+    "                          as long, the average rate stays --fps\n" \
+    " ---------------------------------------------------------------\n");
+}
+
+/******************************************************************************
+Description.: draw one frame of the test pattern: color bars, a bar that
+              moves from frame to frame and the number of the frame in
+              the pool as row of black and white blocks
+Input Value.: pctx is the instance
+              index is the number of the frame in the pool
+              rgb receives width * height * 3 bytes
+Return Value: -
+******************************************************************************/
+static void draw_pattern(context *pctx, int index, unsigned char *rgb)
+{
+    static const unsigned char bars[8][3] = {
+        {255, 255, 255}, {255, 255, 0}, {0, 255, 255}, {0, 255, 0},
+        {255, 0, 255}, {255, 0, 0}, {0, 0, 255}, {0, 0, 0}
+    };
+    int x, y, bar, block = MAX(pctx->width / 32, 1);
+    int moving = (long long)index * pctx->width / pctx->count;
+    unsigned char *p = rgb, shade;
+
+    for(y = 0; y < pctx->height; y++) {
+        for(x = 0; x < pctx->width; x++, p += 3) {
+            if(y < block && (x / block) < 32) {
+                /* the index of the frame, most significant bit left */
+                shade = ((index >> (31 - x / block)) & 1) ? 255 : 0;
+                p[0] = p[1] = p[2] = shade;
+            } else if(x >= moving && x < moving + block) {
+                p[0] = p[1] = p[2] = 255 - (y * 255 / pctx->height);
+            } else {
+                bar = x * 8 / pctx->width;
+                /* a gradient gives the encoder something to do */
+                p[0] = bars[bar][0] * (pctx->height - y / 2) / pctx->height;
+                p[1] = bars[bar][1] * (pctx->height - y / 2) / pctx->height;
+                p[2] = bars[bar][2] * (pctx->height - y / 2) / pctx->height;
+            }
+        }
+    }
+}
+
+/******************************************************************************
+Description.: compress an RGB picture
+Input Value.: pctx is the instance
+              rgb is the picture
+              out and out_size receive the JPG, free it with free()
+Return Value: 0 if everything is OK, -1 if libjpeg failed
+******************************************************************************/
+static int compress_rgb(context *pctx, unsigned char *rgb, unsigned char **out, unsigned long *out_size)
+{
+    struct jpeg_compress_struct cinfo;
+    struct error_mgr jerr;
+    JSAMPROW row;
+
+    *out = NULL;
+    *out_size = 0;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = error_exit;
+    if(setjmp(jerr.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        free(*out);
+        *out = NULL;
+        return -1;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, out, out_size);
+
+    cinfo.image_width = pctx->width;
+    cinfo.image_height = pctx->height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, pctx->quality, TRUE);
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while(cinfo.next_scanline < cinfo.image_height) {
+        row = rgb + cinfo.next_scanline * pctx->width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: write the header of a COM segment
+Input Value.: p is where the segment starts
+              payload is the number of bytes that follow the header
+Return Value: pointer to the payload
+******************************************************************************/
+static unsigned char *com_segment(unsigned char *p, int payload)
+{
+    p[0] = 0xFF;
+    p[1] = 0xFE;
+    p[2] = (payload + 2) >> 8;
+    p[3] = (payload + 2) & 0xFF;
+
+    return p + 4;
+}
+
+/******************************************************************************
+Description.: find the end of the segments that must stay in front, SOI and
+              the JFIF APP0 segment that has to follow it directly
+Input Value.: jpg and size describe the JPG
+Return Value: the number of bytes to keep in front
+******************************************************************************/
+static int header_length(const unsigned char *jpg, unsigned long size)
+{
+    if(size > 6 && jpg[2] == 0xFF && jpg[3] == 0xE0)
+        return 4 + ((jpg[4] << 8) | jpg[5]);
+
+    return 2;
+}
+
+/******************************************************************************
+Description.: encode the frames of the pool. Each one is SOI and APP0, the
+              COM segment of the marker, COM segments padding it to its
+              size and the rest of the JPG. The sizes are drawn from the range
+              of -s with a fixed seed, so every run publishes the same
+Input Value.: pctx is the instance
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+static int encode_pool(context *pctx)
+{
+    unsigned char *rgb, *jpg, *p;
+    unsigned long jpg_size;
+    unsigned int seed = 1;
+    size_t size, target, chunk;
+    int i, header;
+
+    if((rgb = malloc(pctx->width * pctx->height * 3)) == NULL ||
+       (pctx->pool = calloc(pctx->count, sizeof(unsigned char *))) == NULL ||
+       (pctx->sizes = calloc(pctx->count, sizeof(int))) == NULL) {
+        free(rgb);
+        return -1;
+    }
+
+    for(i = 0; i < pctx->count; i++) {
+        draw_pattern(pctx, i, rgb);
+        if(compress_rgb(pctx, rgb, &jpg, &jpg_size) != 0)
+            break;
+
+        size = jpg_size + 4 + MARKER_LENGTH;
+        target = pctx->min_size;
+        if(pctx->max_size > pctx->min_size)
+            target += rand_r(&seed) % (pctx->max_size - pctx->min_size + 1);
+
+        /* a padding segment has a header of its own */
+        while(size < target)
+            size += 4 + MIN(target - size, PAD_CHUNK);
+
+        if((pctx->pool[i] = malloc(size)) == NULL) {
+            free(jpg);
+            break;
+        }
+
+        p = pctx->pool[i];
+        header = header_length(jpg, jpg_size);
+        memcpy(p, jpg, header);
+        p = com_segment(p + header, MARKER_LENGTH);
+        pctx->marker = p - pctx->pool[i];
+        memset(p, ' ', MARKER_LENGTH);
+        p += MARKER_LENGTH;
+
+        for(target = size - (jpg_size + 4 + MARKER_LENGTH); target > 0; target -= chunk + 4) {
+            chunk = MIN(target - 4, PAD_CHUNK);
+            p = com_segment(p, chunk);
+            memset(p, 0, chunk);
+            p += chunk;
+        }
+
+        memcpy(p, jpg + header, jpg_size - header);
+        pctx->sizes[i] = size;
+        free(jpg);
+    }
+
+    free(rgb);
+
+    if(i < pctx->count) {
+        free_pool(pctx);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void free_pool(context *pctx)
+{
+    int i;
+
+    for(i = 0; pctx->pool != NULL && i < pctx->count; i++)
+        free(pctx->pool[i]);
+    free(pctx->pool);
+    free(pctx->sizes);
+    pctx->pool = NULL;
+    pctx->sizes = NULL;
+}
+
+/******************************************************************************
+Description.: publish the next frame of the pool with a fresh marker
+Input Value.: pctx is the instance
+Return Value: -
+******************************************************************************/
+static void publish(context *pctx)
+{
+    input *in = pglobal->in[pctx->id];
+    char marker[MARKER_LENGTH + 1];
+    int index = pctx->sequence % pctx->count;
+    frame *f;
+
+    /* the memory budget (-m) may be exhausted */
+    if((f = input_frame_alloc(in, pctx->sizes[index])) == NULL)
+        return;
+
+    pctx->sequence++;
+    gettimeofday(&f->timestamp, NULL);
+    snprintf(marker, sizeof(marker), MARKER_FORMAT, pctx->sequence,
+             (long)f->timestamp.tv_sec, (long)f->timestamp.tv_usec);
+
+    memcpy(f->buf, pctx->pool[index], pctx->sizes[index]);
+    memcpy(f->buf + pctx->marker, marker, MARKER_LENGTH);
+    f->size = pctx->sizes[index];
+    f->width = pctx->width;
+    f->height = pctx->height;
+    f->format = V4L2_PIX_FMT_JPEG;
+    f->quality = pctx->quality;
+
+    TRACE2(frame_grab, pctx->id, f->size);
+    input_publish_frame(in, f);
+}
+
+/******************************************************************************
+Description.: add nanoseconds to a time
+Input Value.: t is the time
+              nsec is the time to add
+Return Value: -
+******************************************************************************/
+static void timespec_add(struct timespec *t, long long nsec)
+{
+    nsec += t->tv_nsec;
+    t->tv_sec += nsec / 1000000000LL;
+    t->tv_nsec = nsec % 1000000000LL;
+}
+
+/* the worker thread of an instance */
+void *worker_thread(void *arg)
+{
+    context *pctx = arg;
+    input *in = pglobal->in[pctx->id];
+    struct timespec next;
+    int i;
+
+    /* set cleanup handler to cleanup allocated resources */
+    pthread_cleanup_push(worker_cleanup, pctx);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while(!pglobal->stop) {
+        /* do not generate frames nobody watches, see -L */
+        if(!input_has_demand(in)) {
+            if(input_wait_demand(in) != 0)
+                break;
+            clock_gettime(CLOCK_MONOTONIC, &next);
+        }
+
+        for(i = 0; i < pctx->burst; i++)
+            publish(pctx);
+
+        if(pctx->fps == 0) {
+            pthread_testcancel();
+            continue;
+        }
+
+        /* absolute deadlines, the time to publish does not add up */
+        timespec_add(&next, pctx->burst * 1000000000LL / pctx->fps);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+    }
+
+    DBG("leaving input thread, calling cleanup function now\n");
+    /* call cleanup handler, signal with the parameter */
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+void worker_cleanup(void *arg)
+{
+    DBG("cleaning up resources allocated by input thread\n");
+}
@@ -136,23 +136,39 @@ int input_init(input_parameter *param, int id)
     v4l2_std_id tvnorm = V4L2_STD_UNKNOWN;
     context *pctx;
     context_settings *settings;
+    char labels[64];
     
-    pctx = calloc(1, sizeof(context));
-    if (pctx == NULL) {
-        IPRINT("error allocating context");
-        exit(EXIT_FAILURE);
-    }
-    
-    settings = pctx->init_settings = init_settings();
     pglobal = param->global;
-    pglobal->in[id].context = pctx;
 
-    /* initialize the mutes variable */
-    if(pthread_mutex_init(&pctx->controls_mutex, NULL) != 0) {
-        IPRINT("could not initialize mutex variable\n");
-        exit(EXIT_FAILURE);
+    /*
+     * a restart by the watchdog initializes the camera again, the context
+     * and its mutex are reused, what the last attempt left is released
+     */
+    if((pctx = pglobal->in[id]->context) != NULL) {
+        free(pctx->init_settings);
+        if(pctx->videoIn != NULL) {
+            close_v4l2(pctx->videoIn);
+            free(pctx->videoIn->tmpbuffer);
+            free(pctx->videoIn);
+            pctx->videoIn = NULL;
+        }
+    } else {
+        pctx = calloc(1, sizeof(context));
+        if (pctx == NULL) {
+            IPRINT("error allocating context");
+            exit(EXIT_FAILURE);
+        }
+
+        /* initialize the mutes variable */
+        if(pthread_mutex_init(&pctx->controls_mutex, NULL) != 0) {
+            IPRINT("could not initialize mutex variable\n");
+            exit(EXIT_FAILURE);
+        }
+        pglobal->in[id]->context = pctx;
     }
 
+    settings = pctx->init_settings = init_settings();
+
     param->argv[0] = INPUT_PLUGIN_NAME;
 
     /* show all parameters for DBG purposes */
@@ -368,10 +384,23 @@ int input_init(input_parameter *param, int id)
             return 1;
         }
     }
+    /* opening the camera is slow, let other inputs initialize meanwhile */
+    plugin_args_parsed();
+
     DBG("input id: %d\n", id);
     pctx->id = id;
     pctx->pglobal = param->global;
 
+    snprintf(labels, sizeof(labels), "input=\"%d\",reason=\"every\"", id);
+    pctx->dropped_every = metric_register(METRIC_COUNTER, "mjpg_input_frames_dropped_total",
+                                          "Frames dropped by the input plugin", labels, 1);
+    snprintf(labels, sizeof(labels), "input=\"%d\",reason=\"minimum_size\"", id);
+    pctx->dropped_small = metric_register(METRIC_COUNTER, "mjpg_input_frames_dropped_total",
+                                          "Frames dropped by the input plugin", labels, 1);
+    snprintf(labels, sizeof(labels), "input=\"%d\",reason=\"framedrop\"", id);
+    pctx->dropped_framedrop = metric_register(METRIC_COUNTER, "mjpg_input_frames_dropped_total",
+                                              "Frames dropped by the input plugin", labels, 1);
+
     /* allocate webcam datastructure */
     pctx->videoIn = calloc(1, sizeof(struct vdIn));
     if(pctx->videoIn == NULL) {
@@ -419,8 +448,10 @@ int input_init(input_parameter *param, int id)
     /* open video device and prepare data structure */
     if(init_videoIn(pctx->videoIn, dev, width, height, fps, format, 1, pctx->pglobal, id, tvnorm) < 0) {
         IPRINT("init_VideoIn failed\n");
-        closelog();
-        exit(EXIT_FAILURE);
+        /* the watchdog tries again later if the camera is gone for a while */
+        free(pctx->videoIn);
+        pctx->videoIn = NULL;
+        return 1;
     }
     /*
      * recent linux-uvc driver (revision > ~#125) requires to use dynctrls
@@ -442,7 +473,7 @@ Return Value: always 0
 ******************************************************************************/
 int input_stop(int id)
 {
-    input * in = &pglobal->in[id];
+    input * in = pglobal->in[id];
     context *pctx = (context*)in->context;
     
     DBG("will cancel camera thread #%02d\n", id);
@@ -457,18 +488,12 @@ Return Value: always 0
 ******************************************************************************/
 int input_run(int id)
 {
-    input * in = &pglobal->in[id];
+    input * in = pglobal->in[id];
     context *pctx = (context*)in->context;
-    
-    in->buf = malloc(pctx->videoIn->framesizeIn);
-    if(in->buf == NULL) {
-        fprintf(stderr, "could not allocate memory\n");
-        exit(EXIT_FAILURE);
-    }
 
     DBG("launching camera thread #%02d\n", id);
     /* create thread and pass context to thread function */
-    pthread_create(&(pctx->threadID), NULL, cam_thread, in);
+    thread_create(&(pctx->threadID), &in->threads, "uvc", id, cam_thread, in);
     pthread_detach(pctx->threadID);
     return 0;
 }
@@ -532,6 +557,19 @@ void help(void)
     );
 }
 
+#ifndef NO_LIBJPEG
+/******************************************************************************
+Description.: encoder of the frames captured in YUV mode, it is called by the
+              first consumer that needs the JPG picture
+Input Value.: f is the frame with the raw pixels, quality and destination
+Return Value: size of the JPG picture, -1 on error
+******************************************************************************/
+static int encode_frame(frame *f, int quality, unsigned char *buf, int size)
+{
+    return compress_raw_to_jpeg(f->raw, f->width, f->height, f->raw_format, buf, size, quality);
+}
+#endif
+
 /******************************************************************************
 Description.: this thread worker grabs a frame and copies it to the global buffer
 Input Value.: unused
@@ -544,7 +582,9 @@ void *cam_thread(void *arg)
     context_settings *settings = pcontext->init_settings;
     
     unsigned int every_count = 0;
-    int quality = settings->quality;
+    int quality = settings->quality, ret;
+    struct timeval last_timestamp = {0, 0};
+    frame *f;
     
     /* set cleanup handler to cleanup allocated resources */
     pthread_cleanup_push(cam_cleanup, in);
@@ -623,19 +663,50 @@ void *cam_thread(void *arg)
     pcontext->init_settings = NULL;
 
     while(!pglobal->stop) {
+        /* stop streaming while nobody needs the frames, see -L */
+        if(!input_has_demand(in)) {
+            DBG("no consumers, pausing the capture\n");
+            if(video_pause(pcontext->videoIn) != 0) {
+                IPRINT("could not pause the capture\n");
+                exit(EXIT_FAILURE);
+            }
+            if(input_wait_demand(in) != 0)
+                break;
+            DBG("resuming the capture\n");
+            if(video_unpause(pcontext->videoIn) != 0) {
+                IPRINT("could not resume the capture\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
         while(pcontext->videoIn->streamingState == STREAMING_PAUSED) {
             usleep(1); // maybe not the best way so FIXME
         }
 
         /* grab a frame */
-        if(uvcGrab(pcontext->videoIn) < 0) {
+        if((ret = uvcGrab(pcontext->videoIn)) < 0) {
             IPRINT("Error grabbing frames\n");
+            /*
+             * the watchdog (-W) opens the camera again, e.g. after it was
+             * unplugged. Wait for its input_stop(), usleep() can be cancelled
+             */
+            if(pglobal->watchdog >= 0) {
+                while(!pglobal->stop)
+                    usleep(100 * 1000);
+                break;
+            }
             exit(EXIT_FAILURE);
         }
 
+        /* no frame for a while, the watchdog restarts a camera that stays silent */
+        if(ret == GRAB_TIMEOUT)
+            continue;
+        TRACE2(frame_grab, pcontext->id, pcontext->videoIn->buf.bytesused);
+
         if ( every_count < every - 1 ) {
             DBG("dropping %d frame for every=%d\n", every_count + 1, every);
             ++every_count;
+            metric_add(pcontext->dropped_every, 1);
             continue;
         } else {
             every_count = 0;
@@ -652,14 +723,15 @@ void *cam_thread(void *arg)
          */
         if(pcontext->videoIn->tmpbytesused < minimum_size) {
             DBG("dropping too small frame, assuming it as broken\n");
+            metric_add(pcontext->dropped_small, 1);
             continue;
         }
 
         // use software frame dropping on low fps
         if (pcontext->videoIn->soft_framedrop == 1) 
         {
-            unsigned long last = pglobal->in[pcontext->id].timestamp.tv_sec * 1000 +
-                                (pglobal->in[pcontext->id].timestamp.tv_usec/1000); // convert to ms
+            unsigned long last = last_timestamp.tv_sec * 1000 +
+                                (last_timestamp.tv_usec/1000); // convert to ms
 
             unsigned long current = pcontext->videoIn->tmptimestamp.tv_sec * 1000 +
                                     pcontext->videoIn->tmptimestamp.tv_usec/1000; // convert to ms
@@ -668,17 +740,22 @@ void *cam_thread(void *arg)
             if ((current - last) < pcontext->videoIn->frame_period_time) 
             {
                 //DBG("Last frame taken %d ms ago so drop it\n", (current - last));
+                metric_add(pcontext->dropped_framedrop, 1);
                 continue;
             }
 
             DBG("Lagg: %ld\n", (current - last) - pcontext->videoIn->frame_period_time);
         }
 
-        /* copy JPG picture to global buffer */
-        pthread_mutex_lock(&pglobal->in[pcontext->id].db);
+        /* every frame gets its own buffer, consumers may still hold the previous one */
+        if((f = input_frame_alloc(in, pcontext->videoIn->framesizeIn)) == NULL) {
+            IPRINT("could not allocate memory for frame\n");
+            continue;
+        }
 
         /*
-         * If capturing in YUV mode convert to JPEG now.
+         * If capturing in YUV mode keep the raw pixels, they are converted to
+         * JPEG when the first consumer asks for it (frame_jpeg).
          * This compression requires many CPU cycles, so try to avoid YUV format.
          * Getting JPEGs straight from the webcam, is one of the major advantages of
          * Linux-UVC compatible devices.
@@ -688,21 +765,30 @@ void *cam_thread(void *arg)
             || (pcontext->videoIn->formatIn == V4L2_PIX_FMT_UYVY) 
             || (pcontext->videoIn->formatIn == V4L2_PIX_FMT_RGB565) ) 
         {
-            DBG("compressing frame from input: %d\n", (int)pcontext->id);
+            DBG("keeping raw frame from input: %d\n", (int)pcontext->id);
 
-            pglobal->in[pcontext->id].size = compress_image_to_jpeg(pcontext->videoIn, pglobal->in[pcontext->id].buf, pcontext->videoIn->framesizeIn, quality);
+            if(frame_reserve_raw(f, pcontext->videoIn->framesizeIn) != 0) {
+                IPRINT("could not allocate memory for frame\n");
+                frame_unref(f);
+                continue;
+            }
+            memcpy(f->raw, pcontext->videoIn->framebuffer, pcontext->videoIn->framesizeIn);
+            f->raw_size = pcontext->videoIn->framesizeIn;
+            f->raw_format = pcontext->videoIn->formatIn;
+            f->encoder = encode_frame;
+            f->quality = quality;
             
             /* copy this frame's timestamp to user space */
-            pglobal->in[pcontext->id].timestamp = pcontext->videoIn->buf.timestamp;
+            f->timestamp = pcontext->videoIn->buf.timestamp;
         } 
         else 
         {
         #endif
             DBG("copying frame from input: %d\n", (int)pcontext->id);
-            pglobal->in[pcontext->id].size = memcpy_picture(pglobal->in[pcontext->id].buf, pcontext->videoIn->tmpbuffer, pcontext->videoIn->tmpbytesused);
+            f->size = memcpy_picture(f->buf, pcontext->videoIn->tmpbuffer, pcontext->videoIn->tmpbytesused);
             
             /* copy this frame's timestamp to user space */
-            pglobal->in[pcontext->id].timestamp = pcontext->videoIn->tmptimestamp;
+            f->timestamp = pcontext->videoIn->tmptimestamp;
         #ifndef NO_LIBJPEG
         }
         #endif
@@ -715,10 +801,21 @@ void *cam_thread(void *arg)
         prev_size = global->size;
 #endif
 
+        f->width = pcontext->videoIn->width;
+        f->height = pcontext->videoIn->height;
+        f->format = V4L2_PIX_FMT_JPEG;
+
+        /* most drivers take the v4l2_buffer timestamp from the monotonic clock */
+        if((pcontext->videoIn->buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+            f->captured.tv_sec = f->timestamp.tv_sec;
+            f->captured.tv_nsec = f->timestamp.tv_usec * 1000;
+        }
+        f->dequeued = pcontext->videoIn->dequeued;
+
+        last_timestamp = f->timestamp;
 
-        /* signal fresh_frame */
-        pthread_cond_broadcast(&pglobal->in[pcontext->id].db_update);
-        pthread_mutex_unlock(&pglobal->in[pcontext->id].db);
+        /* hand the frame over to the consumers and signal fresh_frame */
+        input_publish_frame(in, f);
     }
 
     DBG("leaving input thread, calling cleanup function now\n");
@@ -745,10 +842,6 @@ void cam_cleanup(void *arg)
         free(pctx->videoIn);
         pctx->videoIn = NULL;
     }
-    
-    free(in->buf);
-    in->buf = NULL;
-    in->size = 0;
 }
 
 /******************************************************************************
@@ -761,7 +854,7 @@ Return Value: depends in the command, for most cases 0 means no errors and
 ******************************************************************************/
 int input_cmd(int plugin_number, unsigned int control_id, unsigned int group, int value, char *value_string)
 {
-    input * in = &pglobal->in[plugin_number];
+    input * in = pglobal->in[plugin_number];
     context *pctx = (context*)in->context;
     
     int ret = -1;
@@ -43,6 +43,7 @@ typedef struct {
     int outbuffer_size;
     unsigned char *outbuffer_cursor;
     int *written;
+    int overflow;
 
 } mjpg_destination_mgr;
 
@@ -75,9 +76,14 @@ METHODDEF(boolean) empty_output_buffer(j_compress_ptr cinfo)
 {
     mjpg_dest_ptr dest = (mjpg_dest_ptr) cinfo->dest;
 
-    memcpy(dest->outbuffer_cursor, dest->buffer, OUTPUT_BUF_SIZE);
-    dest->outbuffer_cursor += OUTPUT_BUF_SIZE;
-    *(dest->written) += OUTPUT_BUF_SIZE;
+    /* drop the data if the picture does not fit, the caller gets an error */
+    if(*(dest->written) + OUTPUT_BUF_SIZE > dest->outbuffer_size) {
+        dest->overflow = 1;
+    } else {
+        memcpy(dest->outbuffer_cursor, dest->buffer, OUTPUT_BUF_SIZE);
+        dest->outbuffer_cursor += OUTPUT_BUF_SIZE;
+        *(dest->written) += OUTPUT_BUF_SIZE;
+    }
 
     dest->pub.next_output_byte = dest->buffer;
     dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
@@ -97,6 +103,10 @@ METHODDEF(void) term_destination(j_compress_ptr cinfo)
     size_t datacount = OUTPUT_BUF_SIZE - dest->pub.free_in_buffer;
 
     /* Write any data remaining in the buffer */
+    if(*(dest->written) + datacount > (size_t)dest->outbuffer_size) {
+        dest->overflow = 1;
+        return;
+    }
     memcpy(dest->outbuffer_cursor, dest->buffer, datacount);
     dest->outbuffer_cursor += datacount;
     *(dest->written) += datacount;
@@ -124,6 +134,7 @@ GLOBAL(void) dest_buffer(j_compress_ptr cinfo, unsigned char *buffer, int size,
     dest->outbuffer_size = size;
     dest->outbuffer_cursor = buffer;
     dest->written = written;
+    dest->overflow = 0;
 }
 
 /******************************************************************************
@@ -134,29 +145,31 @@ Description.: yuv2jpeg function is based on compress_yuyv_to_jpeg written by
               YUYV data to JPEG. Most other implementations use the
               "jpeg_stdio_dest" from libjpeg, which can not store compressed
               pictures to memory instead of a file.
-Input Value.: video structure from v4l2uvc.c/h, destination buffer and buffersize
-              the buffer must be large enough, no error/size checking is done!
-Return Value: the buffer will contain the compressed data
+Input Value.: raw pixels, their size and V4L2_PIX_FMT_* format, destination
+              buffer and buffersize. This does not touch any global state, so
+              pictures can be compressed by several threads at once.
+Return Value: size of the compressed data in the buffer, -1 if the buffer was
+              too small
 ******************************************************************************/
-int compress_image_to_jpeg(struct vdIn *vd, unsigned char *buffer, int size, int quality)
+int compress_raw_to_jpeg(unsigned char *raw, int width, int height, unsigned int format, unsigned char *buffer, int size, int quality)
 {
     struct jpeg_compress_struct cinfo;
     struct jpeg_error_mgr jerr;
     JSAMPROW row_pointer[1];
     unsigned char *line_buffer, *yuyv;
-    int z;
-    static int written;
+    int z, overflow;
+    int written = 0;
 
-    line_buffer = calloc(vd->width * 3, 1);
-    yuyv = vd->framebuffer;
+    line_buffer = calloc(width * 3, 1);
+    yuyv = raw;
 
     cinfo.err = jpeg_std_error(&jerr);
     jpeg_create_compress(&cinfo);
     /* jpeg_stdio_dest (&cinfo, file); */
     dest_buffer(&cinfo, buffer, size, &written);
 
-    cinfo.image_width = vd->width;
-    cinfo.image_height = vd->height;
+    cinfo.image_width = width;
+    cinfo.image_height = height;
     cinfo.input_components = 3;
     cinfo.in_color_space = JCS_RGB;
 
@@ -166,13 +179,13 @@ int compress_image_to_jpeg(struct vdIn *vd, unsigned char *buffer, int size, int
     jpeg_start_compress(&cinfo, TRUE);
 
     z = 0;
-    if (vd->formatIn == V4L2_PIX_FMT_YUYV) {
-        while(cinfo.next_scanline < vd->height) {
+    if (format == V4L2_PIX_FMT_YUYV) {
+        while(cinfo.next_scanline < height) {
             int x;
             unsigned char *ptr = line_buffer;
 
 
-            for(x = 0; x < vd->width; x++) {
+            for(x = 0; x < width; x++) {
                 int r, g, b;
                 int y, u, v;
 
@@ -200,12 +213,12 @@ int compress_image_to_jpeg(struct vdIn *vd, unsigned char *buffer, int size, int
             row_pointer[0] = line_buffer;
             jpeg_write_scanlines(&cinfo, row_pointer, 1);
         }
-    } else if (vd->formatIn == V4L2_PIX_FMT_RGB565) {
-        while(cinfo.next_scanline < vd->height) {
+    } else if (format == V4L2_PIX_FMT_RGB565) {
+        while(cinfo.next_scanline < height) {
             int x;
             unsigned char *ptr = line_buffer;
 
-            for(x = 0; x < vd->width; x++) {
+            for(x = 0; x < width; x++) {
                 /*
                 unsigned int tb = ((unsigned char)raw[i+1] << 8) + (unsigned char)raw[i];
                 r =  ((unsigned char)(raw[i+1]) & 248);
@@ -222,13 +235,13 @@ int compress_image_to_jpeg(struct vdIn *vd, unsigned char *buffer, int size, int
             row_pointer[0] = line_buffer;
             jpeg_write_scanlines(&cinfo, row_pointer, 1);
         }
-    }  else if (vd->formatIn == V4L2_PIX_FMT_UYVY) {
-        while(cinfo.next_scanline < vd->height) {
+    }  else if (format == V4L2_PIX_FMT_UYVY) {
+        while(cinfo.next_scanline < height) {
             int x;
             unsigned char *ptr = line_buffer;
 
 
-            for(x = 0; x < vd->width; x++) {
+            for(x = 0; x < width; x++) {
                 int r, g, b;
                 int y, u, v;
 
@@ -258,9 +271,20 @@ int compress_image_to_jpeg(struct vdIn *vd, unsigned char *buffer, int size, int
         }
     }
     jpeg_finish_compress(&cinfo);
+    overflow = ((mjpg_dest_ptr) cinfo.dest)->overflow;
     jpeg_destroy_compress(&cinfo);
 
     free(line_buffer);
 
-    return (written);
+    return overflow ? -1 : written;
+}
+
+/******************************************************************************
+Description.: compress the current picture of the video device, see above
+Input Value.: video structure from v4l2uvc.c/h, destination buffer and buffersize
+Return Value: size of the compressed data in the buffer, -1 on error
+******************************************************************************/
+int compress_image_to_jpeg(struct vdIn *vd, unsigned char *buffer, int size, int quality)
+{
+    return compress_raw_to_jpeg(vd->framebuffer, vd->width, vd->height, vd->formatIn, buffer, size, quality);
 }
@@ -25,6 +25,7 @@
 
 #include <stdlib.h>
 #include <errno.h>
+#include <poll.h>
 #include "v4l2uvc.h"
 #include "huffman.h"
 #include "dynctrl.h"
@@ -125,8 +126,8 @@ int init_videoIn(struct vdIn *vd, char *device, int width,
     in_struct.index = 0;
     if (xioctl(vd->fd, VIDIOC_ENUMINPUT,  &in_struct) == 0) {
         int nameLength = strlen((char*)&in_struct.name);
-        pglobal->in[id].name = malloc((1+nameLength)*sizeof(char));
-        sprintf(pglobal->in[id].name, "%s", in_struct.name);
+        pglobal->in[id]->name = malloc((1+nameLength)*sizeof(char));
+        sprintf(pglobal->in[id]->name, "%s", in_struct.name);
         DBG("Input name: %s\n", in_struct.name);
     } else {
         DBG("VIDIOC_ENUMINPUT failed\n");
@@ -143,63 +144,63 @@ int init_videoIn(struct vdIn *vd, char *device, int width,
              currentFormat.fmt.pix.height);
     }
 
-    pglobal->in[id].in_formats = NULL;
-    for(pglobal->in[id].formatCount = 0; 1; pglobal->in[id].formatCount++) {
+    pglobal->in[id]->in_formats = NULL;
+    for(pglobal->in[id]->formatCount = 0; 1; pglobal->in[id]->formatCount++) {
         struct v4l2_fmtdesc fmtdesc;
         memset(&fmtdesc, 0, sizeof(struct v4l2_fmtdesc));
-        fmtdesc.index = pglobal->in[id].formatCount;
+        fmtdesc.index = pglobal->in[id]->formatCount;
         fmtdesc.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         if(xioctl(vd->fd, VIDIOC_ENUM_FMT, &fmtdesc) < 0) {
             break;
         }
 
-        if (pglobal->in[id].in_formats == NULL) {
-            pglobal->in[id].in_formats = (input_format*)calloc(1, sizeof(input_format));
+        if (pglobal->in[id]->in_formats == NULL) {
+            pglobal->in[id]->in_formats = (input_format*)calloc(1, sizeof(input_format));
         } else {
-            pglobal->in[id].in_formats = (input_format*)realloc(pglobal->in[id].in_formats, (pglobal->in[id].formatCount + 1) * sizeof(input_format));
+            pglobal->in[id]->in_formats = (input_format*)realloc(pglobal->in[id]->in_formats, (pglobal->in[id]->formatCount + 1) * sizeof(input_format));
         }
 
-        if (pglobal->in[id].in_formats == NULL) {
+        if (pglobal->in[id]->in_formats == NULL) {
             LOG("Calloc/realloc failed: %s\n", strerror(errno));
             return -1;
         }
 
-        memcpy(&pglobal->in[id].in_formats[pglobal->in[id].formatCount], &fmtdesc, sizeof(input_format));
+        memcpy(&pglobal->in[id]->in_formats[pglobal->in[id]->formatCount], &fmtdesc, sizeof(input_format));
 
         if(fmtdesc.pixelformat == format)
-            pglobal->in[id].currentFormat = pglobal->in[id].formatCount;
+            pglobal->in[id]->currentFormat = pglobal->in[id]->formatCount;
 
         DBG("Supported format: %s\n", fmtdesc.description);
         struct v4l2_frmsizeenum fsenum;
         memset(&fsenum, 0, sizeof(struct v4l2_frmsizeenum));
         fsenum.pixel_format = fmtdesc.pixelformat;
         int j = 0;
-        pglobal->in[id].in_formats[pglobal->in[id].formatCount].supportedResolutions = NULL;
-        pglobal->in[id].in_formats[pglobal->in[id].formatCount].resolutionCount = 0;
-        pglobal->in[id].in_formats[pglobal->in[id].formatCount].currentResolution = -1;
+        pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].supportedResolutions = NULL;
+        pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].resolutionCount = 0;
+        pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].currentResolution = -1;
         while(1) {
             fsenum.index = j;
             j++;
             if(xioctl(vd->fd, VIDIOC_ENUM_FRAMESIZES, &fsenum) == 0) {
-                pglobal->in[id].in_formats[pglobal->in[id].formatCount].resolutionCount++;
+                pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].resolutionCount++;
 
-                if (pglobal->in[id].in_formats[pglobal->in[id].formatCount].supportedResolutions == NULL) {
-                    pglobal->in[id].in_formats[pglobal->in[id].formatCount].supportedResolutions = (input_resolution*)
+                if (pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].supportedResolutions == NULL) {
+                    pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].supportedResolutions = (input_resolution*)
                             calloc(1, sizeof(input_resolution));
                 } else {
-                    pglobal->in[id].in_formats[pglobal->in[id].formatCount].supportedResolutions = (input_resolution*)
-                            realloc(pglobal->in[id].in_formats[pglobal->in[id].formatCount].supportedResolutions, j * sizeof(input_resolution));
+                    pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].supportedResolutions = (input_resolution*)
+                            realloc(pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].supportedResolutions, j * sizeof(input_resolution));
                 }
 
-                if (pglobal->in[id].in_formats[pglobal->in[id].formatCount].supportedResolutions == NULL) {
+                if (pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].supportedResolutions == NULL) {
                     LOG("Calloc/realloc failed\n");
                     return -1;
                 }
 
-                pglobal->in[id].in_formats[pglobal->in[id].formatCount].supportedResolutions[j-1].width = fsenum.discrete.width;
-                pglobal->in[id].in_formats[pglobal->in[id].formatCount].supportedResolutions[j-1].height = fsenum.discrete.height;
+                pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].supportedResolutions[j-1].width = fsenum.discrete.width;
+                pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].supportedResolutions[j-1].height = fsenum.discrete.height;
                 if(format == fmtdesc.pixelformat) {
-                    pglobal->in[id].in_formats[pglobal->in[id].formatCount].currentResolution = (j - 1);
+                    pglobal->in[id]->in_formats[pglobal->in[id]->formatCount].currentResolution = (j - 1);
                     DBG("\tSupported size with the current format: %dx%d\n", fsenum.discrete.width, fsenum.discrete.height);
                 } else {
                     DBG("\tSupported size: %dx%d\n", fsenum.discrete.width, fsenum.discrete.height);
@@ -240,7 +241,7 @@ int init_videoIn(struct vdIn *vd, char *device, int width,
         goto error;
     return 0;
 error:
-    free(pglobal->in[id].in_parameters);
+    free(pglobal->in[id]->in_parameters);
     free(vd->videodevice);
     free(vd->status);
     free(vd->pictName);
@@ -496,6 +497,47 @@ static int video_disable(struct vdIn *vd, streaming_state disabledState)
     return 0;
 }
 
+/******************************************************************************
+Description.: stop streaming while nobody needs the frames, the device stays
+              open and keeps its settings and buffers
+Input Value.: vd is the device
+Return Value: 0 if everything is OK, otherwise the error of VIDIOC_STREAMOFF
+******************************************************************************/
+int video_pause(struct vdIn *vd)
+{
+    if(vd->streamingState != STREAMING_ON)
+        return 0;
+
+    return video_disable(vd, STREAMING_PAUSED);
+}
+
+/******************************************************************************
+Description.: resume streaming after video_pause()
+Input Value.: vd is the device
+Return Value: 0 if everything is OK, otherwise -1
+******************************************************************************/
+int video_unpause(struct vdIn *vd)
+{
+    int i;
+
+    if(vd->streamingState != STREAMING_PAUSED)
+        return 0;
+
+    /* VIDIOC_STREAMOFF took all buffers from the driver, queue them again */
+    for(i = 0; i < NB_BUFFER; ++i) {
+        memset(&vd->buf, 0, sizeof(struct v4l2_buffer));
+        vd->buf.index = i;
+        vd->buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        vd->buf.memory = V4L2_MEMORY_MMAP;
+        if(xioctl(vd->fd, VIDIOC_QBUF, &vd->buf) < 0) {
+            perror("Unable to queue buffer");
+            return -1;
+        }
+    }
+
+    return (video_enable(vd) == 0) ? 0 : -1;
+}
+
 /******************************************************************************
 Description.:
 Input Value.:
@@ -547,6 +589,7 @@ int memcpy_picture(unsigned char *out, unsigned char *buf, int size)
 int uvcGrab(struct vdIn *vd)
 {
 #define HEADERFRAME1 0xaf
+    struct pollfd pfd;
     int ret;
 
     if(vd->streamingState == STREAMING_OFF) 
@@ -565,6 +608,20 @@ int uvcGrab(struct vdIn *vd)
     vd->buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     vd->buf.memory = V4L2_MEMORY_MMAP;
 
+    /*
+     * DQBUF blocks in the driver, where the thread can not be cancelled.
+     * poll() is a cancellation point, so input_stop() and the watchdog
+     * can end the thread, and it gives up on a device that hangs
+     */
+    pfd.fd = vd->fd;
+    pfd.events = POLLIN;
+    do {
+        ret = poll(&pfd, 1, GRAB_WAIT);
+    } while(ret < 0 && errno == EINTR);
+
+    if(ret == 0)
+        return GRAB_TIMEOUT;
+
     // Dequeue the buffer
     ret = xioctl(vd->fd, VIDIOC_DQBUF, &vd->buf);
 
@@ -573,6 +630,7 @@ int uvcGrab(struct vdIn *vd)
         perror("Unable to dequeue buffer");
         goto err;
     }
+    clock_gettime(CLOCK_MONOTONIC, &vd->dequeued);
 
     switch(vd->formatIn) {
     case V4L2_PIX_FMT_MJPEG:
@@ -704,8 +762,8 @@ int v4l2SetControl(struct vdIn *vd, int control_id, int value, int plugin_number
     int i;
     int got = -1;
     DBG("Looking for the 0x%08x V4L2 control\n", control_id);
-    for (i = 0; i<pglobal->in[plugin_number].parametercount; i++) {
-        if (pglobal->in[plugin_number].in_parameters[i].ctrl.id == control_id) {
+    for (i = 0; i<pglobal->in[plugin_number]->parametercount; i++) {
+        if (pglobal->in[plugin_number]->in_parameters[i].ctrl.id == control_id) {
             got = 0;
             break;
         }
@@ -713,10 +771,10 @@ int v4l2SetControl(struct vdIn *vd, int control_id, int value, int plugin_number
 
     if (got == 0) { // we have found the control with the specified id
         DBG("V4L2 ctrl 0x%08x found\n", control_id);
-        if (pglobal->in[plugin_number].in_parameters[i].class_id == V4L2_CTRL_CLASS_USER) {
+        if (pglobal->in[plugin_number]->in_parameters[i].class_id == V4L2_CTRL_CLASS_USER) {
             DBG("Control type: USER\n");
-            min = pglobal->in[plugin_number].in_parameters[i].ctrl.minimum;
-            max = pglobal->in[plugin_number].in_parameters[i].ctrl.maximum;
+            min = pglobal->in[plugin_number]->in_parameters[i].ctrl.minimum;
+            max = pglobal->in[plugin_number]->in_parameters[i].ctrl.maximum;
 
             if((value >= min) && (value <= max)) {
                 control_s.id = control_id;
@@ -726,7 +784,7 @@ int v4l2SetControl(struct vdIn *vd, int control_id, int value, int plugin_number
                     return -1;
                 } else {
                     DBG("V4L2 ctrl 0x%08x new value: %d\n", control_id, value);
-                    pglobal->in[plugin_number].in_parameters[i].value = value;
+                    pglobal->in[plugin_number]->in_parameters[i].value = value;
                 }
             } else {
                 LOG("Value (%d) out of range (%d .. %d)\n", value, min, max);
@@ -736,9 +794,9 @@ int v4l2SetControl(struct vdIn *vd, int control_id, int value, int plugin_number
             DBG("Control type: EXTENDED\n");
             struct v4l2_ext_controls ext_ctrls = {0};
             struct v4l2_ext_control ext_ctrl = {0};
-            ext_ctrl.id = pglobal->in[plugin_number].in_parameters[i].ctrl.id;
+            ext_ctrl.id = pglobal->in[plugin_number]->in_parameters[i].ctrl.id;
 
-            switch(pglobal->in[plugin_number].in_parameters[i].ctrl.type) {
+            switch(pglobal->in[plugin_number]->in_parameters[i].ctrl.type) {
 #ifdef V4L2_CTRL_TYPE_STRING
                 case V4L2_CTRL_TYPE_STRING:
                     //string gets set on VIDIOC_G_EXT_CTRLS
@@ -800,23 +858,23 @@ void control_readed(struct vdIn *vd, struct v4l2_queryctrl *ctrl, globals *pglob
     memset(&c, 0, sizeof(struct v4l2_control));
     c.id = ctrl->id;
 
-    if (pglobal->in[id].in_parameters == NULL) {
-        pglobal->in[id].in_parameters = (control*)calloc(1, sizeof(control));
+    if (pglobal->in[id]->in_parameters == NULL) {
+        pglobal->in[id]->in_parameters = (control*)calloc(1, sizeof(control));
     } else {
-        pglobal->in[id].in_parameters =
-        (control*)realloc(pglobal->in[id].in_parameters,(pglobal->in[id].parametercount + 1) * sizeof(control));
+        pglobal->in[id]->in_parameters =
+        (control*)realloc(pglobal->in[id]->in_parameters,(pglobal->in[id]->parametercount + 1) * sizeof(control));
     }
 
-    if (pglobal->in[id].in_parameters == NULL) {
+    if (pglobal->in[id]->in_parameters == NULL) {
         DBG("Calloc failed\n");
         return;
     }
 
-    memcpy(&pglobal->in[id].in_parameters[pglobal->in[id].parametercount].ctrl, ctrl, sizeof(struct v4l2_queryctrl));
-    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].group = IN_CMD_V4L2;
-    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = c.value;
+    memcpy(&pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].ctrl, ctrl, sizeof(struct v4l2_queryctrl));
+    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].group = IN_CMD_V4L2;
+    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = c.value;
     if(ctrl->type == V4L2_CTRL_TYPE_MENU) {
-        pglobal->in[id].in_parameters[pglobal->in[id].parametercount].menuitems =
+        pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].menuitems =
             (struct v4l2_querymenu*)malloc((ctrl->maximum + 1) * sizeof(struct v4l2_querymenu));
         int i;
         for(i = ctrl->minimum; i <= ctrl->maximum; i++) {
@@ -825,28 +883,28 @@ void control_readed(struct vdIn *vd, struct v4l2_queryctrl *ctrl, globals *pglob
             qm.id = ctrl->id;
             qm.index = i;
             if(xioctl(vd->fd, VIDIOC_QUERYMENU, &qm) == 0) {
-                memcpy(&pglobal->in[id].in_parameters[pglobal->in[id].parametercount].menuitems[i], &qm, sizeof(struct v4l2_querymenu));
+                memcpy(&pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].menuitems[i], &qm, sizeof(struct v4l2_querymenu));
                 DBG("Menu item %d: %s\n", qm.index, qm.name);
             } else {
                 DBG("Unable to get menu item for %s, index=%d\n", ctrl->name, qm.index);
             }
         }
     } else {
-        pglobal->in[id].in_parameters[pglobal->in[id].parametercount].menuitems = NULL;
+        pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].menuitems = NULL;
     }
 
-    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = 0;
-    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].class_id = (ctrl->id & 0xFFFF0000);
+    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = 0;
+    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].class_id = (ctrl->id & 0xFFFF0000);
 #ifndef V4L2_CTRL_FLAG_NEXT_CTRL
-    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].class_id = V4L2_CTRL_CLASS_USER;
+    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].class_id = V4L2_CTRL_CLASS_USER;
 #endif
 
     int ret = -1;
-    if (pglobal->in[id].in_parameters[pglobal->in[id].parametercount].class_id == V4L2_CTRL_CLASS_USER) {
+    if (pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].class_id == V4L2_CTRL_CLASS_USER) {
         DBG("V4L2 parameter found: %s value %d Class: USER \n", ctrl->name, c.value);
         ret = xioctl(vd->fd, VIDIOC_G_CTRL, &c);
         if(ret == 0) {
-            pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = c.value;
+            pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = c.value;
         } else {
             DBG("Unable to get the value of %s retcode: %d  %s\n", ctrl->name, ret, strerror(errno));
         }
@@ -868,15 +926,15 @@ void control_readed(struct vdIn *vd, struct v4l2_queryctrl *ctrl, globals *pglob
         if(ret) {
             switch (ext_ctrl.id) {
                 case V4L2_CID_PAN_RESET:
-                    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = 1;
+                    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = 1;
                     DBG("Setting PAN reset value to 1\n");
                     break;
                 case V4L2_CID_TILT_RESET:
-                    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = 1;
+                    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = 1;
                     DBG("Setting the Tilt reset value to 2\n");
                     break;
                 case V4L2_CID_PANTILT_RESET_LOGITECH:
-                    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = 3;
+                    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = 3;
                     DBG("Setting the PAN/TILT reset value to 3\n");
                     break;
                 default:
@@ -889,20 +947,20 @@ void control_readed(struct vdIn *vd, struct v4l2_queryctrl *ctrl, globals *pglob
                 case V4L2_CTRL_TYPE_STRING:
                     //string gets set on VIDIOC_G_EXT_CTRLS
                     //add the maximum size to value
-                    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = ext_ctrl.size;
+                    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = ext_ctrl.size;
                     break;
 #endif
                 case V4L2_CTRL_TYPE_INTEGER64:
-                    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = ext_ctrl.value64;
+                    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = ext_ctrl.value64;
                     break;
                 default:
-                    pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = ext_ctrl.value;
+                    pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = ext_ctrl.value;
                     break;
             }
         }
     }
 
-    pglobal->in[id].parametercount++;
+    pglobal->in[id]->parametercount++;
 }
 
 /*  It should set the capture resolution
@@ -957,8 +1015,8 @@ void enumerateControls(struct vdIn *vd, globals *pglobal, int id)
     // enumerating v4l2 controls
     struct v4l2_queryctrl ctrl;
     memset(&ctrl, 0, sizeof(struct v4l2_queryctrl));
-    pglobal->in[id].parametercount = 0;
-    pglobal->in[id].in_parameters = malloc(0 * sizeof(control));
+    pglobal->in[id]->parametercount = 0;
+    pglobal->in[id]->in_parameters = malloc(0 * sizeof(control));
     /* Enumerate the v4l2 controls
      Try the extended control API first */
 #ifdef V4L2_CTRL_FLAG_NEXT_CTRL
@@ -995,15 +1053,15 @@ void enumerateControls(struct vdIn *vd, globals *pglobal, int id)
         }
     }
 
-    memset(&pglobal->in[id].jpegcomp, 0, sizeof(struct v4l2_jpegcompression));
-    if(xioctl(vd->fd, VIDIOC_G_JPEGCOMP, &pglobal->in[id].jpegcomp) != EINVAL) {
+    memset(&pglobal->in[id]->jpegcomp, 0, sizeof(struct v4l2_jpegcompression));
+    if(xioctl(vd->fd, VIDIOC_G_JPEGCOMP, &pglobal->in[id]->jpegcomp) != EINVAL) {
         DBG("JPEG compression details:\n");
-        DBG("Quality: %d\n", pglobal->in[id].jpegcomp.quality);
-        DBG("APPn: %d\n", pglobal->in[id].jpegcomp.APPn);
-        DBG("APP length: %d\n", pglobal->in[id].jpegcomp.APP_len);
-        DBG("APP data: %s\n", pglobal->in[id].jpegcomp.APP_data);
-        DBG("COM length: %d\n", pglobal->in[id].jpegcomp.COM_len);
-        DBG("COM data: %s\n", pglobal->in[id].jpegcomp.COM_data);
+        DBG("Quality: %d\n", pglobal->in[id]->jpegcomp.quality);
+        DBG("APPn: %d\n", pglobal->in[id]->jpegcomp.APPn);
+        DBG("APP length: %d\n", pglobal->in[id]->jpegcomp.APP_len);
+        DBG("APP data: %s\n", pglobal->in[id]->jpegcomp.APP_data);
+        DBG("COM length: %d\n", pglobal->in[id]->jpegcomp.COM_len);
+        DBG("COM data: %s\n", pglobal->in[id]->jpegcomp.COM_data);
         struct v4l2_queryctrl ctrl_jpeg;
         ctrl_jpeg.id = 1;
         sprintf((char*)&ctrl_jpeg.name, "JPEG quality");
@@ -1013,23 +1071,23 @@ void enumerateControls(struct vdIn *vd, globals *pglobal, int id)
         ctrl_jpeg.default_value = 50;
         ctrl_jpeg.flags = 0;
         ctrl_jpeg.type = V4L2_CTRL_TYPE_INTEGER;
-        if (pglobal->in[id].in_parameters == NULL) {
-            pglobal->in[id].in_parameters = (control*)calloc(1, sizeof(control));
+        if (pglobal->in[id]->in_parameters == NULL) {
+            pglobal->in[id]->in_parameters = (control*)calloc(1, sizeof(control));
         } else {
-            pglobal->in[id].in_parameters = (control*)realloc(pglobal->in[id].in_parameters,(pglobal->in[id].parametercount + 1) * sizeof(control));
+            pglobal->in[id]->in_parameters = (control*)realloc(pglobal->in[id]->in_parameters,(pglobal->in[id]->parametercount + 1) * sizeof(control));
         }
 
-        if (pglobal->in[id].in_parameters == NULL) {
+        if (pglobal->in[id]->in_parameters == NULL) {
             DBG("Calloc/realloc failed\n");
             return;
         }
 
-        memcpy(&pglobal->in[id].in_parameters[pglobal->in[id].parametercount].ctrl, &ctrl_jpeg, sizeof(struct v4l2_queryctrl));
-        pglobal->in[id].in_parameters[pglobal->in[id].parametercount].group = IN_CMD_JPEG_QUALITY;
-        pglobal->in[id].in_parameters[pglobal->in[id].parametercount].value = pglobal->in[id].jpegcomp.quality;
-        pglobal->in[id].parametercount++;
+        memcpy(&pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].ctrl, &ctrl_jpeg, sizeof(struct v4l2_queryctrl));
+        pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].group = IN_CMD_JPEG_QUALITY;
+        pglobal->in[id]->in_parameters[pglobal->in[id]->parametercount].value = pglobal->in[id]->jpegcomp.quality;
+        pglobal->in[id]->parametercount++;
     } else {
         DBG("Modifying the setting of the JPEG compression is not supported\n");
-        pglobal->in[id].jpegcomp.quality = -1;
+        pglobal->in[id]->jpegcomp.quality = -1;
     }
 }
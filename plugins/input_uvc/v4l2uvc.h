@@ -46,6 +46,13 @@
 
 #define IOCTL_RETRY 4
 
+/*
+ * milliseconds uvcGrab() waits for a frame before it returns GRAB_TIMEOUT,
+ * so a hung device does not block the camera thread for good
+ */
+#define GRAB_WAIT 1000
+#define GRAB_TIMEOUT 1
+
 /* ioctl with a number of retries in the case of I/O failure
 * args:
 * fd - device descriptor
@@ -111,6 +118,7 @@ struct vdIn {
     int recordtime;
     uint32_t tmpbytesused;
     struct timeval tmptimestamp;
+    struct timespec dequeued; // CLOCK_MONOTONIC time of the last VIDIOC_DQBUF
     v4l2_std_id vstd;
     unsigned long frame_period_time; // in ms
     unsigned char soft_framedrop;
@@ -143,6 +151,11 @@ typedef struct {
     pthread_mutex_t controls_mutex;
     struct vdIn *videoIn;
     context_settings *init_settings;
+
+    /* dropped frames by reason, see metrics.h */
+    metric *dropped_every;
+    metric *dropped_small;
+    metric *dropped_framedrop;
 } context;
 
 int init_videoIn(struct vdIn *vd, char *device, int width, int height, int fps, int format, int grabmethod, globals *pglobal, int id, v4l2_std_id vstd);
@@ -152,6 +165,8 @@ int setResolution(struct vdIn *vd, int width, int height);
 
 int memcpy_picture(unsigned char *out, unsigned char *buf, int size);
 int uvcGrab(struct vdIn *vd);
+int video_pause(struct vdIn *vd);
+int video_unpause(struct vdIn *vd);
 int close_v4l2(struct vdIn *vd);
 
 int v4l2GetControl(struct vdIn *vd, int control);
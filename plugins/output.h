@@ -22,7 +22,7 @@
 
 #include "../mjpg_streamer.h"
 #define OUTPUT_PLUGIN_PREFIX " o: "
-#define OPRINT(...) { char _bf[1024] = {0}; snprintf(_bf, sizeof(_bf)-1, __VA_ARGS__); fprintf(stderr, "%s", OUTPUT_PLUGIN_PREFIX); fprintf(stderr, "%s", _bf); syslog(LOG_INFO, "%s", _bf); }
+#define OPRINT(...) log_message(LOGLEVEL_INFO, OUTPUT_PLUGIN_PREFIX, 1, __VA_ARGS__)
 
 /* parameters for output plugin */
 typedef struct _output_parameter output_parameter;
@@ -48,6 +48,28 @@ struct _output {
     struct _control *out_parameters;
     int parametercount;
 
+    void *context; // private data for the plugin
+
+    /* how the threads of the plugin run, see thread_create() */
+    thread_config threads;
+
+    /* statistics of this output, registered by output_load(), see metrics.h */
+    struct {
+        metric *frames;
+        metric *bytes;
+        metric *clients;
+        metric *latency_pickup;
+        metric *latency_sent;
+        metric *memory;
+        metric *unchanged;
+    } metrics;
+
+    /* 0 after the plugin was unloaded at runtime, see plugins.c */
+    int loaded;
+
+    /* 1 while the plugin is stopped through the control socket, see output_halt() */
+    int stopped;
+
     int (*init)(output_parameter *param, int id);
     int (*stop)(int);
     int (*run)(int);
@@ -47,12 +47,15 @@
 
 static pthread_t worker;
 static globals *pglobal;
-static int fd, delay, ringbuffer_size = -1, ringbuffer_exceed = 0, max_frame_size;
+static int fd, delay, ringbuffer_size = -1, ringbuffer_exceed = 0;
 static char *folder = "/tmp";
-static unsigned char *frame = NULL;
+static frame *current = NULL;
 static char *command = NULL;
 static int input_number = 0;
 static char *mjpgFileName = NULL;
+static int pretrigger = 0;
+static int plugin_number;
+static memory_consumer consumer;
 
 /******************************************************************************
 Description.: print a help message
@@ -73,6 +76,9 @@ void help(void)
             " [-s | --size ]..........: size of ring buffer (max number of pictures to hold)\n" \
             " [-e | --exceed ]........: allow ringbuffer to exceed limit by this amount\n" \
             " [-c | --command ].......: execute command after saving picture\n"\
+            " [-p | --pretrigger ]....: the take command saves the frames of the last\n" \
+            "                           <ms> milliseconds as mjpg file, this needs a\n" \
+            "                           frame history (mjpg_streamer -H or -B)\n" \
             " ---------------------------------------------------------------\n");
 }
 
@@ -97,9 +103,8 @@ void worker_cleanup(void *arg)
     first_run = 0;
     OPRINT("cleaning up resources allocated by worker thread\n");
 
-    if(frame != NULL) {
-        free(frame);
-    }
+    frame_unref(current);
+    current = NULL;
     close(fd);
 }
 
@@ -202,12 +207,13 @@ Return Value:
 ******************************************************************************/
 void *worker_thread(void *arg)
 {
-    int ok = 1, frame_size = 0, rc = 0;
+    int ok = 1, rc = 0;
+    frame *f;
     char buffer1[1024] = {0}, buffer2[1024] = {0};
     unsigned long long counter = 0;
     time_t t;
     struct tm *now;
-    unsigned char *tmp_framebuffer = NULL;
+    struct timespec sent = {0, 0};
 
     /* set cleanup handler to cleanup allocated resources */
     pthread_cleanup_push(worker_cleanup, NULL);
@@ -215,31 +221,23 @@ void *worker_thread(void *arg)
     while(ok >= 0 && !pglobal->stop) {
         DBG("waiting for fresh frame\n");
 
-        pthread_mutex_lock(&pglobal->in[input_number].db);
-        pthread_cond_wait(&pglobal->in[input_number].db_update, &pglobal->in[input_number].db);
-
-        /* read buffer */
-        frame_size = pglobal->in[input_number].size;
-
-        /* check if buffer for frame is large enough, increase it if necessary */
-        if(frame_size > max_frame_size) {
-            DBG("increasing buffer size to %d\n", frame_size);
-
-            max_frame_size = frame_size + (1 << 16);
-            if((tmp_framebuffer = realloc(frame, max_frame_size)) == NULL) {
-                pthread_mutex_unlock(&pglobal->in[input_number].db);
-                LOG("not enough memory\n");
-                return NULL;
-            }
-
-            frame = tmp_framebuffer;
+        /* release the previous frame and take a reference to a fresh one */
+        if((f = input_wait_frame(pglobal->in[input_number], (current != NULL) ? current->sequence : 0)) == NULL)
+            break;
+        frame_unref(current);
+        current = f;
+        memory_consumer_hold(&consumer, current);
+
+        /* do not fill the disk with pictures of a static scene, see -U */
+        if(frame_skip_unchanged(current, &sent)) {
+            metric_add(pglobal->out[plugin_number]->metrics.unchanged, 1);
+            continue;
         }
 
-        /* copy frame to our local buffer now */
-        memcpy(frame, pglobal->in[input_number].buf, frame_size);
-
-        /* allow others to access the global buffer again */
-        pthread_mutex_unlock(&pglobal->in[input_number].db);
+        if(frame_jpeg(current) != 0) {
+            DBG("could not encode the frame\n");
+            continue;
+        }
 
         if (mjpgFileName == NULL) { // single files with ringbuffer mode
             /* prepare filename */
@@ -264,7 +262,6 @@ void *worker_thread(void *arg)
             /* prepare string, add time and date values */
             if(strftime(buffer1, sizeof(buffer1), "%%s/%Y_%m_%d_%H_%M_%S_%%03d.jpg", now) == 0) {
                 OPRINT("strftime returned 0\n");
-                free(frame); frame = NULL;
                 return NULL;
             }
 
@@ -282,12 +279,15 @@ void *worker_thread(void *arg)
             }
 
             /* save picture to file */
-            if(write(fd, frame, frame_size) < 0) {
+            if(write(fd, current->buf, current->size) < 0) {
                 OPRINT("could not write to file %s\n", buffer2);
                 perror("write()");
                 close(fd);
                 return NULL;
             }
+            metric_add(pglobal->out[plugin_number]->metrics.frames, 1);
+            metric_add(pglobal->out[plugin_number]->metrics.bytes, current->size);
+            metric_observe(pglobal->out[plugin_number]->metrics.latency_sent, frame_latency(current, NULL));
 
             close(fd);
 
@@ -324,12 +324,15 @@ void *worker_thread(void *arg)
             }
         } else { // recording to MJPG file
             /* save picture to file */
-            if(write(fd, frame, frame_size) < 0) {
+            if(write(fd, current->buf, current->size) < 0) {
                 OPRINT("could not write to file %s\n", buffer2);
                 perror("write()");
                 close(fd);
                 return NULL;
             }
+            metric_add(pglobal->out[plugin_number]->metrics.frames, 1);
+            metric_add(pglobal->out[plugin_number]->metrics.bytes, current->size);
+            metric_observe(pglobal->out[plugin_number]->metrics.latency_sent, frame_latency(current, NULL));
         }
 
         /* if specified, wait now */
@@ -344,6 +347,69 @@ void *worker_thread(void *arg)
     return NULL;
 }
 
+/******************************************************************************
+Description.: save the current frame to a file. If a pre-trigger window is
+              set, the frames of this window are taken from the history of
+              the input and saved as mjpg file instead.
+Input Value.: filename is the file to write
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+static int take_frames(char *filename)
+{
+    input *in = pglobal->in[input_number];
+    frame **frames, *f;
+    struct timeval since, window;
+    int i, count, max = 1, fd, rc = 0;
+
+    /* take a reference to the current frame */
+    if((f = input_get_frame(in)) == NULL) {
+        DBG("No frame available\n");
+        return -1;
+    }
+
+    if(pretrigger > 0 && in->history_size > 0)
+        max = in->history_size;
+
+    if((frames = malloc(max * sizeof(frame *))) == NULL) {
+        frame_unref(f);
+        return -1;
+    }
+
+    if(pretrigger > 0) {
+        /* the window ends with the current frame */
+        window.tv_sec = pretrigger / 1000;
+        window.tv_usec = (pretrigger % 1000) * 1000;
+        timersub(&f->timestamp, &window, &since);
+        frame_unref(f);
+        count = input_get_history(in, &since, frames, max);
+    } else {
+        frames[0] = f;
+        count = 1;
+    }
+
+    /* open file for write */
+    if((fd = open(filename, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
+        OPRINT("could not open the file %s\n", filename);
+        rc = -1;
+    }
+
+    /* save pictures to file */
+    for(i = 0; i < count; i++) {
+        if(rc == 0 && (frame_jpeg(frames[i]) != 0 || write(fd, frames[i]->buf, frames[i]->size) < 0)) {
+            OPRINT("could not write to file %s\n", filename);
+            perror("write()");
+            rc = -1;
+        }
+        frame_unref(frames[i]);
+    }
+
+    if(fd >= 0)
+        close(fd);
+    free(frames);
+
+    return rc;
+}
+
 /*** plugin interface functions ***/
 /******************************************************************************
 Description.: this function is called first, in order to initialize
@@ -356,9 +422,10 @@ int output_init(output_parameter *param, int id)
 	int i;
     delay = 0;
     pglobal = param->global;
-    pglobal->out[id].name = malloc((1+strlen(OUTPUT_PLUGIN_NAME))*sizeof(char));
-    sprintf(pglobal->out[id].name, "%s", OUTPUT_PLUGIN_NAME);
-    DBG("OUT plugin %d name: %s\n", id, pglobal->out[id].name);
+    plugin_number = id;
+    pglobal->out[id]->name = malloc((1+strlen(OUTPUT_PLUGIN_NAME))*sizeof(char));
+    sprintf(pglobal->out[id]->name, "%s", OUTPUT_PLUGIN_NAME);
+    DBG("OUT plugin %d name: %s\n", id, pglobal->out[id]->name);
 
     param->argv[0] = OUTPUT_PLUGIN_NAME;
 
@@ -386,6 +453,8 @@ int output_init(output_parameter *param, int id)
             {"input", required_argument, 0, 0},
             {"m", required_argument, 0, 0},
             {"mjpeg", required_argument, 0, 0},
+            {"p", required_argument, 0, 0},
+            {"pretrigger", required_argument, 0, 0},
             {0, 0, 0, 0}
         };
 
@@ -451,6 +520,12 @@ int output_init(output_parameter *param, int id)
             DBG("case 12,13\n");
             mjpgFileName = strdup(optarg);
             break;
+            /* p, pretrigger */
+        case 14:
+        case 15:
+            DBG("case 14,15\n");
+            pretrigger = atoi(optarg);
+            break;
         }
     }
 
@@ -460,8 +535,13 @@ int output_init(output_parameter *param, int id)
     }
 
     OPRINT("output folder.....: %s\n", folder);
-    OPRINT("input plugin.....: %d: %s\n", input_number, pglobal->in[input_number].plugin);
+    OPRINT("input plugin.....: %d: %s\n", input_number, pglobal->in[input_number]->plugin);
     OPRINT("delay after save..: %d\n", delay);
+    if(pretrigger > 0) {
+        OPRINT("pre-trigger window: %d ms\n", pretrigger);
+        if(pglobal->in[input_number]->history_frames == 0 && pglobal->in[input_number]->history_bytes == 0)
+            OPRINT("the input keeps no frame history, only the current frame will be taken\n");
+    }
     if  (mjpgFileName == NULL) {
         if(ringbuffer_size > 0) {
             OPRINT("ringbuffer size...: %d to %d\n", ringbuffer_size, ringbuffer_size + ringbuffer_exceed);
@@ -481,9 +561,9 @@ int output_init(output_parameter *param, int id)
         free(fnBuffer);
     }
 
-    param->global->out[id].parametercount = 2;
+    param->global->out[id]->parametercount = 2;
 
-    param->global->out[id].out_parameters = (control*) calloc(2, sizeof(control));
+    param->global->out[id]->out_parameters = (control*) calloc(2, sizeof(control));
 
     control take_ctrl;
 	take_ctrl.group = IN_CMD_GENERIC;
@@ -499,7 +579,7 @@ int output_init(output_parameter *param, int id)
 	take_ctrl.ctrl.step = 1;
 	take_ctrl.ctrl.default_value = 0;
 
-	param->global->out[id].out_parameters[0] = take_ctrl;
+	param->global->out[id]->out_parameters[0] = take_ctrl;
 
     control filename_ctrl;
 	filename_ctrl.group = IN_CMD_GENERIC;
@@ -515,7 +595,7 @@ int output_init(output_parameter *param, int id)
 	filename_ctrl.ctrl.step = 1;
 	filename_ctrl.ctrl.default_value = 0;
 
-	param->global->out[id].out_parameters[1] = filename_ctrl;
+	param->global->out[id]->out_parameters[1] = filename_ctrl;
 
 
     return 0;
@@ -530,6 +610,8 @@ int output_stop(int id)
 {
     DBG("will cancel worker thread\n");
     pthread_cancel(worker);
+    memory_consumer_remove(&consumer);
+    input_consumer_remove(pglobal->in[input_number]);
     return 0;
 }
 
@@ -540,8 +622,13 @@ Return Value: always 0
 ******************************************************************************/
 int output_run(int id)
 {
+    /* the file is written continuously, keep the input capturing */
+    input_consumer_add(pglobal->in[input_number]);
+    memory_consumer_add(&consumer, pglobal->in[input_number], pglobal->out[plugin_number],
+                        MEMORY_PRIORITY_RECORDER, NULL, NULL);
+
     DBG("launching worker thread\n");
-    pthread_create(&worker, 0, worker_thread, NULL);
+    thread_create(&worker, &pglobal->out[id]->threads, "file-out", id, worker_thread, NULL);
     pthread_detach(worker);
     return 0;
 }
@@ -552,60 +639,16 @@ int output_cmd(int plugin_id, unsigned int control_id, unsigned int group, int v
     DBG("command (%d, value: %d) for group %d triggered for plugin instance #%02d\n", control_id, value, group, plugin_id);
     switch(group) {
 		case IN_CMD_GENERIC:
-			for(i = 0; i < pglobal->out[plugin_id].parametercount; i++) {
-				if((pglobal->out[plugin_id].out_parameters[i].ctrl.id == control_id) && (pglobal->out[plugin_id].out_parameters[i].group == IN_CMD_GENERIC)) {
-					DBG("Generic control found (id: %d): %s\n", control_id, pglobal->out[plugin_id].out_parameters[i].ctrl.name);
+			for(i = 0; i < pglobal->out[plugin_id]->parametercount; i++) {
+				if((pglobal->out[plugin_id]->out_parameters[i].ctrl.id == control_id) && (pglobal->out[plugin_id]->out_parameters[i].group == IN_CMD_GENERIC)) {
+					DBG("Generic control found (id: %d): %s\n", control_id, pglobal->out[plugin_id]->out_parameters[i].ctrl.name);
 					switch(control_id) {
                             case OUT_FILE_CMD_TAKE: {
                                 if (valueStr != NULL) {
-                                    int frame_size = 0;
-                                    unsigned char *tmp_framebuffer = NULL;
-
-                                    if(pthread_mutex_lock(&pglobal->in[input_number].db)) {
-                                        DBG("Unable to lock mutex\n");
-                                        return -1;
-                                    }
-                                    /* read buffer */
-                                    frame_size = pglobal->in[input_number].size;
-
-                                    /* check if buffer for frame is large enough, increase it if necessary */
-                                    if(frame_size > max_frame_size) {
-                                        DBG("increasing buffer size to %d\n", frame_size);
-
-                                        max_frame_size = frame_size + (1 << 16);
-                                        if((tmp_framebuffer = realloc(frame, max_frame_size)) == NULL) {
-                                            pthread_mutex_unlock(&pglobal->in[input_number].db);
-                                            LOG("not enough memory\n");
-                                            return -1;
-                                        }
-
-                                        frame = tmp_framebuffer;
-                                    }
-
-                                    /* copy frame to our local buffer now */
-                                    memcpy(frame, pglobal->in[input_number].buf, frame_size);
-
-                                    /* allow others to access the global buffer again */
-                                    pthread_mutex_unlock(&pglobal->in[input_number].db);
-
                                     DBG("writing file: %s\n", valueStr);
 
-                                    int fd;
-                                    /* open file for write */
-                                    if((fd = open(valueStr, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
-                                        OPRINT("could not open the file %s\n", valueStr);
+                                    if(take_frames(valueStr) != 0)
                                         return -1;
-                                    }
-
-                                    /* save picture to file */
-                                    if(write(fd, frame, frame_size) < 0) {
-                                        OPRINT("could not write to file %s\n", valueStr);
-                                        perror("write()");
-                                        close(fd);
-                                        return -1;
-                                    }
-
-                                    close(fd);
                                 } else {
                                     DBG("No filename specified\n");
                                     return -1;
@@ -620,7 +663,7 @@ int output_cmd(int plugin_id, unsigned int control_id, unsigned int group, int v
                                 return -1;
                             } break;
 					}
-					DBG("Ctrl %s new value: %d\n", pglobal->out[plugin_id].out_parameters[i].ctrl.name, value);
+					DBG("Ctrl %s new value: %d\n", pglobal->out[plugin_id]->out_parameters[i].ctrl.name, value);
 					return 0;
 				}
 			}
@@ -55,7 +55,6 @@
 
 
 static globals *pglobal;
-extern context servers[MAX_OUTPUT_PLUGINS];
 int piggy_fine = 2; // FIXME make it command line parameter
 
 /******************************************************************************
@@ -395,39 +394,94 @@ void update_client_timestamp(client_info *client)
 }
 #endif
 
+/******************************************************************************
+Description.: convert a timestamp like "1234567890.123456", the format of the
+              X-Timestamp header, to a timeval
+Input Value.: * string: the timestamp
+              * tv....: receives the time
+Return Value: 0 if the string is a valid timestamp, -1 otherwise
+******************************************************************************/
+int parse_timestamp(char *string, struct timeval *tv)
+{
+    char *end;
+    long usec = 0, scale = 100000;
+
+    tv->tv_sec = strtol(string, &end, 10);
+    if(end == string)
+        return -1;
+
+    if(*end == '.') {
+        for(end++; *end >= '0' && *end <= '9'; end++) {
+            usec += (*end - '0') * scale;
+            scale /= 10;
+        }
+    }
+    tv->tv_usec = usec;
+
+    return (*end == '\0') ? 0 : -1;
+}
+
 /******************************************************************************
 Description.: Send a complete HTTP response and a single JPG-frame.
-Input Value.: fildescriptor fd to send the answer to
+Input Value.: * context_fd..: fildescriptor fd to send the answer to
+              * input_number: input plugin to take the frame from
+              * at..........: timestamp of the frame to look up in the history
+                              of the input, NULL for the latest frame
 Return Value: -
 ******************************************************************************/
-void send_snapshot(cfd *context_fd, int input_number)
+void send_snapshot(cfd *context_fd, int input_number, char *at)
 {
-    unsigned char *frame = NULL;
-    int frame_size = 0;
+    output *self = pglobal->out[context_fd->pc->id];
+    input *in;
+    frame *f;
+    unsigned int sequence;
+    int ok, stalled = 0;
     char buffer[BUFFER_SIZE] = {0};
-    struct timeval timestamp;
+    struct timeval tv;
 
-    /* wait for a fresh frame */
-    pthread_mutex_lock(&pglobal->in[input_number].db);
-    pthread_cond_wait(&pglobal->in[input_number].db_update, &pglobal->in[input_number].db);
+    if(at != NULL) {
+        /* the frame that was current at the requested time */
+        if(parse_timestamp(at, &tv) != 0) {
+            send_error(context_fd->fd, 400, "Malformed timestamp");
+            return;
+        }
+        if((f = input_find_frame_at(pglobal->in[input_number], &tv)) == NULL) {
+            send_error(context_fd->fd, 404, "no frame for this time in the history");
+            return;
+        }
+    } else {
+        /*
+         * take the latest frame, wait only if nothing was published yet or
+         * the input was paused and its latest frame is stale
+         */
+        in = pglobal->in[input_number];
+        if(input_consumer_add(in)) {
+            input_lock(in, DB_GET);
+            sequence = in->sequence;
+            input_unlock(in);
+            f = input_wait_frame_stall(in, sequence, &stalled);
+        } else if((f = input_get_frame(in)) == NULL) {
+            f = input_wait_frame_stall(in, 0, &stalled);
+        }
+        input_consumer_remove(in);
 
-    /* read buffer */
-    frame_size = pglobal->in[input_number].size;
+        if(stalled) {
+            send_error(context_fd->fd, 503, "the input stalled, it is restarted");
+            return;
+        }
+        if(f == NULL) {
+            send_error(context_fd->fd, 500, "no frame available");
+            return;
+        }
+    }
 
-    /* allocate a buffer for this single frame */
-    if((frame = malloc(frame_size + 1)) == NULL) {
-        free(frame);
-        pthread_mutex_unlock(&pglobal->in[input_number].db);
-        send_error(context_fd->fd, 500, "not enough memory");
+    /* compress the frame unless the input or another consumer did it already */
+    if(frame_jpeg(f) != 0) {
+        frame_unref(f);
+        send_error(context_fd->fd, 500, "could not encode the frame");
         return;
     }
-    /* copy v4l2_buffer timeval to user space */
-    timestamp = pglobal->in[input_number].timestamp;
-
-    memcpy(frame, pglobal->in[input_number].buf, frame_size);
-    DBG("got frame (size: %d kB)\n", frame_size / 1024);
-
-    pthread_mutex_unlock(&pglobal->in[input_number].db);
+    DBG("got frame (size: %d kB)\n", f->size / 1024);
 
     #ifdef MANAGMENT
     update_client_timestamp(context_fd->client);
@@ -439,16 +493,31 @@ void send_snapshot(cfd *context_fd, int input_number)
             STD_HEADER \
             "Content-type: image/jpeg\r\n" \
             "X-Timestamp: %d.%06d\r\n" \
-            "\r\n", (int) timestamp.tv_sec, (int) timestamp.tv_usec);
+            "\r\n", (int) f->timestamp.tv_sec, (int) f->timestamp.tv_usec);
 
     /* send header and image now */
-    if (write(context_fd->fd, buffer, strlen(buffer)) < 0 ||
-        write(context_fd->fd, frame, frame_size) < 0) {
-        free(frame);
-        return;
+    ok = write(context_fd->fd, buffer, strlen(buffer)) >= 0 &&
+         write(context_fd->fd, f->buf, f->size) >= 0;
+    TRACE4(frame_write, self->param.id, input_number, f->sequence, ok);
+    if(ok) {
+        metric_add(self->metrics.frames, 1);
+        metric_add(self->metrics.bytes, f->size);
     }
 
-    free(frame);
+    frame_unref(f);
+}
+
+/******************************************************************************
+Description.: shed a streaming client to stay within the memory budget, the
+              pending write fails and the client thread releases its frame
+Input Value.: arg is the context of the client
+Return Value: -
+******************************************************************************/
+static void shed_client(void *arg)
+{
+    cfd *context_fd = arg;
+
+    shutdown(context_fd->fd, SHUT_RDWR);
 }
 
 /******************************************************************************
@@ -458,10 +527,13 @@ Return Value: -
 ******************************************************************************/
 void send_stream(cfd *context_fd, int input_number)
 {
-    unsigned char *frame = NULL, *tmp = NULL;
-    int frame_size = 0, max_frame_size = 0;
+    frame *f;
     char buffer[BUFFER_SIZE] = {0};
-    struct timeval timestamp;
+    unsigned int last = 0, skipped = 0;
+    int ok, stalled;
+    output *self = pglobal->out[context_fd->pc->id];
+    memory_consumer mc;
+    struct timespec sent = {0, 0};
 
     DBG("preparing header\n");
     sprintf(buffer, "HTTP/1.0 200 OK\r\n" \
@@ -472,43 +544,47 @@ void send_stream(cfd *context_fd, int input_number)
             "--" BOUNDARY "\r\n");
 
     if(write(context_fd->fd, buffer, strlen(buffer)) < 0) {
-        free(frame);
         return;
     }
 
     DBG("Headers send, sending stream now\n");
 
+    input_consumer_add(pglobal->in[input_number]);
+    memory_consumer_add(&mc, pglobal->in[input_number], self, MEMORY_PRIORITY_VIEWER, shed_client, context_fd);
+    metric_add(self->metrics.clients, 1);
     while(!pglobal->stop) {
 
-        /* wait for fresh frames */
-        pthread_mutex_lock(&pglobal->in[input_number].db);
-        pthread_cond_wait(&pglobal->in[input_number].db_update, &pglobal->in[input_number].db);
-
-        /* read buffer */
-        frame_size = pglobal->in[input_number].size;
+        /* wait for a frame newer than the last one sent */
+        memory_consumer_hold(&mc, NULL);
+        if((f = input_wait_frame_stall(pglobal->in[input_number], last, &stalled)) == NULL) {
+            /*
+             * the input stalled (-W), repeat its last frame until it was
+             * restarted, a client that went away is noticed meanwhile
+             */
+            if(!stalled || (f = input_get_frame(pglobal->in[input_number])) == NULL)
+                break;
+        }
 
-        /* check if framebuffer is large enough, increase it if necessary */
-        if(frame_size > max_frame_size) {
-            DBG("increasing buffer size to %d\n", frame_size);
+        metric_observe(self->metrics.latency_pickup, frame_latency(f, NULL));
+        memory_consumer_hold(&mc, f);
 
-            max_frame_size = frame_size + TEN_K;
-            if((tmp = realloc(frame, max_frame_size)) == NULL) {
-                free(frame);
-                pthread_mutex_unlock(&pglobal->in[input_number].db);
-                send_error(context_fd->fd, 500, "not enough memory");
-                return;
-            }
+        /* count the frames this client was too slow for */
+        if(last != 0 && f->sequence > last)
+            skipped += f->sequence - last - 1;
+        last = f->sequence;
 
-            frame = tmp;
+        /* of a static scene only a frame now and then is sent, see -U */
+        if(frame_skip_unchanged(f, &sent)) {
+            metric_add(self->metrics.unchanged, 1);
+            frame_unref(f);
+            continue;
         }
 
-        /* copy v4l2_buffer timeval to user space */
-        timestamp = pglobal->in[input_number].timestamp;
-
-        memcpy(frame, pglobal->in[input_number].buf, frame_size);
-        DBG("got frame (size: %d kB)\n", frame_size / 1024);
-
-        pthread_mutex_unlock(&pglobal->in[input_number].db);
+        if(frame_jpeg(f) != 0) {
+            frame_unref(f);
+            continue;
+        }
+        DBG("got frame (size: %d kB)\n", f->size / 1024);
 
         #ifdef MANAGMENT
         update_client_timestamp(context_fd->client);
@@ -522,19 +598,31 @@ void send_stream(cfd *context_fd, int input_number)
         sprintf(buffer, "Content-Type: image/jpeg\r\n" \
                 "Content-Length: %d\r\n" \
                 "X-Timestamp: %d.%06d\r\n" \
-                "\r\n", frame_size, (int)timestamp.tv_sec, (int)timestamp.tv_usec);
+                "\r\n", f->size, (int)f->timestamp.tv_sec, (int)f->timestamp.tv_usec);
         DBG("sending intemdiate header\n");
-        if(write(context_fd->fd, buffer, strlen(buffer)) < 0) break;
+        ok = write(context_fd->fd, buffer, strlen(buffer)) >= 0;
 
         DBG("sending frame\n");
-        if(write(context_fd->fd, frame, frame_size) < 0) break;
+        ok = ok && write(context_fd->fd, f->buf, f->size) >= 0;
+        TRACE4(frame_write, self->param.id, input_number, f->sequence, ok);
+        if(ok) {
+            metric_add(self->metrics.frames, 1);
+            metric_add(self->metrics.bytes, f->size);
+            metric_observe(self->metrics.latency_sent, frame_latency(f, NULL));
+        }
+
+        frame_unref(f);
+        if(!ok) break;
 
         DBG("sending boundary\n");
         sprintf(buffer, "\r\n--" BOUNDARY "\r\n");
         if(write(context_fd->fd, buffer, strlen(buffer)) < 0) break;
     }
 
-    free(frame);
+    metric_add(self->metrics.clients, -1);
+    memory_consumer_remove(&mc);
+    input_consumer_remove(pglobal->in[input_number]);
+    DBG("stream finished, client skipped %u frames\n", skipped);
 }
 
 #ifdef WXP_COMPAT
@@ -545,10 +633,13 @@ Return Value: -
 ******************************************************************************/
 void send_stream_wxp(cfd *context_fd, int input_number)
 {
-    unsigned char *frame = NULL, *tmp = NULL;
-    int frame_size = 0, max_frame_size = 0;
+    frame *f;
     char buffer[BUFFER_SIZE] = {0};
-    struct timeval timestamp;
+    unsigned int last = 0, skipped = 0;
+    int ok, stalled;
+    output *self = pglobal->out[context_fd->pc->id];
+    memory_consumer mc;
+    struct timespec sent = {0, 0};
 
     DBG("preparing header\n");
 
@@ -575,58 +666,75 @@ void send_stream_wxp(cfd *context_fd, int input_number)
                     expDateBuffer);
 
     if(write(context_fd->fd, buffer, strlen(buffer)) < 0) {
-        free(frame);
         return;
     }
 
     DBG("Headers send, sending stream now\n");
 
+    input_consumer_add(pglobal->in[input_number]);
+    memory_consumer_add(&mc, pglobal->in[input_number], self, MEMORY_PRIORITY_VIEWER, shed_client, context_fd);
+    metric_add(self->metrics.clients, 1);
     while(!pglobal->stop) {
 
-        /* wait for fresh frames */
-        pthread_mutex_lock(&pglobal->in[input_number].db);
-        pthread_cond_wait(&pglobal->in[input_number].db_update, &pglobal->in[input_number].db);
-
-        /* read buffer */
-        frame_size = pglobal->in[input_number].size;
+        /* wait for a frame newer than the last one sent */
+        memory_consumer_hold(&mc, NULL);
+        if((f = input_wait_frame_stall(pglobal->in[input_number], last, &stalled)) == NULL) {
+            /*
+             * the input stalled (-W), repeat its last frame until it was
+             * restarted, a client that went away is noticed meanwhile
+             */
+            if(!stalled || (f = input_get_frame(pglobal->in[input_number])) == NULL)
+                break;
+        }
 
-        /* check if framebuffer is large enough, increase it if necessary */
-        if(frame_size > max_frame_size) {
-            DBG("increasing buffer size to %d\n", frame_size);
+        metric_observe(self->metrics.latency_pickup, frame_latency(f, NULL));
+        memory_consumer_hold(&mc, f);
 
-            max_frame_size = frame_size + TEN_K;
-            if((tmp = realloc(frame, max_frame_size)) == NULL) {
-                free(frame);
-                pthread_mutex_unlock(&pglobal->in[input_number].db);
-                send_error(context_fd->fd, 500, "not enough memory");
-                return;
-            }
+        /* count the frames this client was too slow for */
+        if(last != 0 && f->sequence > last)
+            skipped += f->sequence - last - 1;
+        last = f->sequence;
 
-            frame = tmp;
+        /* of a static scene only a frame now and then is sent, see -U */
+        if(frame_skip_unchanged(f, &sent)) {
+            metric_add(self->metrics.unchanged, 1);
+            frame_unref(f);
+            continue;
         }
 
-        /* copy v4l2_buffer timeval to user space */
-        timestamp = pglobal->in[input_number].timestamp;
+        if(frame_jpeg(f) != 0) {
+            frame_unref(f);
+            continue;
+        }
 
         #ifdef MANAGMENT
         update_client_timestamp(context_fd->client);
         #endif
 
-        memcpy(frame, pglobal->in[input_number].buf, frame_size);
-        DBG("got frame (size: %d kB)\n", frame_size / 1024);
-
-        pthread_mutex_unlock(&pglobal->in[input_number].db);
+        DBG("got frame (size: %d kB)\n", f->size / 1024);
 
         memset(buffer, 0, 50*sizeof(char));
-        sprintf(buffer, "mjpeg %07d12345", frame_size);
+        sprintf(buffer, "mjpeg %07d12345", f->size);
         DBG("sending intemdiate header\n");
-        if(write(context_fd->fd, buffer, 50) < 0) break;
+        ok = write(context_fd->fd, buffer, 50) >= 0;
 
         DBG("sending frame\n");
-        if(write(context_fd->fd, frame, frame_size) < 0) break;
+        ok = ok && write(context_fd->fd, f->buf, f->size) >= 0;
+        TRACE4(frame_write, self->param.id, input_number, f->sequence, ok);
+        if(ok) {
+            metric_add(self->metrics.frames, 1);
+            metric_add(self->metrics.bytes, f->size);
+            metric_observe(self->metrics.latency_sent, frame_latency(f, NULL));
+        }
+
+        frame_unref(f);
+        if(!ok) break;
     }
 
-    free(frame);
+    metric_add(self->metrics.clients, -1);
+    memory_consumer_remove(&mc);
+    input_consumer_remove(pglobal->in[input_number]);
+    DBG("stream finished, client skipped %u frames\n", skipped);
 }
 #endif
 
@@ -677,6 +785,14 @@ void send_error(int fd, int which, char *message)
                 "\r\n" \
                 "403: Forbidden!\r\n" \
                 "%s", message);
+    } else if(which == 503) {
+        sprintf(buffer, "HTTP/1.0 503 Service Unavailable\r\n" \
+                "Content-type: text/plain\r\n" \
+                STD_HEADER \
+                "Retry-After: 5\r\n" \
+                "\r\n" \
+                "503: Service Unavailable!\r\n" \
+                "%s", message);
     } else {
         sprintf(buffer, "HTTP/1.0 501 Not Implemented\r\n" \
                 "Content-type: text/plain\r\n" \
@@ -706,7 +822,7 @@ void send_file(int id, int fd, char *parameter)
     char buffer[BUFFER_SIZE] = {0};
     char *extension, *mimetype = NULL;
     int i, lfd;
-    config conf = servers[id].conf;
+    config conf = ((context *)pglobal->out[id]->context)->conf;
 
     /* in case no parameter was given */
     if(parameter == NULL || strlen(parameter) == 0)
@@ -792,7 +908,7 @@ void execute_cgi(int id, int fd, char *parameter, char *query_string)
     char *buffer = NULL;
     char fn_buffer[BUFFER_SIZE] = {0};
     FILE *f = NULL;
-    config conf = servers[id].conf;
+    config conf = ((context *)pglobal->out[id]->context)->conf;
 
     /* build the absolute path to the file */
     strncat(fn_buffer, conf.www_folder, sizeof(fn_buffer) - 1);
@@ -981,15 +1097,15 @@ void command(int id, int fd, char *parameter)
 
     switch(dest) {
     case Dest_Input:
-        if(plugin_no < pglobal->incnt) {
-            res = pglobal->in[plugin_no].cmd(plugin_no, command_id, group, ivalue, value);
+        if(plugin_no >= 0 && plugin_no < pglobal->incnt && pglobal->in[plugin_no]->cmd != NULL) {
+            res = pglobal->in[plugin_no]->cmd(plugin_no, command_id, group, ivalue, value);
         } else {
             DBG("Invalid plugin number: %d because only %d input plugins loaded", plugin_no,  pglobal->incnt-1);
         }
         break;
     case Dest_Output:
-        if(plugin_no < pglobal->outcnt) {
-            res = pglobal->out[plugin_no].cmd(plugin_no, command_id, group, ivalue, value);
+        if(plugin_no >= 0 && plugin_no < pglobal->outcnt && pglobal->out[plugin_no]->cmd != NULL) {
+            res = pglobal->out[plugin_no]->cmd(plugin_no, command_id, group, ivalue, value);
         } else {
             DBG("Invalid plugin number: %d because only %d output plugins loaded", plugin_no,  pglobal->incnt-1);
         }
@@ -1015,6 +1131,17 @@ void command(int id, int fd, char *parameter)
     if(svalue != NULL) free(svalue);
 }
 
+/******************************************************************************
+Description.: close the connection of a client
+Input Value.: lcfd is the connected client
+Return Value: -
+******************************************************************************/
+static void close_client(cfd *lcfd)
+{
+    TRACE2(http_client_close, lcfd->pc->id, lcfd->fd);
+    close(lcfd->fd);
+}
+
 /******************************************************************************
 Description.: Serve a connected TCP-client. This thread function is called
               for each connect of a HTTP client like a webbrowser. It determines
@@ -1050,7 +1177,7 @@ void *client_thread(void *arg)
     /* What does the client want to receive? Read the request. */
     memset(buffer, 0, sizeof(buffer));
     if((cnt = _readline(lcfd.fd, &iobuf, buffer, sizeof(buffer) - 1, 5)) == -1) {
-        close(lcfd.fd);
+        close_client(&lcfd);
         return NULL;
     }
 
@@ -1060,6 +1187,16 @@ void *client_thread(void *arg)
     if(strstr(buffer, "GET /?action=snapshot") != NULL) {
         req.type = A_SNAPSHOT;
         query_suffixed = 255;
+
+        /*
+         * optional "at=<timestamp>" selects a frame from the history, the
+         * name must start a parameter so "format=" and the like do not match
+         */
+        if((pb = strstr(buffer, "&at=")) != NULL || (pb = strstr(buffer, "?at=")) != NULL) {
+            pb += strlen("&at=");
+            if((cnt = strspn(pb, "1234567890.")) > 0)
+                req.parameter = strndup(pb, cnt);
+        }
         #ifdef MANAGMENT
         if (check_client_status(lcfd.client)) {
             req.type = A_UNKNOWN;
@@ -1125,7 +1262,7 @@ void *client_thread(void *arg)
         if((pb = strstr(buffer, "GET /?action=take")) == NULL) {
             DBG("HTTP request seems to be malformed\n");
             send_error(lcfd.fd, 400, "Malformed HTTP request");
-            close(lcfd.fd);
+            close_client(&lcfd);
             query_suffixed = 0;
             return NULL;
         }
@@ -1144,7 +1281,7 @@ void *client_thread(void *arg)
             free(req.parameter);
             send_error(lcfd.fd, 500, "could not properly unescape command parameter string");
             LOG("could not properly unescape command parameter string\n");
-            close(lcfd.fd);
+            close_client(&lcfd);
             return NULL;
         }
     } else if((strstr(buffer, "GET /input") != NULL) && (strstr(buffer, ".json") != NULL)) {
@@ -1155,6 +1292,16 @@ void *client_thread(void *arg)
         query_suffixed = 255;
     } else if(strstr(buffer, "GET /program.json") != NULL) {
         req.type = A_PROGRAM_JSON;
+    } else if(strstr(buffer, "GET /metrics") != NULL) {
+        req.type = A_METRICS;
+    } else if(strstr(buffer, "GET /?action=syncstream") != NULL) {
+        /* the suffix is the id of the sync group */
+        req.type = A_SYNC_STREAM;
+        query_suffixed = 255;
+    } else if(strstr(buffer, "GET /?action=sync") != NULL) {
+        /* the suffix is the id of the sync group */
+        req.type = A_SYNC;
+        query_suffixed = 255;
     #ifdef MANAGMENT
     } else if(strstr(buffer, "GET /clients.json") != NULL) {
         req.type = A_CLIENTS_JSON;
@@ -1167,7 +1314,7 @@ void *client_thread(void *arg)
         if((pb = strstr(buffer, "GET /?action=command")) == NULL) {
             DBG("HTTP request seems to be malformed\n");
             send_error(lcfd.fd, 400, "Malformed HTTP request");
-            close(lcfd.fd);
+            close_client(&lcfd);
             return NULL;
         }
         pb += strlen("GET /?action=command"); // a pb points to thestring after the first & after command
@@ -1186,7 +1333,7 @@ void *client_thread(void *arg)
             free(req.parameter);
             send_error(lcfd.fd, 500, "could not properly unescape command parameter string");
             LOG("could not properly unescape command parameter string\n");
-            close(lcfd.fd);
+            close_client(&lcfd);
             return NULL;
         }
 
@@ -1200,7 +1347,7 @@ void *client_thread(void *arg)
         if((pb = strstr(buffer, "GET /")) == NULL) {
             DBG("HTTP request seems to be malformed\n");
             send_error(lcfd.fd, 400, "Malformed HTTP request");
-            close(lcfd.fd);
+            close_client(&lcfd);
             return NULL;
         }
 
@@ -1243,11 +1390,8 @@ void *client_thread(void *arg)
     if(query_suffixed) {
         char *sch = strchr(buffer, '_');
         if(sch != NULL) {  // there is an _ in the url so the input number should be present
-            DBG("Suffix character: %s\n", sch + 1); // FIXME if more than 10 input plugin is added
-            char numStr[3];
-            memset(numStr, 0, 3);
-            strncpy(numStr, sch + 1, 1);
-            input_number = atoi(numStr);
+            DBG("Suffix character: %s\n", sch + 1);
+            input_number = atoi(sch + 1);
 
             if ((req.type == A_SNAPSHOT_WXP) || (req.type == A_STREAM_WXP)) { // webcamxp adds offset to the camera number
                 input_number--;
@@ -1265,7 +1409,7 @@ void *client_thread(void *arg)
 
         if((cnt = _readline(lcfd.fd, &iobuf, buffer, sizeof(buffer) - 1, 5)) == -1) {
             free_request(&req);
-            close(lcfd.fd);
+            close_client(&lcfd);
             return NULL;
         }
 
@@ -1284,7 +1428,7 @@ void *client_thread(void *arg)
         if(req.credentials == NULL || strcmp(lcfd.pc->conf.credentials, req.credentials) != 0) {
             DBG("access denied\n");
             send_error(lcfd.fd, 401, "username and password do not match to configuration");
-            close(lcfd.fd);
+            close_client(&lcfd);
             free_request(&req);
             return NULL;
         }
@@ -1294,13 +1438,19 @@ void *client_thread(void *arg)
     /* now it's time to answer */
     if (query_suffixed) {
         if (req.type == A_OUTPUT_JSON) {
-            if(!(input_number < pglobal->outcnt)) {
+            if(input_number < 0 || !(input_number < pglobal->outcnt)) {
                 DBG("Output number: %d out of range (valid: 0..%d)\n", input_number, pglobal->outcnt-1);
                 send_error(lcfd.fd, 404, "Invalid output plugin number");
                 req.type = A_UNKNOWN;
             }
+        } else if (req.type == A_SYNC || req.type == A_SYNC_STREAM) {
+            if(input_number < 0 || !(input_number < pglobal->synccnt)) {
+                DBG("Sync group: %d out of range (valid: 0..%d)\n", input_number, pglobal->synccnt-1);
+                send_error(lcfd.fd, 404, "Invalid sync group number");
+                req.type = A_UNKNOWN;
+            }
         } else {
-            if(!(input_number < pglobal->incnt)) {
+            if(input_number < 0 || !(input_number < pglobal->incnt)) {
                 DBG("Input number: %d out of range (valid: 0..%d)\n", input_number, pglobal->incnt-1);
                 send_error(lcfd.fd, 404, "Invalid input plugin number");
                 req.type = A_UNKNOWN;
@@ -1312,7 +1462,7 @@ void *client_thread(void *arg)
     case A_SNAPSHOT_WXP:
     case A_SNAPSHOT:
         DBG("Request for snapshot from input: %d\n", input_number);
-        send_snapshot(&lcfd, input_number);
+        send_snapshot(&lcfd, input_number, req.parameter);
         break;
     case A_STREAM:
         DBG("Request for stream from input: %d\n", input_number);
@@ -1343,6 +1493,18 @@ void *client_thread(void *arg)
         DBG("Request for the program descriptor JSON file\n");
         send_program_JSON(lcfd.fd);
         break;
+    case A_METRICS:
+        DBG("Request for the metrics\n");
+        send_metrics(lcfd.fd);
+        break;
+    case A_SYNC:
+        DBG("Request for the frame set of sync group: %d\n", input_number);
+        send_sync(lcfd.fd, input_number);
+        break;
+    case A_SYNC_STREAM:
+        DBG("Request for the frame set stream of sync group: %d\n", input_number);
+        send_sync_stream(&lcfd, input_number);
+        break;
     #ifdef MANAGMENT
     case A_CLIENTS_JSON:
         DBG("Request for the clients JSON file\n");
@@ -1363,8 +1525,8 @@ void *client_thread(void *arg)
     case A_TAKE: {
         int i, ret = 0, found = 0;
         for (i = 0; i<pglobal->outcnt; i++) {
-            if (pglobal->out[i].name != NULL) {
-                if (strstr(pglobal->out[i].name, "FILE output plugin")) {
+            if (pglobal->out[i]->name != NULL && pglobal->out[i]->cmd != NULL) {
+                if (strstr(pglobal->out[i]->name, "FILE output plugin")) {
                     found = 255;
                     DBG("output_file found id: %d\n", i);
                     char *filename = NULL;
@@ -1382,7 +1544,7 @@ void *client_thread(void *arg)
                         memcpy(filenamearg, filename, len);
                         DBG("Filename = %s\n", filenamearg);
                         //int output_cmd(int plugin_id, unsigned int control_id, unsigned int group, int value, char *valueStr)
-                        ret = pglobal->out[i].cmd(i, OUT_FILE_CMD_TAKE, IN_CMD_GENERIC, 0, filenamearg);
+                        ret = pglobal->out[i]->cmd(i, OUT_FILE_CMD_TAKE, IN_CMD_GENERIC, 0, filenamearg);
                     } else {
                         DBG("filename is not specified int the URL\n");
                         send_error(lcfd.fd, 404, "The &filename= must present for the take command in the URL");
@@ -1397,7 +1559,7 @@ void *client_thread(void *arg)
             send_error(lcfd.fd, 404, "FILE output plugin not loaded, taking snapshot not possible");
         } else {
             if (ret == 0) {
-                send_snapshot(&lcfd, input_number);
+                send_snapshot(&lcfd, input_number, NULL);
             } else {
                 send_error(lcfd.fd, 404, "Taking snapshot failed!");
             }
@@ -1411,7 +1573,7 @@ void *client_thread(void *arg)
         DBG("unknown request\n");
     }
 
-    close(lcfd.fd);
+    close_client(&lcfd);
     free_request(&req);
 
     DBG("leaving HTTP client thread\n");
@@ -1570,12 +1732,13 @@ void *server_thread(void *arg)
             if(pcontext->sd[i] != -1 && FD_ISSET(pcontext->sd[i], &selectfds)) {
                 pcfd->fd = accept(pcontext->sd[i], (struct sockaddr *)&client_addr, &addr_len);
                 pcfd->pc = pcontext;
+                TRACE2(http_client_accept, pcontext->id, pcfd->fd);
 
                 /* start new thread that will handle this TCP connected client */
                 DBG("create thread to handle client that just established a connection\n");
 
                 if(getnameinfo((struct sockaddr *)&client_addr, addr_len, name, sizeof(name), NULL, 0, NI_NUMERICHOST) == 0) {
-                    syslog(LOG_INFO, "serving client: %s\n", name);
+                    log_event(LOGLEVEL_INFO, "http_client", "output=%d client=%s", pcontext->id, name);
                     DBG("serving client: %s\n", name);
                 }
 
@@ -1583,7 +1746,7 @@ void *server_thread(void *arg)
                 pcfd->client = add_client(name);
                 #endif
 
-                if(pthread_create(&client, NULL, &client_thread, pcfd) != 0) {
+                if(thread_create(&client, &pglobal->out[pcontext->id]->threads, "httpd-client", pcontext->id, &client_thread, pcfd) != 0) {
                     DBG("could not launch another client thread\n");
                     close(pcfd->fd);
                     free(pcfd);
@@ -1621,25 +1784,25 @@ void send_input_JSON(int fd, int input_number)
     sprintf(buffer + strlen(buffer),
             "{\n"
             "\"controls\": [\n");
-    if(pglobal->in[input_number].in_parameters != NULL) {
-        for(i = 0; i < pglobal->in[input_number].parametercount; i++) {
+    if(pglobal->in[input_number]->in_parameters != NULL) {
+        for(i = 0; i < pglobal->in[input_number]->parametercount; i++) {
 
             char *menuString = NULL;
-            if(pglobal->in[input_number].in_parameters[i].ctrl.type == V4L2_CTRL_TYPE_MENU) {
-                if(pglobal->in[input_number].in_parameters[i].menuitems != NULL) {
+            if(pglobal->in[input_number]->in_parameters[i].ctrl.type == V4L2_CTRL_TYPE_MENU) {
+                if(pglobal->in[input_number]->in_parameters[i].menuitems != NULL) {
                     int j, k = 1;
-                    for(j = pglobal->in[input_number].in_parameters[i].ctrl.minimum; j <= pglobal->in[input_number].in_parameters[i].ctrl.maximum; j++) {
+                    for(j = pglobal->in[input_number]->in_parameters[i].ctrl.minimum; j <= pglobal->in[input_number]->in_parameters[i].ctrl.maximum; j++) {
                         char *tempName = NULL; // temporary storage for name sanity checking
 
                         int prevSize = 0;
-                        int itemLength = strlen((char*)&pglobal->in[input_number].in_parameters[i].menuitems[j].name);
+                        int itemLength = strlen((char*)&pglobal->in[input_number]->in_parameters[i].menuitems[j].name);
                         tempName = (char*)calloc(itemLength + 1, sizeof(char));  // allocate space for the sanity checking
                         if (tempName == NULL) {
                             DBG("Realloc/calloc failed: %s\n", strerror(errno));
                             return;
                         }
 
-                        check_JSON_string((char*)&pglobal->in[input_number].in_parameters[i].menuitems[j].name, tempName); // sanity check the string after non printable characters
+                        check_JSON_string((char*)&pglobal->in[input_number]->in_parameters[i].menuitems[j].name, tempName); // sanity check the string after non printable characters
 
                         itemLength += strlen("\"\": \"\"");
 
@@ -1655,7 +1818,7 @@ void send_input_JSON(int fd, int input_number)
                         }
                         prevSize = strlen(menuString);
 
-                        if(j != pglobal->in[input_number].in_parameters[i].ctrl.maximum) {
+                        if(j != pglobal->in[input_number]->in_parameters[i].ctrl.maximum) {
                             sprintf(menuString + prevSize, "\"%d\": \"%s\", ", j , tempName);
                         } else {
                             sprintf(menuString + prevSize, "\"%d\": \"%s\"", j , tempName);
@@ -1679,21 +1842,21 @@ void send_input_JSON(int fd, int input_number)
                     "\"dest\": \"0\",\n"
                     "\"flags\": \"%d\",\n"
                     "\"group\": \"%d\"",
-                    pglobal->in[input_number].in_parameters[i].ctrl.name,
-                    pglobal->in[input_number].in_parameters[i].ctrl.id,
-                    pglobal->in[input_number].in_parameters[i].ctrl.type,
-                    pglobal->in[input_number].in_parameters[i].ctrl.minimum,
-                    pglobal->in[input_number].in_parameters[i].ctrl.maximum,
-                    pglobal->in[input_number].in_parameters[i].ctrl.step,
-                    pglobal->in[input_number].in_parameters[i].ctrl.default_value,
-                    pglobal->in[input_number].in_parameters[i].value,
+                    pglobal->in[input_number]->in_parameters[i].ctrl.name,
+                    pglobal->in[input_number]->in_parameters[i].ctrl.id,
+                    pglobal->in[input_number]->in_parameters[i].ctrl.type,
+                    pglobal->in[input_number]->in_parameters[i].ctrl.minimum,
+                    pglobal->in[input_number]->in_parameters[i].ctrl.maximum,
+                    pglobal->in[input_number]->in_parameters[i].ctrl.step,
+                    pglobal->in[input_number]->in_parameters[i].ctrl.default_value,
+                    pglobal->in[input_number]->in_parameters[i].value,
                     // 0 is the code of the input plugin
-                    pglobal->in[input_number].in_parameters[i].ctrl.flags,
-                    pglobal->in[input_number].in_parameters[i].group
+                    pglobal->in[input_number]->in_parameters[i].ctrl.flags,
+                    pglobal->in[input_number]->in_parameters[i].group
                    );
 
             // append the menu object to the menu typecontrols
-            if(pglobal->in[input_number].in_parameters[i].ctrl.type == V4L2_CTRL_TYPE_MENU) {
+            if(pglobal->in[input_number]->in_parameters[i].ctrl.type == V4L2_CTRL_TYPE_MENU) {
                 sprintf(buffer + strlen(buffer),
                         ",\n"
                         "\"menu\": {%s}\n"
@@ -1705,7 +1868,7 @@ void send_input_JSON(int fd, int input_number)
                         "}");
             }
 
-            if(i != (pglobal->in[input_number].parametercount - 1)) {
+            if(i != (pglobal->in[input_number]->parametercount - 1)) {
                 sprintf(buffer + strlen(buffer), ",\n");
             }
             free(menuString);
@@ -1720,23 +1883,23 @@ void send_input_JSON(int fd, int input_number)
     sprintf(buffer + strlen(buffer),
             //"{\n"
             "\"formats\": [\n");
-    if(pglobal->in[input_number].in_formats != NULL) {
-        for(i = 0; i < pglobal->in[input_number].formatCount; i++) {
+    if(pglobal->in[input_number]->in_formats != NULL) {
+        for(i = 0; i < pglobal->in[input_number]->formatCount; i++) {
             char *resolutionsString = NULL;
             int resolutionsStringLength = 0;
             int j = 0;
-            for(j = 0; j < pglobal->in[input_number].in_formats[i].resolutionCount; j++) {
+            for(j = 0; j < pglobal->in[input_number]->in_formats[i].resolutionCount; j++) {
                 char buffer_num[6];
                 memset(buffer_num, '\0', 6);
                 // JSON format example:
                 // {"0": "320x240", "1": "640x480", "2": "960x720"}
                 sprintf(buffer_num, "%d", j);
                 resolutionsStringLength += strlen(buffer_num);
-                sprintf(buffer_num, "%d", pglobal->in[input_number].in_formats[i].supportedResolutions[j].width);
+                sprintf(buffer_num, "%d", pglobal->in[input_number]->in_formats[i].supportedResolutions[j].width);
                 resolutionsStringLength += strlen(buffer_num);
-                sprintf(buffer_num, "%d", pglobal->in[input_number].in_formats[i].supportedResolutions[j].height);
+                sprintf(buffer_num, "%d", pglobal->in[input_number]->in_formats[i].supportedResolutions[j].height);
                 resolutionsStringLength += strlen(buffer_num);
-                if(j != (pglobal->in[input_number].in_formats[i].resolutionCount - 1)) {
+                if(j != (pglobal->in[input_number]->in_formats[i].resolutionCount - 1)) {
                     resolutionsStringLength += (strlen("\"\": \"x\", ") + 5);
                     if (resolutionsString == NULL)
                         resolutionsString = calloc(resolutionsStringLength, sizeof(char*));
@@ -1750,8 +1913,8 @@ void send_input_JSON(int fd, int input_number)
                     sprintf(resolutionsString + strlen(resolutionsString),
                             "\"%d\": \"%dx%d\", ",
                             j,
-                            pglobal->in[input_number].in_formats[i].supportedResolutions[j].width,
-                            pglobal->in[input_number].in_formats[i].supportedResolutions[j].height);
+                            pglobal->in[input_number]->in_formats[i].supportedResolutions[j].width,
+                            pglobal->in[input_number]->in_formats[i].supportedResolutions[j].height);
                 } else {
                     resolutionsStringLength += (strlen("\"\": \"x\"")+5);
                     if (resolutionsString == NULL)
@@ -1765,8 +1928,8 @@ void send_input_JSON(int fd, int input_number)
                     sprintf(resolutionsString + strlen(resolutionsString),
                             "\"%d\": \"%dx%d\"",
                             j,
-                            pglobal->in[input_number].in_formats[i].supportedResolutions[j].width,
-                            pglobal->in[input_number].in_formats[i].supportedResolutions[j].height);
+                            pglobal->in[input_number]->in_formats[i].supportedResolutions[j].width,
+                            pglobal->in[input_number]->in_formats[i].supportedResolutions[j].height);
                 }
             }
 
@@ -1783,26 +1946,26 @@ void send_input_JSON(int fd, int input_number)
                     "\"current\": \"%s\",\n"
                     "\"resolutions\": {%s}\n"
                     ,
-                    pglobal->in[input_number].in_formats[i].format.index,
-                    pglobal->in[input_number].in_formats[i].format.description,
+                    pglobal->in[input_number]->in_formats[i].format.index,
+                    pglobal->in[input_number]->in_formats[i].format.description,
 #ifdef V4L2_FMT_FLAG_COMPRESSED
-                    pglobal->in[input_number].in_formats[i].format.flags & V4L2_FMT_FLAG_COMPRESSED ? "true" : "false",
+                    pglobal->in[input_number]->in_formats[i].format.flags & V4L2_FMT_FLAG_COMPRESSED ? "true" : "false",
 #endif
 #ifdef V4L2_FMT_FLAG_EMULATED
-                    pglobal->in[input_number].in_formats[i].format.flags & V4L2_FMT_FLAG_EMULATED ? "true" : "false",
+                    pglobal->in[input_number]->in_formats[i].format.flags & V4L2_FMT_FLAG_EMULATED ? "true" : "false",
 #endif
-                    pglobal->in[input_number].in_formats[i].currentResolution != -1 ? "true" : "false",
+                    pglobal->in[input_number]->in_formats[i].currentResolution != -1 ? "true" : "false",
                     resolutionsString
                    );
 
-            if(pglobal->in[input_number].in_formats[i].currentResolution != -1) {
+            if(pglobal->in[input_number]->in_formats[i].currentResolution != -1) {
                 sprintf(buffer + strlen(buffer),
                         ",\n\"currentResolution\": \"%d\"\n",
-                        pglobal->in[input_number].in_formats[i].currentResolution
+                        pglobal->in[input_number]->in_formats[i].currentResolution
                        );
             }
 
-            if(i != (pglobal->in[input_number].formatCount - 1)) {
+            if(i != (pglobal->in[input_number]->formatCount - 1)) {
                 sprintf(buffer + strlen(buffer), "},\n");
             } else {
                 sprintf(buffer + strlen(buffer), "}\n");
@@ -1848,10 +2011,10 @@ void send_program_JSON(int fd)
                 "\"plugin\": \"%s\",\n"
                 "\"args\": \"%s\"\n"
                 "}",
-                pglobal->in[k].param.id,
-                pglobal->in[k].name,
-                pglobal->in[k].plugin,
-                pglobal->in[k].param.parameters);
+                pglobal->in[k]->param.id,
+                pglobal->in[k]->name,
+                pglobal->in[k]->plugin,
+                pglobal->in[k]->param.parameters);
         if(k != (pglobal->incnt - 1))
             sprintf(buffer + strlen(buffer), ", \n");
         else
@@ -1872,10 +2035,10 @@ void send_program_JSON(int fd)
                 "\"plugin\": \"%s\",\n"
                 "\"args\": \"%s\"\n"
                 "}",
-                pglobal->out[k].param.id,
-                pglobal->out[k].name,
-                pglobal->out[k].plugin,
-                pglobal->out[k].param.parameters);
+                pglobal->out[k]->param.id,
+                pglobal->out[k]->name,
+                pglobal->out[k]->plugin,
+                pglobal->out[k]->param.parameters);
         if(k != (pglobal->outcnt - 1))
             sprintf(buffer + strlen(buffer), ", \n");
         else
@@ -1913,6 +2076,147 @@ void check_JSON_string(char *source, char *destination)
     }
 }
 
+/******************************************************************************
+Description.: Send the metrics of all plugins in the Prometheus text format
+Input Value.: fildescriptor fd to send the answer to
+Return Value: -
+******************************************************************************/
+void send_metrics(int fd)
+{
+    char buffer[BUFFER_SIZE] = {0};
+    char *text;
+    size_t size;
+
+    if((text = metrics_render(&size)) == NULL) {
+        send_error(fd, 500, "could not render the metrics");
+        return;
+    }
+
+    sprintf(buffer, "HTTP/1.0 200 OK\r\n" \
+            "Content-type: text/plain; version=0.0.4\r\n" \
+            STD_HEADER \
+            "\r\n");
+
+    if(write(fd, buffer, strlen(buffer)) >= 0)
+        write(fd, text, size);
+
+    free(text);
+}
+
+/******************************************************************************
+Description.: Send the newest complete frame set of a sync group as JSON. The
+              frames can be fetched with ?action=snapshot_<input>&at=<timestamp>
+              as long as they are in the history of their input
+Input Value.: fd is the file descriptor to send the answer to
+              group is the id of the sync group
+Return Value: -
+******************************************************************************/
+void send_sync(int fd, int group)
+{
+    char buffer[BUFFER_SIZE * 2] = {0};
+    frame_set set;
+    int i;
+
+    if(sync_get_set(pglobal->sync[group], &set) != 0) {
+        send_error(fd, 404, "no complete frame set yet");
+        return;
+    }
+
+    sprintf(buffer, "HTTP/1.0 200 OK\r\n" \
+            "Content-type: %s\r\n" \
+            STD_HEADER \
+            "\r\n", "application/json");
+
+    sprintf(buffer + strlen(buffer),
+            "{\n"
+            "\"group\": %d,\n"
+            "\"sequence\": %u,\n"
+            "\"spread\": %.6f,\n"
+            "\"frames\": [\n", group, set.sequence, set.spread / 1e6);
+
+    for(i = 0; i < set.count; i++) {
+        sprintf(buffer + strlen(buffer),
+                "{\"input\": %d, \"sequence\": %u, \"timestamp\": \"%ld.%06ld\"}%s\n",
+                pglobal->sync[group]->inputs[i], set.frames[i]->sequence,
+                (long)set.frames[i]->timestamp.tv_sec, (long)set.frames[i]->timestamp.tv_usec,
+                (i + 1 < set.count) ? "," : "");
+    }
+    sprintf(buffer + strlen(buffer), "]\n}\n");
+
+    frame_set_release(&set);
+
+    if(write(fd, buffer, strlen(buffer)) < 0) {
+        DBG("unable to serve the frame set\n");
+    }
+}
+
+/******************************************************************************
+Description.: Send a stream of the complete frame sets of a sync group. Every
+              set is sent as one part per member, in the order of the group,
+              X-Input and X-Set tell them apart. The frames are referenced
+              by the set while they are sent, so unlike send_sync() they
+              can not leave the history in between
+Input Value.: context_fd is the context of the client
+              group is the id of the sync group
+Return Value: -
+******************************************************************************/
+void send_sync_stream(cfd *context_fd, int group)
+{
+    sync_group *g = pglobal->sync[group];
+    output *self = pglobal->out[context_fd->pc->id];
+    char buffer[BUFFER_SIZE] = {0};
+    frame_set set;
+    frame *f;
+    unsigned int last = 0;
+    int i, ok = 1;
+
+    sprintf(buffer, "HTTP/1.0 200 OK\r\n" \
+            "Access-Control-Allow-Origin: *\r\n" \
+            STD_HEADER \
+            "Content-Type: multipart/x-mixed-replace;boundary=" BOUNDARY "\r\n" \
+            "\r\n" \
+            "--" BOUNDARY "\r\n");
+
+    if(write(context_fd->fd, buffer, strlen(buffer)) < 0) {
+        return;
+    }
+
+    metric_add(self->metrics.clients, 1);
+    while(ok && !pglobal->stop && sync_wait_set(g, last, &set) == 0) {
+        last = set.sequence;
+
+        for(i = 0; ok && i < set.count; i++) {
+            f = set.frames[i];
+            if(frame_jpeg(f) != 0) {
+                DBG("could not encode the frame of input %d\n", g->inputs[i]);
+                continue;
+            }
+
+            sprintf(buffer, "Content-Type: image/jpeg\r\n" \
+                    "Content-Length: %d\r\n" \
+                    "X-Timestamp: %d.%06d\r\n" \
+                    "X-Input: %d\r\n" \
+                    "X-Set: %u\r\n" \
+                    "\r\n", f->size, (int)f->timestamp.tv_sec, (int)f->timestamp.tv_usec,
+                    g->inputs[i], set.sequence);
+            ok = write(context_fd->fd, buffer, strlen(buffer)) >= 0 &&
+                 write(context_fd->fd, f->buf, f->size) >= 0;
+            if(ok) {
+                metric_add(self->metrics.frames, 1);
+                metric_add(self->metrics.bytes, f->size);
+            }
+
+            sprintf(buffer, "\r\n--" BOUNDARY "\r\n");
+            ok = ok && write(context_fd->fd, buffer, strlen(buffer)) >= 0;
+        }
+
+        frame_set_release(&set);
+    }
+    metric_add(self->metrics.clients, -1);
+
+    DBG("frame set stream of group %d finished after set %u\n", group, last);
+}
+
 /******************************************************************************
 Description.: Send a JSON file which is contains information about the output plugin's
               acceptable parameters
@@ -1933,15 +2237,15 @@ void send_output_JSON(int fd, int input_number)
     sprintf(buffer + strlen(buffer),
             "{\n"
             "\"controls\": [\n");
-    if(pglobal->out[input_number].out_parameters != NULL) {
-        for(i = 0; i < pglobal->out[input_number].parametercount; i++) {
+    if(pglobal->out[input_number]->out_parameters != NULL) {
+        for(i = 0; i < pglobal->out[input_number]->parametercount; i++) {
             char *menuString = calloc(0, 0);
-            if(pglobal->out[input_number].out_parameters[i].ctrl.type == V4L2_CTRL_TYPE_MENU) {
-                if(pglobal->out[input_number].out_parameters[i].menuitems != NULL) {
+            if(pglobal->out[input_number]->out_parameters[i].ctrl.type == V4L2_CTRL_TYPE_MENU) {
+                if(pglobal->out[input_number]->out_parameters[i].menuitems != NULL) {
                     int j, k = 1;
-                    for(j = pglobal->out[input_number].out_parameters[i].ctrl.minimum; j <= pglobal->out[input_number].out_parameters[i].ctrl.maximum; j++) {
+                    for(j = pglobal->out[input_number]->out_parameters[i].ctrl.minimum; j <= pglobal->out[input_number]->out_parameters[i].ctrl.maximum; j++) {
                         int prevSize = strlen(menuString);
-                        int itemLength = strlen((char*)&pglobal->out[input_number].out_parameters[i].menuitems[j].name)  + strlen("\"\": \"\"");
+                        int itemLength = strlen((char*)&pglobal->out[input_number]->out_parameters[i].menuitems[j].name)  + strlen("\"\": \"\"");
                         if (menuString == NULL) {
                             menuString = calloc(itemLength, sizeof(char));
                         } else {
@@ -1953,10 +2257,10 @@ void send_output_JSON(int fd, int input_number)
                             return;
                         }
 
-                        if(j != pglobal->out[input_number].out_parameters[i].ctrl.maximum) {
-                            sprintf(menuString + prevSize, "\"%d\": \"%s\", ", j , (char*)&pglobal->out[input_number].out_parameters[i].menuitems[j].name);
+                        if(j != pglobal->out[input_number]->out_parameters[i].ctrl.maximum) {
+                            sprintf(menuString + prevSize, "\"%d\": \"%s\", ", j , (char*)&pglobal->out[input_number]->out_parameters[i].menuitems[j].name);
                         } else {
-                            sprintf(menuString + prevSize, "\"%d\": \"%s\"", j , (char*)&pglobal->out[input_number].out_parameters[i].menuitems[j].name);
+                            sprintf(menuString + prevSize, "\"%d\": \"%s\"", j , (char*)&pglobal->out[input_number]->out_parameters[i].menuitems[j].name);
                         }
                         k++;
                     }
@@ -1976,20 +2280,20 @@ void send_output_JSON(int fd, int input_number)
                     "\"dest\": \"1\",\n"
                     "\"flags\": \"%d\",\n"
                     "\"group\": \"%d\"",
-                    pglobal->out[input_number].out_parameters[i].ctrl.name,
-                    pglobal->out[input_number].out_parameters[i].ctrl.id,
-                    pglobal->out[input_number].out_parameters[i].ctrl.type,
-                    pglobal->out[input_number].out_parameters[i].ctrl.minimum,
-                    pglobal->out[input_number].out_parameters[i].ctrl.maximum,
-                    pglobal->out[input_number].out_parameters[i].ctrl.step,
-                    pglobal->out[input_number].out_parameters[i].ctrl.default_value,
-                    pglobal->out[input_number].out_parameters[i].value,
+                    pglobal->out[input_number]->out_parameters[i].ctrl.name,
+                    pglobal->out[input_number]->out_parameters[i].ctrl.id,
+                    pglobal->out[input_number]->out_parameters[i].ctrl.type,
+                    pglobal->out[input_number]->out_parameters[i].ctrl.minimum,
+                    pglobal->out[input_number]->out_parameters[i].ctrl.maximum,
+                    pglobal->out[input_number]->out_parameters[i].ctrl.step,
+                    pglobal->out[input_number]->out_parameters[i].ctrl.default_value,
+                    pglobal->out[input_number]->out_parameters[i].value,
                     // 1 is the code of the output plugin
-                    pglobal->out[input_number].out_parameters[i].ctrl.flags,
-                    pglobal->out[input_number].out_parameters[i].group
+                    pglobal->out[input_number]->out_parameters[i].ctrl.flags,
+                    pglobal->out[input_number]->out_parameters[i].group
                    );
 
-            if(pglobal->out[input_number].out_parameters[i].ctrl.type == V4L2_CTRL_TYPE_MENU) {
+            if(pglobal->out[input_number]->out_parameters[i].ctrl.type == V4L2_CTRL_TYPE_MENU) {
                 sprintf(buffer + strlen(buffer),
                         ",\n"
                         "\"menu\": {%s}\n"
@@ -2001,7 +2305,7 @@ void send_output_JSON(int fd, int input_number)
                         "}");
             }
 
-            if(i != (pglobal->out[input_number].parametercount - 1)) {
+            if(i != (pglobal->out[input_number]->parametercount - 1)) {
                 sprintf(buffer + strlen(buffer), ",\n");
             }
             free(menuString);
@@ -95,6 +95,9 @@ typedef enum {
     A_INPUT_JSON,
     A_OUTPUT_JSON,
     A_PROGRAM_JSON,
+    A_METRICS,
+    A_SYNC,
+    A_SYNC_STREAM,
     #ifdef MANAGMENT
     A_CLIENTS_JSON
     #endif
@@ -176,6 +179,9 @@ void send_error(int fd, int which, char *message);
 void send_output_JSON(int fd, int plugin_number);
 void send_input_JSON(int fd, int plugin_number);
 void send_program_JSON(int fd);
+void send_metrics(int fd);
+void send_sync(int fd, int group);
+void send_sync_stream(cfd *context_fd, int group);
 void check_JSON_string(char *source, char *destination);
 
 #ifdef MANAGMENT
@@ -42,10 +42,7 @@
 #include "httpd.h"
 
 #define OUTPUT_PLUGIN_NAME "HTTP output plugin"
-/*
- * keep context for each server
- */
-context servers[MAX_OUTPUT_PLUGINS];
+static globals *pglobal;
 
 /******************************************************************************
 Description.: print help for this plugin to stdout
@@ -82,6 +79,7 @@ int output_init(output_parameter *param, int id)
     int  port;
     char *credentials, *www_folder;
     char nocommands;
+    context *server;
 
     DBG("output #%02d\n", param->id);
 
@@ -168,20 +166,27 @@ int output_init(output_parameter *param, int id)
         }
     }
 
-    servers[param->id].id = param->id;
-    servers[param->id].pglobal = param->global;
-    servers[param->id].conf.port = port;
-    servers[param->id].conf.credentials = credentials;
-    servers[param->id].conf.www_folder = www_folder;
-    servers[param->id].conf.nocommands = nocommands;
+    /* keep context for each server, it is not freed as client threads may still use it */
+    if((server = calloc(1, sizeof(context))) == NULL) {
+        OPRINT("could not allocate memory\n");
+        return 1;
+    }
+    pglobal = param->global;
+    server->id = param->id;
+    server->pglobal = param->global;
+    server->conf.port = port;
+    server->conf.credentials = credentials;
+    server->conf.www_folder = www_folder;
+    server->conf.nocommands = nocommands;
+    param->global->out[id]->context = server;
 
     OPRINT("www-folder-path...: %s\n", (www_folder == NULL) ? "disabled" : www_folder);
     OPRINT("HTTP TCP port.....: %d\n", ntohs(port));
     OPRINT("username:password.: %s\n", (credentials == NULL) ? "disabled" : credentials);
     OPRINT("commands..........: %s\n", (nocommands) ? "disabled" : "enabled");
 
-    param->global->out[id].name = malloc((strlen(OUTPUT_PLUGIN_NAME) + 1) * sizeof(char));
-    sprintf(param->global->out[id].name, OUTPUT_PLUGIN_NAME);
+    param->global->out[id]->name = malloc((strlen(OUTPUT_PLUGIN_NAME) + 1) * sizeof(char));
+    sprintf(param->global->out[id]->name, OUTPUT_PLUGIN_NAME);
 
     return 0;
 }
@@ -196,9 +201,10 @@ Return Value: always 0
 ******************************************************************************/
 int output_stop(int id)
 {
+    context *server = pglobal->out[id]->context;
 
     DBG("will cancel server thread #%02d\n", id);
-    pthread_cancel(servers[id].threadID);
+    pthread_cancel(server->threadID);
 
     return 0;
 }
@@ -210,11 +216,13 @@ Return Value: always 0
 ******************************************************************************/
 int output_run(int id)
 {
+    context *server = pglobal->out[id]->context;
+
     DBG("launching server thread #%02d\n", id);
 
     /* create thread and pass context to thread function */
-    pthread_create(&(servers[id].threadID), NULL, server_thread, &(servers[id]));
-    pthread_detach(servers[id].threadID);
+    thread_create(&(server->threadID), &pglobal->out[id]->threads, "httpd", id, server_thread, server);
+    pthread_detach(server->threadID);
 
     return 0;
 }
@@ -65,8 +65,8 @@ enum RTSP_State {
 
 static pthread_t worker;
 static globals *pglobal;
-static int fd, max_frame_size;
-static unsigned char *frame = NULL;
+static int fd;
+static frame *current = NULL;
 static char *command = NULL;
 static int input_number = 0;
 
@@ -106,9 +106,8 @@ void worker_cleanup(void *arg)
     first_run = 0;
     OPRINT("cleaning up resources allocated by worker thread\n");
 
-    if(frame != NULL) {
-        free(frame);
-    }
+    frame_unref(current);
+    current = NULL;
     close(fd);
 }
 
@@ -120,9 +119,9 @@ Return Value:
 ******************************************************************************/
 void *worker_thread(void *arg)
 {
-    int ok = 1, frame_size = 0, rc = 0;
+    int ok = 1, rc = 0;
+    frame *f;
     char buffer1[1024] = {0};
-    unsigned char *tmp_framebuffer = NULL;
 
     /* set cleanup handler to cleanup allocated resources */
     pthread_cleanup_push(worker_cleanup, NULL);
@@ -157,32 +156,17 @@ void *worker_thread(void *arg)
 
 
         DBG("waiting for fresh frame\n");
-        pthread_mutex_lock(&pglobal->in[input_number].db);
-        pthread_cond_wait(&pglobal->in[input_number].db_update, &pglobal->in[input_number].db);
-
-        /* read buffer */
-        frame_size = pglobal->in[input_number].size;
-
-        /* check if buffer for frame is large enough, increase it if necessary */
-        if(frame_size > max_frame_size) {
-            DBG("increasing buffer size to %d\n", frame_size);
-
-            max_frame_size = frame_size + (1 << 16);
-            if((tmp_framebuffer = realloc(frame, max_frame_size)) == NULL) {
-                pthread_mutex_unlock(&pglobal->in[input_number].db);
-                LOG("not enough memory\n");
-                return NULL;
-            }
+        f = input_wait_frame(pglobal->in[input_number], (current != NULL) ? current->sequence : 0);
+        if(f == NULL)
+            break;
+        frame_unref(current);
+        current = f;
 
-            frame = tmp_framebuffer;
+        if(frame_jpeg(current) != 0) {
+            DBG("could not encode the frame\n");
+            continue;
         }
 
-        /* copy frame to our local buffer now */
-        memcpy(frame, pglobal->in[input_number].buf, frame_size);
-
-        /* allow others to access the global buffer again */
-        pthread_mutex_unlock(&pglobal->in[input_number].db);
-
         /* only save a file if a name came in with the UDP message */
         if(strlen(udpbuffer) > 0) {
             DBG("writing file: %s\n", udpbuffer);
@@ -194,7 +178,7 @@ void *worker_thread(void *arg)
             }
 
             /* save picture to file */
-            if(write(fd, frame, frame_size) < 0) {
+            if(write(fd, current->buf, current->size) < 0) {
                 OPRINT("could not write to file %s\n", udpbuffer);
                 perror("write()");
                 close(fd);
@@ -308,7 +292,7 @@ int output_init(output_parameter *param)
         return 1;
     }
 
-    OPRINT("input plugin.....: %d: %s\n", input_number, pglobal->in[input_number].plugin);
+    OPRINT("input plugin.....: %d: %s\n", input_number, pglobal->in[input_number]->plugin);
     OPRINT("UDP port..........: %d\n", port);
     return 0;
 }
@@ -322,6 +306,7 @@ int output_stop(int id)
 {
     DBG("will cancel worker thread\n");
     pthread_cancel(worker);
+    input_consumer_remove(pglobal->in[input_number]);
     return 0;
 }
 
@@ -332,8 +317,11 @@ Return Value: always 0
 ******************************************************************************/
 int output_run(int id)
 {
+    /* requests may come at any time, keep the input capturing, see -L */
+    input_consumer_add(pglobal->in[input_number]);
+
     DBG("launching worker thread\n");
-    pthread_create(&worker, 0, worker_thread, NULL);
+    thread_create(&worker, &pglobal->out[id]->threads, "rtsp", id, worker_thread, NULL);
     pthread_detach(worker);
     return 0;
 }
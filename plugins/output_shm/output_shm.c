@@ -0,0 +1,404 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+/*
+  This output plugin publishes the frames of an input into a POSIX shared
+  memory ring, see shm_ring.h for the layout. Programs on the same host, for
+  example another mjpg_streamer with input_shm, read the pictures straight
+  from the mapping instead of receiving them through a socket.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "../../utils.h"
+#include "../../mjpg_streamer.h"
+#include "shm_ring.h"
+
+#define OUTPUT_PLUGIN_NAME "SHM output plugin"
+
+/* slots and headers start on cache lines, so readers do not share them */
+#define SHM_ALIGN(x) (((x) + 63) & ~(size_t)63)
+
+/* more slots than this only waste memory, no reader falls that far behind */
+#define MAX_SLOTS 1024
+
+static pthread_t worker;
+static globals *pglobal;
+static frame *current = NULL;
+static int input_number = 0;
+static int plugin_number = 0;
+
+static char *name = "/mjpg_streamer";
+static int slot_count = 4;
+static size_t capacity = 2 * 1024 * 1024;
+
+static struct shm_ring_header *ring = NULL;
+static size_t ring_size;
+static metric *dropped;
+
+/******************************************************************************
+Description.: print a help message
+Input Value.: -
+Return Value: -
+******************************************************************************/
+void help(void)
+{
+    fprintf(stderr, " ---------------------------------------------------------------\n" \
+            " Help for output plugin..: "OUTPUT_PLUGIN_NAME"\n" \
+            " ---------------------------------------------------------------\n" \
+            " The following parameters can be passed to this plugin:\n\n" \
+            " [-n | --name ]..........: name of the shared memory object, default /mjpg_streamer\n" \
+            " [-s | --slots ].........: number of frames the ring holds, 2 to 1024,\n" \
+            "                           default 4\n" \
+            " [-b | --bytes ].........: largest frame in bytes, a k, M or G suffix is allowed,\n" \
+            "                           default 2M\n" \
+            " [-i | --input ].........: read frames from the specified input plugin (first input plugin between the arguments is the 0th)\n\n" \
+            " ---------------------------------------------------------------\n");
+}
+
+/******************************************************************************
+Description.: create the shared memory object and map it. An object left
+              behind by a previous run is unlinked first, readers that still
+              map it notice that it is closed and open the new one.
+Input Value.: -
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+static int ring_create(void)
+{
+    size_t header_size = SHM_ALIGN(sizeof(struct shm_ring_header));
+    size_t slot_size = SHM_ALIGN(sizeof(struct shm_ring_slot) + capacity);
+    int fd;
+
+    ring_size = header_size + slot_count * slot_size;
+
+    shm_unlink(name);
+    if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0) {
+        OPRINT("could not create shared memory %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    if(ftruncate(fd, ring_size) != 0) {
+        OPRINT("could not resize shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ring == MAP_FAILED) {
+        OPRINT("could not map shared memory %s: %s\n", name, strerror(errno));
+        ring = NULL;
+        shm_unlink(name);
+        return -1;
+    }
+
+    /* the object is zero filled, so all slots are unlocked and empty */
+    ring->header_size = header_size;
+    ring->slot_count = slot_count;
+    ring->slot_size = slot_size;
+    ring->writer_pid = getpid();
+    ring->version = SHM_RING_VERSION;
+    __atomic_store_n(&ring->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: wake up all readers sleeping on the notify word
+Input Value.: -
+Return Value: -
+******************************************************************************/
+static void ring_notify(void)
+{
+    __atomic_add_fetch(&ring->notify, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &ring->notify, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/******************************************************************************
+Description.: copy a frame into its slot under the seqlock of the slot and
+              publish its sequence
+Input Value.: f is the frame, its JPG is there
+Return Value: 0 if the frame was written, -1 if it is too large
+******************************************************************************/
+static int ring_write(frame *f)
+{
+    struct shm_ring_slot *slot;
+    uint64_t lock;
+
+    if((size_t)f->size > capacity) {
+        OPRINT("frame of %d bytes does not fit into a slot of %zu bytes, see --bytes\n", f->size, capacity);
+        metric_add(dropped, 1);
+        return -1;
+    }
+
+    slot = (struct shm_ring_slot *)((unsigned char *)ring + ring->header_size +
+                                    (f->sequence % ring->slot_count) * ring->slot_size);
+
+    /* an odd lock tells readers the slot is changing */
+    lock = slot->lock;
+    __atomic_store_n(&slot->lock, lock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->sequence = f->sequence;
+    slot->size = f->size;
+    slot->format = V4L2_PIX_FMT_JPEG;
+    slot->width = f->width;
+    slot->height = f->height;
+    slot->quality = f->quality;
+    slot->timestamp_sec = f->timestamp.tv_sec;
+    slot->timestamp_usec = f->timestamp.tv_usec;
+    slot->captured_sec = f->captured.tv_sec;
+    slot->captured_nsec = f->captured.tv_nsec;
+    memcpy(SHM_RING_DATA(slot), f->buf, f->size);
+
+    __atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->sequence, f->sequence, __ATOMIC_RELEASE);
+    ring_notify();
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: clean up allocated resources
+Input Value.: unused argument
+Return Value: -
+******************************************************************************/
+void worker_cleanup(void *arg)
+{
+    static unsigned char first_run = 1;
+
+    if(!first_run) {
+        DBG("already cleaned up resources\n");
+        return;
+    }
+
+    first_run = 0;
+    OPRINT("cleaning up resources allocated by worker thread\n");
+
+    frame_unref(current);
+    current = NULL;
+}
+
+/******************************************************************************
+Description.: this is the main worker thread
+              it loops forever, grabs a fresh frame and writes it to the ring
+Input Value.:
+Return Value:
+******************************************************************************/
+void *worker_thread(void *arg)
+{
+    frame *f;
+
+    /* set cleanup handler to cleanup allocated resources */
+    pthread_cleanup_push(worker_cleanup, NULL);
+
+    while(!pglobal->stop) {
+        DBG("waiting for fresh frame\n");
+
+        if((f = input_wait_frame(pglobal->in[input_number], (current != NULL) ? current->sequence : 0)) == NULL)
+            break;
+        frame_unref(current);
+        current = f;
+
+        if(frame_jpeg(current) != 0) {
+            DBG("could not encode the frame\n");
+            continue;
+        }
+
+        if(ring_write(current) == 0) {
+            metric_add(pglobal->out[plugin_number]->metrics.frames, 1);
+            metric_add(pglobal->out[plugin_number]->metrics.bytes, current->size);
+            metric_observe(pglobal->out[plugin_number]->metrics.latency_sent, frame_latency(current, NULL));
+        }
+    }
+
+    /* cleanup now */
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+/*** plugin interface functions ***/
+/******************************************************************************
+Description.: this function is called first, in order to initialise
+              this plugin and pass a parameter string
+Input Value.: parameters
+Return Value: 0 if everything is ok, non-zero otherwise
+******************************************************************************/
+int output_init(output_parameter *param, int id)
+{
+    int i;
+
+    param->argv[0] = OUTPUT_PLUGIN_NAME;
+    plugin_number = id;
+
+    /* show all parameters for DBG purposes */
+    for(i = 0; i < param->argc; i++) {
+        DBG("argv[%d]=%s\n", i, param->argv[i]);
+    }
+
+    reset_getopt();
+    while(1) {
+        int option_index = 0, c = 0;
+        static struct option long_options[] = {
+            {"h", no_argument, 0, 0
+            },
+            {"help", no_argument, 0, 0},
+            {"n", required_argument, 0, 0},
+            {"name", required_argument, 0, 0},
+            {"s", required_argument, 0, 0},
+            {"slots", required_argument, 0, 0},
+            {"b", required_argument, 0, 0},
+            {"bytes", required_argument, 0, 0},
+            {"i", required_argument, 0, 0},
+            {"input", required_argument, 0, 0},
+            {0, 0, 0, 0}
+        };
+
+        c = getopt_long_only(param->argc, param->argv, "", long_options, &option_index);
+
+        /* no more options to parse */
+        if(c == -1) break;
+
+        /* unrecognized option */
+        if(c == '?') {
+            help();
+            return 1;
+        }
+
+        switch(option_index) {
+            /* h, help */
+        case 0:
+        case 1:
+            DBG("case 0,1\n");
+            help();
+            return 1;
+            break;
+
+            /* n, name */
+        case 2:
+        case 3:
+            DBG("case 2,3\n");
+            /* shm_open() wants exactly one leading slash */
+            name = malloc(strlen(optarg) + 2);
+            sprintf(name, "%s%s", (optarg[0] == '/') ? "" : "/", optarg);
+            break;
+
+            /* s, slots */
+        case 4:
+        case 5:
+            DBG("case 4,5\n");
+            slot_count = atoi(optarg);
+            break;
+
+            /* b, bytes */
+        case 6:
+        case 7:
+            DBG("case 6,7\n");
+            capacity = parse_size_opt(optarg);
+            break;
+
+            /* i, input */
+        case 8:
+        case 9:
+            DBG("case 8,9\n");
+            input_number = atoi(optarg);
+            break;
+        }
+    }
+
+    pglobal = param->global;
+    if(!(input_number < pglobal->incnt)) {
+        OPRINT("ERROR: the %d input_plugin number is too much only %d plugins loaded\n", input_number, pglobal->incnt);
+        return 1;
+    }
+
+    if(slot_count < 2 || slot_count > MAX_SLOTS || capacity == 0 || capacity > SIZE_MAX / 2 / MAX_SLOTS) {
+        OPRINT("ERROR: the ring needs 2 to %d slots of at least one byte\n", MAX_SLOTS);
+        return 1;
+    }
+
+    if(ring_create() != 0)
+        return 1;
+
+    OPRINT("input plugin.....: %d: %s\n", input_number, pglobal->in[input_number]->plugin);
+    OPRINT("shared memory....: %s\n", name);
+    OPRINT("slots............: %d of %zu bytes\n", slot_count, capacity);
+    return 0;
+}
+
+/******************************************************************************
+Description.: calling this function stops the worker thread, marks the ring
+              as closed and removes its name
+Input Value.: -
+Return Value: always 0
+******************************************************************************/
+int output_stop(int id)
+{
+    DBG("will cancel worker thread\n");
+    pthread_cancel(worker);
+    input_consumer_remove(pglobal->in[input_number]);
+
+    if(ring != NULL) {
+        __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+        ring_notify();
+        shm_unlink(name);
+    }
+    return 0;
+}
+
+/******************************************************************************
+Description.: calling this function creates and starts the worker thread
+Input Value.: -
+Return Value: always 0
+******************************************************************************/
+int output_run(int id)
+{
+    char labels[64];
+
+    snprintf(labels, sizeof(labels), "output=\"%d\",reason=\"too_large\"", id);
+    dropped = metric_register(METRIC_COUNTER, "mjpg_output_frames_dropped_total",
+                              "Frames dropped by the output plugin", labels, 1);
+
+    /* readers are not known, keep the input capturing */
+    input_consumer_add(pglobal->in[input_number]);
+
+    DBG("launching worker thread\n");
+    thread_create(&worker, &pglobal->out[id]->threads, "shm-out", id, worker_thread, NULL);
+    pthread_detach(worker);
+    return 0;
+}
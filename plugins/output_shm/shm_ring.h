@@ -0,0 +1,93 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+
+/*
+ * Layout of the shared memory ring written by output_shm and read by
+ * input_shm. Other programs on the same host may map it read-only and use
+ * the pictures in place, so the layout only uses fixed size types.
+ *
+ * The object starts with a shm_ring_header, slot i follows at
+ * header_size + i * slot_size. Frame n is written to slot n % slot_count.
+ *
+ * Each slot is guarded by a seqlock: the writer makes lock odd, changes the
+ * slot and makes lock even again. A reader copies what it needs and accepts
+ * it only if lock was even and did not change meanwhile, otherwise the
+ * writer overtook it and it retries with the newest frame.
+ *
+ * notify is incremented after each frame, readers can sleep on it with
+ * FUTEX_WAIT (the mapping is shared, so no FUTEX_PRIVATE_FLAG).
+ */
+#define SHM_RING_MAGIC   0x534a504dU /* "MPJS" */
+#define SHM_RING_VERSION 1
+
+struct shm_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_count;
+    uint64_t slot_size;
+
+    /* sequence of the newest complete frame, 0 until the first one */
+    uint64_t sequence;
+
+    /* futex word, see above */
+    uint32_t notify;
+
+    /* set when the writer stopped, the name may be reused by a new ring */
+    uint32_t closed;
+
+    uint32_t writer_pid;
+    uint32_t reserved[9];
+};
+
+struct shm_ring_slot {
+    uint64_t lock;
+    uint64_t sequence;
+
+    /* bytes of the picture that follows this struct */
+    uint32_t size;
+
+    /* V4L2_PIX_FMT_* fourcc, quality of the JPG or -1 if unknown */
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    int32_t quality;
+    uint32_t reserved;
+
+    /* gettimeofday() and CLOCK_MONOTONIC time of the capture */
+    int64_t timestamp_sec;
+    int64_t timestamp_usec;
+    int64_t captured_sec;
+    int64_t captured_nsec;
+};
+
+/* the picture of a slot and the bytes available for it */
+#define SHM_RING_DATA(slot) ((unsigned char *)(slot) + sizeof(struct shm_ring_slot))
+#define SHM_RING_CAPACITY(hdr) ((hdr)->slot_size - sizeof(struct shm_ring_slot))
+
+#endif
@@ -0,0 +1,467 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+/*
+  This output plugin serves local clients on a Unix domain socket. Instead
+  of writing the bytes of each frame to every client, the JPG is written
+  once into a sealed memfd and the descriptor is passed to all clients with
+  SCM_RIGHTS, see unix_frame.h. A client then costs one small sendmsg() per
+  frame, no matter how large the picture is.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../../utils.h"
+#include "../../mjpg_streamer.h"
+#include "unix_frame.h"
+
+#define OUTPUT_PLUGIN_NAME "UNIX socket output plugin"
+
+/*
+ * the kernel rounds this up to its minimum, a busy client then has only a
+ * few frames queued and skips the rest instead of pinning many memfds
+ */
+#define CLIENT_SNDBUF 4096
+
+typedef struct _client client;
+struct _client {
+    int fd;
+    uint32_t dropped;
+    client *next;
+};
+
+static pthread_t worker, listener;
+static globals *pglobal;
+static frame *current = NULL;
+static int input_number = 0;
+static int plugin_number = 0;
+
+static char *path = "/tmp/mjpg_streamer.sock";
+static int sd = -1;
+
+/* the connected clients, added by the listener and removed by the worker */
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clients_added = PTHREAD_COND_INITIALIZER;
+static client *clients = NULL;
+
+static metric *dropped;
+
+/******************************************************************************
+Description.: print a help message
+Input Value.: -
+Return Value: -
+******************************************************************************/
+void help(void)
+{
+    fprintf(stderr, " ---------------------------------------------------------------\n" \
+            " Help for output plugin..: "OUTPUT_PLUGIN_NAME"\n" \
+            " ---------------------------------------------------------------\n" \
+            " The following parameters can be passed to this plugin:\n\n" \
+            " [-p | --path ]..........: path of the socket, default /tmp/mjpg_streamer.sock\n" \
+            " [-i | --input ].........: read frames from the specified input plugin (first input plugin between the arguments is the 0th)\n\n" \
+            " ---------------------------------------------------------------\n");
+}
+
+static void unlock_clients(void *arg)
+{
+    pthread_mutex_unlock(&clients_lock);
+}
+
+/******************************************************************************
+Description.: disconnect a client, the caller holds clients_lock
+Input Value.: link points to the list entry of the client
+Return Value: -
+******************************************************************************/
+static void client_remove(client **link)
+{
+    client *c = *link;
+
+    *link = c->next;
+    close(c->fd);
+    free(c);
+
+    metric_add(pglobal->out[plugin_number]->metrics.clients, -1);
+    input_consumer_remove(pglobal->in[input_number]);
+}
+
+/******************************************************************************
+Description.: copy the JPG of a frame into a sealed memfd, so the clients can
+              neither change nor resize it
+Input Value.: f is the frame, its JPG is there
+Return Value: the memfd or -1 on error
+******************************************************************************/
+static int frame_memfd(frame *f)
+{
+    ssize_t n;
+    int fd, done = 0;
+
+    if((fd = memfd_create("mjpg-frame", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0)
+        return -1;
+
+    while(done < f->size) {
+        if((n = write(fd, f->buf + done, f->size - done)) < 0) {
+            if(errno == EINTR)
+                continue;
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+
+    if(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/******************************************************************************
+Description.: pass the memfd of a frame to all clients. A client whose socket
+              is full skips the frame, a client that hung up is removed
+Input Value.: f is the frame
+              fd is its memfd
+Return Value: -
+******************************************************************************/
+static void send_frame(frame *f, int fd)
+{
+    struct unix_frame_header hdr;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { &hdr, sizeof(hdr) };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    client **link;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = UNIX_FRAME_MAGIC;
+    hdr.version = UNIX_FRAME_VERSION;
+    hdr.sequence = f->sequence;
+    hdr.size = f->size;
+    hdr.format = V4L2_PIX_FMT_JPEG;
+    hdr.width = f->width;
+    hdr.height = f->height;
+    hdr.quality = f->quality;
+    hdr.timestamp_sec = f->timestamp.tv_sec;
+    hdr.timestamp_usec = f->timestamp.tv_usec;
+    hdr.captured_sec = f->captured.tv_sec;
+    hdr.captured_nsec = f->captured.tv_nsec;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    pthread_mutex_lock(&clients_lock);
+    pthread_cleanup_push(unlock_clients, NULL);
+    for(link = &clients; *link != NULL;) {
+        hdr.dropped = (*link)->dropped;
+        if(sendmsg((*link)->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(hdr)) {
+            metric_add(pglobal->out[plugin_number]->metrics.frames, 1);
+            metric_add(pglobal->out[plugin_number]->metrics.bytes, f->size);
+            metric_observe(pglobal->out[plugin_number]->metrics.latency_sent, frame_latency(f, NULL));
+        } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            (*link)->dropped++;
+            metric_add(dropped, 1);
+        } else {
+            DBG("client %d left: %s\n", (*link)->fd, strerror(errno));
+            client_remove(link);
+            continue;
+        }
+        link = &(*link)->next;
+    }
+    pthread_cleanup_pop(1);
+}
+
+/******************************************************************************
+Description.: clean up allocated resources
+Input Value.: unused argument
+Return Value: -
+******************************************************************************/
+void worker_cleanup(void *arg)
+{
+    static unsigned char first_run = 1;
+
+    if(!first_run) {
+        DBG("already cleaned up resources\n");
+        return;
+    }
+
+    first_run = 0;
+    OPRINT("cleaning up resources allocated by worker thread\n");
+
+    frame_unref(current);
+    current = NULL;
+}
+
+/******************************************************************************
+Description.: this is the main worker thread, it waits for clients and hands
+              each fresh frame over to them
+Input Value.:
+Return Value:
+******************************************************************************/
+void *worker_thread(void *arg)
+{
+    frame *f;
+    int fd;
+
+    /* set cleanup handler to cleanup allocated resources */
+    pthread_cleanup_push(worker_cleanup, NULL);
+
+    while(!pglobal->stop) {
+        /* nothing to do without clients, the input may even pause */
+        pthread_mutex_lock(&clients_lock);
+        pthread_cleanup_push(unlock_clients, NULL);
+        while(clients == NULL && !pglobal->stop)
+            pthread_cond_wait(&clients_added, &clients_lock);
+        pthread_cleanup_pop(1);
+
+        DBG("waiting for fresh frame\n");
+        if((f = input_wait_frame(pglobal->in[input_number], (current != NULL) ? current->sequence : 0)) == NULL)
+            break;
+        frame_unref(current);
+        current = f;
+
+        if(frame_jpeg(current) != 0) {
+            DBG("could not encode the frame\n");
+            continue;
+        }
+
+        /* one copy per frame, shared by all clients */
+        if((fd = frame_memfd(current)) < 0) {
+            OPRINT("could not create a memfd for the frame: %s\n", strerror(errno));
+            continue;
+        }
+        send_frame(current, fd);
+        close(fd);
+    }
+
+    /* cleanup now */
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+/******************************************************************************
+Description.: accepts the clients and adds them to the list
+Input Value.:
+Return Value:
+******************************************************************************/
+void *listener_thread(void *arg)
+{
+    int fd, size = CLIENT_SNDBUF;
+    client *c;
+
+    while(!pglobal->stop) {
+        if((fd = accept4(sd, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            OPRINT("could not accept clients: %s\n", strerror(errno));
+            break;
+        }
+
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+        if((c = calloc(1, sizeof(*c))) == NULL) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+
+        input_consumer_add(pglobal->in[input_number]);
+        metric_add(pglobal->out[plugin_number]->metrics.clients, 1);
+        log_event(LOGLEVEL_INFO, "unix_client", "output=%d path=%s", plugin_number, path);
+
+        pthread_mutex_lock(&clients_lock);
+        c->next = clients;
+        clients = c;
+        pthread_cond_signal(&clients_added);
+        pthread_mutex_unlock(&clients_lock);
+    }
+
+    return NULL;
+}
+
+/*** plugin interface functions ***/
+/******************************************************************************
+Description.: this function is called first, in order to initialise
+              this plugin and pass a parameter string
+Input Value.: parameters
+Return Value: 0 if everything is ok, non-zero otherwise
+******************************************************************************/
+int output_init(output_parameter *param, int id)
+{
+    struct sockaddr_un addr;
+    int i;
+
+    param->argv[0] = OUTPUT_PLUGIN_NAME;
+    plugin_number = id;
+
+    /* show all parameters for DBG purposes */
+    for(i = 0; i < param->argc; i++) {
+        DBG("argv[%d]=%s\n", i, param->argv[i]);
+    }
+
+    reset_getopt();
+    while(1) {
+        int option_index = 0, c = 0;
+        static struct option long_options[] = {
+            {"h", no_argument, 0, 0
+            },
+            {"help", no_argument, 0, 0},
+            {"p", required_argument, 0, 0},
+            {"path", required_argument, 0, 0},
+            {"i", required_argument, 0, 0},
+            {"input", required_argument, 0, 0},
+            {0, 0, 0, 0}
+        };
+
+        c = getopt_long_only(param->argc, param->argv, "", long_options, &option_index);
+
+        /* no more options to parse */
+        if(c == -1) break;
+
+        /* unrecognized option */
+        if(c == '?') {
+            help();
+            return 1;
+        }
+
+        switch(option_index) {
+            /* h, help */
+        case 0:
+        case 1:
+            DBG("case 0,1\n");
+            help();
+            return 1;
+            break;
+
+            /* p, path */
+        case 2:
+        case 3:
+            DBG("case 2,3\n");
+            path = strdup(optarg);
+            break;
+
+            /* i, input */
+        case 4:
+        case 5:
+            DBG("case 4,5\n");
+            input_number = atoi(optarg);
+            break;
+        }
+    }
+
+    pglobal = param->global;
+    if(!(input_number < pglobal->incnt)) {
+        OPRINT("ERROR: the %d input_plugin number is too much only %d plugins loaded\n", input_number, pglobal->incnt);
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        OPRINT("ERROR: the path %s is too long\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    /* SEQPACKET keeps each header together with its descriptor */
+    if((sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0) {
+        OPRINT("could not create the socket: %s\n", strerror(errno));
+        return 1;
+    }
+
+    unlink(path);
+    if(bind(sd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sd, 16) != 0) {
+        OPRINT("could not listen on %s: %s\n", path, strerror(errno));
+        close(sd);
+        return 1;
+    }
+
+    OPRINT("input plugin.....: %d: %s\n", input_number, pglobal->in[input_number]->plugin);
+    OPRINT("socket...........: %s\n", path);
+    return 0;
+}
+
+/******************************************************************************
+Description.: calling this function stops the threads and disconnects all
+              clients
+Input Value.: -
+Return Value: always 0
+******************************************************************************/
+int output_stop(int id)
+{
+    DBG("will cancel worker threads\n");
+    pthread_cancel(listener);
+    pthread_cancel(worker);
+
+    close(sd);
+    unlink(path);
+
+    pthread_mutex_lock(&clients_lock);
+    while(clients != NULL)
+        client_remove(&clients);
+    pthread_mutex_unlock(&clients_lock);
+    return 0;
+}
+
+/******************************************************************************
+Description.: calling this function creates and starts the worker threads
+Input Value.: -
+Return Value: always 0
+******************************************************************************/
+int output_run(int id)
+{
+    char labels[64];
+
+    snprintf(labels, sizeof(labels), "output=\"%d\",reason=\"client_busy\"", id);
+    dropped = metric_register(METRIC_COUNTER, "mjpg_output_frames_dropped_total",
+                              "Frames dropped by the output plugin", labels, 1);
+
+    DBG("launching worker threads\n");
+    thread_create(&worker, &pglobal->out[id]->threads, "unix-out", id, worker_thread, NULL);
+    pthread_detach(worker);
+    thread_create(&listener, &pglobal->out[id]->threads, "unix-accept", id, listener_thread, NULL);
+    pthread_detach(listener);
+    return 0;
+}
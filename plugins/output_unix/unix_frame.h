@@ -0,0 +1,62 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef UNIX_FRAME_H
+#define UNIX_FRAME_H
+
+#include <stdint.h>
+
+/*
+ * output_unix sends one message of this struct per frame over a
+ * SOCK_SEQPACKET socket. The picture is not part of the message, it comes
+ * as a sealed memfd in a SCM_RIGHTS control message. Map it read-only
+ * (size bytes) or read it, then close it.
+ */
+#define UNIX_FRAME_MAGIC   0x464a504dU /* "MPJF" */
+#define UNIX_FRAME_VERSION 1
+
+struct unix_frame_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;
+
+    /* bytes of the picture in the memfd */
+    uint32_t size;
+
+    /* V4L2_PIX_FMT_* fourcc, quality of the JPG or -1 if unknown */
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    int32_t quality;
+
+    /* frames the client missed because its socket was full */
+    uint32_t dropped;
+
+    /* gettimeofday() and CLOCK_MONOTONIC time of the capture */
+    int64_t timestamp_sec;
+    int64_t timestamp_usec;
+    int64_t captured_sec;
+    int64_t captured_nsec;
+};
+
+#endif
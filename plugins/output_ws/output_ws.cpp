@@ -38,15 +38,13 @@
 #include <syslog.h>
 #include <stdbool.h>
 #include <dirent.h>
+#include <sys/eventfd.h>
 
 // Using Alex Hultman's uWebSockets library: https://github.com/uWebSockets/uWebSockets
 #include <uWS/uWS.h>
 
 #include <string>
-#include <thread>
 #include <iostream>
-#include <chrono>
-#include <atomic>
 
 #include "output_ws.h"
 
@@ -57,19 +55,22 @@ namespace
     // Standard mjpg-streamer plugin variables
     pthread_t worker;
     globals *pglobal;
-    int fd;
     int delay;
-    int max_frame_size;
-    unsigned char *frame = NULL;
+    frame *current = NULL;
     int input_number = 0;
+    output *self = nullptr;
+
+    // When the last frame was broadcast, unchanged ones are skipped until
+    // the interval of -U passed
+    struct timespec sent = { 0, 0 };
 
     // Websocket variables
     // ------------------------
     uint16_t port = 8200;       // -p,--port
 
-    std::atomic<bool> readyToSend( false );
     uv_async_t closeEvent;
-    std::thread t;
+    uv_poll_t framePoll;
+    int frameFd = -1;
     uWS::Group<uWS::SERVER> *tServerGroup = nullptr;
 }
 
@@ -108,21 +109,14 @@ void worker_cleanup( void *arg )
     first_run = 0;
     OPRINT( "Cleaning up resources allocated by worker thread\n" );
 
-    if( frame != NULL )
+    if( frameFd >= 0 )
     {
-        free( frame );
+        input_unsubscribe_fd( pglobal->in[input_number], frameFd );
+        frameFd = -1;
     }
 
-    close( fd );
-
-    // Stop broadcasting
-    readyToSend = false;
-
-    // Send close event
-    uv_async_send( &closeEvent );
-
-    // Wait for the thread to join
-    t.join();
+    frame_unref( current );
+    current = NULL;
 }
 
 void close_async_cb( uv_async_t* async )
@@ -131,6 +125,10 @@ void close_async_cb( uv_async_t* async )
 
     std::cout << "Closing Server..." << std::endl;
 
+    // Stop listening for frames, the loop ends once all handles are closed
+    uv_poll_stop( &framePoll );
+    uv_close( (uv_handle_t*)&framePoll, NULL );
+
     serverGroup->close();
     uv_close((uv_handle_t*)async, NULL);
 
@@ -138,80 +136,87 @@ void close_async_cb( uv_async_t* async )
 }
 
 /******************************************************************************
-Description.: this is the main worker thread
-              it loops forever, grabs a fresh frame and stores it to file
-Input Value.:
-Return Value:
+Description.: called by the server loop when the input published a frame,
+              broadcasts it to all connected clients
+Input Value.: handle, status and events as passed by libuv
+Return Value: -
 ******************************************************************************/
-void *worker_thread(void *args)
+void frame_poll_cb( uv_poll_t* handle, int status, int events )
 {
-    int ok          = 1;
-    int frame_size  = 0;
-    unsigned char *tmp_framebuffer = nullptr;
+    eventfd_t count;
 
-    // Create thread which handles ws connections asynchronously
-    t = std::thread( []
+    // Clear the eventfd, frames published in the meantime are skipped
+    if( status < 0 || eventfd_read( frameFd, &count ) < 0 )
     {
-        uWS::Hub th;
-        tServerGroup = &th.getDefaultGroup<uWS::SERVER>();
-        th.getDefaultGroup<uWS::SERVER>().addAsync();
-
-        // Add close callback event to server's uv loop
-        uv_async_init( th.getLoop(), &closeEvent, close_async_cb );
-        closeEvent.data = (void*)tServerGroup;
-
-        std::cout << "Running Server" << std::endl;
+        return;
+    }
 
-        th.listen( port );
-        readyToSend = true;
+    frame *f = input_get_frame( pglobal->in[input_number] );
 
-        th.run();
-
-        std::cout << "Server thread exited." << std::endl;
-    } );
+    if( f == NULL )
+    {
+        return;
+    }
 
-    /* set cleanup handler to cleanup allocated ressources */
-    pthread_cleanup_push(worker_cleanup, NULL);
+    // Static scenes are only broadcast now and then, see -U
+    if( frame_skip_unchanged( f, &sent ) )
+    {
+        metric_add( self->metrics.unchanged, 1 );
+        frame_unref( f );
+        return;
+    }
 
-    while(ok >= 0 && !pglobal->stop)
+    if( frame_jpeg( f ) != 0 )
     {
-        //DBG("waiting for fresh frame\n");
-        pthread_mutex_lock(&pglobal->in[input_number].db);
-        pthread_cond_wait(&pglobal->in[input_number].db_update, &pglobal->in[input_number].db);
+        frame_unref( f );
+        return;
+    }
 
-        /* read buffer */
-        frame_size = pglobal->in[input_number].size;
+    frame_unref( current );
+    current = f;
 
-        /* check if buffer for frame is large enough, increase it if necessary */
-        if(frame_size > max_frame_size)
-        {
-            DBG("increasing buffer size to %d\n", frame_size);
+    DBG( "Framesize: %d\n", current->size );
 
-            max_frame_size = frame_size + (1 << 16);
+    // Send frame here, this is the thread of the server loop
+    tServerGroup->broadcast( (const char*)current->buf, current->size, uWS::OpCode::BINARY );
+}
 
-            if((tmp_framebuffer = (unsigned char*)realloc(frame, max_frame_size)) == NULL)
-            {
-                pthread_mutex_unlock(&pglobal->in[input_number].db);
-                LOG("not enough memory\n");
-                return NULL;
-            }
+/******************************************************************************
+Description.: this is the main worker thread
+              it runs the websocket server loop, which also wakes up on
+              fresh frames of the input, so no thread blocks on the input
+Input Value.:
+Return Value:
+******************************************************************************/
+void *worker_thread(void *args)
+{
+    uWS::Hub th;
+    tServerGroup = &th.getDefaultGroup<uWS::SERVER>();
+    th.getDefaultGroup<uWS::SERVER>().addAsync();
 
-            frame = tmp_framebuffer;
-        }
+    /* set cleanup handler to cleanup allocated ressources */
+    pthread_cleanup_push(worker_cleanup, NULL);
 
-        /* copy frame to our local buffer now */
-        memcpy(frame, pglobal->in[input_number].buf, frame_size);
+    // Add close callback event to server's uv loop
+    uv_async_init( th.getLoop(), &closeEvent, close_async_cb );
+    closeEvent.data = (void*)tServerGroup;
 
-        /* allow others to access the global buffer again */
-        pthread_mutex_unlock(&pglobal->in[input_number].db);
+    // Add the frame notifications of the input to the same loop
+    if( (frameFd = input_subscribe_fd( pglobal->in[input_number] )) < 0 )
+    {
+        OPRINT( "ERROR: could not subscribe to the input\n" );
+    }
+    else
+    {
+        uv_poll_init( th.getLoop(), &framePoll, frameFd );
+        uv_poll_start( &framePoll, UV_READABLE, frame_poll_cb );
 
-        DBG( "Framesize: %d\n", frame_size );
+        std::cout << "Running Server" << std::endl;
 
-        // Send frame here
-        if( readyToSend )
-        {
-            tServerGroup->broadcast( (const char*)frame, frame_size, uWS::OpCode::BINARY );
-        }
+        th.listen( port );
+        th.run();
+
+        std::cout << "Server thread exited." << std::endl;
     }
 
     /* cleanup now */
@@ -319,7 +324,7 @@ int output_init(output_parameter *param)
         return 1;
     }
 
-    OPRINT( "input plugin.....: %d: %s\n", input_number, pglobal->in[input_number].plugin );
+    OPRINT( "input plugin.....: %d: %s\n", input_number, pglobal->in[input_number]->plugin );
 
     return 0;
 }
@@ -331,8 +336,10 @@ Return Value: always 0
 ******************************************************************************/
 int output_stop(int id)
 {
-    DBG("will cancel worker thread\n");
-    pthread_cancel(worker);
+    DBG("will stop the server loop\n");
+
+    // The loop closes its handles and returns, then the worker cleans up
+    uv_async_send( &closeEvent );
     return 0;
 }
 
@@ -344,7 +351,8 @@ Return Value: always 0
 int output_run(int id)
 {
     DBG("launching worker thread\n");
-    pthread_create(&worker, 0, worker_thread, NULL);
+    self = pglobal->out[id];
+    thread_create(&worker, &pglobal->out[id]->threads, "ws", id, worker_thread, NULL);
     pthread_detach(worker);
     return 0;
 }
@@ -0,0 +1,537 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "signature.h"
+
+/* largest number of components of a frame, Y, Cb and Cr */
+#define MAX_COMPONENTS 3
+
+/* codes up to this length are decoded with one table lookup */
+#define LOOKAHEAD 9
+
+/*
+ * the Huffman tables of the JPG standard (section K.3) as the payload of a
+ * DHT segment, UVC cameras leave them out of their MJPG frames
+ */
+static const unsigned char default_dht[] = {
+    0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x01, 0x00, 0x03, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x10, 0x00,
+    0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00,
+    0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21,
+    0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81,
+    0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24,
+    0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25,
+    0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+    0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56,
+    0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86,
+    0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+    0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3,
+    0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6,
+    0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+    0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1,
+    0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0x11, 0x00, 0x02,
+    0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01,
+    0x02, 0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06,
+    0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14,
+    0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62,
+    0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19,
+    0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+    0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56,
+    0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85,
+    0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2,
+    0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8,
+    0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2,
+    0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+};
+
+typedef struct {
+    int defined;
+    int count;
+    unsigned char vals[256];
+
+    /* codes of each length are consecutive, see section F.2.2.3 */
+    int mincode[17];
+    int maxcode[17];
+    int valptr[17];
+
+    /* length << 8 | value for the next LOOKAHEAD bits, 0 for longer codes */
+    unsigned short lookup[1 << LOOKAHEAD];
+} huffman;
+
+typedef struct {
+    int id;
+    int h, v;
+    int tq;
+    int td, ta;
+} component;
+
+typedef struct {
+    const unsigned char *p, *end;
+
+    /* the next bits of the scan, left aligned */
+    unsigned int acc;
+    int bits;
+
+    /* a marker ended the scan data, zeros are shifted in after it */
+    int marker;
+    int overrun;
+} bitreader;
+
+typedef struct {
+    unsigned short qt[4][64];
+    int qt_defined[4];
+    huffman dc[4], ac[4];
+    component comp[MAX_COMPONENTS];
+    int ncomp;
+    int width, height;
+    int restart;
+    int baseline;
+} jpeg;
+
+/******************************************************************************
+Description.: compute only the exact signature of a picture, an FNV-1a hash
+              of the bytes. This is much cheaper than signature_jpeg()
+Input Value.: buf and size describe the picture
+Return Value: the hash
+******************************************************************************/
+unsigned long long signature_hash(const unsigned char *buf, int size)
+{
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    int i;
+
+    for(i = 0; i < size; i++) {
+        hash ^= buf[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/******************************************************************************
+Description.: read the Huffman tables of a DHT segment
+Input Value.: j receives the tables
+              p and length describe the payload of the segment
+Return Value: 0 if everything is OK, -1 if the segment is malformed
+******************************************************************************/
+static int parse_dht(jpeg *j, const unsigned char *p, int length)
+{
+    const unsigned char *end = p + length;
+    huffman *h;
+    int l, code, k, i, n;
+
+    while(p + 17 <= end) {
+        if((p[0] >> 4) > 1 || (p[0] & 0x0F) > 3)
+            return -1;
+        h = ((p[0] >> 4) == 0) ? &j->dc[p[0] & 0x0F] : &j->ac[p[0] & 0x0F];
+
+        for(l = 1, k = 0; l <= 16; l++)
+            k += p[l];
+        if(k > 256 || p + 17 + k > end)
+            return -1;
+        memcpy(h->vals, p + 17, k);
+        h->count = k;
+
+        /* the codes of each length must fit into it, see F.2.2.3 */
+        for(l = 1, code = 0, k = 0; l <= 16; l++) {
+            h->valptr[l] = k;
+            h->mincode[l] = code;
+            code += p[l];
+            k += p[l];
+            if(code > (1 << l))
+                return -1;
+            h->maxcode[l] = p[l] ? code - 1 : -1;
+            code <<= 1;
+        }
+
+        memset(h->lookup, 0, sizeof(h->lookup));
+        for(l = 1, code = 0, k = 0; l <= LOOKAHEAD; l++) {
+            for(i = 0; i < p[l]; i++, code++, k++) {
+                if(code >= (1 << l))
+                    return -1;
+                for(n = 0; n < (1 << (LOOKAHEAD - l)); n++)
+                    h->lookup[(code << (LOOKAHEAD - l)) | n] = (l << 8) | h->vals[k];
+            }
+            code <<= 1;
+        }
+        h->defined = 1;
+
+        p += 17 + h->count;
+    }
+
+    return 0;
+}
+
+/* make sure at least 25 bits are in the accumulator */
+static void fill(bitreader *br)
+{
+    unsigned int b;
+
+    while(br->bits <= 24) {
+        b = 0;
+        if(!br->marker && br->p < br->end) {
+            b = *br->p++;
+            if(b == 0xFF) {
+                if(br->p < br->end && *br->p == 0x00) {
+                    br->p++;
+                } else {
+                    /* leave the marker for the restart handling */
+                    br->p--;
+                    br->marker = 1;
+                    b = 0;
+                }
+            }
+        } else {
+            br->overrun++;
+        }
+        br->acc |= b << (24 - br->bits);
+        br->bits += 8;
+    }
+}
+
+static int decode(bitreader *br, huffman *h)
+{
+    int l, code;
+
+    fill(br);
+    if((code = h->lookup[br->acc >> (32 - LOOKAHEAD)]) != 0) {
+        l = code >> 8;
+        br->acc <<= l;
+        br->bits -= l;
+        return code & 0xFF;
+    }
+
+    for(l = LOOKAHEAD + 1; l <= 16; l++) {
+        code = br->acc >> (32 - l);
+        if(code <= h->maxcode[l]) {
+            br->acc <<= l;
+            br->bits -= l;
+            code = h->valptr[l] + code - h->mincode[l];
+            return (code < h->count) ? h->vals[code] : -1;
+        }
+    }
+
+    return -1;
+}
+
+/* read s bits and sign extend them, see section F.2.2.1 */
+static int receive(bitreader *br, int s)
+{
+    int v;
+
+    if(s == 0)
+        return 0;
+
+    fill(br);
+    v = br->acc >> (32 - s);
+    br->acc <<= s;
+    br->bits -= s;
+
+    return (v < (1 << (s - 1))) ? v - (1 << s) + 1 : v;
+}
+
+/* skip to the data after the next RST marker */
+static void restart(bitreader *br)
+{
+    br->acc = 0;
+    br->bits = 0;
+    br->marker = 0;
+    br->overrun = 0;
+
+    while(br->p + 1 < br->end && !(br->p[0] == 0xFF && br->p[1] >= 0xD0 && br->p[1] <= 0xD7))
+        br->p++;
+    if(br->p + 1 < br->end)
+        br->p += 2;
+}
+
+/******************************************************************************
+Description.: decode the scan and average the DC coefficients of the first
+              component into the cells of the signature
+Input Value.: j are the headers
+              scan lists the ns components of the scan
+              p and end describe the entropy coded data
+              sig receives the cells
+Return Value: 0 if everything is OK, -1 if the scan is malformed
+******************************************************************************/
+static int decode_scan(jpeg *j, component **scan, int ns, const unsigned char *p,
+                       const unsigned char *end, signature *sig)
+{
+    unsigned int sum[SIGNATURE_WIDTH * SIGNATURE_HEIGHT] = {0};
+    unsigned int count[SIGNATURE_WIDTH * SIGNATURE_HEIGHT] = {0};
+    int pred[MAX_COMPONENTS] = {0};
+    bitreader br = { p, end, 0, 0, 0, 0 };
+    int hmax = 1, vmax = 1, mcux, mcuy, mx, my, c, bh, bv, k, rs, s, mean;
+    int blocks_w, blocks_h, bx, by, cell, todo, i;
+    component *y = &j->comp[0];
+    unsigned short q0 = j->qt[y->tq][0];
+
+    for(i = 0; i < j->ncomp; i++) {
+        if(j->comp[i].h > hmax)
+            hmax = j->comp[i].h;
+        if(j->comp[i].v > vmax)
+            vmax = j->comp[i].v;
+    }
+
+    /* visible blocks of the luminance */
+    blocks_w = ((j->width * y->h + hmax - 1) / hmax + 7) / 8;
+    blocks_h = ((j->height * y->v + vmax - 1) / vmax + 7) / 8;
+
+    if(ns == 1) {
+        /* a non-interleaved scan has one block per MCU */
+        mcux = blocks_w;
+        mcuy = blocks_h;
+    } else {
+        mcux = (j->width + 8 * hmax - 1) / (8 * hmax);
+        mcuy = (j->height + 8 * vmax - 1) / (8 * vmax);
+    }
+
+    todo = j->restart;
+    for(my = 0; my < mcuy; my++) {
+        for(mx = 0; mx < mcux; mx++) {
+            if(j->restart > 0 && todo-- == 0) {
+                restart(&br);
+                memset(pred, 0, sizeof(pred));
+                todo = j->restart - 1;
+            }
+
+            for(c = 0; c < ns; c++) {
+                int nh = (ns == 1) ? 1 : scan[c]->h;
+                int nv = (ns == 1) ? 1 : scan[c]->v;
+
+                for(bv = 0; bv < nv; bv++) {
+                    for(bh = 0; bh < nh; bh++) {
+                        if((s = decode(&br, &j->dc[scan[c]->td])) < 0 || s > 11)
+                            return -1;
+                        pred[c] += receive(&br, s);
+
+                        /* the AC coefficients are only skipped */
+                        for(k = 1; k < 64; k++) {
+                            if((rs = decode(&br, &j->ac[scan[c]->ta])) < 0)
+                                return -1;
+                            if((rs & 0x0F) == 0) {
+                                if(rs != 0xF0)
+                                    break;
+                                k += 15;
+                            } else {
+                                k += rs >> 4;
+                                receive(&br, rs & 0x0F);
+                            }
+                        }
+
+                        if(br.overrun > 4)
+                            return -1;
+
+                        if(scan[c] != y)
+                            continue;
+
+                        bx = (ns == 1) ? mx : mx * nh + bh;
+                        by = (ns == 1) ? my : my * nv + bv;
+                        if(bx >= blocks_w || by >= blocks_h)
+                            continue;
+
+                        /* the DC coefficient is 8 times the average, level shifted */
+                        mean = pred[c] * q0 / 8 + 128;
+                        mean = (mean < 0) ? 0 : (mean > 255) ? 255 : mean;
+                        cell = (by * SIGNATURE_HEIGHT / blocks_h) * SIGNATURE_WIDTH + bx * SIGNATURE_WIDTH / blocks_w;
+                        sum[cell] += mean;
+                        count[cell]++;
+                    }
+                }
+            }
+        }
+    }
+
+    for(i = 0; i < SIGNATURE_WIDTH * SIGNATURE_HEIGHT; i++)
+        sig->cells[i] = count[i] ? sum[i] / count[i] : 0;
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: compute the signatures of a JPG picture
+Input Value.: buf and size describe the picture
+              sig receives the signatures
+Return Value: 0 if everything is OK, -1 if only the hash could be computed
+              because the picture is no baseline JPG
+******************************************************************************/
+int signature_jpeg(const unsigned char *buf, int size, signature *sig)
+{
+    const unsigned char *p = buf, *end = buf + size;
+    component *scan[MAX_COMPONENTS];
+    unsigned char marker;
+    int length, i, k, n, ns;
+    jpeg *j;
+
+    sig->hash = signature_hash(buf, size);
+    sig->valid = 0;
+
+    if(size < 4 || p[0] != 0xFF || p[1] != 0xD8)
+        return -1;
+    p += 2;
+
+    if((j = calloc(1, sizeof(jpeg))) == NULL)
+        return -1;
+
+    while(p + 4 <= end) {
+        if(*p != 0xFF)
+            break;
+
+        /* skip fill bytes */
+        while(p < end && *p == 0xFF)
+            p++;
+        if(p + 3 > end)
+            break;
+
+        marker = *p++;
+        length = (p[0] << 8) | p[1];
+        if(length < 2 || p + length > end)
+            break;
+
+        if(marker == 0xC0 || marker == 0xC1) {
+            /* baseline or extended sequential with Huffman coding */
+            if(length < 8 || p[2] != 8)
+                break;
+            j->height = (p[3] << 8) | p[4];
+            j->width = (p[5] << 8) | p[6];
+            j->ncomp = p[7];
+            if(j->ncomp < 1 || j->ncomp > MAX_COMPONENTS || length < 8 + 3 * j->ncomp ||
+               j->width == 0 || j->height == 0)
+                break;
+            for(i = 0; i < j->ncomp; i++) {
+                j->comp[i].id = p[8 + 3 * i];
+                j->comp[i].h = p[9 + 3 * i] >> 4;
+                j->comp[i].v = p[9 + 3 * i] & 0x0F;
+                j->comp[i].tq = p[10 + 3 * i] & 0x03;
+                if(j->comp[i].h < 1 || j->comp[i].h > 4 || j->comp[i].v < 1 || j->comp[i].v > 4)
+                    j->ncomp = 0;
+            }
+            j->baseline = (j->ncomp > 0);
+        } else if(marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            /* progressive, lossless or arithmetic coding */
+            break;
+        } else if(marker == 0xC4) {
+            if(parse_dht(j, p + 2, length - 2) != 0)
+                break;
+        } else if(marker == 0xDB) {
+            for(k = 2; k < length;) {
+                n = p[k] & 0x03;
+                if(p[k] >> 4) {
+                    if(k + 129 > length)
+                        break;
+                    for(i = 0; i < 64; i++)
+                        j->qt[n][i] = (p[k + 1 + 2 * i] << 8) | p[k + 2 + 2 * i];
+                    k += 129;
+                } else {
+                    if(k + 65 > length)
+                        break;
+                    for(i = 0; i < 64; i++)
+                        j->qt[n][i] = p[k + 1 + i];
+                    k += 65;
+                }
+                j->qt_defined[n] = 1;
+            }
+        } else if(marker == 0xDD && length >= 4) {
+            j->restart = (p[2] << 8) | p[3];
+        } else if(marker == 0xDA) {
+            if(!j->baseline || !j->qt_defined[j->comp[0].tq])
+                break;
+
+            ns = p[2];
+            if(ns < 1 || ns > j->ncomp || length < 6 + 2 * ns)
+                break;
+            for(i = 0; i < ns; i++) {
+                scan[i] = NULL;
+                for(k = 0; k < j->ncomp; k++) {
+                    if(j->comp[k].id == p[3 + 2 * i])
+                        scan[i] = &j->comp[k];
+                }
+                if(scan[i] == NULL)
+                    break;
+                scan[i]->td = p[4 + 2 * i] >> 4;
+                scan[i]->ta = p[4 + 2 * i] & 0x0F;
+                if(scan[i]->td > 3 || scan[i]->ta > 3)
+                    break;
+            }
+            if(i < ns)
+                break;
+
+            /* the first scan has to contain the luminance */
+            for(i = 0; i < ns && scan[i] != &j->comp[0]; i++);
+            if(i == ns)
+                break;
+
+            /* MJPG of UVC cameras comes without Huffman tables */
+            if(!j->dc[0].defined && !j->ac[0].defined)
+                parse_dht(j, default_dht, sizeof(default_dht));
+            for(i = 0; i < ns; i++) {
+                if(!j->dc[scan[i]->td].defined || !j->ac[scan[i]->ta].defined)
+                    break;
+            }
+            if(i < ns)
+                break;
+
+            if(decode_scan(j, scan, ns, p + length, end, sig) == 0)
+                sig->valid = 1;
+            break;
+        }
+
+        p += length;
+    }
+
+    free(j);
+    return sig->valid ? 0 : -1;
+}
+
+/******************************************************************************
+Description.: compare the perceptual signatures of two pictures
+Input Value.: a and b are the signatures
+Return Value: the largest difference of the average luminance of a cell
+              (0-255), 0 for pictures with the same bytes and 256 if one of
+              the signatures is not valid
+******************************************************************************/
+int signature_distance(const signature *a, const signature *b)
+{
+    int i, d, max = 0;
+
+    if(a->hash == b->hash)
+        return 0;
+    if(!a->valid || !b->valid)
+        return 256;
+
+    for(i = 0; i < SIGNATURE_WIDTH * SIGNATURE_HEIGHT; i++) {
+        d = abs(a->cells[i] - b->cells[i]);
+        if(d > max)
+            max = d;
+    }
+
+    return max;
+}
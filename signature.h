@@ -0,0 +1,53 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+
+/*
+ * Cheap signatures of JPG pictures to find frames that did not change
+ * (-U). The exact one is a hash of the bytes. The perceptual one is a
+ * small grid of the average luminance, taken from the DC coefficients of
+ * the 8x8 blocks: the scan is only Huffman decoded, there is no IDCT or
+ * color conversion. Baseline JPGs with or without Huffman tables (as sent
+ * by UVC cameras) are supported.
+ */
+#define SIGNATURE_WIDTH  16
+#define SIGNATURE_HEIGHT 12
+
+typedef struct _signature signature;
+struct _signature {
+    unsigned long long hash;
+
+    /* 0 if the picture could not be decoded, only the hash is valid then */
+    int valid;
+
+    /* average luminance (0-255) of each cell, row by row */
+    unsigned char cells[SIGNATURE_WIDTH * SIGNATURE_HEIGHT];
+};
+
+unsigned long long signature_hash(const unsigned char *buf, int size);
+int signature_jpeg(const unsigned char *buf, int size, signature *sig);
+int signature_distance(const signature *a, const signature *b);
+
+#endif
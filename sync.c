@@ -0,0 +1,373 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "mjpg_streamer.h"
+
+/* default tolerance of a group in milliseconds */
+#define SYNC_TOLERANCE 10
+
+/* buckets of the spread of the sets in microseconds */
+static const long long spread_bounds[] = { 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+
+/* microseconds from a to b */
+static long long timeval_diff(struct timeval *a, struct timeval *b)
+{
+    return (b->tv_sec - a->tv_sec) * 1000000LL + (b->tv_usec - a->tv_usec);
+}
+
+/******************************************************************************
+Description.: create a sync group and register it in globals, the inputs
+              must be loaded already
+Input Value.: global is the global state, the group is appended to sync
+              spec lists the input ids, optionally followed by the tolerance
+              in milliseconds, e.g. "0,1:5"
+Return Value: the group or NULL if the spec is invalid
+******************************************************************************/
+sync_group *sync_create(globals *global, const char *spec)
+{
+    sync_group *g, **tmp;
+    const char *p = spec;
+    char *end;
+    long id, tolerance = SYNC_TOLERANCE;
+    char labels[64];
+    int i, j;
+
+    if((g = calloc(1, sizeof(sync_group))) == NULL)
+        return NULL;
+
+    while(1) {
+        id = strtol(p, &end, 10);
+        if(end == p || id < 0 || id >= global->incnt || g->count == SYNC_MAX_INPUTS) {
+            LOG("invalid sync group \"%s\", it takes up to %d ids of loaded inputs\n", spec, SYNC_MAX_INPUTS);
+            free(g);
+            return NULL;
+        }
+        for(i = 0; i < g->count; i++) {
+            if(g->inputs[i] == id) {
+                LOG("input %ld is given twice in sync group \"%s\"\n", id, spec);
+                free(g);
+                return NULL;
+            }
+        }
+        g->inputs[g->count++] = id;
+        if(*end != ',')
+            break;
+        p = end + 1;
+    }
+
+    if(*end == ':') {
+        p = end + 1;
+        tolerance = strtol(p, &end, 10);
+        if(end == p || tolerance < 0) {
+            LOG("invalid tolerance in sync group \"%s\"\n", spec);
+            free(g);
+            return NULL;
+        }
+    }
+
+    if(*end != '\0' || g->count < 2) {
+        LOG("invalid sync group \"%s\", it needs at least two inputs\n", spec);
+        free(g);
+        return NULL;
+    }
+
+    if((tmp = realloc(global->sync, (global->synccnt + 1) * sizeof(sync_group *))) == NULL) {
+        free(g);
+        return NULL;
+    }
+    global->sync = tmp;
+
+    g->id = global->synccnt;
+    g->global = global;
+    g->tolerance = tolerance * 1000;
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->update, NULL);
+
+    snprintf(labels, sizeof(labels), "group=\"%d\"", g->id);
+    g->metrics.sets = metric_register(METRIC_COUNTER, "mjpg_sync_sets_total",
+                                      "Complete frame sets published by the sync group", labels, 1);
+    g->metrics.incomplete = metric_register(METRIC_COUNTER, "mjpg_sync_incomplete_total",
+                                            "Reference frames without a match within the tolerance", labels, 1);
+    g->metrics.spread = metric_histogram("mjpg_sync_spread_seconds", "Time between the earliest and the latest frame of a set",
+                                         labels, 1e-6, spread_bounds, sizeof(spread_bounds) / sizeof(spread_bounds[0]));
+    for(j = 0; j < g->count; j++) {
+        snprintf(labels, sizeof(labels), "group=\"%d\",input=\"%d\"", g->id, g->inputs[j]);
+        g->metrics.offset[j] = metric_register(METRIC_GAUGE, "mjpg_sync_offset_seconds",
+                                               "Timestamp of the member minus the one of the first member, at the last match",
+                                               labels, 1e-6);
+    }
+
+    global->sync[global->synccnt++] = g;
+
+    return g;
+}
+
+/******************************************************************************
+Description.: release the references of a set and empty it
+Input Value.: set is the set
+Return Value: -
+******************************************************************************/
+void frame_set_release(frame_set *set)
+{
+    int i;
+
+    for(i = 0; i < set->count; i++)
+        frame_unref(set->frames[i]);
+    memset(set, 0, sizeof(frame_set));
+}
+
+/* copy the current set with references of its own, lock is held */
+static void copy_current(sync_group *g, frame_set *set)
+{
+    int i;
+
+    *set = g->current;
+    for(i = 0; i < set->count; i++)
+        frame_ref(set->frames[i]);
+}
+
+/******************************************************************************
+Description.: try to build a set around the newest frame of the member that
+              lags most. Every reference is tried only once, so a set is not
+              published twice and a miss is counted once.
+Input Value.: g is the group
+Return Value: -
+******************************************************************************/
+static void sync_match(sync_group *g)
+{
+    frame *latest[SYNC_MAX_INPUTS] = {NULL};
+    struct timeval at, first;
+    frame_set set;
+    long long d, earliest = 0, newest = 0;
+    int i, ref = 0, complete = 1;
+
+    for(i = 0; i < g->count; i++) {
+        if((latest[i] = input_get_frame(g->global->in[g->inputs[i]])) == NULL)
+            goto release;
+        if(timercmp(&latest[i]->timestamp, &latest[ref]->timestamp, <))
+            ref = i;
+    }
+
+    at = latest[ref]->timestamp;
+    if(!timercmp(&at, &g->reference, >))
+        goto release;
+    g->reference = at;
+
+    memset(&set, 0, sizeof(set));
+    set.count = g->count;
+    for(i = 0; i < g->count; i++) {
+        if(i == ref)
+            set.frames[i] = frame_ref(latest[ref]);
+        else
+            set.frames[i] = input_find_frame_near(g->global->in[g->inputs[i]], &at, NULL);
+        if(set.frames[i] == NULL) {
+            frame_set_release(&set);
+            goto release;
+        }
+
+        d = timeval_diff(&at, &set.frames[i]->timestamp);
+        if(d > g->tolerance || d < -g->tolerance)
+            complete = 0;
+        if(i == 0 || d < earliest)
+            earliest = d;
+        if(i == 0 || d > newest)
+            newest = d;
+    }
+
+    /* the drift between the members, also when they are out of tolerance */
+    first = set.frames[0]->timestamp;
+    for(i = 0; i < g->count; i++)
+        metric_set(g->metrics.offset[i], timeval_diff(&first, &set.frames[i]->timestamp));
+
+    if(!complete) {
+        DBG("no set for reference %ld.%06ld of group %d\n", (long)at.tv_sec, (long)at.tv_usec, g->id);
+        metric_add(g->metrics.incomplete, 1);
+        frame_set_release(&set);
+        goto release;
+    }
+
+    set.spread = newest - earliest;
+    metric_add(g->metrics.sets, 1);
+    metric_observe(g->metrics.spread, set.spread);
+
+    pthread_mutex_lock(&g->lock);
+    set.sequence = g->current.sequence + 1;
+    frame_set_release(&g->current);
+    g->current = set;
+    pthread_cond_broadcast(&g->update);
+    pthread_mutex_unlock(&g->lock);
+
+release:
+    for(i = 0; i < g->count; i++)
+        frame_unref(latest[i]);
+}
+
+/******************************************************************************
+Description.: thread of a group, waits for fresh frames of the members
+Input Value.: arg is the group
+Return Value: NULL
+******************************************************************************/
+static void *sync_thread(void *arg)
+{
+    sync_group *g = arg;
+    struct pollfd fds[SYNC_MAX_INPUTS];
+    uint64_t value;
+    int i;
+
+    /* a group is a consumer of all members */
+    for(i = 0; i < g->count; i++) {
+        fds[i].fd = input_subscribe_fd(g->global->in[g->inputs[i]]);
+        fds[i].events = POLLIN;
+        if(fds[i].fd < 0)
+            LOG("sync group %d can not watch input %d\n", g->id, g->inputs[i]);
+    }
+
+    /* the timeout notices the stop flag */
+    while(!g->global->stop) {
+        if(poll(fds, g->count, 100) <= 0)
+            continue;
+
+        for(i = 0; i < g->count; i++) {
+            if(fds[i].revents & POLLIN)
+                read(fds[i].fd, &value, sizeof(value));
+        }
+
+        sync_match(g);
+    }
+
+    for(i = 0; i < g->count; i++) {
+        if(fds[i].fd >= 0)
+            input_unsubscribe_fd(g->global->in[g->inputs[i]], fds[i].fd);
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+Description.: start the threads of all sync groups
+Input Value.: global is the global state
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+int sync_start(globals *global)
+{
+    sync_group *g;
+    int i;
+
+    for(i = 0; i < global->synccnt; i++) {
+        g = global->sync[i];
+        if(thread_create(&g->thread, NULL, "sync", g->id, sync_thread, g) != 0)
+            return -1;
+        g->running = 1;
+        LOG("Sync group %d..........: %d inputs within %lld ms\n", g->id, g->count, g->tolerance / 1000);
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: stop the threads of all sync groups and wake up the consumers
+              waiting in sync_wait_set(), the stop flag must be set. Joins
+              the threads, so it must not be called by one of them or from
+              a signal handler
+Input Value.: global is the global state
+Return Value: -
+******************************************************************************/
+void sync_stop(globals *global)
+{
+    sync_group *g;
+    int i;
+
+    for(i = 0; i < global->synccnt; i++) {
+        g = global->sync[i];
+
+        pthread_mutex_lock(&g->lock);
+        pthread_cond_broadcast(&g->update);
+        pthread_mutex_unlock(&g->lock);
+
+        if(g->running) {
+            pthread_join(g->thread, NULL);
+            g->running = 0;
+        }
+    }
+}
+
+/******************************************************************************
+Description.: get the newest complete set of a group
+Input Value.: g is the group
+              set receives the set, release it with frame_set_release()
+Return Value: 0 if everything is OK, -1 if there is no set yet
+******************************************************************************/
+int sync_get_set(sync_group *g, frame_set *set)
+{
+    int rc = -1;
+
+    pthread_mutex_lock(&g->lock);
+    if(g->current.sequence != 0) {
+        copy_current(g, set);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&g->lock);
+
+    return rc;
+}
+
+/* cleanup handler, a consumer cancelled while waiting must not keep the lock */
+static void unlock_group(void *arg)
+{
+    pthread_mutex_unlock(arg);
+}
+
+/******************************************************************************
+Description.: wait for a set newer than the one a consumer has, the wait can
+              be cancelled
+Input Value.: g is the group
+              sequence is the sequence of the set the consumer has, 0 if none
+              set receives the set, release it with frame_set_release()
+Return Value: 0 if everything is OK, -1 if the program stops
+******************************************************************************/
+int sync_wait_set(sync_group *g, unsigned int sequence, frame_set *set)
+{
+    int rc = -1;
+
+    pthread_mutex_lock(&g->lock);
+    pthread_cleanup_push(unlock_group, &g->lock);
+    while(!g->global->stop && (g->current.sequence == 0 || g->current.sequence == sequence))
+        pthread_cond_wait(&g->update, &g->lock);
+    pthread_cleanup_pop(0);
+    if(!g->global->stop) {
+        copy_current(g, set);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&g->lock);
+
+    return rc;
+}
@@ -0,0 +1,94 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <pthread.h>
+#include <sys/time.h>
+
+/*
+ * A sync group matches the frames of several inputs by their timestamp,
+ * e.g. the cameras of a stereo rig (-S 0,1:5). A thread of the group waits
+ * for fresh frames of all members. It takes the newest frame of the member
+ * that lags most as reference and picks the frame closest to it from the
+ * history of every other member. If all of them are within the tolerance,
+ * the frames are published as a set that consumers fetch with
+ * sync_get_set() or sync_wait_set(), holding a reference of every frame.
+ * A history (-H) lets members that run ahead still find the matching frame.
+ *
+ * The thread stays subscribed to all members while the program runs, so
+ * grouped inputs count as watched and are never paused by -L.
+ */
+#define SYNC_MAX_INPUTS 8
+
+typedef struct _frame_set frame_set;
+struct _frame_set {
+    /* counts the sets of a group from 1 without gaps, 0 if empty */
+    unsigned int sequence;
+
+    /* one frame per member, in the order of the group */
+    int count;
+    frame *frames[SYNC_MAX_INPUTS];
+
+    /* microseconds between the earliest and the latest timestamp */
+    long long spread;
+};
+
+typedef struct _sync_group sync_group;
+struct _sync_group {
+    int id;
+    int inputs[SYNC_MAX_INPUTS];
+    int count;
+
+    /* largest distance of a member from the reference in microseconds */
+    long long tolerance;
+
+    /* the newest complete set, protected by lock */
+    pthread_mutex_t lock;
+    pthread_cond_t update;
+    frame_set current;
+
+    struct _globals *global;
+    pthread_t thread;
+    int running;
+
+    /* timestamp of the reference of the last attempt, see sync_match() */
+    struct timeval reference;
+
+    struct {
+        metric *sets;
+        metric *incomplete;
+        metric *spread;
+        metric *offset[SYNC_MAX_INPUTS];
+    } metrics;
+};
+
+sync_group *sync_create(struct _globals *global, const char *spec);
+int sync_start(struct _globals *global);
+void sync_stop(struct _globals *global);
+int sync_get_set(sync_group *g, frame_set *set);
+int sync_wait_set(sync_group *g, unsigned int sequence, frame_set *set);
+void frame_set_release(frame_set *set);
+
+#endif
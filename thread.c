@@ -0,0 +1,298 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <syslog.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "mjpg_streamer.h"
+
+/* what the new thread needs to set itself up before it runs fn */
+typedef struct {
+    void *(*fn)(void *);
+    void *arg;
+    thread_config *tc;
+    char name[16];
+} thread_start;
+
+/******************************************************************************
+Description.: parse a list of CPUs like "0-2,5"
+Input Value.: list is the text
+              set receives the CPUs
+Return Value: 0 if everything is OK, -1 if the list is invalid
+******************************************************************************/
+static int parse_cpus(const char *list, cpu_set_t *set)
+{
+    char *end;
+    long first, last;
+
+    CPU_ZERO(set);
+    while(*list != '\0') {
+        first = last = strtol(list, &end, 10);
+        if(end == list || first < 0)
+            return -1;
+        if(*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if(end == list || last < first)
+                return -1;
+        }
+        if(last >= CPU_SETSIZE)
+            return -1;
+        for(; first <= last; first++)
+            CPU_SET(first, set);
+
+        if(*end == ',')
+            end++;
+        else if(*end != '\0')
+            return -1;
+        list = end;
+    }
+
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/******************************************************************************
+Description.: parse a scheduling class like "fifo:50", "rr:10" or "other"
+Input Value.: tc receives the class and the priority
+              text is the value of --sched
+Return Value: 0 if everything is OK, -1 if the value is invalid
+******************************************************************************/
+static int parse_sched(thread_config *tc, const char *text)
+{
+    const char *colon = strchr(text, ':');
+    size_t len = (colon != NULL) ? (size_t)(colon - text) : strlen(text);
+    char *end;
+
+    if(len == 4 && strncmp(text, "fifo", 4) == 0)
+        tc->policy = SCHED_FIFO;
+    else if(len == 2 && strncmp(text, "rr", 2) == 0)
+        tc->policy = SCHED_RR;
+    else if(len == 5 && strncmp(text, "other", 5) == 0)
+        tc->policy = SCHED_OTHER;
+    else
+        return -1;
+
+    tc->priority = 0;
+    if(tc->policy == SCHED_OTHER)
+        return (colon == NULL) ? 0 : -1;
+
+    if(colon == NULL)
+        return -1;
+    tc->priority = strtol(colon + 1, &end, 10);
+    if(end == colon + 1 || *end != '\0' ||
+       tc->priority < sched_get_priority_min(tc->policy) ||
+       tc->priority > sched_get_priority_max(tc->policy))
+        return -1;
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: take the generic thread parameters out of the parameters of a
+              plugin, the plugin never sees them
+Input Value.: tc receives the settings
+              argc and argv are the parameters, argv[0] is not looked at
+Return Value: 0 if everything is OK, -1 if a value is invalid
+******************************************************************************/
+int thread_config_parse(thread_config *tc, int *argc, char **argv)
+{
+    cpu_set_t set;
+    char *end;
+    int i = 1, rc;
+
+    memset(tc, 0, sizeof(*tc));
+    tc->policy = SCHED_OTHER;
+
+    while(i < *argc) {
+        if(strcmp(argv[i], "--cpus") != 0 && strcmp(argv[i], "--sched") != 0 && strcmp(argv[i], "--nice") != 0) {
+            i++;
+            continue;
+        }
+
+        if(i + 1 >= *argc) {
+            LOG("%s needs a value\n", argv[i]);
+            return -1;
+        }
+
+        rc = 0;
+        if(strcmp(argv[i], "--cpus") == 0) {
+            if((rc = parse_cpus(argv[i + 1], &set)) == 0) {
+                free(tc->cpus);
+                if((tc->cpus = malloc(sizeof(cpu_set_t))) == NULL)
+                    return -1;
+                memcpy(tc->cpus, &set, sizeof(cpu_set_t));
+            }
+        } else if(strcmp(argv[i], "--sched") == 0) {
+            rc = parse_sched(tc, argv[i + 1]);
+        } else {
+            tc->nice = strtol(argv[i + 1], &end, 10);
+            tc->has_nice = 1;
+            if(end == argv[i + 1] || *end != '\0' || tc->nice < -20 || tc->nice > 19)
+                rc = -1;
+        }
+
+        if(rc != 0) {
+            LOG("invalid value for %s: %s\n", argv[i], argv[i + 1]);
+            return -1;
+        }
+
+        free(argv[i]);
+        free(argv[i + 1]);
+        memmove(&argv[i], &argv[i + 2], (*argc - i - 2) * sizeof(char *));
+        *argc -= 2;
+        argv[*argc] = argv[*argc + 1] = NULL;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: report a setting that could not be applied, once per plugin
+Input Value.: tc is the configuration
+              what names the setting
+              err is the error number
+Return Value: -
+******************************************************************************/
+static void warn(thread_config *tc, const char *what, int err)
+{
+    if(__sync_lock_test_and_set(&tc->warned, 1))
+        return;
+
+    LOG("could not set the %s of a thread: %s\n", what, strerror(err));
+}
+
+/* the thread ended or was cancelled, see thread_wait_all() */
+static void thread_ended(void *arg)
+{
+    thread_config *tc = arg;
+
+    if(tc != NULL)
+        __sync_fetch_and_sub(&tc->running, 1);
+}
+
+/******************************************************************************
+Description.: entry of all threads started with thread_create(), applies the
+              settings to the thread itself and runs it
+Input Value.: arg is a thread_start, it is freed here
+Return Value: the return value of the thread function
+******************************************************************************/
+static void *thread_main(void *arg)
+{
+    thread_start start = *(thread_start *)arg;
+    thread_config *tc = start.tc;
+    struct sched_param param;
+    void *result;
+    int rc;
+
+    free(arg);
+    pthread_setname_np(pthread_self(), start.name);
+
+    if(tc != NULL) {
+        if(tc->cpus != NULL &&
+           (rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), tc->cpus)) != 0)
+            warn(tc, "CPU affinity", rc);
+
+        if(tc->policy != SCHED_OTHER) {
+            param.sched_priority = tc->priority;
+            if((rc = pthread_setschedparam(pthread_self(), tc->policy, &param)) != 0)
+                warn(tc, "scheduling class", rc);
+        }
+
+        /* the nice value is per thread on Linux */
+        if(tc->has_nice && setpriority(PRIO_PROCESS, syscall(SYS_gettid), tc->nice) != 0)
+            warn(tc, "nice value", errno);
+    }
+
+    /* the cleanup handlers of the plugin run before this one */
+    pthread_cleanup_push(thread_ended, tc);
+    result = start.fn(start.arg);
+    pthread_cleanup_pop(1);
+
+    return result;
+}
+
+/******************************************************************************
+Description.: start a thread that runs with the settings of a plugin
+Input Value.: thread receives the thread id
+              tc are the settings, NULL to only name the thread
+              name and id name the thread, e.g. "uvc" and 0 give "uvc0",
+              id is left out if it is negative. Cut to 15 characters.
+              fn and arg as for pthread_create()
+Return Value: 0 if everything is OK, an error number as pthread_create()
+******************************************************************************/
+int thread_create(pthread_t *thread, thread_config *tc, const char *name, int id, void *(*fn)(void *), void *arg)
+{
+    thread_start *start;
+    int rc;
+
+    if((start = malloc(sizeof(thread_start))) == NULL)
+        return ENOMEM;
+
+    start->fn = fn;
+    start->arg = arg;
+    start->tc = tc;
+    if(id >= 0)
+        snprintf(start->name, sizeof(start->name), "%s%d", name, id);
+    else
+        snprintf(start->name, sizeof(start->name), "%s", name);
+
+    if(tc != NULL)
+        __sync_fetch_and_add(&tc->running, 1);
+
+    if((rc = pthread_create(thread, NULL, thread_main, start)) != 0) {
+        free(start);
+        thread_ended(tc);
+    }
+
+    return rc;
+}
+
+/******************************************************************************
+Description.: wait until all threads started with the settings of a plugin
+              ended, e.g. after the plugin was stopped. Stopping usually
+              only cancels the threads, they end at their next cancellation
+              point
+Input Value.: tc are the settings of the plugin
+              timeout is the longest time to wait in milliseconds
+Return Value: 0 if all threads ended, -1 if some still run
+******************************************************************************/
+int thread_wait_all(thread_config *tc, int timeout)
+{
+    while(__sync_fetch_and_add(&tc->running, 0) > 0) {
+        if(timeout <= 0)
+            return -1;
+        usleep(10000);
+        timeout -= 10;
+    }
+
+    return 0;
+}
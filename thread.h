@@ -0,0 +1,51 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <pthread.h>
+
+/*
+ * How the threads of a plugin are run, given with the generic plugin
+ * parameters --cpus, --sched and --nice that the core removes before the
+ * plugin parses its own, e.g. -i "input_uvc.so --cpus 0 --sched fifo:50".
+ * Plugins start their threads with thread_create(), which applies them and
+ * names the thread for top and perf.
+ */
+typedef struct _thread_config thread_config;
+struct _thread_config {
+    void *cpus;     /* cpu_set_t, NULL to run on all CPUs */
+    int policy;     /* SCHED_OTHER, SCHED_FIFO or SCHED_RR */
+    int priority;   /* for SCHED_FIFO and SCHED_RR */
+    int nice;
+    int has_nice;
+    int warned;     /* a setting failed and was reported already */
+    int running;    /* threads started with these settings that did not end */
+};
+
+int thread_config_parse(thread_config *tc, int *argc, char **argv);
+int thread_create(pthread_t *thread, thread_config *tc, const char *name, int id, void *(*fn)(void *), void *arg);
+int thread_wait_all(thread_config *tc, int timeout);
+
+#endif
@@ -0,0 +1,52 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Static tracepoints (USDT) on the hot paths of the frame pipeline. If
+ * <sys/sdt.h> (systemtap-sdt-dev) was found at build time every TRACE is a
+ * single nop instruction until perf or bpftrace attaches to it, e.g.
+ *
+ *   bpftrace -e 'usdt:./mjpg_streamer:mjpg_streamer:frame_publish { @[arg0] = count(); }'
+ *
+ * Without it they compile to nothing. The provider is always mjpg_streamer,
+ * the arguments must be integers or pointers.
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define TRACE(name) DTRACE_PROBE(mjpg_streamer, name)
+#define TRACE1(name, a) DTRACE_PROBE1(mjpg_streamer, name, a)
+#define TRACE2(name, a, b) DTRACE_PROBE2(mjpg_streamer, name, a, b)
+#define TRACE3(name, a, b, c) DTRACE_PROBE3(mjpg_streamer, name, a, b, c)
+#define TRACE4(name, a, b, c, d) DTRACE_PROBE4(mjpg_streamer, name, a, b, c, d)
+#else
+#define TRACE(name) do {} while(0)
+#define TRACE1(name, a) do {} while(0)
+#define TRACE2(name, a, b) do {} while(0)
+#define TRACE3(name, a, b, c) do {} while(0)
+#define TRACE4(name, a, b, c, d) do {} while(0)
+#endif
+
+#endif
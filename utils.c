@@ -133,6 +133,30 @@ void parse_resolution_opt(const char * optarg, int * width, int * height) {
     }
 }
 
+/******************************************************************************
+Description.: parse a size in bytes, a k, M or G suffix multiplies it by
+              1024, 1024^2 or 1024^3
+Input Value.: optarg is the string to parse, like "16M"
+Return Value: the size, the program exits if the string is invalid
+******************************************************************************/
+size_t parse_size_opt(const char * optarg) {
+    char *end;
+    unsigned long long size = strtoull(optarg, &end, 10);
+
+    switch(*end) {
+    case 'g': case 'G': size *= 1024; /* fall through */
+    case 'm': case 'M': size *= 1024; /* fall through */
+    case 'k': case 'K': size *= 1024; end++; break;
+    }
+
+    if (end == optarg || *end != '\0') {
+        fprintf(stderr, "Invalid size '%s' specified!\n", optarg);
+        exit(EXIT_FAILURE);
+    }
+
+    return (size_t)size;
+}
+
 void resolutions_help(const char * padding) {
     int i;
     for(i = 0; i < LENGTH_OF(resolutions); i++) {
@@ -128,4 +128,5 @@ void daemon_mode(void);
 
 void resolutions_help(const char * padding);
 void parse_resolution_opt(const char * optarg, int * width, int * height);
+size_t parse_size_opt(const char * optarg);
 
@@ -0,0 +1,150 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "mjpg_streamer.h"
+
+/* stalls are noticed within this fraction of the limit */
+#define WATCHDOG_CHECKS 4
+
+/* a stall is at least this many frame intervals of the input */
+#define WATCHDOG_INTERVALS 5
+
+static globals *pglobal;
+static int running;
+
+/******************************************************************************
+Description.: restart a stalled input, runs on a thread of its own because
+              stopping and initializing a camera can take seconds
+Input Value.: arg is the id of the input
+Return Value: NULL
+******************************************************************************/
+static void *restart_thread(void *arg)
+{
+    int id = (int)(long)arg;
+
+    input_restart(pglobal, id);
+    __sync_lock_release(&pglobal->in[id]->restarting);
+
+    return NULL;
+}
+
+/******************************************************************************
+Description.: the time without a frame that counts as stall for an input
+Input Value.: in is the input
+Return Value: the limit in nanoseconds
+******************************************************************************/
+static long long stall_limit(input *in)
+{
+    long long limit = pglobal->watchdog * 1000000LL, fps;
+
+    /* the rate is kept in 1/1000 fps */
+    if(in->metrics.fps != NULL && (fps = in->metrics.fps->value) > 0 &&
+       WATCHDOG_INTERVALS * 1000000000000LL / fps > limit)
+        limit = WATCHDOG_INTERVALS * 1000000000000LL / fps;
+
+    return limit;
+}
+
+/******************************************************************************
+Description.: check all inputs periodically
+Input Value.: -
+Return Value: NULL
+******************************************************************************/
+static void *watchdog_thread(void *arg)
+{
+    pthread_t restarter;
+    input *in;
+    int i, count, period;
+
+    period = pglobal->watchdog / WATCHDOG_CHECKS;
+    if(period < 10)
+        period = 10;
+
+    while(running && !pglobal->stop) {
+        usleep(period * 1000);
+
+        /* inputs loaded at runtime are checked from the next round on */
+        count = pglobal->incnt;
+        for(i = 0; i < count && running; i++) {
+            in = pglobal->in[i];
+            if(!in->loaded || in->stopped || !input_check_stall(in, stall_limit(in)))
+                continue;
+
+            /* the last restart may still wait for the threads of the input */
+            if(__sync_lock_test_and_set(&in->restarting, 1))
+                continue;
+
+            LOG("input %d stalled, restarting it\n", i);
+            if(thread_create(&restarter, NULL, "restart", i, restart_thread, (void *)(long)i) != 0) {
+                __sync_lock_release(&in->restarting);
+                continue;
+            }
+            pthread_detach(restarter);
+        }
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+Description.: start the watchdog if it was enabled with -W
+Input Value.: global is the global state
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+int watchdog_start(globals *global)
+{
+    pthread_t thread;
+
+    if(global->watchdog < 0)
+        return 0;
+
+    pglobal = global;
+    running = 1;
+
+    if(thread_create(&thread, NULL, "watchdog", -1, watchdog_thread, NULL) != 0) {
+        running = 0;
+        return -1;
+    }
+    pthread_detach(thread);
+
+    LOG("Watchdog..............: restart inputs after %d ms without a frame\n", global->watchdog);
+    return 0;
+}
+
+/******************************************************************************
+Description.: stop the watchdog, it ends with its next check. Restarts in
+              progress finish on their own
+Input Value.: -
+Return Value: -
+******************************************************************************/
+void watchdog_stop(void)
+{
+    running = 0;
+}
@@ -0,0 +1,41 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+/*
+ * The watchdog (-W <ms>) notices inputs that stop delivering frames, e.g. a
+ * camera hanging in VIDIOC_DQBUF or a network source that went silent. An
+ * input stalls when it published nothing for <ms> or five of its usual
+ * frame intervals, whichever is longer. Consumers waiting with
+ * input_wait_frame_stall() are then woken on every check, so they can send
+ * a placeholder or give up instead of piling up. The input is restarted
+ * (stop, init, run) on a thread of its own, and again after every further
+ * limit without a frame. Paused inputs (-L) do not stall, filters stall
+ * with their source and are not restarted.
+ */
+int watchdog_start(struct _globals *global);
+void watchdog_stop(void);
+
+#endif
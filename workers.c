@@ -0,0 +1,283 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "mjpg_streamer.h"
+
+typedef struct {
+    worker_job fn;
+    void *arg;
+} job;
+
+/*
+ * the queue of one worker, the owner takes the newest job (its caches are
+ * still warm), thieves take the oldest one
+ */
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    job *jobs;
+    unsigned int head;
+    unsigned int count;
+    unsigned int size;
+} worker;
+
+static struct {
+    worker *workers;
+    int count;
+
+    /* idle workers sleep here until a job is queued */
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;
+    int stop;
+
+    /* queue for the next job submitted by a thread outside the pool */
+    unsigned int next;
+} pool = { NULL, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0 };
+
+/* index of the worker running in this thread, -1 for all other threads */
+static __thread int self = -1;
+
+/******************************************************************************
+Description.: append a job to the queue of a worker
+Input Value.: w is the worker, j the job
+Return Value: 0 if everything is OK, -1 if not enough memory is available
+******************************************************************************/
+static int queue_push(worker *w, job *j)
+{
+    job *tmp;
+    unsigned int i, size;
+
+    pthread_mutex_lock(&w->lock);
+    if(w->count == w->size) {
+        size = (w->size > 0) ? w->size * 2 : 16;
+        if((tmp = malloc(size * sizeof(job))) == NULL) {
+            pthread_mutex_unlock(&w->lock);
+            return -1;
+        }
+        for(i = 0; i < w->count; i++)
+            tmp[i] = w->jobs[(w->head + i) % w->size];
+        free(w->jobs);
+        w->jobs = tmp;
+        w->size = size;
+        w->head = 0;
+    }
+    w->jobs[(w->head + w->count) % w->size] = *j;
+    w->count++;
+    pthread_mutex_unlock(&w->lock);
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: take a job from the queue of a worker
+Input Value.: w is the worker
+              j receives the job
+              steal is 0 for the owner (newest job), 1 for others (oldest)
+Return Value: 1 if a job was taken, 0 if the queue is empty
+******************************************************************************/
+static int queue_pop(worker *w, job *j, int steal)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&w->lock);
+    if(w->count > 0) {
+        if(steal) {
+            *j = w->jobs[w->head];
+            w->head = (w->head + 1) % w->size;
+        } else {
+            *j = w->jobs[(w->head + w->count - 1) % w->size];
+        }
+        w->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return found;
+}
+
+/******************************************************************************
+Description.: find the next job for a worker, first in its own queue, then in
+              the queues of the others
+Input Value.: id is the index of the worker
+              j receives the job
+Return Value: 1 if a job was found, 0 otherwise
+******************************************************************************/
+static int find_job(int id, job *j)
+{
+    int i;
+
+    if(queue_pop(&pool.workers[id], j, 0))
+        return 1;
+
+    for(i = 1; i < pool.count; i++) {
+        if(queue_pop(&pool.workers[(id + i) % pool.count], j, 1))
+            return 1;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: the worker thread, runs jobs until the pool is stopped and all
+              queued jobs are done
+Input Value.: arg is the index of the worker
+Return Value: always NULL
+******************************************************************************/
+static void *worker_thread(void *arg)
+{
+    job j;
+
+    self = (int)(long)arg;
+
+    while(1) {
+        if(find_job(self, &j)) {
+            __sync_sub_and_fetch(&pool.pending, 1);
+            j.fn(j.arg);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        while(pool.pending == 0 && !pool.stop)
+            pthread_cond_wait(&pool.wakeup, &pool.lock);
+        if(pool.stop && pool.pending == 0) {
+            pthread_mutex_unlock(&pool.lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+Description.: start the worker threads
+Input Value.: count is the number of threads, usually the number of cores
+Return Value: 0 if everything is OK, -1 otherwise
+******************************************************************************/
+int workers_start(int count)
+{
+    int i;
+
+    if(count < 1)
+        count = 1;
+
+    if((pool.workers = calloc(count, sizeof(worker))) == NULL)
+        return -1;
+
+    /* the workers steal from each other, so the count must be final first */
+    pool.count = count;
+    for(i = 0; i < count; i++)
+        pthread_mutex_init(&pool.workers[i].lock, NULL);
+
+    for(i = 0; i < count; i++) {
+        if(thread_create(&pool.workers[i].thread, NULL, "worker", i, worker_thread, (void *)(long)i) != 0) {
+            pool.count = i;
+            workers_stop();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: let the workers finish the queued jobs and wait for them to end.
+              Must not be called by a job or from a signal handler, the
+              calling thread would wait for itself
+Input Value.: -
+Return Value: -
+******************************************************************************/
+void workers_stop(void)
+{
+    int i;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.wakeup);
+    pthread_mutex_unlock(&pool.lock);
+
+    for(i = 0; i < pool.count; i++)
+        pthread_join(pool.workers[i].thread, NULL);
+
+    /* only now nobody steals from the queues anymore */
+    for(i = 0; i < pool.count; i++) {
+        free(pool.workers[i].jobs);
+        pthread_mutex_destroy(&pool.workers[i].lock);
+    }
+
+    free(pool.workers);
+    pool.workers = NULL;
+    pool.count = 0;
+}
+
+/******************************************************************************
+Description.: queue a job. Jobs submitted by a worker go to its own queue,
+              others are spread over the queues round robin.
+Input Value.: fn is the function to run, arg is passed to it
+Return Value: 0 if the job was queued, -1 if there is no pool (anymore) or not
+              enough memory, the caller still owns arg then
+******************************************************************************/
+int workers_submit(worker_job fn, void *arg)
+{
+    job j = { fn, arg };
+    int id = self;
+
+    /* while stopping, only the running jobs may queue follow-up jobs */
+    pthread_mutex_lock(&pool.lock);
+    if(pool.count == 0 || (pool.stop && id < 0)) {
+        pthread_mutex_unlock(&pool.lock);
+        return -1;
+    }
+    __sync_add_and_fetch(&pool.pending, 1);
+    pthread_mutex_unlock(&pool.lock);
+
+    if(id < 0)
+        id = __sync_fetch_and_add(&pool.next, 1) % pool.count;
+
+    if(queue_push(&pool.workers[id], &j) != 0) {
+        __sync_sub_and_fetch(&pool.pending, 1);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pthread_cond_signal(&pool.wakeup);
+    pthread_mutex_unlock(&pool.lock);
+
+    return 0;
+}
+
+/******************************************************************************
+Description.: number of worker threads
+Input Value.: -
+Return Value: the number of threads, 0 if the pool is not running
+******************************************************************************/
+int workers_count(void)
+{
+    return pool.count;
+}
@@ -0,0 +1,39 @@
+/*******************************************************************************
+#                                                                              #
+#      MJPG-streamer allows to stream JPG frames from an input-plugin          #
+#      to several output plugins                                               #
+#                                                                              #
+#      Copyright (C) 2007 Tom Stöveken                                         #
+#                                                                              #
+# This program is free software; you can redistribute it and/or modify         #
+# it under the terms of the GNU General Public License as published by         #
+# the Free Software Foundation; version 2 of the License.                      #
+#                                                                              #
+# This program is distributed in the hope that it will be useful,              #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of               #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                #
+# GNU General Public License for more details.                                 #
+#                                                                              #
+# You should have received a copy of the GNU General Public License            #
+# along with this program; if not, write to the Free Software                  #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA    #
+#                                                                              #
+*******************************************************************************/
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/*
+ * A pool of worker threads owned by mjpg_streamer for CPU heavy jobs like
+ * JPG encoding. Every worker has its own queue, a worker that runs out of
+ * jobs steals from the others, so the jobs of all plugins spread over all
+ * cores. Plugins submit jobs with workers_submit().
+ */
+typedef void (*worker_job)(void *arg);
+
+int workers_start(int count);
+void workers_stop(void);
+int workers_submit(worker_job fn, void *arg);
+int workers_count(void);
+
+#endif